@@ -0,0 +1,65 @@
+var sqlite3 = require('../lib/sqlite3');
+var support = require('./support');
+
+// Queries per second for a batch of scans issued at once, as the thread
+// pool grows, with and without reader connections and a worker thread.
+// Each case runs in a process of its own, with UV_THREADPOOL_SIZE set from
+// its env.
+exports.cases = function(options) {
+    var cases = [];
+    function add(name, threads, mode, dbOptions) {
+        cases.push({
+            name: name + ' threadpool=' + threads,
+            params: { threadpool: threads, mode: mode, options: dbOptions },
+            env: { UV_THREADPOOL_SIZE: String(threads) },
+            run: function(callback) { run(mode, dbOptions, options, callback); }
+        });
+    }
+    add('serialize', 4, 'serialize', {});
+    add('parallelize', 4, 'parallelize', {});
+    add('parallelize workerThread', 4, 'parallelize', { workerThread: true });
+    (options.quick ? [1, 4] : [1, 2, 4, 8]).forEach(function(threads) {
+        add('parallelize readers=4', threads, 'parallelize', { readers: 4 });
+    });
+    return cases;
+};
+
+function run(mode, dbOptions, options, callback) {
+    var rows = options.quick ? 20000 : 100000;
+    var queries = options.quick ? 16 : 64;
+    var file = support.tmpfile('concurrency.db');
+    support.unlink(file);
+
+    var setup = new sqlite3.Database(file);
+    setup.run("PRAGMA journal_mode = WAL");
+    support.fillTable(setup, rows, function(err) {
+        if (err) return callback(err);
+        setup.close(function(err) {
+            if (err) return callback(err);
+            var db = new sqlite3.Database(file, dbOptions);
+            support.repeat(options.quick ? 2 : 3, function(done) {
+                batch(db, mode, queries, done);
+            }, function(err, samples) {
+                db.close(function() {
+                    callback(err, samples && support.medians(samples));
+                });
+            });
+        });
+    });
+}
+
+function batch(db, mode, queries, callback) {
+    var remaining = queries;
+    var failed = null;
+    var start = support.now();
+    db[mode](function() {
+        for (var i = 0; i < queries; i++) {
+            db.get("SELECT sum(length(txt) * num) AS s FROM t WHERE id % ? != 0", i + 2, function(err) {
+                failed = failed || err;
+                if (--remaining) return;
+                var ms = support.now() - start;
+                callback(failed, { queriesPerSec: queries / (ms / 1000), totalMs: ms });
+            });
+        }
+    });
+}
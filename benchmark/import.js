@@ -0,0 +1,52 @@
+var sqlite3 = require('../lib/sqlite3');
+var support = require('./support');
+
+// Database#import throughput over files of a few widths and sizes, with
+// the serial and the parallel engine.
+exports.cases = function(options) {
+    var shapes = options.quick ?
+        [{ rows: 20000, cols: 4 }, { rows: 5000, cols: 16 }] :
+        [{ rows: 200000, cols: 4 }, { rows: 1000000, cols: 4 },
+         { rows: 50000, cols: 16 }, { rows: 12500, cols: 64 }];
+    var cases = [];
+    shapes.forEach(function(shape) {
+        [false, true].forEach(function(parallel) {
+            cases.push({
+                name: (parallel ? 'parallel' : 'serial') + ' ' + shape.rows + 'x' + shape.cols,
+                params: { rows: shape.rows, cols: shape.cols, parallel: parallel },
+                run: function(callback) { run(shape, parallel, options, callback); }
+            });
+        });
+    });
+    return cases;
+};
+
+function run(shape, parallel, options, callback) {
+    var file = support.tmpfile('import.csv');
+    var bytes = support.writeCsv(file, shape.rows, shape.cols);
+    var db = new sqlite3.Database(':memory:');
+    var table = 0;
+
+    support.repeat(options.quick ? 1 : 3, function(done) {
+        var name = 'imported' + table++;
+        var start = support.now();
+        db.import(file, name, { parallel: parallel }, function(err, res) {
+            if (err) return done(err);
+            var ms = support.now() - start;
+            db.run('DROP TABLE ' + name, function(err) {
+                done(err, {
+                    mbPerSec: bytes / 1048576 / (ms / 1000),
+                    rowsPerSec: res.rowCount / (ms / 1000),
+                    metascanMs: res.timing.metascan,
+                    loadMs: res.timing.load,
+                    commitMs: res.timing.commit,
+                    totalMs: ms
+                });
+            });
+        });
+    }, function(err, samples) {
+        db.close(function() {
+            callback(err, samples && support.medians(samples));
+        });
+    });
+}
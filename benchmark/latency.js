@@ -0,0 +1,64 @@
+var sqlite3 = require('../lib/sqlite3');
+var support = require('./support');
+
+// Percentiles of the time from a one-shot Database#get to its callback,
+// one at a time and with others in flight.
+exports.cases = function(options) {
+    var calls = options.quick ? 2000 : 20000;
+    return [1, 16].map(function(inFlight) {
+        return {
+            name: 'db.get ' + inFlight + ' in flight',
+            params: { calls: calls, inFlight: inFlight },
+            run: function(callback) { run(calls, inFlight, callback); }
+        };
+    });
+};
+
+function run(calls, inFlight, callback) {
+    var rows = 10000;
+    var db = new sqlite3.Database(':memory:');
+    support.fillTable(db, rows, function(err) {
+        if (err) return callback(err);
+        var latencies = [];
+        var issued = 0;
+        var failed = null;
+        var start = support.now();
+
+        function issue() {
+            var i = issued++;
+            var sent = support.now();
+            db.get("SELECT * FROM t WHERE id = ?", 1 + (i * 7919) % rows, function(err) {
+                latencies.push(support.now() - sent);
+                failed = failed || err;
+                if (issued < calls) {
+                    issue();
+                }
+                else if (latencies.length === calls) {
+                    finish();
+                }
+            });
+        }
+
+        function finish() {
+            var ms = support.now() - start;
+            latencies.sort(function(a, b) { return a - b; });
+            db.close(function() {
+                callback(failed, {
+                    callsPerSec: calls / (ms / 1000),
+                    p50Ms: support.percentile(latencies, 50),
+                    p90Ms: support.percentile(latencies, 90),
+                    p99Ms: support.percentile(latencies, 99),
+                    p999Ms: support.percentile(latencies, 99.9),
+                    maxMs: latencies[latencies.length - 1]
+                });
+            });
+        }
+
+        // Warm up the statement cache before measuring.
+        db.get("SELECT * FROM t WHERE id = ?", 1, function(err) {
+            if (err) return callback(err);
+            start = support.now();
+            for (var i = 0; i < inFlight; i++) issue();
+        });
+    });
+}
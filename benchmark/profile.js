@@ -0,0 +1,71 @@
+var sqlite3 = require('../lib/sqlite3');
+var support = require('./support');
+
+// The cost of the 'profile' event, which is emitted once for each
+// statement profiled: db.get throughput with no listener, with one that
+// sees every statement, and with one that sees a sample of them.
+exports.cases = function(options) {
+    var calls = options.quick ? 5000 : 50000;
+    return [
+        { name: 'no listener', sampling: null },
+        { name: 'every statement', sampling: 1 },
+        { name: 'sampling 0.1', sampling: 0.1 }
+    ].map(function(c) {
+        return {
+            name: c.name,
+            params: { calls: calls, inFlight: 16, sampling: c.sampling },
+            run: function(callback) { run(calls, 16, c.sampling, callback); }
+        };
+    });
+};
+
+function run(calls, inFlight, sampling, callback) {
+    var rows = 10000;
+    var db = new sqlite3.Database(':memory:');
+    var events = 0;
+    support.fillTable(db, rows, function(err) {
+        if (err) return callback(err);
+        if (sampling !== null) {
+            db.configure('profileSampling', sampling);
+            db.on('profile', function(sql, ms) { events++; });
+        }
+        var issued = 0;
+        var answered = 0;
+        var failed = null;
+        var start;
+
+        function issue() {
+            var i = issued++;
+            db.get("SELECT * FROM t WHERE id = ?", 1 + (i * 7919) % rows, function(err) {
+                failed = failed || err;
+                if (issued < calls) {
+                    issue();
+                }
+                else if (++answered === inFlight) {
+                    finish();
+                }
+            });
+        }
+
+        function finish() {
+            var ms = support.now() - start;
+            // Let the events of the last statements come in.
+            setImmediate(function() {
+                db.close(function() {
+                    callback(failed, {
+                        callsPerSec: calls / (ms / 1000),
+                        eventsPerSec: events / (ms / 1000)
+                    });
+                });
+            });
+        }
+
+        // Warm up the statement cache before measuring.
+        db.get("SELECT * FROM t WHERE id = ?", 1, function(err) {
+            if (err) return callback(err);
+            events = 0;
+            start = support.now();
+            for (var i = 0; i < inFlight; i++) issue();
+        });
+    });
+}
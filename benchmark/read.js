@@ -0,0 +1,96 @@
+var sqlite3 = require('../lib/sqlite3');
+var support = require('./support');
+
+// Rows per second through Statement#get, #all and #each, and how the time
+// of a row splits between SQLite and V8.  Statement#stats times the work
+// on the thread pool (nativeUs); the rest of the time from the call to the
+// callback is mostly spent turning the rows into JavaScript values (v8Us).
+// #each hands rows over while it is still stepping, so its native time
+// includes waiting for the main thread and there is no V8 figure.
+exports.cases = function(options) {
+    var rows = options.quick ? 20000 : 100000;
+    return [
+        {
+            name: 'get',
+            params: { calls: rows / 10 },
+            run: function(callback) { run(rows, options, get(rows / 10), callback); }
+        },
+        {
+            name: 'all',
+            params: { rows: rows },
+            run: function(callback) { run(rows, options, all, callback); }
+        },
+        {
+            name: 'each',
+            params: { rows: rows },
+            run: function(callback) { run(rows, options, each, callback); }
+        }
+    ];
+};
+
+function run(rows, options, method, callback) {
+    var db = new sqlite3.Database(':memory:');
+    support.fillTable(db, rows, function(err) {
+        if (err) return callback(err);
+        support.repeat(options.quick ? 2 : 5, function(done) {
+            method(db, rows, done);
+        }, function(err, samples) {
+            db.close(function() {
+                callback(err, samples && support.medians(samples));
+            });
+        });
+    });
+}
+
+// The time each row took, from the start and the statement's stats.
+function split(count, ms, stats, each) {
+    var result = {
+        rowsPerSec: count / (ms / 1000),
+        nativeUsPerRow: stats.runTime * 1000 / count
+    };
+    if (!each) {
+        result.v8UsPerRow = Math.max(0, ms - stats.runTime - stats.waitTime) * 1000 / count;
+    }
+    return result;
+}
+
+function get(calls) {
+    return function(db, rows, callback) {
+        var stmt = db.prepare("SELECT * FROM t WHERE id = ?");
+        var i = 0;
+        var start = support.now();
+        (function next(err) {
+            if (err) return callback(err);
+            if (i === calls) {
+                var ms = support.now() - start;
+                var stats = stmt.stats();
+                return stmt.finalize(function() { callback(null, split(calls, ms, stats)); });
+            }
+            stmt.get(1 + (i++ * 7919) % rows, next);
+        })();
+    };
+}
+
+function all(db, rows, callback) {
+    var stmt = db.prepare("SELECT * FROM t");
+    var start = support.now();
+    stmt.all(function(err, result) {
+        if (err) return callback(err);
+        var ms = support.now() - start;
+        var stats = stmt.stats();
+        stmt.finalize(function() { callback(null, split(result.length, ms, stats)); });
+    });
+}
+
+function each(db, rows, callback) {
+    var stmt = db.prepare("SELECT * FROM t");
+    var start = support.now();
+    stmt.each(function(err) {
+        if (err) throw err;
+    }, function(err, count) {
+        if (err) return callback(err);
+        var ms = support.now() - start;
+        var stats = stmt.stats();
+        stmt.finalize(function() { callback(null, split(count, ms, stats, true)); });
+    });
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env node
+// Runs the benchmark suites and prints one line per case, optionally
+// writing the results as JSON and comparing them with an earlier run:
+//
+//     node benchmark/run.js [--quick] [--json FILE] [--compare FILE]
+//                           [--threshold PERCENT] [SUITE...]
+//
+// Each case runs in a fresh process, so that one does not warm up or
+// fragment the heap for the next, and so that a case can set the size of
+// the thread pool.  Metrics ending in Ms or UsPerRow are times, where less
+// is better; the rest are rates, where more is.
+
+var child_process = require('child_process');
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+var suites = ['import', 'read', 'latency', 'concurrency', 'profile', 'insert'];
+
+// The cases of a suite.  benchmark/insert.js predates the others and is
+// in the exports.compare form, which is timed here as a whole.
+function cases(suite, options) {
+    var module = require('./' + suite);
+    if (module.cases) return module.cases(options);
+    var support = require('./support');
+    return Object.keys(module.compare).map(function(name) {
+        return {
+            name: name,
+            params: {},
+            run: function(callback) {
+                support.repeat(options.quick ? 1 : 3, function(done) {
+                    var start = support.now();
+                    module.compare[name](function(err) {
+                        done(err, { totalMs: support.now() - start });
+                    });
+                }, function(err, samples) {
+                    callback(err, samples && support.medians(samples));
+                });
+            }
+        };
+    });
+}
+
+function child(suite, name, options) {
+    var found = cases(suite, options).filter(function(c) { return c.name === name; })[0];
+    found.run(function(err, metrics) {
+        if (err) throw err;
+        process.send({ metrics: metrics }, function() { process.exit(0); });
+    });
+}
+
+function parse(argv) {
+    var options = { quick: false, json: null, compare: null, threshold: 5, suites: [] };
+    for (var i = 0; i < argv.length; i++) {
+        switch (argv[i]) {
+            case '--quick': options.quick = true; break;
+            case '--json': options.json = argv[++i]; break;
+            case '--compare': options.compare = argv[++i]; break;
+            case '--threshold': options.threshold = Number(argv[++i]); break;
+            default:
+                if (suites.indexOf(argv[i]) === -1) {
+                    console.error('Unknown suite or option: ' + argv[i]);
+                    console.error('Suites: ' + suites.join(', '));
+                    process.exit(2);
+                }
+                options.suites.push(argv[i]);
+        }
+    }
+    if (!options.suites.length) options.suites = suites;
+    return options;
+}
+
+function environment() {
+    var commit = null;
+    try {
+        commit = child_process.execSync('git rev-parse HEAD', {
+            cwd: __dirname, stdio: ['ignore', 'pipe', 'ignore']
+        }).toString().trim();
+    } catch (err) {}
+    var cpus = os.cpus();
+    return {
+        commit: commit,
+        date: new Date().toISOString(),
+        node: process.version,
+        sqlite: require('../lib/sqlite3').VERSION,
+        platform: process.platform + '-' + process.arch,
+        cpus: cpus.length,
+        cpuModel: cpus.length ? cpus[0].model : null
+    };
+}
+
+function format(value) {
+    if (value >= 100) return value.toFixed(0);
+    if (value >= 1) return value.toFixed(2);
+    return value.toPrecision(3);
+}
+
+function lowerIsBetter(metric) {
+    return /(Ms|UsPerRow)$/.test(metric);
+}
+
+// Prints how each metric moved from the baseline; returns the number of
+// metrics that got worse by more than threshold percent.
+function compare(results, baseline, threshold) {
+    var previous = {};
+    baseline.results.forEach(function(r) { previous[r.suite + '\0' + r.name] = r.metrics; });
+    var regressions = 0;
+    console.log('\nCompared with ' + (baseline.environment.commit || 'baseline') + ':');
+    results.forEach(function(r) {
+        var before = previous[r.suite + '\0' + r.name];
+        if (!before) return;
+        var changes = Object.keys(r.metrics).filter(function(m) { return before[m] > 0; }).map(function(m) {
+            var change = (r.metrics[m] - before[m]) / before[m] * 100;
+            var worse = lowerIsBetter(m) ? change > threshold : change < -threshold;
+            if (worse) regressions++;
+            return m + ' ' + (change >= 0 ? '+' : '') + change.toFixed(1) + '%' + (worse ? ' (!)' : '');
+        });
+        console.log('  ' + r.suite + ' / ' + r.name + ': ' + changes.join(', '));
+    });
+    return regressions;
+}
+
+function main(options) {
+    var results = [];
+    var todo = [];
+    options.suites.forEach(function(suite) {
+        cases(suite, options).forEach(function(c) { todo.push({ suite: suite, case: c }); });
+    });
+
+    (function next() {
+        if (!todo.length) return finish();
+        var item = todo.shift();
+        var args = ['--child', item.suite, item.case.name].concat(options.quick ? ['--quick'] : []);
+        var env = Object.assign({}, process.env, item.case.env || {});
+        var metrics = null;
+        var proc = child_process.fork(__filename, args, { cwd: path.join(__dirname, '..'), env: env });
+        proc.on('message', function(message) { metrics = message.metrics; });
+        proc.on('exit', function(code) {
+            if (code !== 0 || !metrics) {
+                console.error(item.suite + ' / ' + item.case.name + ': failed with exit code ' + code);
+                process.exitCode = 1;
+            }
+            else {
+                results.push({ suite: item.suite, name: item.case.name, params: item.case.params, metrics: metrics });
+                console.log(item.suite + ' / ' + item.case.name + ': ' + Object.keys(metrics).map(function(m) {
+                    return m + '=' + format(metrics[m]);
+                }).join(' '));
+            }
+            next();
+        });
+    })();
+
+    function finish() {
+        var output = { environment: environment(), quick: options.quick, results: results };
+        if (options.json) {
+            fs.writeFileSync(options.json, JSON.stringify(output, null, 2) + '\n');
+        }
+        if (options.compare) {
+            var regressions = compare(results, JSON.parse(fs.readFileSync(options.compare, 'utf8')),
+                                      options.threshold);
+            if (regressions) {
+                console.log(regressions + ' metric(s) worse by more than ' + options.threshold + '%');
+                process.exitCode = 1;
+            }
+        }
+    }
+}
+
+if (process.argv[2] === '--child') {
+    child(process.argv[3], process.argv[4], { quick: process.argv[5] === '--quick' });
+}
+else {
+    main(parse(process.argv.slice(2)));
+}
@@ -0,0 +1,103 @@
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+// Milliseconds since an arbitrary point, with sub-microsecond resolution.
+exports.now = function() {
+    var t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+};
+
+exports.median = function(samples) {
+    var sorted = samples.slice().sort(function(a, b) { return a - b; });
+    var mid = sorted.length >> 1;
+    return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+};
+
+// The p'th percentile (0 to 100) of a sorted array, by nearest rank.
+exports.percentile = function(sorted, p) {
+    if (!sorted.length) return NaN;
+    var rank = Math.ceil(p / 100 * sorted.length);
+    return sorted[Math.min(sorted.length, Math.max(1, rank)) - 1];
+};
+
+// Calls run(callback) times times, one after another, and calls back with
+// the samples it passed on, or the first error.
+exports.repeat = function(times, run, callback) {
+    var samples = [];
+    (function next() {
+        if (samples.length === times) return callback(null, samples);
+        run(function(err, sample) {
+            if (err) return callback(err);
+            samples.push(sample);
+            setImmediate(next);
+        });
+    })();
+};
+
+// The median of each metric over samples of the same shape.
+exports.medians = function(samples) {
+    var metrics = {};
+    for (var key in samples[0]) {
+        metrics[key] = exports.median(samples.map(function(sample) { return sample[key]; }));
+    }
+    return metrics;
+};
+
+// A path for a scratch file, removed when the process exits.
+exports.tmpfile = function(name) {
+    var file = path.join(os.tmpdir(), 'node-sqlite3-bench-' + process.pid + '-' + name);
+    process.on('exit', function() {
+        exports.unlink(file);
+        exports.unlink(file + '-wal');
+        exports.unlink(file + '-shm');
+    });
+    return file;
+};
+
+exports.unlink = function(file) {
+    try { fs.unlinkSync(file); } catch (err) { if (err.code !== 'ENOENT') throw err; }
+};
+
+// Writes a CSV file with a header and rows records of cols columns, cycling
+// through integer, real, short text and quoted text values.  The content
+// only depends on the arguments, so runs stay comparable.
+exports.writeCsv = function(file, rows, cols) {
+    var fd = fs.openSync(file, 'w');
+    var header = [];
+    for (var c = 0; c < cols; c++) header.push('c' + c);
+    var lines = [header.join(',')];
+    var pending = 0;
+    for (var r = 0; r < rows; r++) {
+        var fields = [];
+        for (var c = 0; c < cols; c++) {
+            switch (c % 4) {
+                case 0: fields.push(r * cols + c); break;
+                case 1: fields.push(((r * 7919 + c) % 100000) / 100); break;
+                case 2: fields.push('value ' + (r % 1000)); break;
+                case 3: fields.push('"quoted, ""text"" ' + r + '"'); break;
+            }
+        }
+        lines.push(fields.join(','));
+        if (++pending === 10000) {
+            fs.writeSync(fd, lines.join('\n') + '\n');
+            lines = [];
+            pending = 0;
+        }
+    }
+    if (lines.length) fs.writeSync(fd, lines.join('\n') + '\n');
+    fs.closeSync(fd);
+    return fs.statSync(file).size;
+};
+
+// Creates table t(id INTEGER PRIMARY KEY, num REAL, txt TEXT) with rows rows.
+exports.fillTable = function(db, rows, callback) {
+    var params = [];
+    for (var i = 1; i <= rows; i++) params.push([i, i / 3, 'row number ' + i]);
+    db.serialize(function() {
+        db.run("CREATE TABLE t (id INTEGER PRIMARY KEY, num REAL, txt TEXT)");
+        db.run("BEGIN");
+        db.runBatch("INSERT INTO t VALUES (?, ?, ?)", params);
+        db.run("COMMIT", callback);
+    });
+};
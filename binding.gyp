@@ -33,10 +33,18 @@
       ],
       "sources": [
         "src/backup.cc",
+        "src/blob.cc",
+        "src/change_feed.cc",
         "src/database.cc",
         "src/node_sqlite3.cc",
+        "src/profiler.cc",
         "src/statement.cc",
-        "src/import.cc"
+        "src/import.cc",
+        "src/import_stream.cc",
+        "src/export.cc",
+        "src/export_stream.cc",
+        "src/function.cc",
+        "src/worker_thread.cc"
       ]
     },
     {
@@ -87,6 +87,7 @@
           'SQLITE_ENABLE_FTS3',
           'SQLITE_ENABLE_FTS4',
           'SQLITE_ENABLE_FTS5',
+          'SQLITE_ENABLE_DESERIALIZE',
           'SQLITE_ENABLE_JSON1',
           'SQLITE_ENABLE_RTREE'
         ],
@@ -101,6 +102,7 @@
         'SQLITE_ENABLE_FTS3',
         'SQLITE_ENABLE_FTS4',
         'SQLITE_ENABLE_FTS5',
+        'SQLITE_ENABLE_DESERIALIZE',
         'SQLITE_ENABLE_JSON1',
         'SQLITE_ENABLE_RTREE'
       ],
@@ -0,0 +1,144 @@
+// Pull-based iteration over the rows of a Statement.
+//
+// Rows are fetched from the native side a page at a time, and only when the
+// consumer asks for more, so no more than one page of rows is held in memory
+// however large the result is.
+var Readable = require('stream').Readable;
+
+var DEFAULT_PAGE_SIZE = 256;
+
+function pageSize(options) {
+    var size = options && options.pageSize;
+    if (size === undefined) return DEFAULT_PAGE_SIZE;
+    if (typeof size !== 'number' || size <= 0 || Math.floor(size) !== size) {
+        throw new TypeError('options.pageSize must be a positive integer');
+    }
+    return size;
+}
+
+// statement: an unfinished Statement
+// params: bind parameters for the first page, or undefined to reset instead
+// owned: finalize the statement when done, rather than reset it
+function Cursor(statement, params, options, owned) {
+    this.statement = statement;
+    this.pageSize = pageSize(options);
+    this._params = params;
+    this._owned = owned;
+    this._rows = [];
+    this._index = 0;
+    this._done = false;
+    this._error = null;
+    this._reject = null;
+    this._last = Promise.resolve();
+    if (params === undefined) statement.reset();
+}
+
+// Called when the statement could not be prepared.
+Cursor.prototype._fail = function(err) {
+    this._error = err;
+    if (this._reject) this._reject(err);
+};
+
+// Fetch the next page of rows.
+Cursor.prototype._page = function() {
+    var self = this;
+    if (this._error) return Promise.reject(this._error);
+    return new Promise(function(resolve, reject) {
+        self._reject = reject;
+        var args = [self.pageSize];
+        if (self._params !== undefined) args.push(self._params);
+        self._params = undefined;
+        args.push(function(err, rows) {
+            self._reject = null;
+            if (err) reject(err);
+            else resolve(rows);
+        });
+        self.statement.fetch.apply(self.statement, args);
+    }).then(function(rows) {
+        // A short page is the last.
+        if (rows.length < self.pageSize) self._finish();
+        return rows;
+    }, function(err) {
+        self._finish();
+        throw err;
+    });
+};
+
+Cursor.prototype._finish = function() {
+    if (this._done) return;
+    this._done = true;
+    // Let go of the read transaction as soon as possible.
+    if (this._owned) this.statement.finalize();
+    else this.statement.reset();
+};
+
+Cursor.prototype._next = function() {
+    var self = this;
+    if (this._index < this._rows.length) {
+        var row = this._rows[this._index];
+        this._rows[this._index++] = undefined;
+        return { value: row, done: false };
+    }
+    if (this._done) return { value: undefined, done: true };
+    return this._page().then(function(rows) {
+        self._rows = rows;
+        self._index = 0;
+        return self._next();
+    });
+};
+
+// Calls are queued, so next() may be called again before it resolves.
+Cursor.prototype._queue = function(fn) {
+    var result = this._last.then(fn);
+    this._last = result.then(function() {}, function() {});
+    return result;
+};
+
+Cursor.prototype.next = function() {
+    return this._queue(this._next.bind(this));
+};
+
+Cursor.prototype.return = function(value) {
+    var self = this;
+    return this._queue(function() {
+        self._rows = [];
+        self._index = 0;
+        self._finish();
+        return { value: value, done: true };
+    });
+};
+
+if (typeof Symbol !== 'undefined' && Symbol.asyncIterator) {
+    Cursor.prototype[Symbol.asyncIterator] = function() {
+        return this;
+    };
+}
+
+// An object mode Readable of the rows, fetching a page whenever the
+// stream's buffer runs low.
+Cursor.prototype.stream = function() {
+    var cursor = this;
+    return new Readable({
+        objectMode: true,
+        highWaterMark: cursor.pageSize,
+        read: function() {
+            var readable = this;
+            cursor._queue(function() {
+                if (cursor._done) return [];
+                return cursor._page();
+            }).then(function(rows) {
+                for (var i = 0; i < rows.length; i++) readable.push(rows[i]);
+                if (cursor._done) readable.push(null);
+            }, function(err) {
+                readable.destroy(err);
+            });
+        },
+        destroy: function(err, cb) {
+            cursor.return().then(function() { cb(err); });
+        }
+    });
+};
+
+Cursor.pageSize = pageSize;
+
+module.exports = Cursor;
@@ -1,9 +1,14 @@
 var path = require('path');
 var sqlite3 = require('./sqlite3-binding.js');
 var EventEmitter = require('events').EventEmitter;
+var Writable = require('stream').Writable;
+var Readable = require('stream').Readable;
+var Cursor = require('./cursor');
 module.exports = exports = sqlite3;
 
-function normalizeMethod (fn) {
+// cached: the statement is only used for the one call, and may be taken
+// from, and put back in, the database's statement cache.
+function normalizeMethod (fn, cached) {
     return function (sql) {
         var errBack;
         var args = Array.prototype.slice.call(arguments, 1);
@@ -15,11 +20,30 @@ function normalizeMethod (fn) {
                 }
             };
         }
-        var statement = new Statement(this, sql, errBack);
+        var statement = new Statement(this, sql, errBack, !!cached);
         return fn.call(this, statement, args);
     };
 }
 
+// Runs statement[method](params...) and finalizes the statement, putting it
+// back in the database's cache before the callback runs, so that a query
+// issued from the callback can have it.  With rows, the callback is only
+// the one for completion when a row callback comes before it.
+function callAndFinalize(statement, method, params, rows) {
+    var last = params.length - 1;
+    var callback = params[last];
+    if (typeof callback !== 'function' || (rows && typeof params[last - 1] !== 'function')) {
+        statement[method].apply(statement, params).finalize();
+        return;
+    }
+
+    var result;
+    params = params.slice(0, last).concat(function() { result = arguments; });
+    statement[method].apply(statement, params).finalize(function() {
+        if (result) callback.apply(statement, result);
+    });
+}
+
 function inherits(target, source) {
     for (var k in source.prototype)
         target.prototype[k] = source.prototype[k];
@@ -58,10 +82,15 @@ sqlite3.cached = {
 var Database = sqlite3.Database;
 var Statement = sqlite3.Statement;
 var Backup = sqlite3.Backup;
+var Blob = sqlite3.Blob;
+var ImportStream = sqlite3.ImportStream;
+var ExportStream = sqlite3.ExportStream;
 
 inherits(Database, EventEmitter);
 inherits(Statement, EventEmitter);
 inherits(Backup, EventEmitter);
+inherits(Blob, EventEmitter);
+inherits(ImportStream, EventEmitter);
 
 // Database#prepare(sql, [bind1, bind2, ...], [callback])
 Database.prototype.prepare = normalizeMethod(function(statement, params) {
@@ -72,32 +101,63 @@ Database.prototype.prepare = normalizeMethod(function(statement, params) {
 
 // Database#run(sql, [bind1, bind2, ...], [callback])
 Database.prototype.run = normalizeMethod(function(statement, params) {
-    statement.run.apply(statement, params).finalize();
+    callAndFinalize(statement, 'run', params);
     return this;
-});
+}, true);
 
 // Database#get(sql, [bind1, bind2, ...], [callback])
 Database.prototype.get = normalizeMethod(function(statement, params) {
-    statement.get.apply(statement, params).finalize();
+    callAndFinalize(statement, 'get', params);
     return this;
-});
+}, true);
+
+// Database#runBatch(sql, [params1, params2, ...], [options], [callback])
+Database.prototype.runBatch = normalizeMethod(function(statement, params) {
+    callAndFinalize(statement, 'runBatch', params);
+    return this;
+}, true);
 
 // Database#all(sql, [bind1, bind2, ...], [callback])
 Database.prototype.all = normalizeMethod(function(statement, params) {
-    statement.all.apply(statement, params).finalize();
+    callAndFinalize(statement, 'all', params);
     return this;
-});
+}, true);
 
 // Database#each(sql, [bind1, bind2, ...], [callback], [complete])
 Database.prototype.each = normalizeMethod(function(statement, params) {
-    statement.each.apply(statement, params).finalize();
+    callAndFinalize(statement, 'each', params, true);
     return this;
-});
+}, true);
+
+// Database#eachBatch(sql, size, [bind1, bind2, ...], [callback], [complete])
+Database.prototype.eachBatch = normalizeMethod(function(statement, params) {
+    callAndFinalize(statement, 'eachBatch', params, true);
+    return this;
+}, true);
+
+// Database#iterate(sql, [params], [options])
+// Returns an async iterator of the rows, fetched options.pageSize at a time.
+Database.prototype.iterate = function(sql, params, options) {
+    // Check the options before there is a statement to clean up.
+    Cursor.pageSize(options);
+    var cursor;
+    var statement = new Statement(this, sql, function(err) {
+        if (err) cursor._fail(err);
+    });
+    cursor = new Cursor(statement, params, options, true);
+    return cursor;
+};
+
+// Database#createReadStream(sql, [params], [options])
+// As Database#iterate, as an object mode Readable.
+Database.prototype.createReadStream = function(sql, params, options) {
+    return this.iterate(sql, params, options).stream();
+};
 
 Database.prototype.map = normalizeMethod(function(statement, params) {
-    statement.map.apply(statement, params).finalize();
+    callAndFinalize(statement, 'map', params);
     return this;
-});
+}, true);
 
 // Database#backup(filename, [callback])
 // Database#backup(filename, destName, sourceName, filenameIsDest, [callback])
@@ -116,6 +176,388 @@ Database.prototype.backup = function() {
     return backup;
 };
 
+// Database#stats([reset], callback)
+// Calls back with the sqlite3_db_status counters, summed over the
+// database's readers, and starts the counts over if reset is true.
+var statsNative = Database.prototype.stats;
+Database.prototype.stats = function(reset, callback) {
+    if (typeof reset === 'function') {
+        callback = reset;
+        reset = false;
+    }
+    return statsNative.call(this, !!reset, callback);
+};
+
+// Database#function(name, [options], fn, [callback])
+// Makes fn callable from SQL as name(...), with fn.length arguments, or
+// any number with { varargs: true }.  Statements run on other threads wait
+// for the main thread to run it, so it should be quick.  Declare it with
+// { deterministic: true } when the same arguments always give the same
+// result, so that SQLite may use it in indexes and factor it out of loops.
+var functionNative = Database.prototype.function;
+Database.prototype.function = function(name, options, fn, callback) {
+    if (typeof options === 'function') {
+        callback = fn;
+        fn = options;
+        options = {};
+    }
+    options = options || {};
+    if (typeof fn !== 'function') {
+        throw new TypeError('fn must be a function');
+    }
+    var nArg = options.varargs ? -1 : fn.length;
+    return functionNative.call(this, name, nArg, !!options.deterministic, fn, callback);
+};
+
+// Database#aggregate(name, options, [callback])
+// Makes an aggregate callable from SQL as name(...).  For each group, the
+// value starts as options.start, or what it returns if it is a function.
+// options.step(value, ...args) returns the value with a row folded in, and
+// options.result(value), if given, turns the last value into the result.
+// Takes options.varargs and options.deterministic as Database#function.
+var aggregateNative = Database.prototype.aggregate;
+Database.prototype.aggregate = function(name, options, callback) {
+    options = options || {};
+    if (typeof options.step !== 'function') {
+        throw new TypeError('options.step must be a function');
+    }
+    if (options.result !== undefined && typeof options.result !== 'function') {
+        throw new TypeError('options.result must be a function');
+    }
+    var nArg = options.varargs ? -1 : Math.max(options.step.length - 1, 0);
+    return aggregateNative.call(this, name, nArg, !!options.deterministic,
+        options.start === undefined ? null : options.start, options.step, options.result, callback);
+};
+
+// Database#loadExtension(filename, [entryPoint], [callback])
+// Loads an extension into each of the database's connections, calling
+// entryPoint, or the default sqlite3_extension_init or the like, which may
+// register native functions that run without going to the main thread.
+var loadExtensionNative = Database.prototype.loadExtension;
+Database.prototype.loadExtension = function(filename, entryPoint, callback) {
+    if (typeof entryPoint === 'function') {
+        callback = entryPoint;
+        entryPoint = undefined;
+    }
+    return loadExtensionNative.call(this, filename, entryPoint || '', callback);
+};
+
+var DEFAULT_BACKUP_SLICE = 5;
+
+// Backup#run([options], [callback])
+// Steps the backup until it is done, with stepFor(options.slice), which
+// holds the lock for about 5 ms by default, and waits options.pause ms
+// between steps, or by default, until the event loop has had a turn.
+// Errors in backup.retryErrors, such as SQLITE_BUSY, are tried again.
+Backup.prototype.run = function(options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    options = options || {};
+    var slice = options.slice === undefined ? DEFAULT_BACKUP_SLICE : options.slice;
+    if (typeof slice !== 'number' || !(slice > 0)) {
+        throw new TypeError('options.slice must be a positive number');
+    }
+    var pause = options.pause || 0;
+    var backup = this;
+    function done(err) {
+        if (typeof callback === 'function') callback.call(backup, err);
+        else if (err) backup.emit('error', err);
+    }
+    function next() {
+        backup.stepFor(slice, function(err, completed) {
+            if (err && (backup.failed || backup.retryErrors.indexOf(err.errno) < 0)) {
+                return done(err);
+            }
+            if (!err) {
+                backup.emit('progress', { remaining: backup.remaining, pageCount: backup.pageCount });
+            }
+            if (completed) return done(null);
+            if (pause > 0) setTimeout(next, pause);
+            else setImmediate(next);
+        });
+    }
+    next();
+    return this;
+};
+
+// Database#toBuffer([schema], [callback])
+// Calls back with a Buffer holding a copy of the whole database.
+var toBufferNative = Database.prototype.toBuffer;
+Database.prototype.toBuffer = function(schema, callback) {
+    if (typeof schema === 'function') {
+        callback = schema;
+        schema = undefined;
+    }
+    return toBufferNative.call(this, schema === undefined ? 'main' : schema, callback);
+};
+
+// Database#loadBuffer(buffer, [options], [callback])
+// Replaces options.schema ('main') with the database in buffer.  With
+// { readonly: true } it is read in place rather than copied, and the
+// Buffer must not be changed while the database is open.
+var loadBufferNative = Database.prototype.loadBuffer;
+Database.prototype.loadBuffer = function(buffer, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    return loadBufferNative.call(this, buffer, options || {}, callback);
+};
+
+// Database.fromBuffer(buffer, [options], [callback])
+// Opens an in-memory database with the contents of buffer.
+Database.fromBuffer = function(buffer, options, callback) {
+    var db = new Database(':memory:');
+    return db.loadBuffer(buffer, options, callback);
+};
+
+var DEFAULT_BLOB_CHUNK_SIZE = 65536;
+
+// Database#openBlob(table, column, rowid, [options], [callback])
+// Returns a Readable of the value in column of the row of table, or with
+// { writable: true }, a Writable over it.  Either moves options.chunkSize
+// bytes at a time, and emits 'open' once stream.size is known.  The value
+// can not grow or shrink: make room for what is written with zeroblob(n).
+Database.prototype.openBlob = function(table, column, rowid, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    options = options || {};
+    var chunkSize = options.chunkSize === undefined ? DEFAULT_BLOB_CHUNK_SIZE : options.chunkSize;
+    if (typeof chunkSize !== 'number' || chunkSize <= 0 || Math.floor(chunkSize) !== chunkSize) {
+        throw new TypeError('options.chunkSize must be a positive integer');
+    }
+    var writable = !!options.writable;
+    var offset = 0;
+    var closed = false;
+    // Whether the blob opened, once that is known.  A blob that failed to
+    // open has nothing to close, and a close queued on it would be dropped.
+    var opened = null;
+    var closing = null;
+    var blob = new Blob(this, table, column, rowid, writable, options.database || 'main', function(err) {
+        opened = !err;
+        if (!err) {
+            stream.size = blob.size;
+            stream.emit('open', blob.size);
+        }
+        if (typeof callback === 'function') {
+            callback.call(stream, err);
+            if (err) stream.destroy();
+        }
+        else if (err) {
+            stream.destroy(err);
+        }
+        if (closing) close(closing);
+    });
+    function close(cb) {
+        if (opened === null) {
+            closing = cb;
+            return;
+        }
+        closing = null;
+        if (closed || !opened) return cb(null);
+        closed = true;
+        blob.close(cb);
+    }
+    var stream;
+    if (writable) {
+        stream = new Writable({
+            highWaterMark: chunkSize,
+            write: function(chunk, encoding, cb) {
+                var length = chunk.length;
+                var done = 0;
+                // Larger chunks are written a piece at a time, too.
+                (function next(err) {
+                    if (err || done === length) return cb(err);
+                    var piece = chunk.slice(done, done + chunkSize);
+                    blob.write(offset, piece, function(err) {
+                        if (!err) {
+                            offset += piece.length;
+                            done += piece.length;
+                        }
+                        next(err);
+                    });
+                })(null);
+            },
+            final: function(cb) {
+                close(cb);
+            },
+            destroy: function(err, cb) {
+                close(function() { cb(err); });
+            }
+        });
+    }
+    else {
+        stream = new Readable({
+            highWaterMark: chunkSize,
+            read: function() {
+                blob.read(offset, chunkSize, function(err, chunk) {
+                    if (err) return stream.destroy(err);
+                    offset += chunk.length;
+                    if (chunk.length) return stream.push(chunk);
+                    // Let go of the blob before the stream ends.
+                    close(function(err) {
+                        if (err) stream.destroy(err);
+                        else stream.push(null);
+                    });
+                });
+            },
+            destroy: function(err, cb) {
+                close(function() { cb(err); });
+            }
+        });
+    }
+    stream.size = -1;
+    return stream;
+};
+
+// Database#createImportStream(tablename, [options], [callback])
+// Returns a Writable; CSV text written to it is imported into tablename.
+Database.prototype.createImportStream = function(tablename, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    var sink = new ImportStream(this, tablename, options || {}, callback);
+    var ended = false;
+    var writable = new Writable({
+        write: function(chunk, encoding, cb) {
+            sink.write(chunk, function() { cb(); });
+        },
+        final: function(cb) {
+            ended = true;
+            sink.end();
+            cb();
+        },
+        destroy: function(err, cb) {
+            // Abandon the import unless the input was complete.
+            if (!ended) sink.cancel();
+            cb(err);
+        }
+    });
+    sink.on('progress', function(progress) {
+        writable.emit('progress', progress);
+    });
+    return writable;
+};
+
+// Database#import(source, tablename, options, [callback])
+// source is a filename, a Buffer, or a readable stream of CSV text.
+var importNative = Database.prototype.import;
+Database.prototype.import = function(source, tablename, options, callback) {
+    if (!source || typeof source.pipe !== 'function') {
+        return importNative.apply(this, arguments);
+    }
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    var failed = null;
+    var sink = this.createImportStream(tablename, options, function(err, res) {
+        if (typeof callback === 'function') {
+            if (failed) callback(failed);
+            else callback.apply(this, arguments);
+        }
+    });
+    source.on('error', function(err) {
+        // Roll back whatever arrived and report the read error instead.
+        failed = failed || err;
+        source.unpipe(sink);
+        sink.destroy();
+    });
+    source.pipe(sink);
+    return this;
+};
+
+// Database#createExportStream(sql, [options], [callback])
+// Returns a Readable of the CSV text for the rows of sql.
+Database.prototype.createExportStream = function(sql, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    var ended = false;
+    var source = new ExportStream(this, sql, options || {}, function(err, res) {
+        if (typeof callback === 'function') {
+            callback.apply(this, arguments);
+            if (err) readable.destroy();
+        }
+        else if (err) {
+            readable.destroy(err);
+        }
+    });
+    var readable = new Readable({
+        read: function() {
+            source.read(function(chunk) {
+                ended = chunk === null;
+                readable.push(chunk);
+            });
+        },
+        destroy: function(err, cb) {
+            // Stop the export unless all of it was read.
+            if (!ended) source.cancel();
+            cb(err);
+        }
+    });
+    return readable;
+};
+
+// Database#export(sql, filename|stream, [options], [callback])
+var exportNative = Database.prototype.export;
+Database.prototype.export = function(sql, target, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = {};
+    }
+    options = options || {};
+    if (typeof target === 'string') {
+        return exportNative.call(this, sql, target, options, callback);
+    }
+    var db = this;
+    var result = null;
+    var written = false;
+    var reported = false;
+    function report(err) {
+        if (reported || !(err || (result && written))) return;
+        reported = true;
+        if (typeof callback === 'function') {
+            if (err) callback.call(db, err);
+            else callback.call(db, null, result);
+        }
+        else if (err) {
+            db.emit('error', err);
+        }
+    }
+    var source = this.createExportStream(sql, options, function(err, res) {
+        result = res;
+        report(err);
+    });
+    target.on('error', function(err) {
+        source.destroy();
+        report(err);
+    });
+    target.on('finish', function() {
+        written = true;
+        report(null);
+    });
+    source.pipe(target);
+    return this;
+};
+
+// Statement#iterate([params], [options])
+// The statement is reset, or bound to params, and reset again once done.
+Statement.prototype.iterate = function(params, options) {
+    return new Cursor(this, params, options, false);
+};
+
+// Statement#createReadStream([params], [options])
+Statement.prototype.createReadStream = function(params, options) {
+    return this.iterate(params, options).stream();
+};
+
 Statement.prototype.map = function() {
     var params = Array.prototype.slice.call(arguments);
     var callback = params.pop();
@@ -144,7 +586,7 @@ Statement.prototype.map = function() {
 
 var isVerbose = false;
 
-var supportedEvents = [ 'trace', 'profile', 'insert', 'update', 'delete' ];
+var supportedEvents = [ 'trace', 'profile', 'insert', 'update', 'delete', 'change' ];
 
 Database.prototype.addListener = Database.prototype.on = function(type) {
     var val = EventEmitter.prototype.addListener.apply(this, arguments);
@@ -178,8 +620,10 @@ sqlite3.verbose = function() {
             'prepare',
             'get',
             'run',
+            'runBatch',
             'all',
             'each',
+            'eachBatch',
             'map',
             'close',
             'exec'
@@ -190,8 +634,11 @@ sqlite3.verbose = function() {
             'bind',
             'get',
             'run',
+            'runBatch',
             'all',
             'each',
+            'eachBatch',
+            'fetch',
             'map',
             'reset',
             'finalize',
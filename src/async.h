@@ -22,11 +22,12 @@ public:
     Parent* parent;
 
 public:
-    Async(Parent* parent_, Callback cb_)
+    // On the loop of the environment parent belongs to.
+    Async(uv_loop_t* loop, Parent* parent_, Callback cb_)
         : callback(cb_), parent(parent_) {
         watcher.data = this;
         NODE_SQLITE3_MUTEX_INIT
-        uv_async_init(uv_default_loop(), &watcher, reinterpret_cast<uv_async_cb>(listener));
+        uv_async_init(loop, &watcher, reinterpret_cast<uv_async_cb>(listener));
     }
 
     static void listener(uv_async_t* handle, int status) {
@@ -55,6 +56,18 @@ public:
         uv_close((uv_handle_t*)&watcher, close);
     }
 
+    // Like finish, but drops the items that are left instead of handing
+    // them to the callback, for when JavaScript can no longer run.
+    void abandon() {
+        NODE_SQLITE3_MUTEX_LOCK(&mutex)
+        for (unsigned int i = 0, size = data.size(); i < size; i++) {
+            delete data[i];
+        }
+        data.clear();
+        NODE_SQLITE3_MUTEX_UNLOCK(&mutex)
+        uv_close((uv_handle_t*)&watcher, close);
+    }
+
     void add(Item* item) {
         NODE_SQLITE3_MUTEX_LOCK(&mutex);
         data.push_back(item);
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <limits.h>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_version.h>
@@ -9,9 +10,6 @@
 
 using namespace node_sqlite3;
 
-Nan::Persistent<FunctionTemplate> Backup::constructor_template;
-
-
 NAN_MODULE_INIT(Backup::Init) {
     Nan::HandleScope scope;
 
@@ -21,6 +19,7 @@ NAN_MODULE_INIT(Backup::Init) {
     t->SetClassName(Nan::New("Backup").ToLocalChecked());
 
     Nan::SetPrototypeMethod(t, "step", Step);
+    Nan::SetPrototypeMethod(t, "stepFor", StepFor);
     Nan::SetPrototypeMethod(t, "finish", Finish);
 
     NODE_SET_GETTER(t, "idle", IdleGetter);
@@ -31,7 +30,6 @@ NAN_MODULE_INIT(Backup::Init) {
 
     NODE_SET_SETTER(t, "retryErrors", RetryErrorGetter, RetryErrorSetter);
 
-    constructor_template.Reset(t);
     Nan::Set(target, Nan::New("Backup").ToLocalChecked(),
         Nan::GetFunction(t).ToLocalChecked());
 }
@@ -185,8 +183,8 @@ NAN_METHOD(Backup::New) {
 void Backup::Work_BeginInitialize(Database::Baton* baton) {
     assert(baton->db->open);
     baton->db->pending++;
-    int status = uv_queue_work(uv_default_loop(),
-        &baton->request, Work_Initialize, (uv_after_work_cb)Work_AfterInitialize);
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Initialize, (uv_after_work_cb)Work_AfterInitialize);
     assert(status == 0);
 }
 
@@ -251,13 +249,40 @@ NAN_METHOD(Backup::Step) {
     info.GetReturnValue().Set(info.This());
 }
 
+NAN_METHOD(Backup::StepFor) {
+    Backup* backup = Nan::ObjectWrap::Unwrap<Backup>(info.This());
+
+    if (info.Length() <= 0 || !info[0]->IsNumber() ||
+        !(Nan::To<double>(info[0]).FromJust() > 0)) {
+        return Nan::ThrowTypeError("Argument 0 must be a positive number");
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+
+    StepBaton* baton = new StepBaton(backup, callback, 0);
+    baton->sliceTime = Nan::To<double>(info[0]).FromJust();
+    backup->GetRetryErrors(baton->retryErrorsSet);
+    backup->Schedule(Work_BeginStep, baton);
+    info.GetReturnValue().Set(info.This());
+}
+
 void Backup::Work_BeginStep(Baton* baton) {
     BACKUP_BEGIN(Step);
 }
 
 void Backup::Work_Step(uv_work_t* req) {
     BACKUP_INIT(StepBaton);
-    if (backup->_handle) {
+    if (backup->_handle && baton->sliceTime > 0) {
+        baton->pages = backup->slicePages;
+        uint64_t started = uv_hrtime();
+        backup->status = sqlite3_backup_step(backup->_handle, baton->pages);
+        double elapsed = (uv_hrtime() - started) / 1e6;
+        if (backup->status == SQLITE_OK) {
+            backup->AdaptSlice(baton->pages, elapsed, baton->sliceTime);
+        }
+        backup->remaining = sqlite3_backup_remaining(backup->_handle);
+        backup->pageCount = sqlite3_backup_pagecount(backup->_handle);
+    }
+    else if (backup->_handle) {
         backup->status = sqlite3_backup_step(backup->_handle, baton->pages);
         backup->remaining = sqlite3_backup_remaining(backup->_handle);
         backup->pageCount = sqlite3_backup_pagecount(backup->_handle);
@@ -339,6 +364,15 @@ void Backup::Work_AfterFinish(uv_work_t* req) {
     BACKUP_END();
 }
 
+void Backup::AdaptSlice(int pages, double elapsed, double sliceTime) {
+    // Aim at sliceTime from the rate of this step, but grow no more than
+    // fourfold at a time, as a short step says little about the rate.
+    double next = elapsed > 0 ? pages * sliceTime / elapsed : pages * 4.0;
+    if (next > pages * 4.0) next = pages * 4.0;
+    if (next > INT_MAX / 4) next = INT_MAX / 4;
+    slicePages = next < 1 ? 1 : static_cast<int>(next);
+}
+
 void Backup::FinishAll() {
     assert(!finished);
     if (!completed && !failed) {
@@ -346,7 +380,12 @@ void Backup::FinishAll() {
     }
     finished = true;
     CleanQueue();
+    // The backup is from or to the database's connection, whose mutex
+    // finishing it takes.
+    sqlite3* connection = _handle ? db->_handle : NULL;
+    if (connection) db->EnterConnection(connection);
     FinishSqlite();
+    if (connection) db->LeaveConnection(connection);
     db->Unref();
 }
 
@@ -13,6 +13,9 @@
 using namespace v8;
 using namespace node;
 
+// The pages in the first step of stepFor.
+#define BACKUP_SLICE_PAGES 64
+
 namespace node_sqlite3 {
 
 /**
@@ -38,7 +41,11 @@ namespace node_sqlite3 {
  *   - `sqlite3_backup_init`: This is implemented as
  *     `db.backup(filename, [callback])` or
  *     `db.backup(filename, destDbName, sourceDbName, filenameIsDest, [callback])`.
- *   - `sqlite3_backup_step`: `backup.step(pages, [callback])`.
+ *   - `sqlite3_backup_step`: `backup.step(pages, [callback])`, or
+ *     `backup.stepFor(milliseconds, [callback])`, which picks the number
+ *     of pages itself, aiming to hold the database's lock for no longer
+ *     than that.  It starts at BACKUP_SLICE_PAGES pages, and goes by how
+ *     fast the pages before went.
  *   - `sqlite3_backup_finish`: `backup.finish([callback])`.
  *   - `sqlite3_backup_remaining`: `backup.remaining`.
  *   - `sqlite3_backup_pagecount`: `backup.pageCount`.
@@ -82,6 +89,10 @@ namespace node_sqlite3 {
  * `backup.retryErrors` to `[]`.  In that case, it is necessary
  * to call `backup.finish()`.
  *
+ * `backup.run([options], [callback])` in lib/sqlite3.js steps the backup
+ * with `stepFor` until it is done, yielding to the event loop between
+ * steps and emitting 'progress' after each of them.
+ *
  * In the same way as node-sqlite3 databases and statements,
  * backup methods can be called safely without callbacks, due
  * to an internal call queue.  So for example this naive code
@@ -94,13 +105,11 @@ namespace node_sqlite3 {
  */
 class Backup : public Nan::ObjectWrap {
 public:
-    static Nan::Persistent<FunctionTemplate> constructor_template;
-
     static NAN_MODULE_INIT(Init);
     static NAN_METHOD(New);
 
     struct Baton {
-        uv_work_t request;
+        WorkRequest request;
         Backup* backup;
         Nan::Persistent<Function> callback;
 
@@ -136,9 +145,11 @@ public:
 
     struct StepBaton : Baton {
         int pages;
+        // In milliseconds, for stepFor, or 0 to step the given pages.
+        double sliceTime;
         std::set<int> retryErrorsSet;
         StepBaton(Backup* backup_, Local<Function> cb_, int pages_) :
-            Baton(backup_, cb_), pages(pages_) {}
+            Baton(backup_, cb_), pages(pages_), sliceTime(0) {}
     };
 
     typedef void (*Work_Callback)(Baton* baton);
@@ -160,18 +171,23 @@ public:
            failed(false),
            remaining(-1),
            pageCount(-1),
+           slicePages(BACKUP_SLICE_PAGES),
            finished(false) {
         db->Ref();
     }
 
     ~Backup() {
         if (!finished) {
+            // Freed by the garbage collector, where no JavaScript may run.
+            db->collecting++;
             FinishAll();
+            db->collecting--;
         }
         retryErrors.Reset();
     }
 
     WORK_DEFINITION(Step);
+    static NAN_METHOD(StepFor);
     WORK_DEFINITION(Finish);
     static NAN_GETTER(IdleGetter);
     static NAN_GETTER(CompletedGetter);
@@ -197,6 +213,7 @@ protected:
     void FinishAll();
     void FinishSqlite();
     void GetRetryErrors(std::set<int>& retryErrorsSet);
+    void AdaptSlice(int pages, double elapsed, double sliceTime);
 
     Database* db;
 
@@ -212,6 +229,8 @@ protected:
     bool failed;
     int remaining;
     int pageCount;
+    // The pages for the next step of stepFor.
+    int slicePages;
     bool finished;
     std::queue<Call*> queue;
 
@@ -0,0 +1,421 @@
+#include <string.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <node_version.h>
+
+#include "macros.h"
+#include "database.h"
+#include "blob.h"
+
+using namespace node_sqlite3;
+
+NAN_MODULE_INIT(Blob::Init) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    t->SetClassName(Nan::New("Blob").ToLocalChecked());
+
+    Nan::SetPrototypeMethod(t, "read", Read);
+    Nan::SetPrototypeMethod(t, "write", Write);
+    Nan::SetPrototypeMethod(t, "close", Close);
+
+    NODE_SET_GETTER(t, "size", SizeGetter);
+
+    Nan::Set(target, Nan::New("Blob").ToLocalChecked(),
+        Nan::GetFunction(t).ToLocalChecked());
+}
+
+void Blob::Process() {
+    if (finished && !queue.empty()) {
+        return CleanQueue();
+    }
+
+    while (inited && !locked && !queue.empty()) {
+        Call* call = queue.front();
+        queue.pop();
+
+        call->callback(call->baton);
+        delete call;
+    }
+}
+
+void Blob::Schedule(Work_Callback callback, Baton* baton) {
+    if (finished) {
+        queue.push(new Call(callback, baton));
+        CleanQueue();
+    }
+    else if (!inited || locked || !queue.empty()) {
+        queue.push(new Call(callback, baton));
+    }
+    else {
+        callback(baton);
+    }
+}
+
+template <class T> void Blob::Error(T* baton) {
+    Nan::HandleScope scope;
+
+    Blob* blob = baton->blob;
+    // Fail hard on logic errors.
+    assert(blob->status != 0);
+    EXCEPTION(blob->message, blob->status, exception);
+
+    Local<Function> cb = Nan::New(baton->callback);
+
+    if (!cb.IsEmpty() && cb->IsFunction()) {
+        Local<Value> argv[] = { exception };
+        TRY_CATCH_CALL(blob->handle(), cb, 1, argv);
+    }
+    else {
+        Local<Value> argv[] = { Nan::New("error").ToLocalChecked(), exception };
+        EMIT_EVENT(blob->handle(), 2, argv);
+    }
+}
+
+void Blob::SetError() {
+    message = std::string(sqlite3_errmsg(db->_handle));
+}
+
+void Blob::CleanQueue() {
+    Nan::HandleScope scope;
+
+    if (inited && !queue.empty()) {
+        // This blob was opened and has since been closed.  Fire an error
+        // for all remaining items in the queue.
+        EXCEPTION("Blob is already closed", SQLITE_MISUSE, exception);
+        Local<Value> argv[] = { exception };
+        bool called = false;
+
+        // Clear out the queue so that this object can get GC'ed.
+        while (!queue.empty()) {
+            Call* call = queue.front();
+            queue.pop();
+
+            Local<Function> cb = Nan::New(call->baton->callback);
+
+            if (!cb.IsEmpty() && cb->IsFunction()) {
+                TRY_CATCH_CALL(handle(), cb, 1, argv);
+                called = true;
+            }
+
+            // We don't call the actual callback, so we have to make sure that
+            // the baton gets destroyed.
+            delete call->baton;
+            delete call;
+        }
+
+        // When we couldn't call a callback function, emit an error on the
+        // Blob object.
+        if (!called) {
+            Local<Value> info[] = { Nan::New("error").ToLocalChecked(), exception };
+            EMIT_EVENT(handle(), 2, info);
+        }
+    }
+    else while (!queue.empty()) {
+        // Just delete all items in the queue; we already fired an event when
+        // opening the blob failed.
+        Call* call = queue.front();
+        queue.pop();
+
+        delete call->baton;
+        delete call;
+    }
+}
+
+NAN_METHOD(Blob::New) {
+    if (!info.IsConstructCall()) {
+        return Nan::ThrowTypeError("Use the new operator to create new Blob objects");
+    }
+
+    int length = info.Length();
+
+    if (length <= 0 || !Database::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("Database object expected");
+    }
+    else if (length <= 1 || !info[1]->IsString()) {
+        return Nan::ThrowTypeError("Table name expected");
+    }
+    else if (length <= 2 || !info[2]->IsString()) {
+        return Nan::ThrowTypeError("Column name expected");
+    }
+    else if (length <= 3 || !info[3]->IsNumber()) {
+        return Nan::ThrowTypeError("Rowid expected");
+    }
+    else if (length <= 4 || !info[4]->IsBoolean()) {
+        return Nan::ThrowTypeError("Writable flag expected");
+    }
+    else if (length <= 5 || !info[5]->IsString()) {
+        return Nan::ThrowTypeError("Database name expected");
+    }
+    else if (length > 6 && !info[6]->IsUndefined() && !info[6]->IsFunction()) {
+        return Nan::ThrowTypeError("Callback expected");
+    }
+
+    Database* db = Nan::ObjectWrap::Unwrap<Database>(info[0].As<Object>());
+    Local<String> table = Local<String>::Cast(info[1]);
+    Local<String> column = Local<String>::Cast(info[2]);
+    Local<Boolean> writable = Local<Boolean>::Cast(info[4]);
+
+    Nan::ForceSet(info.This(), Nan::New("table").ToLocalChecked(), table, ReadOnly);
+    Nan::ForceSet(info.This(), Nan::New("column").ToLocalChecked(), column, ReadOnly);
+    Nan::ForceSet(info.This(), Nan::New("rowid").ToLocalChecked(), info[3], ReadOnly);
+    Nan::ForceSet(info.This(), Nan::New("writable").ToLocalChecked(), writable, ReadOnly);
+
+    Blob* blob = new Blob(db);
+    blob->Wrap(info.This());
+
+    OpenBaton* baton = new OpenBaton(db, Local<Function>::Cast(info[6]), blob);
+    baton->databaseName = std::string(*Nan::Utf8String(info[5]));
+    baton->table = std::string(*Nan::Utf8String(table));
+    baton->column = std::string(*Nan::Utf8String(column));
+    baton->rowid = Nan::To<int64_t>(info[3]).FromJust();
+    baton->writable = Nan::To<bool>(writable).FromJust();
+    db->Schedule(Work_BeginOpen, baton);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+void Blob::Work_BeginOpen(Database::Baton* baton) {
+    assert(baton->db->open);
+    baton->db->pending++;
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Open, (uv_after_work_cb)Work_AfterOpen);
+    assert(status == 0);
+}
+
+void Blob::Work_Open(uv_work_t* req) {
+    BLOB_INIT(OpenBaton);
+
+    sqlite3_mutex* mtx = sqlite3_db_mutex(baton->db->_handle);
+    sqlite3_mutex_enter(mtx);
+
+    blob->status = sqlite3_blob_open(baton->db->_handle,
+        baton->databaseName.c_str(), baton->table.c_str(), baton->column.c_str(),
+        baton->rowid, baton->writable ? 1 : 0, &blob->_handle);
+
+    if (blob->status == SQLITE_OK) {
+        blob->size = sqlite3_blob_bytes(blob->_handle);
+    }
+    else {
+        blob->SetError();
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Blob::Work_AfterOpen(uv_work_t* req) {
+    Nan::HandleScope scope;
+
+    BLOB_INIT(OpenBaton);
+
+    if (blob->status != SQLITE_OK) {
+        Error(baton);
+        blob->FinishAll();
+    }
+    else {
+        blob->inited = true;
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Local<Value> argv[] = { Nan::Null() };
+            TRY_CATCH_CALL(blob->handle(), cb, 1, argv);
+        }
+    }
+
+    BLOB_END();
+}
+
+NAN_METHOD(Blob::Read) {
+    Blob* blob = Nan::ObjectWrap::Unwrap<Blob>(info.This());
+
+    REQUIRE_ARGUMENT_INTEGER(0, offset);
+    REQUIRE_ARGUMENT_INTEGER(1, length);
+    OPTIONAL_ARGUMENT_FUNCTION(2, callback);
+
+    if (offset < 0 || length < 0) {
+        return Nan::ThrowRangeError("Offset and length must not be negative");
+    }
+
+    ReadBaton* baton = new ReadBaton(blob, callback, offset, length);
+    blob->Schedule(Work_BeginRead, baton);
+    info.GetReturnValue().Set(info.This());
+}
+
+void Blob::Work_BeginRead(Baton* baton) {
+    BLOB_BEGIN(Read);
+}
+
+void Blob::Work_Read(uv_work_t* req) {
+    BLOB_INIT(ReadBaton);
+
+    // Read no further than the end, and nothing past it.
+    int left = blob->size > baton->offset ? blob->size - baton->offset : 0;
+    if (baton->length > left) baton->length = left;
+    if (baton->length == 0) {
+        blob->status = SQLITE_OK;
+        return;
+    }
+
+    baton->data = (char*)malloc(baton->length);
+    if (!baton->data) {
+        blob->status = SQLITE_NOMEM;
+        blob->message = std::string(sqlite3_errstr(SQLITE_NOMEM));
+        return;
+    }
+    sqlite3_mutex* mtx = sqlite3_db_mutex(blob->db->_handle);
+    sqlite3_mutex_enter(mtx);
+    blob->status = sqlite3_blob_read(blob->_handle, baton->data, baton->length, baton->offset);
+    if (blob->status != SQLITE_OK) {
+        blob->SetError();
+    }
+    sqlite3_mutex_leave(mtx);
+}
+
+void Blob::Work_AfterRead(uv_work_t* req) {
+    Nan::HandleScope scope;
+
+    BLOB_INIT(ReadBaton);
+
+    if (blob->status != SQLITE_OK) {
+        Error(baton);
+    }
+    else {
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Local<Value> buffer;
+            if (baton->data) {
+                // The Buffer takes over the memory.
+                buffer = Nan::NewBuffer(baton->data, baton->length).ToLocalChecked();
+                baton->data = NULL;
+            }
+            else {
+                buffer = Nan::NewBuffer(0).ToLocalChecked();
+            }
+            Local<Value> argv[] = { Nan::Null(), buffer };
+            TRY_CATCH_CALL(blob->handle(), cb, 2, argv);
+        }
+    }
+
+    BLOB_END();
+}
+
+NAN_METHOD(Blob::Write) {
+    Blob* blob = Nan::ObjectWrap::Unwrap<Blob>(info.This());
+
+    REQUIRE_ARGUMENT_INTEGER(0, offset);
+    if (info.Length() <= 1 || !Buffer::HasInstance(info[1])) {
+        return Nan::ThrowTypeError("Argument 1 must be a Buffer");
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(2, callback);
+
+    if (offset < 0) {
+        return Nan::ThrowRangeError("Offset must not be negative");
+    }
+
+    WriteBaton* baton = new WriteBaton(blob, callback, offset, info[1].As<Object>());
+    blob->Schedule(Work_BeginWrite, baton);
+    info.GetReturnValue().Set(info.This());
+}
+
+void Blob::Work_BeginWrite(Baton* baton) {
+    BLOB_BEGIN(Write);
+}
+
+void Blob::Work_Write(uv_work_t* req) {
+    BLOB_INIT(WriteBaton);
+
+    sqlite3_mutex* mtx = sqlite3_db_mutex(blob->db->_handle);
+    sqlite3_mutex_enter(mtx);
+    blob->status = sqlite3_blob_write(blob->_handle, baton->data, baton->length, baton->offset);
+    if (blob->status != SQLITE_OK) {
+        blob->SetError();
+    }
+    sqlite3_mutex_leave(mtx);
+}
+
+void Blob::Work_AfterWrite(uv_work_t* req) {
+    Nan::HandleScope scope;
+
+    BLOB_INIT(WriteBaton);
+
+    if (blob->status != SQLITE_OK) {
+        Error(baton);
+    }
+    else {
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Local<Value> argv[] = { Nan::Null() };
+            TRY_CATCH_CALL(blob->handle(), cb, 1, argv);
+        }
+    }
+
+    BLOB_END();
+}
+
+NAN_METHOD(Blob::Close) {
+    Blob* blob = Nan::ObjectWrap::Unwrap<Blob>(info.This());
+
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+
+    Baton* baton = new Baton(blob, callback);
+    blob->Schedule(Work_BeginClose, baton);
+    info.GetReturnValue().Set(info.This());
+}
+
+void Blob::Work_BeginClose(Baton* baton) {
+    BLOB_BEGIN(Close);
+}
+
+void Blob::Work_Close(uv_work_t* req) {
+    BLOB_INIT(Baton);
+
+    // Closing a writable blob commits the writes, when there is no
+    // transaction open, and that can fail.
+    sqlite3_mutex* mtx = sqlite3_db_mutex(blob->db->_handle);
+    sqlite3_mutex_enter(mtx);
+    blob->status = sqlite3_blob_close(blob->_handle);
+    blob->_handle = NULL;
+    if (blob->status != SQLITE_OK) {
+        blob->SetError();
+    }
+    sqlite3_mutex_leave(mtx);
+}
+
+void Blob::Work_AfterClose(uv_work_t* req) {
+    Nan::HandleScope scope;
+
+    BLOB_INIT(Baton);
+    blob->FinishAll();
+
+    if (blob->status != SQLITE_OK) {
+        Error(baton);
+    }
+    else {
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Local<Value> argv[] = { Nan::Null() };
+            TRY_CATCH_CALL(blob->handle(), cb, 1, argv);
+        }
+    }
+
+    BLOB_END();
+}
+
+void Blob::FinishAll() {
+    assert(!finished);
+    finished = true;
+    CleanQueue();
+    if (_handle) {
+        db->EnterConnection(db->_handle);
+        sqlite3_blob_close(_handle);
+        db->LeaveConnection(db->_handle);
+        _handle = NULL;
+    }
+    db->Unref();
+}
+
+NAN_GETTER(Blob::SizeGetter) {
+    Blob* blob = Nan::ObjectWrap::Unwrap<Blob>(info.This());
+    info.GetReturnValue().Set(blob->size);
+}
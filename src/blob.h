@@ -0,0 +1,176 @@
+#ifndef NODE_SQLITE3_SRC_BLOB_H
+#define NODE_SQLITE3_SRC_BLOB_H
+
+#include "database.h"
+
+#include <string>
+#include <queue>
+
+#include <sqlite3.h>
+#include <nan.h>
+
+using namespace v8;
+using namespace node;
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * A class for managing an sqlite3_blob object, for reading and writing a
+ * large value a piece at a time rather than as a whole.  lib/sqlite3.js
+ * wraps it in a stream:
+ *
+ *   db.openBlob('assets', 'data', rowid).pipe(response);
+ *   source.pipe(db.openBlob('assets', 'data', rowid, { writable: true }));
+ *
+ * Here is how sqlite's incremental blob api is exposed:
+ *
+ *   - `sqlite3_blob_open`: `new Blob(db, table, column, rowid, writable,
+ *     databaseName, [callback])`, scheduled on the database like any
+ *     other call.
+ *   - `sqlite3_blob_read`: `blob.read(offset, length, [callback])`, which
+ *     calls back with a Buffer of at most length bytes, and an empty one
+ *     past the end.
+ *   - `sqlite3_blob_write`: `blob.write(offset, buffer, [callback])`.
+ *   - `sqlite3_blob_close`: `blob.close([callback])`.
+ *   - `sqlite3_blob_bytes`: `blob.size`, or -1 until the blob is open.
+ *
+ * As with backups, calls are queued until the blob is open, and each runs
+ * on the threadpool, counting as pending work on the database so that an
+ * exclusive call waits for it.  Writes can not change the size of the
+ * value; make room for it first, e.g. with zeroblob(n).
+ *
+ */
+class Blob : public Nan::ObjectWrap {
+public:
+    static NAN_MODULE_INIT(Init);
+    static NAN_METHOD(New);
+
+    struct Baton {
+        WorkRequest request;
+        Blob* blob;
+        Nan::Persistent<Function> callback;
+
+        Baton(Blob* blob_, Local<Function> cb_) : blob(blob_) {
+            blob->Ref();
+            request.data = this;
+            callback.Reset(cb_);
+        }
+        virtual ~Baton() {
+            blob->Unref();
+            callback.Reset();
+        }
+    };
+
+    struct OpenBaton : Database::Baton {
+        Blob* blob;
+        std::string databaseName;
+        std::string table;
+        std::string column;
+        sqlite3_int64 rowid;
+        bool writable;
+        OpenBaton(Database* db_, Local<Function> cb_, Blob* blob_) :
+            Baton(db_, cb_), blob(blob_), rowid(0), writable(false) {
+            blob->Ref();
+        }
+        virtual ~OpenBaton() {
+            blob->Unref();
+            if (!db->IsOpen() && db->IsLocked()) {
+                // The database handle was closed before the blob could be opened.
+                blob->FinishAll();
+            }
+        }
+    };
+
+    struct ReadBaton : Baton {
+        int offset;
+        int length;
+        char* data;
+        ReadBaton(Blob* blob_, Local<Function> cb_, int offset_, int length_) :
+            Baton(blob_, cb_), offset(offset_), length(length_), data(NULL) {}
+        virtual ~ReadBaton() {
+            // Still set unless handed to a Buffer.
+            free(data);
+        }
+    };
+
+    struct WriteBaton : Baton {
+        int offset;
+        Nan::Persistent<Object> buffer; // Keeps data alive
+        const char* data;
+        int length;
+        WriteBaton(Blob* blob_, Local<Function> cb_, int offset_, Local<Object> buffer_) :
+            Baton(blob_, cb_), offset(offset_) {
+            buffer.Reset(buffer_);
+            data = Buffer::Data(buffer_);
+            length = Buffer::Length(buffer_);
+        }
+        virtual ~WriteBaton() {
+            buffer.Reset();
+        }
+    };
+
+    typedef void (*Work_Callback)(Baton* baton);
+
+    struct Call {
+        Call(Work_Callback cb_, Baton* baton_) : callback(cb_), baton(baton_) {};
+        Work_Callback callback;
+        Baton* baton;
+    };
+
+    Blob(Database* db_) : Nan::ObjectWrap(),
+           db(db_),
+           _handle(NULL),
+           status(SQLITE_OK),
+           size(-1),
+           inited(false),
+           locked(true),
+           finished(false) {
+        db->Ref();
+    }
+
+    ~Blob() {
+        if (!finished) {
+            // Freed by the garbage collector, where no JavaScript may run.
+            db->collecting++;
+            FinishAll();
+            db->collecting--;
+        }
+    }
+
+    WORK_DEFINITION(Read);
+    WORK_DEFINITION(Write);
+    WORK_DEFINITION(Close);
+    static NAN_GETTER(SizeGetter);
+
+protected:
+    static void Work_BeginOpen(Database::Baton* baton);
+    static void Work_Open(uv_work_t* req);
+    static void Work_AfterOpen(uv_work_t* req);
+
+    void Schedule(Work_Callback callback, Baton* baton);
+    void Process();
+    void CleanQueue();
+    template <class T> static void Error(T* baton);
+    // Keep the connection's error message for a failed call.  Called on
+    // the threadpool with the connection's mutex held.
+    void SetError();
+
+    void FinishAll();
+
+    Database* db;
+
+    sqlite3_blob* _handle;
+    int status;
+    std::string message;
+    int size;
+
+    bool inited;
+    bool locked;
+    bool finished;
+    std::queue<Call*> queue;
+};
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include <string.h>
+#include <node.h>
+
+#include "change_feed.h"
+
+using namespace node_sqlite3;
+
+ChangeFeed::ChangeFeed(uv_loop_t* loop, void* parent_, Callback callback_) :
+    parent(parent_),
+    callback(callback_),
+    last(0),
+    statement(NULL),
+    writes(false),
+    starts(0) {
+    uv_mutex_init(&mutex);
+    watcher.data = this;
+    uv_async_init(loop, &watcher, Wakeup);
+}
+
+ChangeFeed::~ChangeFeed() {
+    uv_mutex_destroy(&mutex);
+}
+
+void ChangeFeed::Update(int type, const char* database, const char* table, sqlite3_int64 rowid) {
+    // Most statements change rows of one table, so try the last one first.
+    if (last < current.size()) {
+        Change& change = current[last];
+        if (change.type == type && change.table == table && change.database == database) {
+            change.rowids.push_back(rowid);
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < current.size(); i++) {
+        Change& change = current[i];
+        if (change.type == type && change.table == table && change.database == database) {
+            change.rowids.push_back(rowid);
+            last = i;
+            return;
+        }
+    }
+
+    current.push_back(Change());
+    Change& change = current.back();
+    change.database = database;
+    change.table = table;
+    change.type = type;
+    change.rowids.push_back(rowid);
+    last = current.size() - 1;
+}
+
+void ChangeFeed::Commit() {
+    if (current.empty()) return;
+
+    uv_mutex_lock(&mutex);
+    // The main thread takes all of them each time it wakes, so it only
+    // needs waking for the first one after that.
+    bool wake = committed.empty();
+    committed.push_back(Transaction());
+    committed.back().swap(current);
+    uv_mutex_unlock(&mutex);
+
+    last = 0;
+    statement = NULL;
+    savepoints.clear();
+    if (wake) uv_async_send(&watcher);
+}
+
+void ChangeFeed::Rollback() {
+    current.clear();
+    last = 0;
+    statement = NULL;
+    savepoints.clear();
+}
+
+// Reads the word or name at sql into word, without its quotes, and returns
+// where it ends.
+static const char* NextWord(const char* sql, std::string& word) {
+    word.clear();
+    while (*sql == ' ' || *sql == '\t' || *sql == '\n' || *sql == '\r') sql++;
+    char close = 0;
+    switch (*sql) {
+        case '"': case '\'': case '`': close = *sql; break;
+        case '[': close = ']'; break;
+    }
+    if (close) {
+        for (sql++; *sql; sql++) {
+            if (*sql == close) {
+                // Doubled, a quote stands for itself.
+                if (close == ']' || sql[1] != close) return sql + 1;
+                sql++;
+            }
+            word += *sql;
+        }
+        return sql;
+    }
+    for (; *sql && *sql != ';' && !strchr(" \t\n\r", *sql); sql++) {
+        word += *sql;
+    }
+    return sql;
+}
+
+void ChangeFeed::Started(sqlite3_stmt* stmt, const char* sql) {
+    starts++;
+    statement = stmt;
+    writes = !sqlite3_stmt_readonly(stmt);
+    Mark(start);
+
+    std::string word;
+    sql = NextWord(sql, word);
+    if (sqlite3_stricmp(word.c_str(), "SAVEPOINT") == 0) {
+        savepoints.push_back(Savepoint());
+        NextWord(sql, savepoints.back().name);
+        savepoints.back().start = start;
+        return;
+    }
+
+    bool release = sqlite3_stricmp(word.c_str(), "RELEASE") == 0;
+    if (!release && sqlite3_stricmp(word.c_str(), "ROLLBACK") != 0) return;
+    sql = NextWord(sql, word);
+    if (!release) {
+        // Without TO, the rollback hook drops the whole transaction.
+        if (sqlite3_stricmp(word.c_str(), "TRANSACTION") == 0) sql = NextWord(sql, word);
+        if (sqlite3_stricmp(word.c_str(), "TO") != 0) return;
+        sql = NextWord(sql, word);
+    }
+    if (sqlite3_stricmp(word.c_str(), "SAVEPOINT") == 0) sql = NextWord(sql, word);
+
+    // The innermost of that name; if there is none, the statement fails.
+    for (size_t i = savepoints.size(); i-- > 0;) {
+        if (sqlite3_stricmp(savepoints[i].name.c_str(), word.c_str()) == 0) {
+            if (release) {
+                savepoints.resize(i);
+            }
+            else {
+                // Rolled back to, the savepoint stays open.
+                Revert(savepoints[i].start);
+                savepoints.resize(i + 1);
+                Mark(start);
+            }
+            return;
+        }
+    }
+}
+
+void ChangeFeed::Failed(sqlite3_stmt* stmt, uint64_t before) {
+    if (statement == NULL || starts <= before || (stmt && stmt != statement)) return;
+    if (writes) Revert(start);
+    statement = NULL;
+}
+
+void ChangeFeed::Mark(Point& point) {
+    point.resize(current.size());
+    for (size_t i = 0; i < current.size(); i++) {
+        point[i] = current[i].rowids.size();
+    }
+}
+
+void ChangeFeed::Revert(const Point& point) {
+    current.resize(point.size());
+    for (size_t i = 0; i < point.size(); i++) {
+        current[i].rowids.resize(point[i]);
+    }
+    last = 0;
+}
+
+void ChangeFeed::Deliver() {
+    std::vector<Transaction> transactions;
+    uv_mutex_lock(&mutex);
+    transactions.swap(committed);
+    uv_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < transactions.size(); i++) {
+        callback(parent, transactions[i]);
+    }
+}
+
+void ChangeFeed::Wakeup(uv_async_t* handle) {
+    static_cast<ChangeFeed*>(handle->data)->Deliver();
+}
+
+void ChangeFeed::Stop() {
+    // Deliver the transactions committed since the last wakeup.
+    Deliver();
+    uv_close(reinterpret_cast<uv_handle_t*>(&watcher), Closed);
+}
+
+void ChangeFeed::Discard() {
+    uv_close(reinterpret_cast<uv_handle_t*>(&watcher), Closed);
+}
+
+void ChangeFeed::Closed(uv_handle_t* handle) {
+    delete static_cast<ChangeFeed*>(handle->data);
+}
@@ -0,0 +1,109 @@
+#ifndef NODE_SQLITE3_SRC_CHANGE_FEED_H
+#define NODE_SQLITE3_SRC_CHANGE_FEED_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Collects the rows a Database's connection changes, a transaction at a
+ * time, for the 'change' event.  The update hook adds each row to the open
+ * transaction, grouped by table and operation so that a row costs only its
+ * rowid.  The commit hook hands the transaction to the main thread, which
+ * is woken once for all those committed since it last looked; the rollback
+ * hook drops it.
+ *
+ * The trace hook tells it as each statement starts, which marks where the
+ * statement's rows begin, and follows SAVEPOINT, RELEASE and ROLLBACK TO,
+ * so that what a savepoint rolls back is dropped too.  The rows of a
+ * statement that fails are dropped once the thread that ran it says so.
+ *
+ * A transaction is reported when its COMMIT starts, so one that is then
+ * kept open by SQLITE_BUSY has been reported already.  Rows a statement
+ * with OR FAIL changed before failing are dropped although they are kept,
+ * and rows removed by a REPLACE conflict are not reported at all, as the
+ * update hook does not see them.
+ *
+ */
+class ChangeFeed {
+public:
+    struct Change {
+        std::string database;
+        std::string table;
+        int type; // SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE
+        // In the order they were changed, once for each change.
+        std::vector<sqlite3_int64> rowids;
+    };
+    typedef std::vector<Change> Transaction;
+
+    // Called on the main thread for each committed transaction.
+    typedef void (*Callback)(void* parent, Transaction& changes);
+
+    ChangeFeed(uv_loop_t* loop, void* parent, Callback callback);
+
+    // Called from the hooks, on the thread holding the connection.
+    void Update(int type, const char* database, const char* table, sqlite3_int64 rowid);
+    void Commit();
+    void Rollback();
+    // Called from the trace hook as a statement starts, but not for those
+    // that triggers run.
+    void Started(sqlite3_stmt* stmt, const char* sql);
+    // The statements started so far.
+    uint64_t Starts() { return starts; }
+    // Called on the thread holding the connection once stmt, or with NULL
+    // the statement last started, failed, with Starts() from before it ran:
+    // drops its rows, unless another statement has started since.
+    void Failed(sqlite3_stmt* stmt, uint64_t before);
+    // Deliver what is committed, and free this once the uv_async_t is closed.
+    void Stop();
+    // As Stop, dropping what is committed, for when JavaScript can no
+    // longer run.
+    void Discard();
+
+protected:
+    ~ChangeFeed();
+
+    void Deliver();
+
+    // Where the rows of current were: how many of each change there were.
+    typedef std::vector<size_t> Point;
+    void Mark(Point& point);
+    void Revert(const Point& point);
+
+    static void Wakeup(uv_async_t* handle);
+    static void Closed(uv_handle_t* handle);
+
+    void* parent;
+    Callback callback;
+    uv_async_t watcher;
+
+    // The open transaction, only used by the thread holding the connection.
+    Transaction current;
+    // Into current, of the change last added to.
+    size_t last;
+    // The statement started last, whether it can change rows, and where
+    // its rows begin, or NULL once it cannot be rolled back on its own.
+    sqlite3_stmt* statement;
+    bool writes;
+    Point start;
+    uint64_t starts;
+    // The savepoints open, outermost first.
+    struct Savepoint {
+        std::string name;
+        Point start;
+    };
+    std::vector<Savepoint> savepoints;
+
+    uv_mutex_t mutex;
+    std::vector<Transaction> committed;
+};
+
+}
+
+#endif
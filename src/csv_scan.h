@@ -0,0 +1,98 @@
+#ifndef NODE_SQLITE3_SRC_CSV_SCAN_H
+#define NODE_SQLITE3_SRC_CSV_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+** Byte scanning primitives for the CSV tokenizer in import.cc.
+**
+** csv_scan2() finds the next occurrence of either of two bytes, 16 or 32
+** bytes at a time where the target has vector registers.  The instruction
+** set is chosen when compiling: AVX2 if enabled (e.g. -mavx2), otherwise
+** SSE2 on x86 and NEON on 64-bit ARM, falling back to a plain loop.
+*/
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CSV_SCAN_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CSV_SCAN_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && defined(__GNUC__)
+#include <arm_neon.h>
+#define CSV_SCAN_NEON 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(CSV_SCAN_AVX2)
+#define CSV_SCAN_ENGINE "avx2"
+#elif defined(CSV_SCAN_SSE2)
+#define CSV_SCAN_ENGINE "sse2"
+#elif defined(CSV_SCAN_NEON)
+#define CSV_SCAN_ENGINE "neon"
+#else
+#define CSV_SCAN_ENGINE "scalar"
+#endif
+
+/* Index of the lowest set bit of a non-zero mask */
+static inline unsigned csv_scan_ctz(uint32_t m) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, m);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(m);
+#endif
+}
+
+/*
+** Return a pointer to the first byte of z..zEnd equal to a or b, or zEnd
+** if there is none.
+*/
+static inline const char *csv_scan2(const char *z, const char *zEnd, int a, int b) {
+#if defined(CSV_SCAN_AVX2)
+    const __m256i va = _mm256_set1_epi8((char)a);
+    const __m256i vb = _mm256_set1_epi8((char)b);
+    while (zEnd - z >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z));
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (m) return z + csv_scan_ctz(m);
+        z += 32;
+    }
+#elif defined(CSV_SCAN_SSE2)
+    const __m128i va = _mm_set1_epi8((char)a);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    while (zEnd - z >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z));
+        uint32_t m = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (m) return z + csv_scan_ctz(m);
+        z += 16;
+    }
+#elif defined(CSV_SCAN_NEON)
+    const uint8x16_t va = vdupq_n_u8((uint8_t)a);
+    const uint8x16_t vb = vdupq_n_u8((uint8_t)b);
+    while (zEnd - z >= 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(z));
+        uint8x16_t eq = vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb));
+        if (vmaxvq_u8(eq)) {
+            // Narrow to four bits per byte to locate the first match.
+            uint64_t m = vget_lane_u64(vreinterpret_u64_u8(
+                vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+            return z + (__builtin_ctzll(m) >> 2);
+        }
+        z += 16;
+    }
+#endif
+    for (; z < zEnd; z++) {
+        if (*z == (char)a || *z == (char)b) return z;
+    }
+    return zEnd;
+}
+
+#endif
@@ -4,10 +4,47 @@
 #include "database.h"
 #include "statement.h"
 #include "import.h"
+#include "import_stream.h"
+#include "export_stream.h"
+
+// sqlite3_serialize() and sqlite3_deserialize() are always there from
+// 3.36.0, and before that only with SQLITE_ENABLE_DESERIALIZE, which the
+// bundled copy is built with.
+#if defined(SQLITE_ENABLE_DESERIALIZE) || \
+    (SQLITE_VERSION_NUMBER >= 3036000 && !defined(SQLITE_OMIT_DESERIALIZE))
+#define HAVE_DESERIALIZE
+#endif
 
 using namespace node_sqlite3;
 
-Nan::Persistent<FunctionTemplate> Database::constructor_template;
+thread_local Nan::Persistent<FunctionTemplate> Database::constructor_template;
+thread_local std::set<Database *> Database::instances;
+thread_local unsigned int Database::working = 0;
+
+#if NODE_VERSION_AT_LEAST(14, 8, 0)
+namespace
+{
+
+thread_local node::AsyncCleanupHookHandle cleanupHook;
+
+// What Database::Cleanup waits on, checked on every turn of the loop until
+// the work of the databases is done, and closed last to tell Node.js so.
+struct Teardown
+{
+    uv_check_t handle;
+    void (*done)(void *);
+    void *arg;
+};
+
+void TeardownClosed(uv_handle_t *handle)
+{
+    Teardown *teardown = static_cast<Teardown *>(handle->data);
+    teardown->done(teardown->arg);
+    delete teardown;
+}
+
+}
+#endif
 
 NAN_MODULE_INIT(Database::Init)
 {
@@ -22,15 +59,27 @@ NAN_MODULE_INIT(Database::Init)
     Nan::SetPrototypeMethod(t, "exec", Exec);
     Nan::SetPrototypeMethod(t, "wait", Wait);
     Nan::SetPrototypeMethod(t, "loadExtension", LoadExtension);
+    Nan::SetPrototypeMethod(t, "function", DefineFunction);
+    Nan::SetPrototypeMethod(t, "aggregate", DefineAggregate);
+    Nan::SetPrototypeMethod(t, "toBuffer", ToBuffer);
+    Nan::SetPrototypeMethod(t, "loadBuffer", LoadBuffer);
     Nan::SetPrototypeMethod(t, "import", Import);
+    Nan::SetPrototypeMethod(t, "export", Export);
     Nan::SetPrototypeMethod(t, "serialize", Serialize);
     Nan::SetPrototypeMethod(t, "parallelize", Parallelize);
     Nan::SetPrototypeMethod(t, "configure", Configure);
     Nan::SetPrototypeMethod(t, "interrupt", Interrupt);
+    Nan::SetPrototypeMethod(t, "stats", Stats);
 
     NODE_SET_GETTER(t, "open", OpenGetter);
+    NODE_SET_GETTER(t, "statementCache", StatementCacheGetter);
 
     constructor_template.Reset(t);
+#if NODE_VERSION_AT_LEAST(14, 8, 0)
+    // Once for each environment the module is loaded in.
+    cleanupHook = node::AddEnvironmentCleanupHook(Isolate::GetCurrent(), Cleanup,
+                                                  Nan::GetCurrentEventLoop());
+#endif
 
     Nan::Set(target, Nan::New("Database").ToLocalChecked(),
              Nan::GetFunction(t).ToLocalChecked());
@@ -144,6 +193,55 @@ NAN_METHOD(Database::New)
         mode = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX;
     }
 
+    bool workerThread = false;
+    bool csvModule = false;
+    unsigned int readers = 0;
+    unsigned int cacheSize = STATEMENT_CACHE_SIZE;
+    if (info.Length() > pos && info[pos]->IsObject() && !info[pos]->IsFunction())
+    {
+        Local<Object> options = info[pos++].As<Object>();
+        Local<String> key = Nan::New("workerThread").ToLocalChecked();
+        if (Nan::Has(options, key).FromJust())
+        {
+            Local<Value> value = Nan::Get(options, key).ToLocalChecked();
+            if (!value->IsBoolean())
+            {
+                return Nan::ThrowTypeError("options.workerThread must be a boolean");
+            }
+            workerThread = Nan::To<bool>(value).FromJust();
+        }
+        key = Nan::New("csvModule").ToLocalChecked();
+        if (Nan::Has(options, key).FromJust())
+        {
+            Local<Value> value = Nan::Get(options, key).ToLocalChecked();
+            if (!value->IsBoolean())
+            {
+                return Nan::ThrowTypeError("options.csvModule must be a boolean");
+            }
+            csvModule = Nan::To<bool>(value).FromJust();
+        }
+        key = Nan::New("readers").ToLocalChecked();
+        if (Nan::Has(options, key).FromJust())
+        {
+            Local<Value> value = Nan::Get(options, key).ToLocalChecked();
+            if (!value->IsUint32())
+            {
+                return Nan::ThrowTypeError("options.readers must be a non-negative integer");
+            }
+            readers = Nan::To<uint32_t>(value).FromJust();
+        }
+        key = Nan::New("statementCache").ToLocalChecked();
+        if (Nan::Has(options, key).FromJust())
+        {
+            Local<Value> value = Nan::Get(options, key).ToLocalChecked();
+            if (!value->IsUint32())
+            {
+                return Nan::ThrowTypeError("options.statementCache must be a non-negative integer");
+            }
+            cacheSize = Nan::To<uint32_t>(value).FromJust();
+        }
+    }
+
     Local<Function> callback;
     if (info.Length() >= pos && info[pos]->IsFunction())
     {
@@ -152,21 +250,35 @@ NAN_METHOD(Database::New)
 
     Database *db = new Database();
     db->Wrap(info.This());
+    db->cacheSize = cacheSize;
+    if (workerThread)
+    {
+        db->worker = new WorkerThread(db->loop);
+    }
 
     Nan::ForceSet(info.This(), Nan::New("filename").ToLocalChecked(), info[0].As<String>(), ReadOnly);
     Nan::ForceSet(info.This(), Nan::New("mode").ToLocalChecked(), Nan::New(mode), ReadOnly);
 
     // Start opening the database.
-    OpenBaton *baton = new OpenBaton(db, callback, *filename, mode);
+    OpenBaton *baton = new OpenBaton(db, callback, *filename, mode, readers, csvModule);
     Work_BeginOpen(baton);
 
     info.GetReturnValue().Set(info.This());
 }
 
+void Database::StopWorker()
+{
+    if (worker)
+    {
+        worker->Stop();
+        worker = NULL;
+    }
+}
+
 void Database::Work_BeginOpen(Baton *baton)
 {
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request, Work_Open, (uv_after_work_cb)Work_AfterOpen);
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Open, (uv_after_work_cb)Work_AfterOpen);
     assert(status == 0);
 }
 
@@ -191,7 +303,117 @@ void Database::Work_Open(uv_work_t *req)
     {
         // Set default database handle values.
         sqlite3_busy_timeout(db->_handle, 1000);
+        // The module reads any file the process can, so SQL only gets it
+        // with { csvModule: true }.
+        if (baton->csvModule)
+        {
+            sqlite_import_register_csv(db->_handle);
+        }
+        if (db->cacheSize > 0)
+        {
+            sqlite3_set_authorizer(db->_handle, AuthorizerCallback, db);
+        }
+
+        if (baton->readers > 0 && !db->OpenReaders(baton))
+        {
+            db->CloseReaders();
+            sqlite3_close(db->_handle);
+            db->_handle = NULL;
+        }
+    }
+}
+
+// Switch the database to WAL, so that readers and the writer do not block
+// each other, and open the read-only connections.  In-memory and temporary
+// databases cannot be shared between connections, and are left without.
+bool Database::OpenReaders(OpenBaton *baton)
+{
+    const char *path = sqlite3_db_filename(_handle, "main");
+    if (path == NULL || path[0] == '\0')
+    {
+        return true;
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    bool wal = false;
+    baton->status = sqlite3_prepare_v2(_handle, "PRAGMA journal_mode = WAL", -1, &stmt, NULL);
+    if (baton->status == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *journal = (const char *)sqlite3_column_text(stmt, 0);
+        wal = journal && sqlite3_stricmp(journal, "wal") == 0;
+    }
+    baton->status = sqlite3_finalize(stmt);
+    if (baton->status != SQLITE_OK)
+    {
+        baton->message = std::string(sqlite3_errmsg(_handle));
+        return false;
+    }
+    if (!wal)
+    {
+        // A read-only database that is not already in WAL mode.
+        return true;
+    }
+
+    int mode = SQLITE_OPEN_READONLY |
+        (baton->mode & (SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_FULLMUTEX));
+    for (unsigned int i = 0; i < baton->readers; i++)
+    {
+        sqlite3 *handle = NULL;
+        baton->status = sqlite3_open_v2(path, &handle, mode, NULL);
+        if (baton->status != SQLITE_OK)
+        {
+            baton->message = std::string(sqlite3_errmsg(handle));
+            sqlite3_close(handle);
+            return false;
+        }
+        sqlite3_busy_timeout(handle, 1000);
+        // For csv tables in the schema the writer created.
+        if (baton->csvModule)
+        {
+            sqlite_import_register_csv(handle);
+        }
+        readers.push_back(new Reader(handle));
+    }
+    return true;
+}
+
+// A reader that statements are still open on cannot be closed, and is kept,
+// as they point at it.  Returns whether every reader was closed.
+bool Database::CloseReaders()
+{
+    std::vector<Reader *> busy;
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        if (sqlite3_close(readers[i]->handle) == SQLITE_OK)
+        {
+            delete readers[i];
+        }
+        else
+        {
+            busy.push_back(readers[i]);
+        }
+    }
+    readers.swap(busy);
+    return readers.empty();
+}
+
+// Called on the thread preparing a statement.  Another may pick the same
+// reader at the same time, which only makes the choice less even.
+Database::Reader *Database::AcquireReader()
+{
+    Reader *best = NULL;
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        if (best == NULL || readers[i]->statements.load() < best->statements.load())
+        {
+            best = readers[i];
+        }
+    }
+    if (best)
+    {
+        best->statements++;
     }
+    return best;
 }
 
 void Database::Work_AfterOpen(uv_work_t *req)
@@ -241,6 +463,238 @@ NAN_GETTER(Database::OpenGetter)
     info.GetReturnValue().Set(db->open);
 }
 
+// Hands out a cached statement for sql, if there is one that may be used
+// now.  Statements on a reader are left for later while the database is in
+// a transaction, as a new query would go to the database's own connection.
+bool Database::TakeCachedStatement(const std::string &sql, sqlite3_stmt **handle, Reader **reader)
+{
+    if (cachedSchema != schemaChanges.load())
+    {
+        FlushStatementCache();
+    }
+
+    std::unordered_map<std::string, StatementCache::iterator>::iterator it = cacheIndex.find(sql);
+    if (it == cacheIndex.end() || (it->second->reader && !sqlite3_get_autocommit(_handle)))
+    {
+        cacheMisses++;
+        return false;
+    }
+
+    *handle = it->second->handle;
+    *reader = it->second->reader;
+    cache.erase(it->second);
+    cacheIndex.erase(it);
+    cacheHits++;
+    return true;
+}
+
+// Takes over handle, keeping it for reuse if there is room and it was
+// prepared against the current schema, and finalizing it otherwise.
+void Database::CacheStatement(const std::string &sql, sqlite3_stmt *handle, Reader *reader,
+                              unsigned int schema)
+{
+    CachedStatement cached = {sql, handle, reader};
+    if (cachedSchema != schemaChanges.load())
+    {
+        FlushStatementCache();
+    }
+    if (!open || closing || cacheSize == 0 || schema != cachedSchema ||
+        cacheIndex.count(sql))
+    {
+        FinalizeCached(cached);
+        return;
+    }
+
+    EnterConnection(sqlite3_db_handle(handle));
+    sqlite3_reset(handle);
+    sqlite3_clear_bindings(handle);
+    LeaveConnection(sqlite3_db_handle(handle));
+    cache.push_front(cached);
+    cacheIndex[sql] = cache.begin();
+
+    if (cache.size() > cacheSize)
+    {
+        cacheIndex.erase(cache.back().sql);
+        FinalizeCached(cache.back());
+        cache.pop_back();
+    }
+}
+
+void Database::FlushStatementCache()
+{
+    for (StatementCache::iterator it = cache.begin(); it != cache.end(); it++)
+    {
+        FinalizeCached(*it);
+    }
+    cache.clear();
+    cacheIndex.clear();
+    cachedSchema = schemaChanges.load();
+}
+
+void Database::FinalizeCached(CachedStatement &cached)
+{
+    sqlite3 *connection = sqlite3_db_handle(cached.handle);
+    EnterConnection(connection);
+    sqlite3_finalize(cached.handle);
+    LeaveConnection(connection);
+    cached.handle = NULL;
+    if (cached.reader)
+    {
+        cached.reader->statements--;
+    }
+}
+
+// Note: This function is called in the thread pool, as statements are
+// prepared.  Only keeps track of statements that change the schema, so that
+// the cache can let go of the ones prepared before; it authorizes everything.
+int Database::AuthorizerCallback(void *db, int action, const char *arg1,
+                                 const char *arg2, const char *database, const char *trigger)
+{
+    switch (action)
+    {
+    case SQLITE_CREATE_INDEX:
+    case SQLITE_CREATE_TABLE:
+    case SQLITE_CREATE_TEMP_INDEX:
+    case SQLITE_CREATE_TEMP_TABLE:
+    case SQLITE_CREATE_TEMP_TRIGGER:
+    case SQLITE_CREATE_TEMP_VIEW:
+    case SQLITE_CREATE_TRIGGER:
+    case SQLITE_CREATE_VIEW:
+    case SQLITE_CREATE_VTABLE:
+    case SQLITE_DROP_INDEX:
+    case SQLITE_DROP_TABLE:
+    case SQLITE_DROP_TEMP_INDEX:
+    case SQLITE_DROP_TEMP_TABLE:
+    case SQLITE_DROP_TEMP_TRIGGER:
+    case SQLITE_DROP_TEMP_VIEW:
+    case SQLITE_DROP_TRIGGER:
+    case SQLITE_DROP_VIEW:
+    case SQLITE_DROP_VTABLE:
+    case SQLITE_ALTER_TABLE:
+    case SQLITE_ATTACH:
+    case SQLITE_DETACH:
+        static_cast<Database *>(db)->schemaChanges++;
+        break;
+    case SQLITE_DELETE:
+        // Ignoring it turns off the truncate optimization, which deletes
+        // every row of a table without the update hook seeing them.
+        if (static_cast<Database *>(db)->changes)
+        {
+            return SQLITE_IGNORE;
+        }
+        break;
+    }
+    return SQLITE_OK;
+}
+
+NAN_GETTER(Database::StatementCacheGetter)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    Local<Object> stats = Nan::New<Object>();
+    Nan::Set(stats, Nan::New("capacity").ToLocalChecked(), Nan::New<Number>(db->cacheSize));
+    Nan::Set(stats, Nan::New("size").ToLocalChecked(), Nan::New<Number>((double)db->cache.size()));
+    Nan::Set(stats, Nan::New("hits").ToLocalChecked(), Nan::New<Number>(db->cacheHits));
+    Nan::Set(stats, Nan::New("misses").ToLocalChecked(), Nan::New<Number>(db->cacheMisses));
+    info.GetReturnValue().Set(stats);
+}
+
+// The sqlite3_db_status counters Database#stats reports.  For some, the
+// value is in the high-water mark.
+static const struct
+{
+    int op;
+    const char *name;
+    bool highwater;
+} databaseStatus[] = {
+    {SQLITE_DBSTATUS_CACHE_USED, "cacheUsed", false},
+    {SQLITE_DBSTATUS_CACHE_HIT, "cacheHits", false},
+    {SQLITE_DBSTATUS_CACHE_MISS, "cacheMisses", false},
+    {SQLITE_DBSTATUS_CACHE_WRITE, "cacheWrites", false},
+#ifdef SQLITE_DBSTATUS_CACHE_SPILL
+    {SQLITE_DBSTATUS_CACHE_SPILL, "cacheSpills", false},
+#endif
+    {SQLITE_DBSTATUS_LOOKASIDE_USED, "lookasideUsed", false},
+    {SQLITE_DBSTATUS_LOOKASIDE_HIT, "lookasideHits", true},
+    {SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, "lookasideMissesSize", true},
+    {SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, "lookasideMissesFull", true},
+    {SQLITE_DBSTATUS_SCHEMA_USED, "schemaUsed", false},
+    {SQLITE_DBSTATUS_STMT_USED, "statementUsed", false},
+};
+
+NAN_METHOD(Database::Stats)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    if (info.Length() <= 0 || !info[0]->IsBoolean())
+    {
+        return Nan::ThrowTypeError("Argument 0 must be a boolean");
+    }
+    bool reset = Nan::To<bool>(info[0]).FromJust();
+    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+
+    Baton *baton = new StatusBaton(db, callback, reset);
+    db->Schedule(Work_BeginStats, baton);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+void Database::Work_BeginStats(Baton *baton)
+{
+    assert(baton->db->open);
+    baton->db->pending++;
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Stats, reinterpret_cast<uv_after_work_cb>(Work_AfterStats));
+    assert(status == 0);
+}
+
+void Database::Work_Stats(uv_work_t *req)
+{
+    StatusBaton *baton = static_cast<StatusBaton *>(req->data);
+    Database *db = baton->db;
+    const size_t count = sizeof(databaseStatus) / sizeof(databaseStatus[0]);
+
+    // Summed over the readers too.  Each call takes the connection's mutex,
+    // which is why this runs off the main thread.
+    baton->values.assign(count, 0);
+    for (size_t r = 0; r <= db->readers.size(); r++)
+    {
+        sqlite3 *handle = r == 0 ? db->_handle : db->readers[r - 1]->handle;
+        for (size_t i = 0; i < count; i++)
+        {
+            int current = 0, highwater = 0;
+            sqlite3_db_status(handle, databaseStatus[i].op, &current, &highwater, baton->reset);
+            baton->values[i] += databaseStatus[i].highwater ? highwater : current;
+        }
+    }
+}
+
+void Database::Work_AfterStats(uv_work_t *req)
+{
+    Nan::HandleScope scope;
+
+    StatusBaton *baton = static_cast<StatusBaton *>(req->data);
+    Database *db = baton->db;
+    Local<Function> cb = Nan::New(baton->callback);
+
+    if (!cb.IsEmpty() && cb->IsFunction())
+    {
+        Local<Object> stats = Nan::New<Object>();
+        for (size_t i = 0; i < baton->values.size(); i++)
+        {
+            Nan::Set(stats, Nan::New(databaseStatus[i].name).ToLocalChecked(),
+                     Nan::New<Number>(baton->values[i]));
+        }
+        Local<Value> argv[] = {Nan::Null(), stats};
+        TRY_CATCH_CALL(db->handle(), cb, 2, argv);
+    }
+
+    db->pending--;
+    db->Process();
+
+    delete baton;
+}
+
 NAN_METHOD(Database::Close)
 {
     Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
@@ -260,10 +714,11 @@ void Database::Work_BeginClose(Baton *baton)
     assert(baton->db->pending == 0);
 
     baton->db->RemoveCallbacks();
+    baton->db->FlushStatementCache();
     baton->db->closing = true;
 
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request, Work_Close, (uv_after_work_cb)Work_AfterClose);
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Close, (uv_after_work_cb)Work_AfterClose);
     assert(status == 0);
 }
 
@@ -272,6 +727,17 @@ void Database::Work_Close(uv_work_t *req)
     Baton *baton = static_cast<Baton *>(req->data);
     Database *db = baton->db;
 
+    for (size_t i = 0; i < db->readers.size(); i++)
+    {
+        if (db->readers[i]->statements.load() > 0)
+        {
+            // Leave every connection open, as sqlite3_close() does.
+            baton->status = SQLITE_BUSY;
+            baton->message = "unable to close due to unfinalized statements or unfinished backups";
+            return;
+        }
+    }
+
     baton->status = sqlite3_close(db->_handle);
 
     if (baton->status != SQLITE_OK)
@@ -281,6 +747,7 @@ void Database::Work_Close(uv_work_t *req)
     else
     {
         db->_handle = NULL;
+        db->CloseReaders();
     }
 }
 
@@ -302,6 +769,10 @@ void Database::Work_AfterClose(uv_work_t *req)
     else
     {
         db->open = false;
+        // Nothing more can be queued.
+        db->StopWorker();
+        db->ReleaseBuffers();
+        db->DeleteFunctions();
         // Leave db->locked to indicate that this db object has reached
         // the end of its life.
         argv[0] = Nan::Null();
@@ -386,6 +857,39 @@ NAN_METHOD(Database::Configure)
         Baton *baton = new Baton(db, handle);
         db->Schedule(RegisterProfileCallback, baton);
     }
+    else if (Nan::Equals(info[0], Nan::New("change").ToLocalChecked()).FromJust())
+    {
+        Local<Function> handle;
+        Baton *baton = new Baton(db, handle);
+        baton->status = Nan::To<bool>(info[1]).FromJust();
+        db->Schedule(RegisterChangeCallback, baton);
+    }
+    else if (Nan::Equals(info[0], Nan::New("profileSampling").ToLocalChecked()).FromJust())
+    {
+        double sampling = info[1]->IsNumber() ? Nan::To<double>(info[1]).FromJust() : 0;
+        if (!(sampling > 0 && sampling <= 1))
+        {
+            return Nan::ThrowTypeError("Value must be a number above 0 and at most 1");
+        }
+        db->profileSampling = sampling;
+        if (db->debug_profile)
+        {
+            db->debug_profile->Configure(db->profileSampling, db->profileThreshold);
+        }
+    }
+    else if (Nan::Equals(info[0], Nan::New("profileThreshold").ToLocalChecked()).FromJust())
+    {
+        double threshold = info[1]->IsNumber() ? Nan::To<double>(info[1]).FromJust() : -1;
+        if (!(threshold >= 0))
+        {
+            return Nan::ThrowTypeError("Value must be a non-negative number");
+        }
+        db->profileThreshold = threshold;
+        if (db->debug_profile)
+        {
+            db->debug_profile->Configure(db->profileSampling, db->profileThreshold);
+        }
+    }
     else if (Nan::Equals(info[0], Nan::New("busyTimeout").ToLocalChecked()).FromJust())
     {
         if (!info[1]->IsInt32())
@@ -426,7 +930,17 @@ NAN_METHOD(Database::Interrupt)
         return Nan::ThrowError("Database is closing");
     }
 
-    sqlite3_interrupt(db->_handle);
+    db->InterruptConnections();
+    if (db->importing)
+    {
+        // The import mostly runs between statements, where
+        // sqlite3_interrupt() cannot reach it.
+        db->importing->cancelled = true;
+        if (db->importing->stream)
+        {
+            db->importing->stream->Close();
+        }
+    }
     info.GetReturnValue().Set(info.This());
 }
 
@@ -436,7 +950,16 @@ void Database::SetBusyTimeout(Baton *baton)
     assert(baton->db->_handle);
 
     // Abuse the status field for passing the timeout.
-    sqlite3_busy_timeout(baton->db->_handle, baton->status);
+    Database *db = baton->db;
+    db->EnterConnection(db->_handle);
+    sqlite3_busy_timeout(db->_handle, baton->status);
+    db->LeaveConnection(db->_handle);
+    for (size_t i = 0; i < db->readers.size(); i++)
+    {
+        db->EnterConnection(db->readers[i]->handle);
+        sqlite3_busy_timeout(db->readers[i]->handle, baton->status);
+        db->LeaveConnection(db->readers[i]->handle);
+    }
 
     delete baton;
 }
@@ -450,25 +973,79 @@ void Database::RegisterTraceCallback(Baton *baton)
     if (db->debug_trace == NULL)
     {
         // Add it.
-        db->debug_trace = new AsyncTrace(db, TraceCallback);
-        sqlite3_trace(db->_handle, TraceCallback, db);
+        db->debug_trace = new AsyncTrace(db->loop, db, TraceCallback);
+        db->SetTraceMask();
     }
     else
     {
-        // Remove it.
-        sqlite3_trace(db->_handle, NULL, NULL);
-        db->debug_trace->finish();
+        // Remove it, once no more events can come in.
+        AsyncTrace *trace = db->debug_trace;
         db->debug_trace = NULL;
+        db->SetTraceMask();
+        trace->finish();
     }
 
     delete baton;
 }
 
-void Database::TraceCallback(void *db, const char *sql)
+void Database::SetTraceMask()
+{
+    // One callback for both, as each sqlite3_trace_v2() call replaces the
+    // last.  It waits for the connection's mutex, so no callback is still
+    // running once it returns.
+    // The change feed follows the statements of the main connection, the
+    // only one that changes rows.
+    unsigned int mask = (debug_trace ? SQLITE_TRACE_STMT : 0) |
+                        (debug_profile ? SQLITE_TRACE_PROFILE : 0);
+    unsigned int main = mask | (changes ? SQLITE_TRACE_STMT : 0);
+    EnterConnection(_handle);
+    sqlite3_trace_v2(_handle, main, main ? TraceCallback : NULL, this);
+    LeaveConnection(_handle);
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        EnterConnection(readers[i]->handle);
+        sqlite3_trace_v2(readers[i]->handle, mask, mask ? TraceCallback : NULL, this);
+        LeaveConnection(readers[i]->handle);
+    }
+}
+
+int Database::TraceCallback(unsigned int type, void *context, void *stmt, void *x)
 {
     // Note: This function is called in the thread pool.
     // Note: Some queries, such as "EXPLAIN" queries, are not sent through this.
-    static_cast<Database *>(db)->debug_trace->send(new std::string(sql));
+    Database *db = static_cast<Database *>(context);
+
+    if (type == SQLITE_TRACE_PROFILE)
+    {
+        if (db->debug_profile)
+        {
+            db->debug_profile->Record(static_cast<sqlite3_stmt *>(stmt),
+                                      *static_cast<sqlite3_int64 *>(x));
+        }
+    }
+    else if (type == SQLITE_TRACE_STMT)
+    {
+        const char *sql = static_cast<const char *>(x);
+        bool trigger = strncmp(sql, "--", 2) == 0;
+        if (db->changes && !trigger &&
+            sqlite3_db_handle(static_cast<sqlite3_stmt *>(stmt)) == db->_handle)
+        {
+            db->changes->Started(static_cast<sqlite3_stmt *>(stmt), sql);
+        }
+        // As sqlite3_trace() did: with the parameters filled in, except
+        // for the comments that mark the start of a trigger.
+        if (db->debug_trace && trigger)
+        {
+            db->debug_trace->send(new std::string(sql));
+        }
+        else if (db->debug_trace)
+        {
+            char *expanded = sqlite3_expanded_sql(static_cast<sqlite3_stmt *>(stmt));
+            db->debug_trace->send(new std::string(expanded ? expanded : sql));
+            sqlite3_free(expanded);
+        }
+    }
+    return 0;
 }
 
 void Database::TraceCallback(Database *db, std::string *sql)
@@ -492,40 +1069,34 @@ void Database::RegisterProfileCallback(Baton *baton)
     if (db->debug_profile == NULL)
     {
         // Add it.
-        db->debug_profile = new AsyncProfile(db, ProfileCallback);
-        sqlite3_profile(db->_handle, ProfileCallback, db);
+        db->debug_profile = new Profiler(db->loop, db, ProfileCallback);
+        db->debug_profile->Configure(db->profileSampling, db->profileThreshold);
+        db->SetTraceMask();
     }
     else
     {
-        // Remove it.
-        sqlite3_profile(db->_handle, NULL, NULL);
-        db->debug_profile->finish();
+        // Remove it, once no more events can come in.
+        Profiler *profiler = db->debug_profile;
         db->debug_profile = NULL;
+        db->SetTraceMask();
+        profiler->Stop();
     }
 
     delete baton;
 }
 
-void Database::ProfileCallback(void *db, const char *sql, sqlite3_uint64 nsecs)
-{
-    // Note: This function is called in the thread pool.
-    // Note: Some queries, such as "EXPLAIN" queries, are not sent through this.
-    ProfileInfo *info = new ProfileInfo();
-    info->sql = std::string(sql);
-    info->nsecs = nsecs;
-    static_cast<Database *>(db)->debug_profile->send(info);
-}
-
-void Database::ProfileCallback(Database *db, ProfileInfo *info)
+void Database::ProfileCallback(void *context, const std::string &sql, sqlite3_int64 nsecs)
 {
+    // Note: This function is called in the main V8 thread, for each of a
+    // batch of events.
+    Database *db = static_cast<Database *>(context);
     Nan::HandleScope scope;
 
     Local<Value> argv[] = {
         Nan::New("profile").ToLocalChecked(),
-        Nan::New(info->sql.c_str()).ToLocalChecked(),
-        Nan::New<Number>((double)info->nsecs / 1000000.0)};
+        Nan::New(sql).ToLocalChecked(),
+        Nan::New<Number>((double)nsecs / 1000000.0)};
     EMIT_EVENT(db->handle(), 3, argv);
-    delete info;
 }
 
 void Database::RegisterUpdateCallback(Baton *baton)
@@ -537,31 +1108,52 @@ void Database::RegisterUpdateCallback(Baton *baton)
     if (db->update_event == NULL)
     {
         // Add it.
-        db->update_event = new AsyncUpdate(db, UpdateCallback);
-        sqlite3_update_hook(db->_handle, UpdateCallback, db);
+        db->update_event = new AsyncUpdate(db->loop, db, UpdateCallback);
+        db->SetHooks();
     }
     else
     {
         // Remove it.
-        sqlite3_update_hook(db->_handle, NULL, NULL);
-        db->update_event->finish();
+        AsyncUpdate *update = db->update_event;
         db->update_event = NULL;
+        db->SetHooks();
+        update->finish();
     }
 
     delete baton;
 }
 
+void Database::SetHooks()
+{
+    // Like sqlite3_trace_v2(), these wait for the connection's mutex.  The
+    // readers are read-only, so only the main connection changes rows.
+    bool updates = update_event || changes;
+    EnterConnection(_handle);
+    sqlite3_update_hook(_handle, updates ? UpdateCallback : NULL, this);
+    sqlite3_commit_hook(_handle, changes ? CommitCallback : NULL, this);
+    sqlite3_rollback_hook(_handle, changes ? RollbackCallback : NULL, this);
+    LeaveConnection(_handle);
+}
+
 void Database::UpdateCallback(void *db, int type, const char *database,
                               const char *table, sqlite3_int64 rowid)
 {
     // Note: This function is called in the thread pool.
     // Note: Some queries, such as "EXPLAIN" queries, are not sent through this.
-    UpdateInfo *info = new UpdateInfo();
-    info->type = type;
-    info->database = std::string(database);
-    info->table = std::string(table);
-    info->rowid = rowid;
-    static_cast<Database *>(db)->update_event->send(info);
+    Database *parent = static_cast<Database *>(db);
+    if (parent->changes)
+    {
+        parent->changes->Update(type, database, table, rowid);
+    }
+    if (parent->update_event)
+    {
+        UpdateInfo *info = new UpdateInfo();
+        info->type = type;
+        info->database = std::string(database);
+        info->table = std::string(table);
+        info->rowid = rowid;
+        parent->update_event->send(info);
+    }
 }
 
 void Database::UpdateCallback(Database *db, UpdateInfo *info)
@@ -578,27 +1170,136 @@ void Database::UpdateCallback(Database *db, UpdateInfo *info)
     delete info;
 }
 
-NAN_METHOD(Database::Exec)
+void Database::RegisterChangeCallback(Baton *baton)
 {
-    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    Database *db = baton->db;
 
-    REQUIRE_ARGUMENT_STRING(0, sql);
-    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+    // Abuse the status field for passing whether to add it.
+    if (baton->status && db->changes == NULL)
+    {
+        db->changes = new ChangeFeed(db->loop, db, ChangeCallback);
+        db->SetHooks();
+        db->SetTraceMask();
+        // Cached statements were prepared with the truncate optimization.
+        db->FlushStatementCache();
+    }
+    else if (!baton->status && db->changes)
+    {
+        // A transaction still open is left out.
+        ChangeFeed *changes = db->changes;
+        db->changes = NULL;
+        db->SetHooks();
+        db->SetTraceMask();
+        changes->Stop();
+    }
 
-    Baton *baton = new ExecBaton(db, callback, *sql);
-    db->Schedule(Work_BeginExec, baton, true);
+    delete baton;
+}
 
-    info.GetReturnValue().Set(info.This());
+int Database::CommitCallback(void *db)
+{
+    // Note: This function is called in the thread pool.
+    Database *parent = static_cast<Database *>(db);
+    if (parent->changes)
+    {
+        parent->changes->Commit();
+    }
+    return 0;
 }
 
-void Database::Work_BeginExec(Baton *baton)
+void Database::RollbackCallback(void *db)
 {
-    assert(baton->db->locked);
+    // Note: This function is called in the thread pool.
+    Database *parent = static_cast<Database *>(db);
+    if (parent->changes)
+    {
+        parent->changes->Rollback();
+    }
+}
+
+uint64_t Database::ChangeMark()
+{
+    // Note: This function is called in the thread pool.
+    sqlite3_mutex *mtx = sqlite3_db_mutex(_handle);
+    sqlite3_mutex_enter(mtx);
+    uint64_t mark = changes ? changes->Starts() : 0;
+    sqlite3_mutex_leave(mtx);
+    return mark;
+}
+
+void Database::ChangeFailed(sqlite3_stmt *stmt, uint64_t before)
+{
+    // Note: This function is called in the thread pool.
+    sqlite3_mutex *mtx = sqlite3_db_mutex(_handle);
+    sqlite3_mutex_enter(mtx);
+    if (changes)
+    {
+        changes->Failed(stmt, before);
+    }
+    sqlite3_mutex_leave(mtx);
+}
+
+void Database::ChangeCallback(void *db, ChangeFeed::Transaction &changes)
+{
+    // Note: This function is called in the main V8 thread.
+    Nan::HandleScope scope;
+
+    Local<Array> result = Nan::New<Array>(changes.size());
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        ChangeFeed::Change &change = changes[i];
+
+        size_t count = change.rowids.size();
+        double *rowids = static_cast<double *>(malloc(count * sizeof(double)));
+        for (size_t j = 0; j < count; j++)
+        {
+            rowids[j] = static_cast<double>(change.rowids[j]);
+        }
+        // The Buffer takes over the memory, and the Float64Array shares it.
+        Local<Object> buffer = Nan::NewBuffer(reinterpret_cast<char *>(rowids),
+                                              count * sizeof(double))
+                                   .ToLocalChecked();
+        Local<ArrayBuffer> contents = buffer.As<Uint8Array>()->Buffer();
+
+        Local<Object> item = Nan::New<Object>();
+        Nan::Set(item, Nan::New("database").ToLocalChecked(), Nan::New(change.database).ToLocalChecked());
+        Nan::Set(item, Nan::New("table").ToLocalChecked(), Nan::New(change.table).ToLocalChecked());
+        Nan::Set(item, Nan::New("type").ToLocalChecked(),
+                 Nan::New(sqlite_authorizer_string(change.type)).ToLocalChecked());
+        Nan::Set(item, Nan::New("rowids").ToLocalChecked(), Float64Array::New(contents, 0, count));
+        Nan::Set(result, i, item);
+    }
+
+    Database *parent = static_cast<Database *>(db);
+    Local<Value> argv[] = {
+        Nan::New("change").ToLocalChecked(),
+        result};
+    EMIT_EVENT(parent->handle(), 2, argv);
+}
+
+NAN_METHOD(Database::Exec)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    REQUIRE_ARGUMENT_STRING(0, sql);
+    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+
+    Baton *baton = new ExecBaton(db, callback, *sql);
+    db->Schedule(Work_BeginExec, baton, true);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+void Database::Work_BeginExec(Baton *baton)
+{
+    assert(baton->db->locked);
     assert(baton->db->open);
     assert(baton->db->_handle);
     assert(baton->db->pending == 0);
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request, Work_Exec, (uv_after_work_cb)Work_AfterExec);
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Exec, (uv_after_work_cb)Work_AfterExec);
     assert(status == 0);
 }
 
@@ -606,6 +1307,7 @@ void Database::Work_Exec(uv_work_t *req)
 {
     ExecBaton *baton = static_cast<ExecBaton *>(req->data);
 
+    uint64_t before = baton->db->ChangeMark();
     char *message = NULL;
     baton->status = sqlite3_exec(
         baton->db->_handle,
@@ -614,6 +1316,11 @@ void Database::Work_Exec(uv_work_t *req)
         NULL,
         &message);
 
+    if (baton->status != SQLITE_OK)
+    {
+        // It stops at the statement that failed.
+        baton->db->ChangeFailed(NULL, before);
+    }
     if (baton->status != SQLITE_OK && message != NULL)
     {
         baton->message = std::string(message);
@@ -694,9 +1401,10 @@ NAN_METHOD(Database::LoadExtension)
     Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
 
     REQUIRE_ARGUMENT_STRING(0, filename);
-    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+    REQUIRE_ARGUMENT_STRING(1, entryPoint);
+    OPTIONAL_ARGUMENT_FUNCTION(2, callback);
 
-    Baton *baton = new LoadExtensionBaton(db, callback, *filename);
+    Baton *baton = new LoadExtensionBaton(db, callback, *filename, *entryPoint);
     db->Schedule(Work_BeginLoadExtension, baton, true);
 
     info.GetReturnValue().Set(info.This());
@@ -708,45 +1416,95 @@ void Database::Work_BeginLoadExtension(Baton *baton)
     assert(baton->db->open);
     assert(baton->db->_handle);
     assert(baton->db->pending == 0);
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request, Work_LoadExtension, reinterpret_cast<uv_after_work_cb>(Work_AfterLoadExtension));
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_LoadExtension, reinterpret_cast<uv_after_work_cb>(Work_AfterLoadExtension));
     assert(status == 0);
 }
 
-void Database::Work_LoadExtension(uv_work_t *req)
+NAN_METHOD(Database::DefineFunction)
 {
-    LoadExtensionBaton *baton = static_cast<LoadExtensionBaton *>(req->data);
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
 
-    sqlite3_enable_load_extension(baton->db->_handle, 1);
+    REQUIRE_ARGUMENT_STRING(0, name);
+    REQUIRE_ARGUMENT_INTEGER(1, nArg);
+    bool deterministic = Nan::To<bool>(info[2]).FromJust();
+    REQUIRE_ARGUMENT_FUNCTION(3, fn);
+    OPTIONAL_ARGUMENT_FUNCTION(4, callback);
 
-    char *message = NULL;
-    baton->status = sqlite3_load_extension(
-        baton->db->_handle,
-        baton->filename.c_str(),
-        0,
-        &message);
+    if (db->calls == NULL)
+    {
+        db->calls = new FunctionCalls(db->loop);
+    }
+    UserFunction *function = new UserFunction(db->calls, *name);
+    function->scalar.Reset(fn);
 
-    sqlite3_enable_load_extension(baton->db->_handle, 0);
+    Baton *baton = new FunctionBaton(db, callback, function, nArg, deterministic);
+    db->Schedule(CreateFunction, baton, true);
 
-    if (baton->status != SQLITE_OK && message != NULL)
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(Database::DefineAggregate)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    REQUIRE_ARGUMENT_STRING(0, name);
+    REQUIRE_ARGUMENT_INTEGER(1, nArg);
+    bool deterministic = Nan::To<bool>(info[2]).FromJust();
+    REQUIRE_ARGUMENT_FUNCTION(4, step);
+    if (!info[5]->IsUndefined() && !info[5]->IsFunction())
     {
-        baton->message = std::string(message);
-        sqlite3_free(message);
+        return Nan::ThrowTypeError("Argument 5 must be a function");
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(6, callback);
+
+    if (db->calls == NULL)
+    {
+        db->calls = new FunctionCalls(db->loop);
+    }
+    UserFunction *function = new UserFunction(db->calls, *name);
+    function->start.Reset(info[3]);
+    function->step.Reset(step);
+    if (info[5]->IsFunction())
+    {
+        function->result.Reset(info[5].As<Function>());
     }
+
+    Baton *baton = new FunctionBaton(db, callback, function, nArg, deterministic);
+    db->Schedule(CreateFunction, baton, true);
+
+    info.GetReturnValue().Set(info.This());
 }
 
-void Database::Work_AfterLoadExtension(uv_work_t *req)
+void Database::CreateFunction(Baton *b)
 {
     Nan::HandleScope scope;
 
-    LoadExtensionBaton *baton = static_cast<LoadExtensionBaton *>(req->data);
+    FunctionBaton *baton = static_cast<FunctionBaton *>(b);
     Database *db = baton->db;
-    Local<Function> cb = Nan::New(baton->callback);
-
-    if (baton->status != SQLITE_OK)
+    assert(db->locked);
+    assert(db->open);
+    assert(db->_handle);
+    assert(db->pending == 0);
+
+    UserFunction *function = baton->function;
+    baton->function = NULL;
+    db->functions.push_back(function);
+
+    // With nothing running, no connection is busy.  The readers get it too,
+    // so that queries find it wherever they run.
+    sqlite3 *handle = db->_handle;
+    int status = function->Create(handle, baton->nArg, baton->deterministic);
+    for (size_t i = 0; i < db->readers.size() && status == SQLITE_OK; i++)
     {
-        EXCEPTION(baton->message, baton->status, exception);
+        handle = db->readers[i]->handle;
+        status = function->Create(handle, baton->nArg, baton->deterministic);
+    }
 
+    Local<Function> cb = Nan::New(baton->callback);
+    if (status != SQLITE_OK)
+    {
+        EXCEPTION(std::string(sqlite3_errmsg(handle)), status, exception);
         if (!cb.IsEmpty() && cb->IsFunction())
         {
             Local<Value> argv[] = {exception};
@@ -769,130 +1527,168 @@ void Database::Work_AfterLoadExtension(uv_work_t *req)
     delete baton;
 }
 
-NAN_METHOD(Database::Import)
+void Database::DeleteFunctions()
 {
-    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
-    /* Unpack options here, because we have access to isolate via
-     * info and its non-obvious to me how to unpack a pure JS
-     * object with Nan
-     */
-    Isolate *isolate = info.GetIsolate();
-    Local<Context> context = isolate->GetCurrentContext();
-
-    REQUIRE_ARGUMENT_STRING(0, filename);
-    REQUIRE_ARGUMENT_STRING(1, tablename);
-    REQUIRE_ARGUMENT_OBJECT(2, options);
-    OPTIONAL_ARGUMENT_FUNCTION(3, callback);
+    // Only once the connections that call them are closed.
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        delete functions[i];
+    }
+    functions.clear();
+    if (calls)
+    {
+        calls->Stop();
+        calls = NULL;
+    }
+}
 
-    Local<Array> colIdsJS = Local<Array>::Cast(
-        options->Get(context, String::NewFromUtf8(isolate, "columnIds").ToLocalChecked()).ToLocalChecked());
+void Database::EnterConnection(sqlite3 *handle)
+{
+    if (calls)
+    {
+        calls->Enter(sqlite3_db_mutex(handle), collecting == 0);
+    }
+}
 
-    std::vector<std::string> colIds;
-    int colCount = colIdsJS->Length();
-    for (int i = 0; i < colCount; i++)
+void Database::LeaveConnection(sqlite3 *handle)
+{
+    if (calls)
     {
-        Nan::Utf8String nsColId(colIdsJS->Get(context, i).ToLocalChecked());
-        std::string colId(*nsColId);
-        colIds.push_back(colId);
+        sqlite3_mutex_leave(sqlite3_db_mutex(handle));
     }
+}
 
-    char delimChar = ',';
+void Database::Work_LoadExtension(uv_work_t *req)
+{
+    LoadExtensionBaton *baton = static_cast<LoadExtensionBaton *>(req->data);
+    Database *db = baton->db;
+    const char *entryPoint = baton->entryPoint.empty() ? NULL : baton->entryPoint.c_str();
 
-    if (options->Has(context, String::NewFromUtf8(isolate, "delimiter").ToLocalChecked()).FromJust())
+    // Into the readers too, so that the functions and modules it registers
+    // are there wherever a query runs.
+    for (size_t i = 0; i <= db->readers.size() && baton->status == SQLITE_OK; i++)
     {
-        Nan::Utf8String delimNanStr(options->Get(context, String::NewFromUtf8(isolate, "delimiter").ToLocalChecked()).ToLocalChecked());
-        if (delimNanStr.length() != 1)
+        sqlite3 *handle = i == 0 ? db->_handle : db->readers[i - 1]->handle;
+        sqlite3_enable_load_extension(handle, 1);
+
+        char *message = NULL;
+        baton->status = sqlite3_load_extension(
+            handle,
+            baton->filename.c_str(),
+            entryPoint,
+            &message);
+
+        sqlite3_enable_load_extension(handle, 0);
+
+        if (baton->status != SQLITE_OK && message != NULL)
         {
-            return Nan::ThrowError("options.delimeter must be a string of length 1");
+            baton->message = std::string(message);
+            sqlite3_free(message);
         }
-        delimChar = (*delimNanStr)[0];
     }
+}
 
-    bool noHeaderRow = false;
-    if (options->Has(context, String::NewFromUtf8(isolate, "noHeaderRow").ToLocalChecked()).FromJust())
+void Database::Work_AfterLoadExtension(uv_work_t *req)
+{
+    Nan::HandleScope scope;
+
+    LoadExtensionBaton *baton = static_cast<LoadExtensionBaton *>(req->data);
+    Database *db = baton->db;
+    Local<Function> cb = Nan::New(baton->callback);
+
+    if (baton->status != SQLITE_OK)
     {
-        Local<Value> noHeaderValue =
-            options->Get(context, String::NewFromUtf8(isolate, "noHeaderRow").ToLocalChecked()).ToLocalChecked();
-        noHeaderRow = noHeaderValue->BooleanValue(isolate);
+        EXCEPTION(baton->message, baton->status, exception);
+
+        if (!cb.IsEmpty() && cb->IsFunction())
+        {
+            Local<Value> argv[] = {exception};
+            TRY_CATCH_CALL(db->handle(), cb, 1, argv);
+        }
+        else
+        {
+            Local<Value> info[] = {Nan::New("error").ToLocalChecked(), exception};
+            EMIT_EVENT(db->handle(), 2, info);
+        }
+    }
+    else if (!cb.IsEmpty() && cb->IsFunction())
+    {
+        Local<Value> argv[] = {Nan::Null()};
+        TRY_CATCH_CALL(db->handle(), cb, 1, argv);
     }
 
-    ImportOptions importOptions(colIds, delimChar, noHeaderRow);
+    db->Process();
+
+    delete baton;
+}
 
-    Baton *baton = new ImportBaton(db, callback, *filename, *tablename, importOptions);
-    db->Schedule(Work_BeginImport, baton, true);
+NAN_METHOD(Database::ToBuffer)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    REQUIRE_ARGUMENT_STRING(0, schema);
+    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+
+    Baton *baton = new SerializeBaton(db, callback, *schema);
+    db->Schedule(Work_BeginToBuffer, baton, true);
 
     info.GetReturnValue().Set(info.This());
 }
 
-void Database::Work_BeginImport(Baton *baton)
+void Database::Work_BeginToBuffer(Baton *baton)
 {
     assert(baton->db->locked);
     assert(baton->db->open);
     assert(baton->db->_handle);
     assert(baton->db->pending == 0);
-    int status = uv_queue_work(uv_default_loop(),
-                               &baton->request, Work_Import, reinterpret_cast<uv_after_work_cb>(Work_AfterImport));
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_ToBuffer, reinterpret_cast<uv_after_work_cb>(Work_AfterToBuffer));
     assert(status == 0);
 }
 
-void Database::Work_Import(uv_work_t *req)
+void Database::Work_ToBuffer(uv_work_t *req)
 {
-    ImportBaton *baton = static_cast<ImportBaton *>(req->data);
-
-    ImportResult *ires = sqlite_import(baton->db->_handle,
-                                       baton->filename.c_str(),
-                                       baton->tablename.c_str(),
-                                       baton->options,
-                                       baton->message);
-    baton->result = ires;
-    if (!ires)
+    SerializeBaton *baton = static_cast<SerializeBaton *>(req->data);
+
+#ifndef HAVE_DESERIALIZE
+    baton->status = SQLITE_MISUSE;
+    baton->message = "Not supported by this build of SQLite";
+    return;
+#else
+    if (sqlite3_db_filename(baton->db->_handle, baton->schema.c_str()) == NULL)
     {
         baton->status = SQLITE_ERROR;
+        baton->message = "unknown database " + baton->schema;
+        return;
     }
-    else
-    {
-        baton->status = SQLITE_OK;
-    }
-}
 
-Local<Array> strVecToJS(std::vector<std::string> const &svec)
-{
-    Nan::EscapableHandleScope scope;
-
-    Local<Array> result(Nan::New<Array>(svec.size()));
-    std::vector<std::string>::const_iterator it = svec.begin();
-    std::vector<std::string>::const_iterator end = svec.end();
-    for (int i = 0; it < end; ++it, ++i)
+    // A copy, as a memory database's own pages can go on changing.  An
+    // empty database has no pages, and comes back as NULL.
+    baton->data = sqlite3_serialize(baton->db->_handle, baton->schema.c_str(), &baton->size, 0);
+    if (baton->data == NULL && baton->size != 0)
     {
-        Nan::Set(result, i, Nan::New(it->c_str()).ToLocalChecked());
+        baton->status = SQLITE_NOMEM;
+        baton->message = "out of memory";
     }
-
-    return scope.Escape(result);
+#endif
 }
 
-Local<Object> importResultToJS(ImportResult *ir)
+void Database::FreeSerialized(char *data, void *hint)
 {
-    Nan::EscapableHandleScope scope;
-    Local<Object> result = Nan::New<Object>();
-
-    Nan::Set(result, Nan::New("tableName").ToLocalChecked(), Nan::New(ir->tableName.c_str()).ToLocalChecked());
-    Nan::Set(result, Nan::New("columnIds").ToLocalChecked(), strVecToJS(ir->columnIds));
-    Nan::Set(result, Nan::New("columnTypes").ToLocalChecked(), strVecToJS(ir->columnTypes));
-    Nan::Set(result, Nan::New("rowCount").ToLocalChecked(), Nan::New(ir->rowCount));
-    return scope.Escape(result);
+    sqlite3_free(data);
 }
 
-void Database::Work_AfterImport(uv_work_t *req)
+void Database::Work_AfterToBuffer(uv_work_t *req)
 {
     Nan::HandleScope scope;
 
-    ImportBaton *baton = static_cast<ImportBaton *>(req->data);
+    SerializeBaton *baton = static_cast<SerializeBaton *>(req->data);
     Database *db = baton->db;
     Local<Function> cb = Nan::New(baton->callback);
 
     if (baton->status != SQLITE_OK)
     {
-        EXCEPTION(baton->message.c_str(), baton->status, exception);
+        EXCEPTION(baton->message, baton->status, exception);
 
         if (!cb.IsEmpty() && cb->IsFunction())
         {
@@ -907,8 +1703,19 @@ void Database::Work_AfterImport(uv_work_t *req)
     }
     else if (!cb.IsEmpty() && cb->IsFunction())
     {
-        Local<Object> impResJS = importResultToJS(baton->result);
-        Local<Value> argv[] = {Nan::Null(), impResJS};
+        Local<Value> buffer;
+        if (baton->data)
+        {
+            // The Buffer takes over the memory.
+            buffer = Nan::NewBuffer((char *)baton->data, baton->size,
+                                    FreeSerialized, NULL).ToLocalChecked();
+            baton->data = NULL;
+        }
+        else
+        {
+            buffer = Nan::NewBuffer(0).ToLocalChecked();
+        }
+        Local<Value> argv[] = {Nan::Null(), buffer};
         TRY_CATCH_CALL(db->handle(), cb, 2, argv);
     }
 
@@ -917,16 +1724,859 @@ void Database::Work_AfterImport(uv_work_t *req)
     delete baton;
 }
 
-void Database::RemoveCallbacks()
+NAN_METHOD(Database::LoadBuffer)
 {
-    if (debug_trace)
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    if (info.Length() <= 0 || !node::Buffer::HasInstance(info[0]))
     {
-        debug_trace->finish();
-        debug_trace = NULL;
+        return Nan::ThrowTypeError("Argument 0 must be a Buffer");
     }
-    if (debug_profile)
+    REQUIRE_ARGUMENT_OBJECT(1, options);
+    OPTIONAL_ARGUMENT_FUNCTION(2, callback);
+
+    std::string schema = "main";
+    Local<Value> value = Nan::Get(options, Nan::New("schema").ToLocalChecked()).ToLocalChecked();
+    if (value->IsString())
     {
-        debug_profile->finish();
-        debug_profile = NULL;
+        schema = *Nan::Utf8String(value);
+    }
+    else if (!value->IsUndefined())
+    {
+        return Nan::ThrowTypeError("options.schema must be a string");
+    }
+    value = Nan::Get(options, Nan::New("readonly").ToLocalChecked()).ToLocalChecked();
+    bool readonly = Nan::To<bool>(value).FromJust();
+
+    Baton *baton = new DeserializeBaton(db, callback, schema.c_str(),
+                                        info[0].As<Object>(), readonly);
+    db->Schedule(Work_BeginLoadBuffer, baton, true);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+void Database::Work_BeginLoadBuffer(Baton *baton)
+{
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_LoadBuffer, reinterpret_cast<uv_after_work_cb>(Work_AfterLoadBuffer));
+    assert(status == 0);
+}
+
+void Database::Work_LoadBuffer(uv_work_t *req)
+{
+    DeserializeBaton *baton = static_cast<DeserializeBaton *>(req->data);
+    Database *db = baton->db;
+
+#ifndef HAVE_DESERIALIZE
+    baton->status = SQLITE_MISUSE;
+    baton->message = "Not supported by this build of SQLite";
+    return;
+#else
+    if (sqlite3_db_filename(db->_handle, baton->schema.c_str()) == NULL)
+    {
+        baton->status = SQLITE_ERROR;
+        baton->message = "unknown database " + baton->schema;
+        return;
+    }
+    if (!db->readers.empty() && baton->schema == "main")
+    {
+        // The readers would go on reading the file.
+        baton->status = SQLITE_MISUSE;
+        baton->message = "Cannot load a buffer into a database with readers";
+        return;
+    }
+
+    unsigned char *data;
+    unsigned int flags;
+    if (baton->readonly)
+    {
+        // Read in place; the Buffer is kept alive until the schema is
+        // replaced or the database is closed.
+        data = (unsigned char *)baton->data;
+        flags = SQLITE_DESERIALIZE_READONLY;
+    }
+    else
+    {
+        data = (unsigned char *)sqlite3_malloc64(baton->length ? baton->length : 1);
+        if (data == NULL)
+        {
+            baton->status = SQLITE_NOMEM;
+            baton->message = "out of memory";
+            return;
+        }
+        memcpy(data, baton->data, baton->length);
+        flags = SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE;
+    }
+
+    baton->status = sqlite3_deserialize(db->_handle, baton->schema.c_str(), data,
+                                        baton->length, baton->length, flags);
+    if (baton->status != SQLITE_OK)
+    {
+        // Only taken over when it succeeds.
+        if (!baton->readonly) sqlite3_free(data);
+        baton->message = sqlite3_errcode(db->_handle) != SQLITE_OK
+            ? std::string(sqlite3_errmsg(db->_handle))
+            : std::string(sqlite3_errstr(baton->status));
+    }
+    else
+    {
+        // Statements cached for the old contents must be prepared again.
+        db->schemaChanges++;
+    }
+#endif
+}
+
+void Database::Work_AfterLoadBuffer(uv_work_t *req)
+{
+    Nan::HandleScope scope;
+
+    DeserializeBaton *baton = static_cast<DeserializeBaton *>(req->data);
+    Database *db = baton->db;
+    Local<Function> cb = Nan::New(baton->callback);
+
+    if (baton->status != SQLITE_OK)
+    {
+        EXCEPTION(baton->message, baton->status, exception);
+
+        if (!cb.IsEmpty() && cb->IsFunction())
+        {
+            Local<Value> argv[] = {exception};
+            TRY_CATCH_CALL(db->handle(), cb, 1, argv);
+        }
+        else
+        {
+            Local<Value> info[] = {Nan::New("error").ToLocalChecked(), exception};
+            EMIT_EVENT(db->handle(), 2, info);
+        }
+    }
+    else
+    {
+        // The schema's old contents, if read in place, are no longer used.
+        std::map<std::string, Nan::Persistent<Object> *>::iterator it = db->buffers.find(baton->schema);
+        if (it != db->buffers.end())
+        {
+            it->second->Reset();
+            delete it->second;
+            db->buffers.erase(it);
+        }
+        if (baton->readonly)
+        {
+            db->buffers[baton->schema] = new Nan::Persistent<Object>(Nan::New(baton->buffer));
+        }
+
+        if (!cb.IsEmpty() && cb->IsFunction())
+        {
+            Local<Value> argv[] = {Nan::Null()};
+            TRY_CATCH_CALL(db->handle(), cb, 1, argv);
+        }
+    }
+
+    db->Process();
+
+    delete baton;
+}
+
+void Database::ReleaseBuffers()
+{
+    std::map<std::string, Nan::Persistent<Object> *>::iterator it;
+    for (it = buffers.begin(); it != buffers.end(); it++)
+    {
+        it->second->Reset();
+        delete it->second;
+    }
+    buffers.clear();
+}
+
+NAN_METHOD(Database::Import)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    if (info.Length() <= 0 || !(info[0]->IsString() || node::Buffer::HasInstance(info[0])))
+    {
+        return Nan::ThrowTypeError("Argument 0 must be a string or Buffer");
+    }
+    REQUIRE_ARGUMENT_STRING(1, tablename);
+    REQUIRE_ARGUMENT_OBJECT(2, options);
+    OPTIONAL_ARGUMENT_FUNCTION(3, callback);
+
+    ImportOptions importOptions(std::vector<std::string>(), ',', false);
+    Local<Function> progress;
+    if (!ParseImportOptions(options, importOptions, progress))
+    {
+        return;
+    }
+
+    ImportBaton *baton;
+    if (info[0]->IsString())
+    {
+        Nan::Utf8String filename(info[0]);
+        baton = new ImportBaton(db, callback, *filename, *tablename, importOptions);
+    }
+    else
+    {
+        // Import straight from the Buffer, which is kept alive until done.
+        Local<Object> buffer = info[0].As<Object>();
+        baton = new ImportBaton(db, callback, "<buffer>", *tablename, importOptions);
+        baton->buffer.Reset(buffer);
+        baton->data = node::Buffer::Data(buffer);
+        baton->length = node::Buffer::Length(buffer);
+    }
+    baton->progressCallback.Reset(progress);
+    db->Schedule(Work_BeginImport, baton, true);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+// Also an import's progress interval, in nanoseconds.
+#define IMPORT_PROGRESS_INTERVAL (100 * 1000 * 1000)
+
+Database::ImportBaton::~ImportBaton()
+{
+    buffer.Reset();
+    progressCallback.Reset();
+    delete result;
+    if (stream)
+    {
+        // Whether or not the import ran, nothing more will be read.
+        stream->baton = NULL;
+        stream->Close();
+        stream->Unref();
+    }
+}
+
+void Database::ImportBaton::progress(unsigned int rowCount, sqlite3_int64 nBytes, bool done)
+{
+    if (!async)
+        return;
+    uint64_t now = uv_hrtime();
+    if (!done && now - reported < IMPORT_PROGRESS_INTERVAL)
+        return;
+    reported = now;
+
+    ImportProgress *info = new ImportProgress();
+    info->rows = rowCount;
+    info->bytes = (double)nBytes;
+    info->rowsPerSecond = now > started ? rowCount / ((now - started) / 1e9) : 0;
+    async->send(info);
+}
+
+void Database::ImportProgressCallback(ImportBaton *baton, ImportProgress *info)
+{
+    // Note: This function is called in the main V8 thread.
+    Nan::HandleScope scope;
+
+    Local<Object> progress = Nan::New<Object>();
+    Nan::Set(progress, Nan::New("rows").ToLocalChecked(), Nan::New<Number>(info->rows));
+    Nan::Set(progress, Nan::New("bytes").ToLocalChecked(), Nan::New<Number>(info->bytes));
+    Nan::Set(progress, Nan::New("rowsPerSecond").ToLocalChecked(), Nan::New<Number>(info->rowsPerSecond));
+    delete info;
+
+    if (!baton->progressCallback.IsEmpty())
+    {
+        Local<Function> cb = Nan::New(baton->progressCallback);
+        Local<Value> argv[] = {progress};
+        TRY_CATCH_CALL(baton->db->handle(), cb, 1, argv);
+    }
+    if (baton->stream)
+    {
+        Local<Value> argv[] = {Nan::New("progress").ToLocalChecked(), progress};
+        EMIT_EVENT(baton->stream->handle(), 2, argv);
+    }
+}
+
+/* Unpack the options object of Database#import into importOptions.  Returns
+ * false, with a JS exception pending, if an option is invalid.
+ */
+bool Database::ParseImportOptions(Local<Object> options, ImportOptions &importOptions,
+                                  Local<Function> &progress)
+{
+    Isolate *isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Value> colIdsValue =
+        options->Get(context, String::NewFromUtf8(isolate, "columnIds").ToLocalChecked()).ToLocalChecked();
+
+    std::vector<std::string> colIds;
+    if (colIdsValue->IsArray())
+    {
+        Local<Array> colIdsJS = Local<Array>::Cast(colIdsValue);
+        int colCount = colIdsJS->Length();
+        for (int i = 0; i < colCount; i++)
+        {
+            Nan::Utf8String nsColId(colIdsJS->Get(context, i).ToLocalChecked());
+            std::string colId(*nsColId);
+            colIds.push_back(colId);
+        }
+    }
+
+    char delimChar = ',';
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "delimiter").ToLocalChecked()).FromJust())
+    {
+        Nan::Utf8String delimNanStr(options->Get(context, String::NewFromUtf8(isolate, "delimiter").ToLocalChecked()).ToLocalChecked());
+        if (delimNanStr.length() != 1)
+        {
+            Nan::ThrowError("options.delimeter must be a string of length 1");
+            return false;
+        }
+        delimChar = (*delimNanStr)[0];
+    }
+
+    bool noHeaderRow = false;
+    if (options->Has(context, String::NewFromUtf8(isolate, "noHeaderRow").ToLocalChecked()).FromJust())
+    {
+        Local<Value> noHeaderValue =
+            options->Get(context, String::NewFromUtf8(isolate, "noHeaderRow").ToLocalChecked()).ToLocalChecked();
+        noHeaderRow = noHeaderValue->BooleanValue(isolate);
+    }
+
+    importOptions.columnIds = colIds;
+    importOptions.columnDelimiter = delimChar;
+    importOptions.noHeaderRow = noHeaderRow;
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "parallel").ToLocalChecked()).FromJust())
+    {
+        Local<Value> parallelValue =
+            options->Get(context, String::NewFromUtf8(isolate, "parallel").ToLocalChecked()).ToLocalChecked();
+        importOptions.parallel = parallelValue->BooleanValue(isolate);
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "workers").ToLocalChecked()).FromJust())
+    {
+        Local<Value> workersValue =
+            options->Get(context, String::NewFromUtf8(isolate, "workers").ToLocalChecked()).ToLocalChecked();
+        if (!workersValue->IsInt32() || Nan::To<int32_t>(workersValue).FromJust() < 0)
+        {
+            Nan::ThrowError("options.workers must be a non-negative integer");
+            return false;
+        }
+        importOptions.workers = Nan::To<int32_t>(workersValue).FromJust();
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "sampleRows").ToLocalChecked()).FromJust())
+    {
+        Local<Value> sampleRowsValue =
+            options->Get(context, String::NewFromUtf8(isolate, "sampleRows").ToLocalChecked()).ToLocalChecked();
+        if (!sampleRowsValue->IsInt32() || Nan::To<int32_t>(sampleRowsValue).FromJust() < 1)
+        {
+            Nan::ThrowError("options.sampleRows must be a positive integer");
+            return false;
+        }
+        importOptions.sampleRows = Nan::To<int32_t>(sampleRowsValue).FromJust();
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "sampleRegions").ToLocalChecked()).FromJust())
+    {
+        Local<Value> sampleRegionsValue =
+            options->Get(context, String::NewFromUtf8(isolate, "sampleRegions").ToLocalChecked()).ToLocalChecked();
+        if (!sampleRegionsValue->IsInt32() || Nan::To<int32_t>(sampleRegionsValue).FromJust() < 1)
+        {
+            Nan::ThrowError("options.sampleRegions must be a positive integer");
+            return false;
+        }
+        importOptions.sampleRegions = Nan::To<int32_t>(sampleRegionsValue).FromJust();
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "bulk").ToLocalChecked()).FromJust())
+    {
+        Local<Value> bulkValue =
+            options->Get(context, String::NewFromUtf8(isolate, "bulk").ToLocalChecked()).ToLocalChecked();
+        importOptions.bulk = bulkValue->BooleanValue(isolate);
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "commitRows").ToLocalChecked()).FromJust())
+    {
+        Local<Value> commitRowsValue =
+            options->Get(context, String::NewFromUtf8(isolate, "commitRows").ToLocalChecked()).ToLocalChecked();
+        if (!commitRowsValue->IsInt32() || Nan::To<int32_t>(commitRowsValue).FromJust() < 1)
+        {
+            Nan::ThrowError("options.commitRows must be a positive integer");
+            return false;
+        }
+        importOptions.commitRows = Nan::To<int32_t>(commitRowsValue).FromJust();
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "progress").ToLocalChecked()).FromJust())
+    {
+        Local<Value> progressValue =
+            options->Get(context, String::NewFromUtf8(isolate, "progress").ToLocalChecked()).ToLocalChecked();
+        if (!progressValue->IsFunction())
+        {
+            Nan::ThrowError("options.progress must be a function");
+            return false;
+        }
+        progress = progressValue.As<Function>();
+    }
+
+    return true;
+}
+
+void Database::Work_BeginImport(Baton *b)
+{
+    assert(b->db->locked);
+    assert(b->db->open);
+    assert(b->db->_handle);
+    assert(b->db->pending == 0);
+    ImportBaton *baton = static_cast<ImportBaton *>(b);
+    baton->db->importing = baton;
+    if (!baton->progressCallback.IsEmpty() || baton->stream)
+    {
+        baton->async = new AsyncImportProgress(b->db->loop, baton, ImportProgressCallback);
+    }
+    if (baton->stream)
+    {
+        // A streamed import waits on its writer, so it gets a thread of
+        // its own rather than holding one of the threadpool's.
+        baton->stream->Start(baton);
+        return;
+    }
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Import, reinterpret_cast<uv_after_work_cb>(Work_AfterImport));
+    assert(status == 0);
+}
+
+void Database::Work_Import(uv_work_t *req)
+{
+    ImportBaton *baton = static_cast<ImportBaton *>(req->data);
+
+    ImportResult *ires;
+    baton->started = baton->reported = uv_hrtime();
+    if (baton->stream)
+    {
+        ires = sqlite_import_source(baton->db->_handle,
+                                    baton->stream,
+                                    baton->filename.c_str(),
+                                    baton->tablename.c_str(),
+                                    baton->options,
+                                    baton->message,
+                                    baton);
+    }
+    else if (!baton->buffer.IsEmpty())
+    {
+        ires = sqlite_import_memory(baton->db->_handle,
+                                    baton->data,
+                                    baton->length,
+                                    baton->filename.c_str(),
+                                    baton->tablename.c_str(),
+                                    baton->options,
+                                    baton->message,
+                                    baton);
+    }
+    else
+    {
+        ires = sqlite_import(baton->db->_handle,
+                             baton->filename.c_str(),
+                             baton->tablename.c_str(),
+                             baton->options,
+                             baton->message,
+                             baton);
+    }
+    baton->result = ires;
+    if (!ires)
+    {
+        baton->status = baton->cancelled ? SQLITE_INTERRUPT : SQLITE_ERROR;
+    }
+    else
+    {
+        baton->status = SQLITE_OK;
+    }
+}
+
+Local<Array> strVecToJS(std::vector<std::string> const &svec)
+{
+    Nan::EscapableHandleScope scope;
+
+    Local<Array> result(Nan::New<Array>(svec.size()));
+    std::vector<std::string>::const_iterator it = svec.begin();
+    std::vector<std::string>::const_iterator end = svec.end();
+    for (int i = 0; it < end; ++it, ++i)
+    {
+        Nan::Set(result, i, Nan::New(it->c_str()).ToLocalChecked());
+    }
+
+    return scope.Escape(result);
+}
+
+Local<Object> importResultToJS(ImportResult *ir)
+{
+    Nan::EscapableHandleScope scope;
+    Local<Object> result = Nan::New<Object>();
+
+    Nan::Set(result, Nan::New("tableName").ToLocalChecked(), Nan::New(ir->tableName.c_str()).ToLocalChecked());
+    Nan::Set(result, Nan::New("columnIds").ToLocalChecked(), strVecToJS(ir->columnIds));
+    Nan::Set(result, Nan::New("columnTypes").ToLocalChecked(), strVecToJS(ir->columnTypes));
+    Nan::Set(result, Nan::New("rowCount").ToLocalChecked(), Nan::New(ir->rowCount));
+
+    Local<Object> timing = Nan::New<Object>();
+    Nan::Set(timing, Nan::New("metascan").ToLocalChecked(), Nan::New(ir->metascanMs));
+    Nan::Set(timing, Nan::New("create").ToLocalChecked(), Nan::New(ir->createMs));
+    Nan::Set(timing, Nan::New("load").ToLocalChecked(), Nan::New(ir->loadMs));
+    Nan::Set(timing, Nan::New("commit").ToLocalChecked(), Nan::New(ir->commitMs));
+    Nan::Set(result, Nan::New("timing").ToLocalChecked(), timing);
+    return scope.Escape(result);
+}
+
+void Database::Work_AfterImport(uv_work_t *req)
+{
+    Nan::HandleScope scope;
+
+    ImportBaton *baton = static_cast<ImportBaton *>(req->data);
+    Database *db = baton->db;
+    Local<Function> cb = Nan::New(baton->callback);
+
+    db->importing = NULL;
+    if (baton->async)
+    {
+        // Deliver the last progress report before the result.
+        baton->async->finish();
+        baton->async = NULL;
+    }
+
+    if (baton->status != SQLITE_OK)
+    {
+        EXCEPTION(baton->message.c_str(), baton->status, exception);
+
+        if (!cb.IsEmpty() && cb->IsFunction())
+        {
+            Local<Value> argv[] = {exception};
+            TRY_CATCH_CALL(db->handle(), cb, 1, argv);
+        }
+        else
+        {
+            Local<Value> info[] = {Nan::New("error").ToLocalChecked(), exception};
+            EMIT_EVENT(db->handle(), 2, info);
+        }
+    }
+    else if (!cb.IsEmpty() && cb->IsFunction())
+    {
+        Local<Object> impResJS = importResultToJS(baton->result);
+        Local<Value> argv[] = {Nan::Null(), impResJS};
+        TRY_CATCH_CALL(db->handle(), cb, 2, argv);
+    }
+
+    db->Process();
+
+    delete baton;
+}
+
+NAN_METHOD(Database::Export)
+{
+    Database *db = Nan::ObjectWrap::Unwrap<Database>(info.This());
+
+    REQUIRE_ARGUMENT_STRING(0, sql);
+    REQUIRE_ARGUMENT_STRING(1, filename);
+    REQUIRE_ARGUMENT_OBJECT(2, options);
+    OPTIONAL_ARGUMENT_FUNCTION(3, callback);
+
+    ExportOptions exportOptions;
+    if (!ParseExportOptions(options, exportOptions))
+    {
+        return;
+    }
+
+    ExportBaton *baton = new ExportBaton(db, callback, *sql, *filename, exportOptions);
+    db->Schedule(Work_BeginExport, baton, true);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+Database::ExportBaton::~ExportBaton()
+{
+    delete result;
+    if (stream)
+    {
+        // Whether or not the export ran, nothing more will be written.
+        stream->baton = NULL;
+        stream->Close();
+        stream->Unref();
+    }
+}
+
+/* Unpack the options object of Database#export into exportOptions, as
+ * ParseImportOptions does for the options they share.
+ */
+bool Database::ParseExportOptions(Local<Object> options, ExportOptions &exportOptions)
+{
+    Isolate *isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "delimiter").ToLocalChecked()).FromJust())
+    {
+        Nan::Utf8String delimNanStr(options->Get(context, String::NewFromUtf8(isolate, "delimiter").ToLocalChecked()).ToLocalChecked());
+        if (delimNanStr.length() != 1)
+        {
+            Nan::ThrowError("options.delimeter must be a string of length 1");
+            return false;
+        }
+        exportOptions.columnDelimiter = (*delimNanStr)[0];
+    }
+
+    if (options->Has(context, String::NewFromUtf8(isolate, "noHeaderRow").ToLocalChecked()).FromJust())
+    {
+        Local<Value> noHeaderValue =
+            options->Get(context, String::NewFromUtf8(isolate, "noHeaderRow").ToLocalChecked()).ToLocalChecked();
+        exportOptions.noHeaderRow = noHeaderValue->BooleanValue(isolate);
+    }
+
+    return true;
+}
+
+void Database::Work_BeginExport(Baton *b)
+{
+    assert(b->db->locked);
+    assert(b->db->open);
+    assert(b->db->_handle);
+    assert(b->db->pending == 0);
+    ExportBaton *baton = static_cast<ExportBaton *>(b);
+    if (baton->stream)
+    {
+        // Like a streamed import, this waits on JS, here for its reader.
+        baton->stream->Start(baton);
+        return;
+    }
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Export, reinterpret_cast<uv_after_work_cb>(Work_AfterExport));
+    assert(status == 0);
+}
+
+void Database::Work_Export(uv_work_t *req)
+{
+    ExportBaton *baton = static_cast<ExportBaton *>(req->data);
+
+    if (baton->stream)
+    {
+        baton->result = sqlite_export_sink(baton->db->_handle,
+                                           baton->sql.c_str(),
+                                           baton->stream,
+                                           baton->options,
+                                           baton->message);
+    }
+    else
+    {
+        baton->result = sqlite_export(baton->db->_handle,
+                                      baton->sql.c_str(),
+                                      baton->filename.c_str(),
+                                      baton->options,
+                                      baton->message);
+    }
+    if (!baton->result)
+    {
+        int errcode = sqlite3_errcode(baton->db->_handle);
+        baton->status = errcode == SQLITE_INTERRUPT || (baton->stream && baton->stream->IsCancelled())
+            ? SQLITE_INTERRUPT : SQLITE_ERROR;
+    }
+    else
+    {
+        baton->status = SQLITE_OK;
+    }
+}
+
+Local<Object> exportResultToJS(ExportResult *er)
+{
+    Nan::EscapableHandleScope scope;
+    Local<Object> result = Nan::New<Object>();
+
+    Nan::Set(result, Nan::New("columnIds").ToLocalChecked(), strVecToJS(er->columnIds));
+    Nan::Set(result, Nan::New("rowCount").ToLocalChecked(), Nan::New(er->rowCount));
+    Nan::Set(result, Nan::New("bytes").ToLocalChecked(), Nan::New<Number>((double)er->bytes));
+    return scope.Escape(result);
+}
+
+void Database::Work_AfterExport(uv_work_t *req)
+{
+    Nan::HandleScope scope;
+
+    ExportBaton *baton = static_cast<ExportBaton *>(req->data);
+    Database *db = baton->db;
+    Local<Function> cb = Nan::New(baton->callback);
+
+    if (baton->status != SQLITE_OK)
+    {
+        EXCEPTION(baton->message.c_str(), baton->status, exception);
+
+        if (!cb.IsEmpty() && cb->IsFunction())
+        {
+            Local<Value> argv[] = {exception};
+            TRY_CATCH_CALL(db->handle(), cb, 1, argv);
+        }
+        else
+        {
+            Local<Value> info[] = {Nan::New("error").ToLocalChecked(), exception};
+            EMIT_EVENT(db->handle(), 2, info);
+        }
+    }
+    else if (!cb.IsEmpty() && cb->IsFunction())
+    {
+        Local<Value> argv[] = {Nan::Null(), exportResultToJS(baton->result)};
+        TRY_CATCH_CALL(db->handle(), cb, 2, argv);
+    }
+
+    db->Process();
+
+    delete baton;
+}
+
+void Database::RemoveCallbacks()
+{
+    if (debug_trace)
+    {
+        debug_trace->finish();
+        debug_trace = NULL;
+    }
+    if (debug_profile)
+    {
+        debug_profile->Stop();
+        debug_profile = NULL;
+    }
+    if (changes)
+    {
+        ChangeFeed *feed = changes;
+        changes = NULL;
+        if (_handle)
+        {
+            SetHooks();
+        }
+        feed->Stop();
+    }
+}
+
+// The environment on this thread is going away, and its loop can only be
+// closed once every handle on it is.  JavaScript can no longer run, so stop
+// the work of the databases left open from waiting on it, and check on
+// every turn of the loop until that work is done, and only then close their
+// handles and report back.
+#if NODE_VERSION_AT_LEAST(14, 8, 0)
+void Database::Cleanup(void *arg, void (*done)(void *), void *doneArg)
+{
+    for (std::set<Database *>::iterator it = instances.begin(); it != instances.end(); it++)
+    {
+        (*it)->Abandon();
+    }
+    constructor_template.Reset();
+
+    Teardown *teardown = new Teardown();
+    teardown->done = done;
+    teardown->arg = doneArg;
+    teardown->handle.data = teardown;
+    uv_check_init(static_cast<uv_loop_t *>(arg), &teardown->handle);
+    uv_check_start(&teardown->handle, CleanupCheck);
+    CleanupCheck(&teardown->handle);
+}
+
+void Database::CleanupCheck(uv_check_t *handle)
+{
+    bool drained = working == 0;
+    for (std::set<Database *>::iterator it = instances.begin(); it != instances.end(); it++)
+    {
+        // Again, for statements that started after the last time.
+        (*it)->InterruptConnections();
+        drained = drained && (*it)->running.empty();
+    }
+    if (!drained)
+    {
+        return;
+    }
+
+    for (std::set<Database *>::iterator it = instances.begin(); it != instances.end(); it++)
+    {
+        (*it)->Shutdown();
+    }
+    // Its close callback runs in the same turn of the loop as those of the
+    // handles closed above, which is all Node.js waits for.
+    uv_check_stop(handle);
+    uv_close(reinterpret_cast<uv_handle_t *>(handle), TeardownClosed);
+}
+#endif
+
+// Interrupt what runs on the connections of the database, if they are open.
+void Database::InterruptConnections()
+{
+    if (!open || closing)
+    {
+        return;
+    }
+    sqlite3_interrupt(_handle);
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        sqlite3_interrupt(readers[i]->handle);
+    }
+}
+
+// Stop what the database runs on other threads from waiting on the main
+// thread, and have it finish as soon as it can, as JavaScript can no longer
+// run.  What is queued still runs, and its callbacks are not called.
+void Database::Abandon()
+{
+    abandoned = true;
+    InterruptConnections();
+    // So that statements waiting for the main thread to run one of their
+    // functions fail instead.
+    if (calls)
+    {
+        calls->Discard();
+    }
+    if (importing)
+    {
+        importing->cancelled = true;
+    }
+    for (std::set<Running *>::iterator it = running.begin(); it != running.end(); it++)
+    {
+        (*it)->Abandon();
+    }
+}
+
+// Once nothing of the database runs any more, close its handles without
+// handing back what is pending, and its connections unless statements are
+// still open on them.
+void Database::Shutdown()
+{
+    AsyncTrace *trace = debug_trace;
+    Profiler *profile = debug_profile;
+    AsyncUpdate *update = update_event;
+    ChangeFeed *feed = changes;
+    debug_trace = NULL;
+    debug_profile = NULL;
+    update_event = NULL;
+    changes = NULL;
+    if (_handle)
+    {
+        SetTraceMask();
+        SetHooks();
+    }
+    if (trace)
+    {
+        trace->abandon();
+    }
+    if (profile)
+    {
+        profile->Discard();
+    }
+    if (update)
+    {
+        update->abandon();
+    }
+    if (feed)
+    {
+        feed->Discard();
+    }
+    StopWorker();
+    if (calls)
+    {
+        calls->Stop();
+        calls = NULL;
+    }
+
+    FlushStatementCache();
+    CloseReaders();
+    if (sqlite3_close(_handle) == SQLITE_OK)
+    {
+        _handle = NULL;
+        open = false;
+        DeleteFunctions();
+        ReleaseBuffers();
     }
 }
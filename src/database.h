@@ -3,25 +3,49 @@
 #define NODE_SQLITE3_SRC_DATABASE_H
 
 
+#include <atomic>
+#include <list>
+#include <map>
 #include <string>
 #include <queue>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 #include <sqlite3.h>
 #include <nan.h>
 
 #include "async.h"
 #include "import.h"
+#include "export.h"
+#include "worker_thread.h"
+#include "profiler.h"
+#include "change_feed.h"
+#include "function.h"
 
 using namespace v8;
 
+// Statements kept for reuse by Database#run, #get and the like, unless the
+// database is opened with another { statementCache: n }.
+#define STATEMENT_CACHE_SIZE 16
+
 namespace node_sqlite3 {
 
 class Database;
+class ImportStream;
+class ExportStream;
+
+// A uv_work_t that also holds the callback to run once the work is done,
+// so that Database::QueueWork can count the work in flight.
+struct WorkRequest : uv_work_t {
+    uv_after_work_cb after;
+};
 
 
 class Database : public Nan::ObjectWrap {
 public:
-    static Nan::Persistent<FunctionTemplate> constructor_template;
+    // Of the environment on this thread: the main thread's, or a worker's.
+    static thread_local Nan::Persistent<FunctionTemplate> constructor_template;
     static NAN_MODULE_INIT(Init);
 
     static inline bool HasInstance(Local<Value> val) {
@@ -32,7 +56,7 @@ public:
     }
 
     struct Baton {
-        uv_work_t request;
+        WorkRequest request;
         Database* db;
         Nan::Persistent<Function> callback;
         int status;
@@ -53,8 +77,12 @@ public:
     struct OpenBaton : Baton {
         std::string filename;
         int mode;
-        OpenBaton(Database* db_, Local<Function> cb_, const char* filename_, int mode_) :
-            Baton(db_, cb_), filename(filename_), mode(mode_) {}
+        unsigned int readers;
+        bool csvModule;
+        OpenBaton(Database* db_, Local<Function> cb_, const char* filename_, int mode_,
+          unsigned int readers_, bool csvModule_) :
+            Baton(db_, cb_), filename(filename_), mode(mode_), readers(readers_),
+            csvModule(csvModule_) {}
     };
 
     struct ExecBaton : Baton {
@@ -65,24 +93,121 @@ public:
 
     struct LoadExtensionBaton : Baton {
         std::string filename;
-        LoadExtensionBaton(Database* db_, Local<Function> cb_, const char* filename_) :
-            Baton(db_, cb_), filename(filename_) {}
+        // Empty for the default sqlite3_extension_init, or the like.
+        std::string entryPoint;
+        LoadExtensionBaton(Database* db_, Local<Function> cb_, const char* filename_,
+                           const char* entryPoint_) :
+            Baton(db_, cb_), filename(filename_), entryPoint(entryPoint_) {}
+    };
+
+    struct FunctionBaton : Baton {
+        UserFunction* function;
+        int nArg;
+        bool deterministic;
+        FunctionBaton(Database* db_, Local<Function> cb_, UserFunction* function_,
+                      int nArg_, bool deterministic_) :
+            Baton(db_, cb_), function(function_), nArg(nArg_),
+            deterministic(deterministic_) {}
+        virtual ~FunctionBaton() {
+            // Unless the database took it.
+            delete function;
+        }
     };
 
-    struct ImportBaton : Baton {
+    struct StatusBaton : Baton {
+        bool reset;
+        // In the order of the counters in database.cc
+        std::vector<double> values;
+        StatusBaton(Database* db_, Local<Function> cb_, bool reset_) :
+            Baton(db_, cb_), reset(reset_) {}
+    };
+
+    struct SerializeBaton : Baton {
+        std::string schema;
+        unsigned char* data;
+        sqlite3_int64 size;
+        SerializeBaton(Database* db_, Local<Function> cb_, const char* schema_) :
+            Baton(db_, cb_), schema(schema_), data(NULL), size(0) {}
+        virtual ~SerializeBaton() {
+            // Still set unless handed to a Buffer.
+            sqlite3_free(data);
+        }
+    };
+
+    struct DeserializeBaton : Baton {
+        std::string schema;
+        Nan::Persistent<Object> buffer; // Keeps data alive
+        const char* data;
+        size_t length;
+        bool readonly;
+        DeserializeBaton(Database* db_, Local<Function> cb_, const char* schema_,
+          Local<Object> buffer_, bool readonly_) :
+            Baton(db_, cb_), schema(schema_), readonly(readonly_) {
+            buffer.Reset(buffer_);
+            data = node::Buffer::Data(buffer_);
+            length = node::Buffer::Length(buffer_);
+        }
+        virtual ~DeserializeBaton() {
+            buffer.Reset();
+        }
+    };
+
+    struct ImportProgress {
+        unsigned int rows;
+        double bytes;
+        double rowsPerSecond;
+    };
+
+    struct ImportBaton;
+    typedef Async<ImportProgress, ImportBaton> AsyncImportProgress;
+
+    // Also the import's monitor: Database#interrupt cancels it, and its
+    // progress reports go to options.progress and the stream, if any.
+    struct ImportBaton : Baton, ImportMonitor {
         std::string filename;
         std::string tablename;
         ImportOptions options;
         ImportResult *result;
+        // In-memory input, when importing from a Buffer.
+        Nan::Persistent<Object> buffer;
+        const char* data;
+        size_t length;
+        // Streamed input, when importing from an ImportStream.
+        ImportStream* stream;
+        // Progress reporting, when anyone is listening.
+        Nan::Persistent<Function> progressCallback;
+        AsyncImportProgress* async;
+        uint64_t started;
+        uint64_t reported;
 
         ImportBaton(Database* db_, Local<Function> cb_,
           const char* filename_, const char *tablename_, ImportOptions &options_) :
             Baton(db_, cb_), filename(filename_), tablename(tablename_),
-            options(options_), result(0) {
+            options(options_), result(0), data(NULL), length(0), stream(NULL),
+            async(NULL), started(0), reported(0) {
         }
 
-        ~ImportBaton() {
+        ~ImportBaton();
+
+        // Called on the import thread.
+        void progress(unsigned int rowCount, sqlite3_int64 nBytes, bool done);
+    };
+
+    struct ExportBaton : Baton {
+        std::string sql;
+        std::string filename;
+        ExportOptions options;
+        ExportResult *result;
+        // Streamed output, when exporting to an ExportStream.
+        ExportStream* stream;
+
+        ExportBaton(Database* db_, Local<Function> cb_,
+          const char* sql_, const char* filename_, ExportOptions &options_) :
+            Baton(db_, cb_), sql(sql_), filename(filename_),
+            options(options_), result(0), stream(NULL) {
         }
+
+        ~ExportBaton();
     };
 
     typedef void (*Work_Callback)(Baton* baton);
@@ -95,11 +220,6 @@ public:
         Baton* baton;
     };
 
-    struct ProfileInfo {
-        std::string sql;
-        sqlite3_int64 nsecs;
-    };
-
     struct UpdateInfo {
         int type;
         std::string database;
@@ -107,18 +227,50 @@ public:
         sqlite3_int64 rowid;
     };
 
+    // An extra read-only connection to a WAL database, opened with
+    // { readers: n }.  Queries are prepared on the least busy one.
+    struct Reader {
+        sqlite3* handle;
+        // Statements prepared on it and not yet finalized.
+        std::atomic<unsigned int> statements;
+        Reader(sqlite3* handle_) : handle(handle_), statements(0) {}
+    };
+
+    // A prepared statement put back by Database#run and the like, reset and
+    // with its bindings cleared, for the next call with the same SQL.
+    struct CachedStatement {
+        std::string sql;
+        sqlite3_stmt* handle;
+        Reader* reader;
+    };
+    typedef std::list<CachedStatement> StatementCache;
+
+    // Work for the database that runs on a thread, may wait on the main
+    // thread while it does, and holds a handle on the loop: an each or
+    // eachBatch call, or a streamed import or export.  It is in the
+    // database's running set from when it starts until its handle closes.
+    struct Running {
+        virtual ~Running() {}
+        // Called when JavaScript can no longer run, to stop waiting on the
+        // main thread and finish as soon as possible.
+        virtual void Abandon() = 0;
+    };
+
     bool IsOpen() { return open; }
     bool IsLocked() { return locked; }
 
     typedef Async<std::string, Database> AsyncTrace;
-    typedef Async<ProfileInfo, Database> AsyncProfile;
     typedef Async<UpdateInfo, Database> AsyncUpdate;
 
     friend class Statement;
     friend class Backup;
+    friend class Blob;
+    friend class ImportStream;
+    friend class ExportStream;
 
 protected:
     Database() : Nan::ObjectWrap(),
+        loop(Nan::GetCurrentEventLoop()),
         _handle(NULL),
         open(false),
         closing(false),
@@ -127,16 +279,62 @@ protected:
         serialize(false),
         debug_trace(NULL),
         debug_profile(NULL),
-        update_event(NULL) {
+        profileSampling(1),
+        profileThreshold(0),
+        update_event(NULL),
+        changes(NULL),
+        calls(NULL),
+        collecting(0),
+        importing(NULL),
+        abandoned(false),
+        worker(NULL),
+        cacheSize(STATEMENT_CACHE_SIZE),
+        cacheHits(0),
+        cacheMisses(0),
+        schemaChanges(0),
+        cachedSchema(0) {
+        instances.insert(this);
     }
 
     ~Database() {
+        instances.erase(this);
         RemoveCallbacks();
+        FlushStatementCache();
+        CloseReaders();
         sqlite3_close(_handle);
         _handle = NULL;
         open = false;
+        DeleteFunctions();
+        StopWorker();
+        ReleaseBuffers();
+    }
+
+    // Like uv_queue_work, on the database's own thread if it has one, or
+    // with pool, on the threadpool regardless.
+    int QueueWork(WorkRequest* req, uv_work_cb work, uv_after_work_cb after, bool pool = false) {
+        req->after = after;
+        working++;
+        if (worker && !pool) {
+            worker->Queue(req, work, WorkDone);
+            return 0;
+        }
+        return uv_queue_work(loop, req, work, WorkDone);
+    }
+    static void WorkDone(uv_work_t* req, int status) {
+        working--;
+        static_cast<WorkRequest*>(req)->after(req, status);
     }
 
+#if NODE_VERSION_AT_LEAST(14, 8, 0)
+    // Called when the environment goes away with databases still open, to
+    // close what holds its loop open.
+    static void Cleanup(void* arg, void (*done)(void*), void* doneArg);
+    static void CleanupCheck(uv_check_t* handle);
+#endif
+    void InterruptConnections();
+    void Abandon();
+    void Shutdown();
+
     static NAN_METHOD(New);
     static void Work_BeginOpen(Baton* baton);
     static void Work_Open(uv_work_t* req);
@@ -146,6 +344,24 @@ protected:
 
     void Schedule(Work_Callback callback, Baton* baton, bool exclusive = false);
     void Process();
+    void StopWorker();
+    bool OpenReaders(OpenBaton* baton);
+    bool CloseReaders();
+    Reader* AcquireReader();
+
+    bool TakeCachedStatement(const std::string& sql, sqlite3_stmt** handle, Reader** reader);
+    void CacheStatement(const std::string& sql, sqlite3_stmt* handle, Reader* reader,
+        unsigned int schema);
+    void FlushStatementCache();
+    void FinalizeCached(CachedStatement& cached);
+    static int AuthorizerCallback(void* db, int action, const char* arg1,
+        const char* arg2, const char* database, const char* trigger);
+    static NAN_GETTER(StatementCacheGetter);
+
+    static NAN_METHOD(Stats);
+    static void Work_BeginStats(Baton* baton);
+    static void Work_Stats(uv_work_t* req);
+    static void Work_AfterStats(uv_work_t* req);
 
     static NAN_METHOD(Exec);
     static void Work_BeginExec(Baton* baton);
@@ -155,6 +371,17 @@ protected:
     static NAN_METHOD(Wait);
     static void Work_Wait(Baton* baton);
 
+    static NAN_METHOD(DefineFunction);
+    static NAN_METHOD(DefineAggregate);
+    static void CreateFunction(Baton* baton);
+    void DeleteFunctions();
+
+    // Take and give back a connection's mutex on the main thread, where
+    // simply waiting for it could deadlock with a statement waiting for
+    // the main thread to run one of its functions.
+    void EnterConnection(sqlite3* handle);
+    void LeaveConnection(sqlite3* handle);
+
     static NAN_METHOD(Close);
     static void Work_BeginClose(Baton* baton);
     static void Work_Close(uv_work_t* req);
@@ -169,6 +396,27 @@ protected:
     static void Work_BeginImport(Baton* baton);
     static void Work_Import(uv_work_t* req);
     static void Work_AfterImport(uv_work_t* req);
+    static bool ParseImportOptions(Local<Object> options, ImportOptions& importOptions,
+        Local<Function>& progress);
+    static void ImportProgressCallback(ImportBaton* baton, ImportProgress* progress);
+
+    static NAN_METHOD(Export);
+    static void Work_BeginExport(Baton* baton);
+    static void Work_Export(uv_work_t* req);
+    static void Work_AfterExport(uv_work_t* req);
+    static bool ParseExportOptions(Local<Object> options, ExportOptions& exportOptions);
+
+    static NAN_METHOD(ToBuffer);
+    static void Work_BeginToBuffer(Baton* baton);
+    static void Work_ToBuffer(uv_work_t* req);
+    static void Work_AfterToBuffer(uv_work_t* req);
+    static void FreeSerialized(char* data, void* hint);
+
+    static NAN_METHOD(LoadBuffer);
+    static void Work_BeginLoadBuffer(Baton* baton);
+    static void Work_LoadBuffer(uv_work_t* req);
+    static void Work_AfterLoadBuffer(uv_work_t* req);
+    void ReleaseBuffers();
 
     static NAN_METHOD(Serialize);
     static NAN_METHOD(Parallelize);
@@ -180,20 +428,44 @@ protected:
     static void SetBusyTimeout(Baton* baton);
 
     static void RegisterTraceCallback(Baton* baton);
-    static void TraceCallback(void* db, const char* sql);
+    static int TraceCallback(unsigned int type, void* db, void* stmt, void* x);
     static void TraceCallback(Database* db, std::string* sql);
 
     static void RegisterProfileCallback(Baton* baton);
-    static void ProfileCallback(void* db, const char* sql, sqlite3_uint64 nsecs);
-    static void ProfileCallback(Database* db, ProfileInfo* info);
+    static void ProfileCallback(void* db, const std::string& sql, sqlite3_int64 nsecs);
+
+    // Set the sqlite3_trace_v2() events each connection reports, for the
+    // 'trace' and 'profile' events that have listeners.
+    void SetTraceMask();
 
     static void RegisterUpdateCallback(Baton* baton);
     static void UpdateCallback(void* db, int type, const char* database, const char* table, sqlite3_int64 rowid);
     static void UpdateCallback(Database* db, UpdateInfo* info);
 
+    static void RegisterChangeCallback(Baton* baton);
+    static int CommitCallback(void* db);
+    static void RollbackCallback(void* db);
+    // On the thread about to run statements on the main connection: what
+    // ChangeFailed takes.  Then once one of them failed, with it, or NULL
+    // for the last to start, drop the rows it changed from the feed.
+    uint64_t ChangeMark();
+    void ChangeFailed(sqlite3_stmt* stmt, uint64_t before);
+    static void ChangeCallback(void* db, ChangeFeed::Transaction& changes);
+
+    // Set the update, commit and rollback hooks of the connection, for the
+    // update events and the change feed that are in use.
+    void SetHooks();
+
     void RemoveCallbacks();
 
 protected:
+    // The environment's, which all of the database's work is handed back on.
+    uv_loop_t* loop;
+    // The databases of the environment on this thread, and the work they
+    // have queued that is not done.
+    static thread_local std::set<Database*> instances;
+    static thread_local unsigned int working;
+
     sqlite3* _handle;
 
     bool open;
@@ -206,8 +478,54 @@ protected:
     std::queue<Call*> queue;
 
     AsyncTrace* debug_trace;
-    AsyncProfile* debug_profile;
+    Profiler* debug_profile;
+    // Set with db.configure('profileSampling') and ('profileThreshold').
+    double profileSampling;
+    double profileThreshold;
     AsyncUpdate* update_event;
+    // Collects the 'change' event's transactions.
+    ChangeFeed* changes;
+
+    // Functions registered with Database#function and #aggregate, kept
+    // until the connections are closed, and what carries their calls to
+    // the main thread.
+    std::vector<UserFunction*> functions;
+    FunctionCalls* calls;
+    // Above zero while the garbage collector frees a statement, blob or
+    // backup of the database, where EnterConnection must not run calls.
+    unsigned int collecting;
+
+    // The import in progress, if any, for Database#interrupt to cancel.
+    ImportBaton* importing;
+
+    // What runs on a thread and may wait on the main thread, and whether
+    // it should stop, as the environment is going away.
+    std::set<Running*> running;
+    std::atomic<bool> abandoned;
+
+    // The thread work runs on, with { workerThread: true }, or NULL for the
+    // libuv threadpool.
+    WorkerThread* worker;
+
+    // Read-only connections for queries, with { readers: n }.  Only changed
+    // while the database opens and closes.
+    std::vector<Reader*> readers;
+
+    // The Buffers that schemas loaded with { readonly: true } are read
+    // from in place, by schema name.
+    std::map<std::string, Nan::Persistent<Object>*> buffers;
+
+    // Most recently used first, and indexed by SQL.  Only used on the main
+    // thread.
+    StatementCache cache;
+    std::unordered_map<std::string, StatementCache::iterator> cacheIndex;
+    unsigned int cacheSize;
+    double cacheHits;
+    double cacheMisses;
+    // Counts statements that change the schema, as they are prepared.  The
+    // cache is flushed whenever it moves on from cachedSchema.
+    std::atomic<unsigned int> schemaChanges;
+    unsigned int cachedSchema;
 };
 
 }
@@ -0,0 +1,294 @@
+#include "export.h"
+#include "csv_scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <sstream>
+#include <string>
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+// Bytes of CSV text gathered before each write to the sink.
+const size_t EXPORT_BUFFER_BYTES = 1024 * 1024;
+
+/*
+** Accumulates CSV text and hands it to an ExportSink in large pieces, so
+** that the sink sees a handful of writes however small the rows are.  A
+** sink that adopts() is given each full buffer, and a new one is taken.
+*/
+struct ExportWriter {
+  ExportSink *sink;
+  char *buf;                   /* EXPORT_BUFFER_BYTES from malloc(), or 0 */
+  size_t n;                    /* Bytes of buf in use */
+  sqlite3_int64 nWritten;      /* Bytes handed to the sink */
+  bool failed;                 /* The sink refused a write, or nomem */
+  bool nomem;                  /* No buffer could be had */
+  char cColSep;
+
+  ExportWriter(ExportSink *sink_, char cColSep_) :
+    sink(sink_), buf(0), n(0), nWritten(0), failed(false), nomem(false),
+    cColSep(cColSep_) {
+    alloc();
+  }
+
+  ~ExportWriter(){
+    free(buf);
+  }
+
+  /* Take an empty buffer to fill */
+  void alloc(){
+    buf = static_cast<char*>(malloc(EXPORT_BUFFER_BYTES));
+    if( buf==0 ) failed = nomem = true;
+  }
+
+  void flush(){
+    if( n>0 && !failed ){
+      nWritten += n;
+      if( sink->adopts() ){
+        char *z = buf;
+        buf = 0;
+        failed = !sink->adopt(z, n);
+        if( !failed ) alloc();
+      }else{
+        failed = !sink->write(buf, n);
+      }
+    }
+    n = 0;
+  }
+
+  /* Once failed, text is dropped, as there may be nowhere to put it */
+  void put(const char *z, size_t k){
+    if( n+k>EXPORT_BUFFER_BYTES ){
+      flush();
+      if( k>=EXPORT_BUFFER_BYTES ){
+        /* Too big to be worth buffering */
+        if( !failed ) failed = !sink->write(z, k);
+        nWritten += k;
+        return;
+      }
+    }
+    if( failed ) return;
+    memcpy(&buf[n], z, k);
+    n += k;
+  }
+
+  void putc(char c){
+    if( n==EXPORT_BUFFER_BYTES ) flush();
+    if( failed ) return;
+    buf[n++] = c;
+  }
+
+  void endRow(){
+    put("\r\n", 2);
+  }
+
+  /* Append a text field, quoted if RFC 4180 calls for it */
+  void text(const char *z, size_t k){
+    const char *zEnd = z + k;
+    if( k==0 ){
+      /* Keep "" apart from NULL, which is written as nothing at all */
+      put("\"\"", 2);
+      return;
+    }
+    if( csv_scan2(z, zEnd, '"', cColSep)==zEnd && csv_scan2(z, zEnd, '\n', '\r')==zEnd ){
+      put(z, k);
+      return;
+    }
+    putc('"');
+    while( z<zEnd ){
+      const char *zQuote = csv_scan2(z, zEnd, '"', '"');
+      if( zQuote==zEnd ){
+        put(z, zEnd - z);
+        break;
+      }
+      put(z, zQuote + 1 - z);  /* Up to and including the quote */
+      putc('"');               /* which is doubled */
+      z = zQuote + 1;
+    }
+    putc('"');
+  }
+
+  void integer(sqlite3_int64 v){
+    char zBuf[24];
+    char *z = &zBuf[sizeof(zBuf)];
+    sqlite3_uint64 u = v<0 ? (sqlite3_uint64)0 - (sqlite3_uint64)v : (sqlite3_uint64)v;
+    do{
+      *--z = (char)('0' + u%10);
+      u /= 10;
+    }while( u );
+    if( v<0 ) *--z = '-';
+    put(z, &zBuf[sizeof(zBuf)] - z);
+  }
+
+  /* Append the shortest decimal form that reads back as exactly r, with a
+  ** ".0" if it would otherwise read back as an integer */
+  void real(double r){
+    char zBuf[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars>=201611L
+    std::to_chars_result res = std::to_chars(zBuf, zBuf + sizeof(zBuf) - 2, r);
+    size_t k = res.ptr - zBuf;
+#else
+    size_t k = 0;
+    for(int nDigit=15; nDigit<=17; nDigit++){
+      k = snprintf(zBuf, sizeof(zBuf) - 2, "%.*g", nDigit, r);
+      if( strtod(zBuf, 0)==r ) break;
+    }
+#endif
+    if( csv_scan2(zBuf, zBuf + k, '.', 'e')==zBuf + k ){
+      zBuf[k++] = '.';
+      zBuf[k++] = '0';
+    }
+    put(zBuf, k);
+  }
+};
+
+/* Writes to a FILE opened by sqlite_export() */
+struct ExportFileSink : ExportSink {
+  FILE *out;
+  std::string zFile;
+
+  ExportFileSink(FILE *out_, const char *zFile_) : out(out_), zFile(zFile_) { }
+
+  bool write(const char *z, size_t n){
+    return fwrite(z, 1, n, out)==n;
+  }
+
+  std::string error(){
+    return "error writing file \"" + zFile + '"';
+  }
+};
+
+/* Prepare zSql for export_main().  Returns 0, with errMsg set, on failure. */
+static sqlite3_stmt *export_prepare(sqlite3 *db, const char *zSql, std::string &errMsg){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    errMsg = sqlite3_errmsg(db);
+    return 0;
+  }
+  if( pStmt==0 ){
+    errMsg = "no SQL statement to export";
+  }
+  return pStmt;
+}
+
+/*
+** Step pStmt and write each row to pSink as CSV, preceded by a header row
+** of column names unless options.noHeaderRow is set.  Integers, and reals
+** other than infinities, are written so that they read back exactly; text
+** as it is and blobs as their bytes.  pStmt is finalized.
+*/
+static ExportResult *export_main(
+  sqlite3 *db,
+  sqlite3_stmt *pStmt,
+  ExportSink *pSink,
+  ExportOptions &options,
+  std::string &errMsg
+) {
+  int rc = SQLITE_OK;
+  ExportWriter w(pSink, options.columnDelimiter);
+  ExportResult *pResult = new ExportResult();
+  int nCol = sqlite3_column_count(pStmt);
+  for(int i=0; i<nCol; i++){
+    const char *zName = sqlite3_column_name(pStmt, i);
+    pResult->columnIds.push_back(zName ? zName : "");
+  }
+  if( !options.noHeaderRow && nCol>0 ){
+    for(int i=0; i<nCol; i++){
+      if( i>0 ) w.putc(w.cColSep);
+      w.text(pResult->columnIds[i].data(), pResult->columnIds[i].size());
+    }
+    w.endRow();
+  }
+
+  while( !w.failed && (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+    for(int i=0; i<nCol; i++){
+      if( i>0 ) w.putc(w.cColSep);
+      switch( sqlite3_column_type(pStmt, i) ){
+        case SQLITE_NULL:
+          break;
+        case SQLITE_INTEGER:
+          w.integer(sqlite3_column_int64(pStmt, i));
+          break;
+        case SQLITE_FLOAT: {
+          double r = sqlite3_column_double(pStmt, i);
+          if( isfinite(r) ){
+            w.real(r);
+            break;
+          }
+          /* Infinities are written as SQLite's own "Inf" and "-Inf" */
+          w.text((const char*)sqlite3_column_text(pStmt, i), sqlite3_column_bytes(pStmt, i));
+          break;
+        }
+        default: {
+          const char *z = (const char*)sqlite3_column_text(pStmt, i);
+          int k = sqlite3_column_bytes(pStmt, i);
+          w.text(z ? z : "", z ? (size_t)k : 0);
+          break;
+        }
+      }
+    }
+    w.endRow();
+    pResult->rowCount++;
+  }
+  w.flush();
+
+  if( w.nomem ){
+    errMsg = "out of memory";
+  }else if( w.failed ){
+    errMsg = pSink->error();
+  }else if( rc!=SQLITE_DONE ){
+    errMsg = sqlite3_errmsg(db);
+  }
+  sqlite3_finalize(pStmt);
+  if( !errMsg.empty() ){
+    delete pResult;
+    return NULL;
+  }
+  pResult->bytes = w.nWritten;
+  return pResult;
+}
+
+ExportResult *sqlite_export(
+  sqlite3 *db,
+  const char *zSql,       // query to export
+  const char *zFile,      // CSV file to write, replacing any
+  ExportOptions &options,  // export options
+  std::string &errMsg     // set in case of error
+) {
+  /* Leave the file alone if the query is no good */
+  sqlite3_stmt *pStmt = export_prepare(db, zSql, errMsg);
+  if( pStmt==0 ) return NULL;
+  FILE *out = fopen(zFile, "wb");
+  if( out==0 ){
+    std::stringstream ssErr;
+    ssErr << "cannot open file \"" << zFile << '"';
+    errMsg = ssErr.str();
+    sqlite3_finalize(pStmt);
+    return NULL;
+  }
+  ExportFileSink sink(out, zFile);
+  ExportResult *pResult = export_main(db, pStmt, &sink, options, errMsg);
+  if( fclose(out)!=0 && pResult ){
+    errMsg = sink.error();
+    delete pResult;
+    pResult = NULL;
+  }
+  return pResult;
+}
+
+ExportResult *sqlite_export_sink(
+  sqlite3 *db,
+  const char *zSql,
+  ExportSink *pSink,
+  ExportOptions &options,
+  std::string &errMsg
+) {
+  sqlite3_stmt *pStmt = export_prepare(db, zSql, errMsg);
+  if( pStmt==0 ) return NULL;
+  return export_main(db, pStmt, pSink, options, errMsg);
+}
@@ -0,0 +1,62 @@
+#ifndef NODE_SQLITE3_SRC_EXPORT_H
+#define NODE_SQLITE3_SRC_EXPORT_H
+
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+
+struct ExportOptions {
+  char columnDelimiter;
+  bool noHeaderRow;
+
+  ExportOptions() : columnDelimiter(','), noHeaderRow(false) { }
+};
+
+struct ExportResult {
+  std::vector<std::string> columnIds;
+  unsigned int rowCount;
+  sqlite3_int64 bytes;    // CSV text written, header included
+
+  ExportResult() : rowCount(0), bytes(0) { }
+};
+
+// Where exported CSV text goes, a buffer at a time
+struct ExportSink {
+  virtual ~ExportSink() { }
+  // Take the n bytes at z.  Returns false to stop the export.  Called on
+  // the exporting thread.
+  virtual bool write(const char *z, size_t n) = 0;
+  // Take over z, n bytes from malloc() that the sink frees, in place of
+  // write().  A sink that would otherwise copy what it is given overrides
+  // this and adopts(), and buffers are then handed over without copying.
+  virtual bool adopt(char *z, size_t n) {
+    bool ok = write(z, n);
+    free(z);
+    return ok;
+  }
+  virtual bool adopts() { return false; }
+  // Why write() returned false.
+  virtual std::string error() { return "write failed"; }
+};
+
+// Write the rows of zSql to the file zFile as RFC 4180 CSV, NULL as an
+// empty field and the empty string as "".
+ExportResult *sqlite_export(
+  sqlite3 *db,
+  const char *zSql,       // query to export
+  const char *zFile,      // CSV file to write, replacing any
+  ExportOptions &options,  // export options
+  std::string &errMsg      // Set in case of error
+);
+
+// As sqlite_export, writing to pSink
+ExportResult *sqlite_export_sink(
+  sqlite3 *db,
+  const char *zSql,
+  ExportSink *pSink,
+  ExportOptions &options,
+  std::string &errMsg
+);
+
+#endif
@@ -0,0 +1,208 @@
+#include <string.h>
+#include <stdlib.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <node_version.h>
+
+#include "macros.h"
+#include "database.h"
+#include "export_stream.h"
+
+// Buffers written but not yet read before the export waits for its reader.
+#define EXPORT_STREAM_AHEAD 4
+
+using namespace node_sqlite3;
+
+NAN_MODULE_INIT(ExportStream::Init) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    t->SetClassName(Nan::New("ExportStream").ToLocalChecked());
+
+    Nan::SetPrototypeMethod(t, "read", Read);
+    Nan::SetPrototypeMethod(t, "cancel", Cancel);
+
+    Nan::Set(target, Nan::New("ExportStream").ToLocalChecked(),
+        Nan::GetFunction(t).ToLocalChecked());
+}
+
+NAN_METHOD(ExportStream::New) {
+    if (!info.IsConstructCall()) {
+        return Nan::ThrowTypeError("Use the new operator to create new ExportStream objects");
+    }
+
+    int length = info.Length();
+
+    if (length <= 0 || !Database::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("Database object expected");
+    }
+    else if (length <= 1 || !info[1]->IsString()) {
+        return Nan::ThrowTypeError("SQL query expected");
+    }
+    else if (length <= 2 || !info[2]->IsObject()) {
+        return Nan::ThrowTypeError("Options object expected");
+    }
+    else if (length > 3 && !info[3]->IsUndefined() && !info[3]->IsFunction()) {
+        return Nan::ThrowTypeError("Callback expected");
+    }
+
+    Database* db = Nan::ObjectWrap::Unwrap<Database>(info[0].As<Object>());
+    Nan::Utf8String sql(info[1]);
+
+    ExportOptions exportOptions;
+    if (!Database::ParseExportOptions(info[2].As<Object>(), exportOptions)) {
+        return;
+    }
+
+    Local<Function> callback;
+    if (length > 3 && info[3]->IsFunction()) {
+        callback = Local<Function>::Cast(info[3]);
+    }
+
+    ExportStream* stream = new ExportStream(db);
+    stream->Wrap(info.This());
+
+    // The baton holds a reference to the stream until the export is over.
+    Database::ExportBaton* baton =
+        new Database::ExportBaton(db, callback, *sql, "<stream>", exportOptions);
+    baton->stream = stream;
+    stream->baton = baton;
+    stream->Ref();
+    db->Schedule(Database::Work_BeginExport, baton, true);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(ExportStream::Read) {
+    ExportStream* stream = Nan::ObjectWrap::Unwrap<ExportStream>(info.This());
+
+    REQUIRE_ARGUMENT_FUNCTION(0, callback);
+    if (!stream->pending.IsEmpty()) {
+        return Nan::ThrowError("A read is already pending");
+    }
+
+    stream->pending.Reset(callback);
+    stream->Deliver();
+
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(ExportStream::Cancel) {
+    ExportStream* stream = Nan::ObjectWrap::Unwrap<ExportStream>(info.This());
+    stream->Abandon();
+    info.GetReturnValue().Set(info.This());
+}
+
+void ExportStream::Abandon() {
+    uv_mutex_lock(&mutex);
+    cancelled = true;
+    for (size_t i = 0; i < chunks.size(); i++) free(chunks[i].data);
+    chunks.clear();
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+}
+
+void ExportStream::Start(Database::ExportBaton* baton_) {
+    assert(baton == baton_);
+    db->running.insert(this);
+    async = new AsyncEvent(db->loop, this, EventCallback);
+    int status = uv_thread_create(&thread, Work_Export, this);
+    assert(status == 0);
+}
+
+void ExportStream::Work_Export(void* data) {
+    ExportStream* stream = static_cast<ExportStream*>(data);
+    Database::Work_Export(&stream->baton->request);
+    stream->async->send(new Event(Event::DONE));
+}
+
+void ExportStream::Close() {
+    uv_mutex_lock(&mutex);
+    finished = true;
+    uv_mutex_unlock(&mutex);
+    Deliver();
+}
+
+void ExportStream::Deliver() {
+    Nan::HandleScope scope;
+
+    if (pending.IsEmpty()) return;
+
+    Chunk chunk = { NULL, 0 };
+    bool end = false;
+    uv_mutex_lock(&mutex);
+    if (!chunks.empty()) {
+        chunk = chunks.front();
+        chunks.pop_front();
+        uv_cond_signal(&cond);
+    }
+    else {
+        end = finished || cancelled;
+    }
+    uv_mutex_unlock(&mutex);
+
+    if (!chunk.data && !end) return;
+
+    Local<Function> cb = Nan::New(pending);
+    pending.Reset();
+    Local<Value> argv[1];
+    if (chunk.data) {
+        // The Buffer takes over the memory, and frees it.
+        argv[0] = Nan::NewBuffer(chunk.data, chunk.size).ToLocalChecked();
+    }
+    else {
+        argv[0] = Nan::Null();
+    }
+    TRY_CATCH_CALL(handle(), cb, 1, argv);
+}
+
+bool ExportStream::write(const char* z, size_t n) {
+    char* data = static_cast<char*>(malloc(n));
+    if (!data) return false;
+    memcpy(data, z, n);
+    return adopt(data, n);
+}
+
+bool ExportStream::adopt(char* data, size_t n) {
+    uv_mutex_lock(&mutex);
+    while (chunks.size() >= EXPORT_STREAM_AHEAD && !cancelled) {
+        uv_cond_wait(&cond, &mutex);
+    }
+    if (cancelled) {
+        uv_mutex_unlock(&mutex);
+        free(data);
+        return false;
+    }
+    Chunk chunk = { data, n };
+    chunks.push_back(chunk);
+    uv_mutex_unlock(&mutex);
+
+    async->send(new Event(Event::DATA));
+    return true;
+}
+
+void ExportStream::EventCallback(ExportStream* stream, Event* event) {
+    // Note: This function is called in the main V8 thread.
+    Nan::HandleScope scope;
+
+    Event::Type type = event->type;
+    delete event;
+
+    if (type == Event::DATA) {
+        stream->Deliver();
+    }
+    else if (type == Event::DONE) {
+        uv_thread_join(&stream->thread);
+        AsyncEvent* async = stream->async;
+        stream->async = NULL;
+        async->finish();
+        stream->db->running.erase(stream);
+
+        // Reports the result and drops the baton, which closes the stream.
+        Database::ExportBaton* baton = stream->baton;
+        stream->baton = NULL;
+        Database::Work_AfterExport(&baton->request);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef NODE_SQLITE3_SRC_EXPORT_STREAM_H
+#define NODE_SQLITE3_SRC_EXPORT_STREAM_H
+
+#include "database.h"
+#include "export.h"
+
+#include <atomic>
+#include <string>
+#include <deque>
+
+#include <sqlite3.h>
+#include <nan.h>
+#include <uv.h>
+
+using namespace v8;
+using namespace node;
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * CSV text pulled from Database#export by JS, the counterpart of
+ * ImportStream.  lib/sqlite3.js wraps it in a Readable:
+ *
+ *   db.createExportStream('SELECT * FROM t', options, function(err, res) {
+ *       ...
+ *   }).pipe(response);
+ *
+ * The native object underneath has two methods:
+ *
+ *   - `stream.read(callback)` calls back with the next Buffer of CSV
+ *     text, or with null at the end.  The Buffers are handed over without
+ *     copying.
+ *   - `stream.cancel()` abandons the export, which reports
+ *     SQLITE_INTERRUPT.
+ *
+ * The export runs exclusively on the database on a thread of its own,
+ * and waits whenever EXPORT_STREAM_AHEAD buffers are left unread.
+ *
+ */
+class ExportStream : public Nan::ObjectWrap, public ExportSink, public Database::Running {
+public:
+    static NAN_MODULE_INIT(Init);
+    static NAN_METHOD(New);
+    static NAN_METHOD(Read);
+    static NAN_METHOD(Cancel);
+
+    struct Event {
+        enum Type { DATA, DONE };
+        Type type;
+        Event(Type type_) : type(type_) {}
+    };
+
+    struct Chunk {
+        char* data;
+        size_t size;
+    };
+
+    typedef Async<Event, ExportStream> AsyncEvent;
+
+    ExportStream(Database* db_) : Nan::ObjectWrap(),
+        db(db_),
+        baton(NULL),
+        async(NULL),
+        finished(false),
+        cancelled(false) {
+        db->Ref();
+        uv_mutex_init(&mutex);
+        uv_cond_init(&cond);
+    }
+
+    ~ExportStream() {
+        for (size_t i = 0; i < chunks.size(); i++) free(chunks[i].data);
+        pending.Reset();
+        uv_cond_destroy(&cond);
+        uv_mutex_destroy(&mutex);
+        db->Unref();
+    }
+
+    // Called on the main thread by Database::Work_BeginExport.
+    void Start(Database::ExportBaton* baton);
+    // Called once the export is over, or will never run.
+    void Close();
+    // Database::Running: cancel, as JavaScript can no longer read.
+    void Abandon();
+    bool IsCancelled() { return cancelled; }
+
+    // ExportSink, called on the export thread.  The writer's own buffers
+    // are adopted and become the Buffers read; only text too big to
+    // buffer is copied, by write().
+    bool write(const char* z, size_t n);
+    bool adopt(char* data, size_t n);
+    bool adopts() { return true; }
+    std::string error() { return "interrupted"; }
+
+protected:
+    static void Work_Export(void* data);
+    static void EventCallback(ExportStream* stream, Event* event);
+    // Hand the next chunk, or the end, to a pending read.
+    void Deliver();
+
+    Database* db;
+    Database::ExportBaton* baton;
+    AsyncEvent* async;
+    uv_thread_t thread;
+
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    std::deque<Chunk> chunks;
+    bool finished;           // No more chunks will be written
+    std::atomic<bool> cancelled;
+    Nan::Persistent<Function> pending;
+};
+
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include <vector>
+
+#include "function.h"
+
+using namespace node_sqlite3;
+
+#define SHUTDOWN_MESSAGE "Function called while the environment shuts down"
+#define COLLECTED_MESSAGE "Function called while an object on its connection is garbage collected"
+
+int UserFunction::Create(sqlite3* handle, int nArg, bool deterministic) {
+    int flags = SQLITE_UTF8 | (deterministic ? SQLITE_DETERMINISTIC : 0);
+    if (step.IsEmpty()) {
+        return sqlite3_create_function_v2(handle, name.c_str(), nArg, flags, this,
+                                          Scalar, NULL, NULL, NULL);
+    }
+    return sqlite3_create_function_v2(handle, name.c_str(), nArg, flags, this,
+                                      NULL, Step, Final, NULL);
+}
+
+void UserFunction::Scalar(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    Dispatch(context, SCALAR, argc, argv);
+}
+
+void UserFunction::Step(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    Dispatch(context, STEP, argc, argv);
+}
+
+void UserFunction::Final(sqlite3_context* context) {
+    Dispatch(context, FINAL, 0, NULL);
+}
+
+void UserFunction::Dispatch(sqlite3_context* context, Kind kind, int argc, sqlite3_value** argv) {
+    // Note: This function is called in the thread pool.
+    UserFunction* function = static_cast<UserFunction*>(sqlite3_user_data(context));
+    Call call = { function, kind, context, argc, argv, false };
+    function->calls->Run(call);
+}
+
+Local<Value> UserFunction::Start() {
+    Local<Value> value = Nan::New(start);
+    if (value->IsFunction()) {
+        return Nan::Call(value.As<Function>(), Nan::GetCurrentContext()->Global(), 0, NULL)
+            .FromMaybe(Local<Value>(Nan::Undefined()));
+    }
+    return value;
+}
+
+void UserFunction::Invoke(Call& call) {
+    // Note: This function is called in the main V8 thread, while the
+    // statement's thread waits for it.
+    Nan::HandleScope scope;
+    Nan::TryCatch trycatch;
+
+    Local<Object> global = Nan::GetCurrentContext()->Global();
+    std::vector<Local<Value> > argv;
+    Nan::MaybeLocal<Value> value;
+
+    if (call.kind == SCALAR) {
+        for (int i = 0; i < call.argc; i++) {
+            argv.push_back(ValueToJS(call.argv[i]));
+        }
+        value = Nan::Call(Nan::New(scalar), global, static_cast<int>(argv.size()), argv.data());
+    }
+    else if (call.kind == STEP) {
+        // The value so far of the group being folded, which SQLite keeps
+        // for us until Final.
+        Nan::Persistent<Value>** slot = static_cast<Nan::Persistent<Value>**>(
+            sqlite3_aggregate_context(call.context, sizeof(Nan::Persistent<Value>*)));
+        if (slot == NULL) {
+            sqlite3_result_error_nomem(call.context);
+            return;
+        }
+        if (*slot == NULL) {
+            Local<Value> first = Start();
+            if (trycatch.HasCaught()) {
+                Nan::Utf8String message(trycatch.Exception());
+                sqlite3_result_error(call.context, *message, -1);
+                return;
+            }
+            *slot = new Nan::Persistent<Value>(first);
+        }
+        argv.push_back(Nan::New(**slot));
+        for (int i = 0; i < call.argc; i++) {
+            argv.push_back(ValueToJS(call.argv[i]));
+        }
+        value = Nan::Call(Nan::New(step), global, static_cast<int>(argv.size()), argv.data());
+        if (!value.IsEmpty()) {
+            (*slot)->Reset(value.ToLocalChecked());
+            return;
+        }
+    }
+    else {
+        // With no rows, there is no value yet.
+        Nan::Persistent<Value>** slot = static_cast<Nan::Persistent<Value>**>(
+            sqlite3_aggregate_context(call.context, 0));
+        Local<Value> folded;
+        if (slot != NULL && *slot != NULL) {
+            folded = Nan::New(**slot);
+            delete *slot;
+            *slot = NULL;
+        }
+        else {
+            folded = Start();
+        }
+        if (trycatch.HasCaught()) {
+            Nan::Utf8String message(trycatch.Exception());
+            sqlite3_result_error(call.context, *message, -1);
+            return;
+        }
+        if (result.IsEmpty()) {
+            value = folded;
+        }
+        else {
+            argv.push_back(folded);
+            value = Nan::Call(Nan::New(result), global, static_cast<int>(argv.size()), argv.data());
+        }
+    }
+
+    if (trycatch.HasCaught() || value.IsEmpty()) {
+        Nan::Utf8String message(trycatch.Exception());
+        sqlite3_result_error(call.context, *message, -1);
+    }
+    else {
+        ResultFromJS(call.context, value.ToLocalChecked());
+    }
+}
+
+Local<Value> UserFunction::ValueToJS(sqlite3_value* value) {
+    switch (sqlite3_value_type(value)) {
+        case SQLITE_INTEGER: {
+            return Nan::New<Number>(sqlite3_value_int64(value));
+        }
+        case SQLITE_FLOAT: {
+            return Nan::New<Number>(sqlite3_value_double(value));
+        }
+        case SQLITE_TEXT: {
+            const char* text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+            return Nan::New<String>(text, sqlite3_value_bytes(value)).ToLocalChecked();
+        }
+        case SQLITE_BLOB: {
+            const char* blob = static_cast<const char*>(sqlite3_value_blob(value));
+            int length = sqlite3_value_bytes(value);
+            if (length == 0) {
+                return Nan::NewBuffer(0).ToLocalChecked();
+            }
+            return Nan::CopyBuffer(blob, length).ToLocalChecked();
+        }
+        default: {
+            return Nan::Null();
+        }
+    }
+}
+
+// Like Statement::AddParameter, but undefined is NULL too.
+void UserFunction::ResultFromJS(sqlite3_context* context, Local<Value> value) {
+    if (value->IsString() || value->IsRegExp()) {
+        Nan::Utf8String text(value);
+        sqlite3_result_text(context, *text, text.length(), SQLITE_TRANSIENT);
+    }
+    else if (value->IsInt32()) {
+        sqlite3_result_int(context, Nan::To<int32_t>(value).FromJust());
+    }
+    else if (value->IsNumber() || value->IsDate()) {
+        sqlite3_result_double(context, Nan::To<double>(value).FromJust());
+    }
+    else if (value->IsBoolean()) {
+        sqlite3_result_int(context, Nan::To<bool>(value).FromJust() ? 1 : 0);
+    }
+    else if (value->IsNull() || value->IsUndefined()) {
+        sqlite3_result_null(context);
+    }
+    else if (node::Buffer::HasInstance(value)) {
+        Local<Object> buffer = value.As<Object>();
+        sqlite3_result_blob(context, node::Buffer::Data(buffer), node::Buffer::Length(buffer),
+                            SQLITE_TRANSIENT);
+    }
+    else {
+        sqlite3_result_error(context, "Data type is not supported", -1);
+    }
+}
+
+FunctionCalls::FunctionCalls(uv_loop_t* loop) : discarded(false) {
+    main = uv_thread_self();
+    uv_mutex_init(&mutex);
+    uv_cond_init(&posted);
+    uv_cond_init(&finished);
+    watcher.data = this;
+    uv_async_init(loop, &watcher, Wakeup);
+}
+
+FunctionCalls::~FunctionCalls() {
+    uv_cond_destroy(&finished);
+    uv_cond_destroy(&posted);
+    uv_mutex_destroy(&mutex);
+}
+
+void FunctionCalls::Run(UserFunction::Call& call) {
+    uv_thread_t self = uv_thread_self();
+    if (uv_thread_equal(&self, &main)) {
+        call.function->Invoke(call);
+        return;
+    }
+
+    uv_mutex_lock(&mutex);
+    if (discarded) {
+        uv_mutex_unlock(&mutex);
+        sqlite3_result_error(call.context, SHUTDOWN_MESSAGE, -1);
+        return;
+    }
+    queue.push_back(&call);
+    uv_cond_signal(&posted);
+    uv_mutex_unlock(&mutex);
+    uv_async_send(&watcher);
+
+    uv_mutex_lock(&mutex);
+    while (!call.done) {
+        uv_cond_wait(&finished, &mutex);
+    }
+    uv_mutex_unlock(&mutex);
+}
+
+void FunctionCalls::Drain() {
+    std::deque<UserFunction::Call*> calls;
+    uv_mutex_lock(&mutex);
+    calls.swap(queue);
+    uv_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < calls.size(); i++) {
+        calls[i]->function->Invoke(*calls[i]);
+        uv_mutex_lock(&mutex);
+        calls[i]->done = true;
+        uv_cond_broadcast(&finished);
+        uv_mutex_unlock(&mutex);
+    }
+}
+
+void FunctionCalls::Enter(sqlite3_mutex* connection, bool run) {
+    // The thread holding the mutex does not tell us when it lets go, so
+    // look again every millisecond.
+    while (sqlite3_mutex_try(connection) != SQLITE_OK) {
+        uv_mutex_lock(&mutex);
+        if (queue.empty()) {
+            uv_cond_timedwait(&posted, &mutex, 1000000);
+        }
+        if (!run) {
+            Fail(COLLECTED_MESSAGE);
+        }
+        uv_mutex_unlock(&mutex);
+        if (run) {
+            Drain();
+        }
+    }
+}
+
+void FunctionCalls::Wakeup(uv_async_t* handle) {
+    static_cast<FunctionCalls*>(handle->data)->Drain();
+}
+
+void FunctionCalls::Stop() {
+    Drain();
+    uv_close(reinterpret_cast<uv_handle_t*>(&watcher), Closed);
+}
+
+void FunctionCalls::Discard() {
+    uv_mutex_lock(&mutex);
+    discarded = true;
+    Fail(SHUTDOWN_MESSAGE);
+    uv_mutex_unlock(&mutex);
+}
+
+void FunctionCalls::Fail(const char* message) {
+    for (size_t i = 0; i < queue.size(); i++) {
+        sqlite3_result_error(queue[i]->context, message, -1);
+        queue[i]->done = true;
+    }
+    queue.clear();
+    uv_cond_broadcast(&finished);
+}
+
+void FunctionCalls::Closed(uv_handle_t* handle) {
+    delete static_cast<FunctionCalls*>(handle->data);
+}
@@ -0,0 +1,126 @@
+#ifndef NODE_SQLITE3_SRC_FUNCTION_H
+#define NODE_SQLITE3_SRC_FUNCTION_H
+
+#include <deque>
+#include <string>
+
+#include <sqlite3.h>
+#include <nan.h>
+#include <uv.h>
+
+using namespace v8;
+
+namespace node_sqlite3 {
+
+class FunctionCalls;
+
+/**
+ *
+ * A function registered with Database#function, or with Database#aggregate
+ * when step is set.  SQLite calls it on the thread stepping the statement,
+ * which hands each call to the main thread and waits for the result.
+ *
+ */
+class UserFunction {
+public:
+    enum Kind {
+        SCALAR,
+        STEP,
+        FINAL
+    };
+
+    struct Call {
+        UserFunction* function;
+        Kind kind;
+        sqlite3_context* context;
+        int argc;
+        sqlite3_value** argv;
+        bool done;
+    };
+
+    UserFunction(FunctionCalls* calls_, const char* name_) :
+        calls(calls_), name(name_) {}
+
+    ~UserFunction() {
+        scalar.Reset();
+        start.Reset();
+        step.Reset();
+        result.Reset();
+    }
+
+    // Registers it with a connection.
+    int Create(sqlite3* handle, int nArg, bool deterministic);
+
+    // Called on the main thread.
+    void Invoke(Call& call);
+
+    Nan::Persistent<Function> scalar;
+    // Of an aggregate: the first value, or a function returning it, and the
+    // functions folding in a row and turning the value into the result.
+    Nan::Persistent<Value> start;
+    Nan::Persistent<Function> step;
+    Nan::Persistent<Function> result;
+
+protected:
+    static void Scalar(sqlite3_context* context, int argc, sqlite3_value** argv);
+    static void Step(sqlite3_context* context, int argc, sqlite3_value** argv);
+    static void Final(sqlite3_context* context);
+    static void Dispatch(sqlite3_context* context, Kind kind, int argc, sqlite3_value** argv);
+
+    Local<Value> Start();
+    static Local<Value> ValueToJS(sqlite3_value* value);
+    static void ResultFromJS(sqlite3_context* context, Local<Value> value);
+
+    FunctionCalls* calls;
+    std::string name;
+};
+
+/**
+ *
+ * Carries the calls to a Database's functions over to the main thread.
+ * While a call waits, its thread holds the connection's mutex, so the main
+ * thread must not simply wait for that mutex itself: Enter() runs the calls
+ * that come in meanwhile.
+ *
+ */
+class FunctionCalls {
+public:
+    FunctionCalls(uv_loop_t* loop);
+
+    // Called on the thread stepping a statement.  Returns once the main
+    // thread has run the call.
+    void Run(UserFunction::Call& call);
+    // Called on the main thread: takes mutex, running calls until it can,
+    // or where JavaScript must not run, failing them.
+    void Enter(sqlite3_mutex* mutex, bool run = true);
+    // Free this once the uv_async_t is closed.
+    void Stop();
+    // For when JavaScript can no longer run: fail the calls waiting and
+    // those still to come, from statements running on other threads, until
+    // it is stopped.
+    void Discard();
+
+protected:
+    ~FunctionCalls();
+
+    void Drain();
+    // With mutex held: fail the calls waiting.
+    void Fail(const char* message);
+
+    static void Wakeup(uv_async_t* handle);
+    static void Closed(uv_handle_t* handle);
+
+    uv_thread_t main;
+    uv_async_t watcher;
+
+    uv_mutex_t mutex;
+    // Signalled when a call comes in, and when one is done.
+    uv_cond_t posted;
+    uv_cond_t finished;
+    std::deque<UserFunction::Call*> queue;
+    bool discarded;
+};
+
+}
+
+#endif
@@ -1,15 +1,25 @@
 
 #include "import.h"
+#include "csv_scan.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
 #include <ctype.h>
 #include <stdarg.h>
-#include <regex>
 #include <vector>
 #include <sstream>
 #include <string>
+#include <uv.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 enum ColType { CT_NONE, CT_INT, CT_REAL, CT_TEXT };
 
@@ -17,6 +27,22 @@ enum ColType { CT_NONE, CT_INT, CT_REAL, CT_TEXT };
 // Probably conservative by an order of magnitude; tune with real corpus of CSVs.
 const int METASCAN_ROWS = 1024;
 
+// Parallel engine: the input is cut into chunks of about this many bytes,
+// and each worker may run this many chunks ahead of the inserting thread.
+#ifndef IMPORT_CHUNK_BYTES
+#define IMPORT_CHUNK_BYTES (4 * 1024 * 1024)
+#endif
+const size_t IMPORT_CHUNKS_PER_WORKER = 2;
+
+// Serial engine: bytes read from the input file per refill.
+const size_t IMPORT_READ_BYTES = 256 * 1024;
+
+// Bulk profile: rows per transaction unless options.commitRows says otherwise.
+const unsigned int IMPORT_BULK_COMMIT_ROWS = 1000000;
+
+// Rows between progress reports to an ImportMonitor.
+const unsigned int IMPORT_PROGRESS_ROWS = 10000;
+
 /* At some point it might be useful to pass back the fact that
  * metascan resulted in a column having type CT_NONE.  We'll
  * use 'text' for now though
@@ -53,11 +79,6 @@ static int strlen30(const char *z){
   return 0x3fffffff & (int)(z2 - z);
 }
 
-/*
-** True if an interrupt (Control-C) has been received.
-*/
-static volatile int seenInterrupt = 0;
-
 /*
 ** subset of ShellState we need for csv import code
 */
@@ -100,14 +121,53 @@ struct ShellState {
 #define SEP_Unit      "\x1F"
 #define SEP_Record    "\x1E"
 
+/*
+** A read-only view of an input file, memory-mapped where the platform
+** allows it.
+*/
+typedef struct ImportMap ImportMap;
+struct ImportMap {
+  const char *z;      /* First byte of the file */
+  size_t n;           /* Size of the file in bytes */
+#ifdef _WIN32
+  HANDLE hFile;       /* File handle backing the view */
+  HANDLE hMap;        /* File mapping object */
+#endif
+};
+
+/*
+** A diagnostic raised by a tokenizer worker.  Workers do not know the
+** absolute line numbers of their chunk, so messages are held back until
+** the inserting thread reaches that chunk.
+*/
+struct ImportWarning {
+  int nLine;          /* Line number relative to the start of the chunk */
+  std::string zMsg;   /* Message text, without the "file:line: " prefix */
+};
+
 /*
 ** An object used to read a CSV and other files for import.
 */
 typedef struct ImportCtx ImportCtx;
 struct ImportCtx {
   const char *zFile;  /* Name of the input file */
-  FILE *in;           /* Read the CSV text from this input stream */
-  char *z;            /* Accumulated text for a field */
+  FILE *in;           /* Read the CSV text from this input stream, or 0 */
+  ImportSource *source; /* Otherwise, read it from here, or 0 */
+  std::vector<char> *pHistory; /* Bytes read from source, kept for a rewind */
+  bool bReplay;       /* True once rewound: *pHistory is re-read first */
+  size_t iReplay;     /* Next byte of *pHistory to re-read */
+  char *zBuf;         /* Buffer that in or source is read into */
+  const char *zBlock; /* Start of the block zIn..zInEnd was filled from */
+  long iBufOffset;    /* Input offset of zBlock[0] */
+  const char *zIn;    /* Next byte of buffered or in-memory input */
+  const char *zInEnd; /* One past the last byte of buffered input */
+  const char *zMem;   /* Start of in-memory input, or 0 */
+  ImportMap map;      /* Mapped input file, if any */
+  std::vector<ImportWarning> *warnings; /* Deferred diagnostics, or 0 */
+  ImportMonitor *monitor; /* Can cancel the import, if not 0 */
+  const char *zField; /* Text of the most recent field; not NUL-terminated */
+  int nField;         /* Number of bytes in zField */
+  char *z;            /* Accumulated text for a field that needs copying */
   int n;              /* Number of bytes in z */
   int nAlloc;         /* Space allocated for z[] */
   int nLine;          /* Current line number */
@@ -115,44 +175,295 @@ struct ImportCtx {
   int cColSep;        /* The column separator character.  (Usually ",") */
   int cRowSep;        /* The row separator character.  (Usually "\n") */
   bool isNull;         /* non-zero iff null field */
+  int rc;             /* SQLITE_NOMEM once z[] could not grow, else SQLITE_OK */
 };
 
-/* Append a single byte to z[] */
-static void import_append_char(ImportCtx *p, int c){
-  if( p->n+1>=p->nAlloc ){
-    p->nAlloc += p->nAlloc + 100;
-    p->z = reinterpret_cast<char*>(sqlite3_realloc(p->z, p->nAlloc));
-    if( p->z==0 ){
-      raw_printf(stderr, "out of memory\n");
-      exit(1);
+/* Map zFile into memory.  Returns non-zero if the file cannot be read. */
+static int import_map_open(ImportMap *pMap, const char *zFile){
+  memset(pMap, 0, sizeof(*pMap));
+#ifdef _WIN32
+  LARGE_INTEGER size;
+  pMap->hFile = CreateFileA(zFile, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if( pMap->hFile==INVALID_HANDLE_VALUE ){
+    pMap->hFile = NULL;
+    return 1;
+  }
+  if( !GetFileSizeEx(pMap->hFile, &size) ){
+    CloseHandle(pMap->hFile);
+    pMap->hFile = NULL;
+    return 1;
+  }
+  pMap->n = (size_t)size.QuadPart;
+  if( pMap->n==0 ){
+    pMap->z = "";
+    return 0;
+  }
+  pMap->hMap = CreateFileMappingA(pMap->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if( pMap->hMap!=NULL ){
+    pMap->z = (const char*)MapViewOfFile(pMap->hMap, FILE_MAP_READ, 0, 0, 0);
+  }
+  if( pMap->z==0 ){
+    if( pMap->hMap ) CloseHandle(pMap->hMap);
+    CloseHandle(pMap->hFile);
+    memset(pMap, 0, sizeof(*pMap));
+    return 1;
+  }
+  return 0;
+#else
+  struct stat st;
+  int fd = open(zFile, O_RDONLY);
+  if( fd<0 ) return 1;
+  if( fstat(fd, &st)!=0 || !S_ISREG(st.st_mode) ){
+    close(fd);
+    return 1;
+  }
+  pMap->n = (size_t)st.st_size;
+  if( pMap->n==0 ){
+    close(fd);
+    pMap->z = "";
+    return 0;
+  }
+  void *pView = mmap(0, pMap->n, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( pView==MAP_FAILED ){
+    pMap->n = 0;
+    return 1;
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(pView, pMap->n, MADV_SEQUENTIAL);
+#endif
+  pMap->z = (const char*)pView;
+  return 0;
+#endif
+}
+
+static void import_map_close(ImportMap *pMap){
+  if( pMap->z==0 ) return;
+#ifdef _WIN32
+  if( pMap->hMap ){
+    UnmapViewOfFile(pMap->z);
+    CloseHandle(pMap->hMap);
+  }
+  CloseHandle(pMap->hFile);
+#else
+  if( pMap->n>0 ) munmap((void*)pMap->z, pMap->n);
+#endif
+  memset(pMap, 0, sizeof(*pMap));
+}
+
+/* Open zFile for buffered reading.  Returns non-zero on failure. */
+static int import_open_file(ImportCtx *p, const char *zFile){
+  p->in = fopen(zFile, "rb");
+  if( p->in==0 ) return 1;
+  p->zBuf = reinterpret_cast<char*>(sqlite3_malloc(IMPORT_READ_BYTES));
+  if( p->zBuf==0 ){
+    fclose(p->in);
+    p->in = 0;
+    return 1;
+  }
+  p->iBufOffset = 0;
+  p->zBlock = p->zIn = p->zInEnd = p->zBuf;
+  return 0;
+}
+
+/*
+** Read from pSource.  What is read is kept in *pHistory until the first
+** import_seek(), so that the header and metascan can be read twice from
+** input that cannot be rewound.  Returns non-zero on failure.
+*/
+static int import_open_source(ImportCtx *p, ImportSource *pSource,
+                              std::vector<char> *pHistory){
+  p->zBuf = reinterpret_cast<char*>(sqlite3_malloc(IMPORT_READ_BYTES));
+  if( p->zBuf==0 ) return 1;
+  p->source = pSource;
+  p->pHistory = pHistory;
+  p->bReplay = false;
+  p->iReplay = 0;
+  p->iBufOffset = 0;
+  p->zBlock = p->zIn = p->zInEnd = p->zBuf;
+  return 0;
+}
+
+/* True if the input is read in blocks, as opposed to being all in memory */
+static inline bool import_buffered(const ImportCtx *p){
+  return p->in!=0 || p->source!=0;
+}
+
+/* Release the input and the field buffer held by an ImportCtx */
+static void import_close(ImportCtx *p){
+  if( p->in ){
+    fclose(p->in);
+    p->in = 0;
+  }
+  sqlite3_free(p->zBuf);
+  p->zBuf = 0;
+  import_map_close(&p->map);
+  sqlite3_free(p->z);
+  p->z = 0;
+  p->n = p->nAlloc = 0;
+}
+
+/* Replace the buffered input with the next block of the file.  Returns
+** the number of bytes now available, which is 0 at end-of-file and for
+** in-memory input. */
+static size_t import_fill(ImportCtx *p){
+  size_t got;
+  if( !import_buffered(p) ) return 0;
+  p->iBufOffset += (long)(p->zInEnd - p->zBlock);
+  p->zBlock = p->zBuf;
+  if( p->in ){
+    got = fread(p->zBuf, 1, IMPORT_READ_BYTES, p->in);
+  }else if( p->pHistory && p->bReplay ){
+    /* Rewound: hand back the recorded bytes in one block, then forget them */
+    std::vector<char> &history = *p->pHistory;
+    if( p->iReplay<history.size() ){
+      p->zBlock = &history[p->iReplay];
+      got = history.size() - p->iReplay;
+      p->iReplay = history.size();
+    }else{
+      std::vector<char>().swap(history);
+      p->pHistory = 0;
+      got = p->source->read(p->zBuf, IMPORT_READ_BYTES);
     }
+  }else{
+    got = p->source->read(p->zBuf, IMPORT_READ_BYTES);
+    if( p->pHistory ) p->pHistory->insert(p->pHistory->end(), p->zBuf, p->zBuf + got);
+  }
+  p->zIn = p->zBlock;
+  p->zInEnd = p->zBlock + got;
+  return got;
+}
+
+/* Offset of the next unread byte of the input */
+static long import_tell(ImportCtx *p){
+  return p->iBufOffset + (long)(p->zIn - p->zBlock);
+}
+
+/* Number of bytes of input consumed, whatever it is read from */
+static sqlite3_int64 import_offset(ImportCtx *p){
+  if( p->zMem ) return (sqlite3_int64)(p->zIn - p->zMem);
+  return import_tell(p);
+}
+
+/* True once the import has been asked to stop */
+static bool import_cancelled(const ImportCtx *p){
+  return p->monitor && p->monitor->cancelled;
+}
+
+/*
+** Reposition a file input at iOffset, or a source at an offset it has
+** already passed while its history is kept.  Returns non-zero on failure.
+*/
+static int import_seek(ImportCtx *p, long iOffset){
+  if( p->in ){
+    if( fseek(p->in, iOffset, SEEK_SET)!=0 ) return 1;
+  }else{
+    if( p->pHistory==0 || p->bReplay || iOffset<0
+     || (size_t)iOffset>p->pHistory->size() ) return 1;
+    p->bReplay = true;
+    p->iReplay = (size_t)iOffset;
   }
+  p->iBufOffset = iOffset;
+  p->zBlock = p->zIn = p->zInEnd = p->zBuf;
+  return 0;
+}
+
+/* Read the next byte of input, or EOF */
+static inline int import_getc(ImportCtx *p){
+  if( p->zIn>=p->zInEnd && import_fill(p)==0 ) return EOF;
+  return (unsigned char)*(p->zIn++);
+}
+
+/*
+** Report a problem with the input at line nLine.  Printed on stderr
+** straight away unless the context defers its diagnostics.
+*/
+static void import_warning(ImportCtx *p, int nLine, const char *zFormat, ...){
+  char zMsg[200];
+  va_list ap;
+  va_start(ap, zFormat);
+  vsnprintf(zMsg, sizeof(zMsg), zFormat, ap);
+  va_end(ap);
+  if( p->warnings ){
+    ImportWarning w;
+    w.nLine = nLine;
+    w.zMsg = zMsg;
+    p->warnings->push_back(w);
+  }else{
+    utf8_printf(stderr, "%s:%d: %s\n", p->zFile, nLine, zMsg);
+  }
+}
+
+/*
+** Make room for n more bytes in z[].  Returns SQLITE_NOMEM, and leaves it
+** in p->rc, if that cannot be done.
+*/
+static int import_reserve(ImportCtx *p, int n){
+  if( p->n+n<p->nAlloc ) return SQLITE_OK;
+  int nAlloc = p->nAlloc + p->nAlloc + n + 100;
+  char *zNew = reinterpret_cast<char*>(sqlite3_realloc(p->z, nAlloc));
+  if( zNew==0 ){
+    p->rc = SQLITE_NOMEM;
+    return SQLITE_NOMEM;
+  }
+  p->z = zNew;
+  p->nAlloc = nAlloc;
+  return SQLITE_OK;
+}
+
+/* Append a single byte to z[] */
+static int import_append_char(ImportCtx *p, int c){
+  if( import_reserve(p, 1) ) return SQLITE_NOMEM;
   p->z[p->n++] = (char)c;
+  return SQLITE_OK;
+}
+
+/* Append n bytes to z[] */
+static int import_append_text(ImportCtx *p, const char *z, int n){
+  if( n<=0 ) return SQLITE_OK;
+  if( import_reserve(p, n) ) return SQLITE_NOMEM;
+  memcpy(p->z + p->n, z, n);
+  p->n += n;
+  return SQLITE_OK;
+}
+
+/* Leave p at end-of-input, as the field readers do when the input ends */
+static const char *csv_end_of_input(ImportCtx *p){
+  p->cTerm = EOF;
+  p->isNull = true;
+  p->zField = 0;
+  p->nField = 0;
+  return 0;
 }
 
 /* Read a single field of CSV text.  Compatible with rfc4180 and extended
 ** with the option of having a separator other than ",".
 **
-**   +  Input comes from p->in.
-**   +  Store results in p->z of length p->n.  Space to hold p->z comes
-**      from sqlite3_malloc().
+**   +  Input comes from the p->zIn..p->zInEnd buffer, refilled from p->in
+**      when reading a file.
+**   +  Store results in p->zField of length p->nField.  An unquoted field
+**      that lies within the buffer is returned in place; other fields are
+**      copied to p->z, whose space comes from sqlite3_malloc().
 **   +  Use p->cSep as the column separator.  The default is ",".
 **   +  Use p->rSep as the row separator.  The default is "\n".
 **   +  Keep track of the line number in p->nLine.
 **   +  Store the character that terminates the field in p->cTerm.  Store
-**      EOF on end-of-file.
+**      EOF on end-of-file, and also once p->z could not grow, when p->rc
+**      is left at SQLITE_NOMEM.
 **   +  Report syntax errors on stderr
+**
+** Runs of ordinary bytes are skipped with csv_scan2() rather than
+** examined one at a time.
 */
-static char *csv_read_one_field(ImportCtx *p){
+static const char *csv_read_one_field(ImportCtx *p){
   int c;
   int cSep = p->cColSep;
   int rSep = p->cRowSep;
   p->n = 0;
-  c = fgetc(p->in);
-  if( c==EOF || seenInterrupt ){
-    p->cTerm = EOF;
-    p->isNull = true;
-    return 0;
+  c = import_getc(p);
+  if( c==EOF || p->rc!=SQLITE_OK || import_cancelled(p) ){
+    return csv_end_of_input(p);
   }
   if( c=='"' ){
     int pc, ppc;
@@ -161,7 +472,18 @@ static char *csv_read_one_field(ImportCtx *p){
     pc = ppc = 0;
     p->isNull = false;
     while( 1 ){
-      c = fgetc(p->in);
+      if( pc!=cQuote ){
+        /* Nothing but a quote or a row separator needs a closer look */
+        const char *zHit = csv_scan2(p->zIn, p->zInEnd, cQuote, rSep);
+        int nRun = (int)(zHit - p->zIn);
+        if( nRun>0 ){
+          if( import_append_text(p, p->zIn, nRun) ) return csv_end_of_input(p);
+          ppc = nRun>1 ? (unsigned char)zHit[-2] : pc;
+          pc = (unsigned char)zHit[-1];
+          p->zIn = zHit;
+        }
+      }
+      c = import_getc(p);
       if( c==rSep ) p->nLine++;
       if( c==cQuote ){
         if( pc==cQuote ){
@@ -179,37 +501,113 @@ static char *csv_read_one_field(ImportCtx *p){
         break;
       }
       if( pc==cQuote && c!='\r' ){
-        utf8_printf(stderr, "%s:%d: unescaped %c character\n",
-                p->zFile, p->nLine, cQuote);
+        import_warning(p, p->nLine, "unescaped %c character", cQuote);
       }
       if( c==EOF ){
-        utf8_printf(stderr, "%s:%d: unterminated %c-quoted field\n",
-                p->zFile, startLine, cQuote);
+        import_warning(p, startLine, "unterminated %c-quoted field", cQuote);
         p->cTerm = c;
         break;
       }
-      import_append_char(p, c);
+      if( import_append_char(p, c) ) return csv_end_of_input(p);
       ppc = pc;
       pc = c;
     }
+    p->zField = p->z;
+    p->nField = p->n;
   }else{
-    while( c!=EOF && c!=cSep && c!=rSep ){
-      import_append_char(p, c);
-      c = fgetc(p->in);
+    const char *zStart = p->zIn - 1;
+    const char *zHit = zStart;
+    if( c!=cSep && c!=rSep ){
+      zHit = csv_scan2(p->zIn, p->zInEnd, cSep, rSep);
+      c = EOF;
+      while( 1 ){
+        if( zHit<p->zInEnd ){
+          c = (unsigned char)*zHit;
+          p->zIn = zHit + 1;
+          break;
+        }
+        p->zIn = zHit;
+        if( !import_buffered(p) ) break;
+        /* The field runs past the buffered input, so collect it in p->z */
+        if( import_append_text(p, zStart, (int)(zHit - zStart)) ){
+          return csv_end_of_input(p);
+        }
+        zStart = zHit = 0;
+        if( import_fill(p)==0 ) break;
+        zStart = zHit = p->zIn;
+        zHit = csv_scan2(p->zIn, p->zInEnd, cSep, rSep);
+      }
+    }
+    if( p->n>0 ){
+      if( import_append_text(p, zStart, (int)(zHit - zStart)) ){
+        return csv_end_of_input(p);
+      }
+      p->zField = p->z;
+      p->nField = p->n;
+    }else{
+      p->zField = zStart;
+      p->nField = (int)(zHit - zStart);
     }
     if( c==rSep ){
       p->nLine++;
-      if( p->n>0 && p->z[p->n-1]=='\r' ) p->n--;
+      if( p->nField>0 && p->zField[p->nField-1]=='\r' ) p->nField--;
     }
     p->cTerm = c;
-    if (p->n == 0) {
+    if (p->nField == 0) {
       p->isNull = true;
     } else {
       p->isNull = false;
     }
   }
   if( p->z ) p->z[p->n] = 0;
-  return p->z;
+  return p->zField;
+}
+
+#define IS_DIGIT(c) ((c)>='0' && (c)<='9')
+
+// Numeric forms a cell value can take; see numeric_form()
+const int NF_INT = 0x01;
+const int NF_REAL = 0x02;
+
+/*
+ * Classify the n bytes at s as the numeric forms matched by
+ *
+ *   integer:  ^[+-]?\$?[0-9,]+$
+ *   real:     ^[+-]?\$?[0-9,]*\.?[0-9]+([eE][-+]?[0-9]+)?$
+ *
+ * returning a mask of NF_INT and NF_REAL.  Done by hand in one pass since
+ * std::regex costs microseconds per cell.  Note that the integer form also
+ * accepts values such as "1," which are not reals.
+ */
+static int numeric_form(const char *s, int n) {
+  const char *z = s;
+  const char *zEnd = s + n;
+  int form = 0;
+  if (z < zEnd && (*z == '+' || *z == '-')) z++;
+  if (z < zEnd && *z == '$') z++;
+  const char *zRun = z;
+  while (z < zEnd && (IS_DIGIT(*z) || *z == ',')) z++;
+  if (z == zEnd && z > zRun) {
+    form |= NF_INT;
+  }
+  if (z < zEnd && *z == '.') {
+    const char *zFrac = ++z;
+    while (z < zEnd && IS_DIGIT(*z)) z++;
+    if (z == zFrac) return form;
+  } else if (z == zRun || !IS_DIGIT(z[-1])) {
+    return form;
+  }
+  if (z < zEnd && (*z == 'e' || *z == 'E')) {
+    z++;
+    if (z < zEnd && (*z == '+' || *z == '-')) z++;
+    const char *zExp = z;
+    while (z < zEnd && IS_DIGIT(*z)) z++;
+    if (z == zExp) return form;
+  }
+  if (z == zEnd) {
+    form |= NF_REAL;
+  }
+  return form;
 }
 
 /**
@@ -218,20 +616,21 @@ static char *csv_read_one_field(ImportCtx *p){
  * We use the order none <: int <: real <: text, and a guess will only become more general.
  * TODO: support various date formats
  */
-ColType guess_column_type(std::regex const &intRE, std::regex const &realRE, ColType cg, const char *s) {
+ColType guess_column_type(ColType cg, const char *s, int n) {
   if (cg == CT_TEXT) {
     return cg;
   }
-  if ((s==NULL) || strlen30(s)==0) {
+  if ((s==NULL) || n==0) {
     return cg;
   }
+  int form = numeric_form(s, n);
   if ((cg == CT_NONE) || (cg == CT_INT)) {
-    if (regex_match(s, intRE)) {
+    if (form & NF_INT) {
       return CT_INT;
     }
   }
   if ((cg == CT_NONE) || (cg == CT_INT) || (cg == CT_REAL)) {
-    if (regex_match(s, realRE)) {
+    if (form & NF_REAL) {
       return CT_REAL;
     }
   }
@@ -239,24 +638,26 @@ ColType guess_column_type(std::regex const &intRE, std::regex const &realRE, Col
 }
 
 /*
- * perform initial scan of file using RegEx's to determine column types.
+ * perform initial scan of file to determine column types.
  *
  * Assumes header row has already been read
  *
- * Optimistically only looks at the first METASCAN_ROWS rows to determine
- * column types
+ * Optimistically only looks at the next nRows rows to determine
+ * column types.  With partial set, ctx is positioned at an arbitrary
+ * row separator, which may lie inside a quoted field; only records with
+ * exactly nCol fields then contribute to colTypes.
  */
-int metascan(std::vector<ColType> &colTypes, ImportCtx &ctx, int nCol) {
-  std::regex intRE("^(\\+|-)?\\$?[[:digit:],]+$");
-  std::regex realRE("(^\\+|-)?\\$?[[:digit:],]*\\.?[[:digit:]]+([eE][-+]?[[:digit:]]+)?$");
-
+int metascan(std::vector<ColType> &colTypes, ImportCtx &ctx, int nCol, int nRows,
+             bool partial) {
+  std::vector<ColType> rowTypes;
   int i;
-  for (int row = 0; row < METASCAN_ROWS; row++) {
+  for (int row = 0; row < nRows; row++) {
     int startLine = ctx.nLine;
+    rowTypes = colTypes;
     for (i = 0; i < nCol; i++) {
-      char *z = csv_read_one_field(&ctx);
-      if (colTypes[i] != CT_TEXT) {
-        colTypes[i]=guess_column_type(intRE, realRE, colTypes[i], z);
+      const char *z = csv_read_one_field(&ctx);
+      if (rowTypes[i] != CT_TEXT) {
+        rowTypes[i]=guess_column_type(rowTypes[i], z, ctx.nField);
       }
       /*
       ** Did we reach end-of-file before finding any columns?
@@ -264,8 +665,9 @@ int metascan(std::vector<ColType> &colTypes, ImportCtx &ctx, int nCol) {
       */
       if( z==0 && i==0 ) break;
       if( i<nCol-1 && ctx.cTerm!=ctx.cColSep ){
-        utf8_printf(stderr, "%s:%d: metascan: expected %d columns but found %d\n",
-                        ctx.zFile, startLine, nCol, i+1);
+        if( partial ) break;
+        import_warning(&ctx, startLine, "metascan: expected %d columns but found %d",
+                       nCol, i+1);
       }
     }
     // keep reading until we hit a line separator (or EOF)
@@ -273,9 +675,12 @@ int metascan(std::vector<ColType> &colTypes, ImportCtx &ctx, int nCol) {
       do {
         csv_read_one_field(&ctx);
       } while( ctx.cTerm==ctx.cColSep );
-      utf8_printf(stderr, "%s:%d: metascan: expected %d columns but found %d - "
-                      "extras ignored\n",
-                      ctx.zFile, startLine, nCol, i);
+      if( partial ) continue;
+      import_warning(&ctx, startLine, "metascan: expected %d columns but found %d - "
+                     "extras ignored", nCol, i);
+    }
+    if( !partial || i==nCol ){
+      colTypes.swap(rowTypes);
     }
     if (ctx.cTerm==EOF)
       break;
@@ -283,15 +688,609 @@ int metascan(std::vector<ColType> &colTypes, ImportCtx &ctx, int nCol) {
   return 0;
 }
 
+/*
+ * Continue the metascan at nRegions-1 evenly spaced points past the start
+ * of the data, so that a column whose values change form further into a
+ * large file is still typed correctly.  Each point is moved to the start
+ * of the next line before scanning.  Leaves ctx at an arbitrary position;
+ * the caller rewinds it.
+ */
+int metascan_regions(std::vector<ColType> &colTypes, ImportCtx &ctx, int nCol, int nRows,
+                     int nRegions, long iStart) {
+  long iEnd;
+  if( ctx.in ){
+    if( fseek(ctx.in, 0, SEEK_END)!=0 ) return 1;
+    iEnd = ftell(ctx.in);
+    if( iEnd<0 ) return 1;
+  }else{
+    iEnd = (long)(ctx.zInEnd - ctx.zMem);
+  }
+  for (int r = 1; r < nRegions; r++) {
+    long iOffset = iStart + (long)((double)(iEnd - iStart) * r / nRegions);
+    long iPos = ctx.in ? import_tell(&ctx) : (long)(ctx.zIn - ctx.zMem);
+    if( iOffset<=iPos ) continue;    /* Already covered by the previous scan */
+    if( ctx.in ){
+      if( import_seek(&ctx, iOffset)!=0 ) return 1;
+    }else{
+      ctx.zIn = ctx.zMem + iOffset;
+    }
+    int c;
+    do{
+      c = import_getc(&ctx);
+    }while( c!=EOF && c!=ctx.cRowSep );
+    if( c==EOF ) break;
+    metascan(colTypes, ctx, nCol, nRows, true);
+  }
+  return 0;
+}
+
+/*
+** Read one record of nCol fields from p, passing each value to
+** sink.field(iCol, z, n) with z==0 for NULL.  Short records are NULL-filled
+** and extra fields are skipped.  Returns the number of fields consumed;
+** a record should only be inserted when that is at least nCol.
+*/
+template <class Sink>
+static int csv_read_record(ImportCtx *p, int nCol, Sink &sink){
+  int i;
+  int startLine = p->nLine;
+  for(i=0; i<nCol; i++){
+    const char *z = csv_read_one_field(p);
+    /*
+    ** Did we reach end-of-file before finding any columns?
+    ** If so, stop instead of NULL filling the remaining columns.
+    */
+    if( z==0 && i==0 ) break;
+    sink.field(i, p->isNull ? 0 : z, p->nField);
+    if( i<nCol-1 && p->cTerm!=p->cColSep ){
+      import_warning(p, startLine, "expected %d columns but found %d - "
+                     "filling the rest with NULL", nCol, i+1);
+      i += 2;
+      while( i<=nCol ){ sink.field(i-1, 0, 0); i++; }
+    }
+  }
+  if( p->cTerm==p->cColSep ){
+    do{
+      csv_read_one_field(p);
+      i++;
+    }while( p->cTerm==p->cColSep );
+    import_warning(p, startLine, "expected %d columns but found %d - "
+                   "extras ignored", nCol, i);
+  }
+  return i;
+}
+
+/*
+** If the n bytes at z are a plain decimal integer that fits in 64 bits,
+** store it in *pValue and return 1.  Otherwise return 0.
+*/
+static int import_parse_int64(const char *z, int n, sqlite3_int64 *pValue){
+  const char *zEnd = z + n;
+  bool neg = false;
+  sqlite3_uint64 u = 0;
+  if( z<zEnd && (*z=='+' || *z=='-') ){
+    neg = *z=='-';
+    z++;
+  }
+  if( z==zEnd || zEnd-z>19 ) return 0;
+  for(; z<zEnd; z++){
+    if( !IS_DIGIT(*z) ) return 0;
+    u = u*10 + (*z - '0');
+  }
+  if( u>(sqlite3_uint64)0x7fffffffffffffffLL + (neg ? 1 : 0) ) return 0;
+  *pValue = neg ? (sqlite3_int64)(0 - u) : (sqlite3_int64)u;
+  return 1;
+}
+
+/*
+** If the n bytes at z are a decimal number of the form
+** [+-]?(d+(.d*)?|.d+)([eE][+-]?d+)?, store its value in *pValue and
+** return 1.  Otherwise return 0.
+*/
+static int import_parse_double(const char *z, int n, double *pValue){
+  char zBuf[64];
+  const char *zEnd = z + n;
+  const char *zPos = z;
+  int nDigit = 0;
+  if( n<=0 || n>=(int)sizeof(zBuf) ) return 0;
+  if( *zPos=='+' || *zPos=='-' ) zPos++;
+  while( zPos<zEnd && IS_DIGIT(*zPos) ){ zPos++; nDigit++; }
+  if( zPos<zEnd && *zPos=='.' ){
+    zPos++;
+    while( zPos<zEnd && IS_DIGIT(*zPos) ){ zPos++; nDigit++; }
+  }
+  if( nDigit==0 ) return 0;
+  if( zPos<zEnd && (*zPos=='e' || *zPos=='E') ){
+    zPos++;
+    if( zPos<zEnd && (*zPos=='+' || *zPos=='-') ) zPos++;
+    if( zPos==zEnd ) return 0;
+    while( zPos<zEnd && IS_DIGIT(*zPos) ) zPos++;
+  }
+  if( zPos!=zEnd ) return 0;
+  memcpy(zBuf, z, n);
+  zBuf[n] = 0;
+  /* strtod() honours the locale; not consuming everything means it differs */
+  char *zTail = 0;
+  *pValue = strtod(zBuf, &zTail);
+  return zTail==zBuf+n;
+}
+
+/*
+** Record sink that binds each value to a prepared INSERT.  Values in
+** integer and real columns are converted here, so that SQLite need not
+** copy and re-parse the text; anything that does not convert is bound
+** as text and left to the column affinity, as before.  Text is bound
+** with SQLITE_STATIC, so the caller must keep every value in place until
+** the statement has been stepped.
+*/
+struct ImportBindSink {
+  sqlite3_stmt *pStmt;
+  const ColType *aType;        /* Column types chosen by metascan */
+
+  void field(int i, const char *z, int n){
+    if( z==0 ){
+      sqlite3_bind_null(pStmt, i+1);
+      return;
+    }
+    sqlite3_int64 iValue;
+    double rValue;
+    switch( aType[i] ){
+      case CT_INT:
+        if( import_parse_int64(z, n, &iValue) ){
+          sqlite3_bind_int64(pStmt, i+1, iValue);
+          return;
+        }
+        break;
+      case CT_REAL:
+        if( import_parse_double(z, n, &rValue) ){
+          sqlite3_bind_double(pStmt, i+1, rValue);
+          return;
+        }
+        break;
+      default:
+        break;
+    }
+    sqlite3_bind_text(pStmt, i+1, z, n, SQLITE_STATIC);
+  }
+};
+
+/* One field value: z==0 for NULL, otherwise n bytes at z */
+struct ImportSpan {
+  const char *z;               /* Field text, or 0 for NULL */
+  int n;                       /* Bytes in z */
+};
+
+/*
+** Record sink for the serial engine.  The tokenizer reuses its buffers
+** from one field to the next, so the values of a record are gathered
+** here and only bound, in one go, once the record is complete.  Both
+** vectors keep their capacity from row to row.
+*/
+struct ImportRowSink {
+  std::vector<char> text;      /* Values of the current record */
+  std::vector<int> offsets;    /* Offset of each value in text, or -1 */
+  std::vector<int> lengths;    /* Bytes in each value */
+
+  ImportRowSink(int nCol) : offsets(nCol, -1), lengths(nCol, 0) { }
+
+  void field(int i, const char *z, int n){
+    if( i==0 ) text.clear();
+    if( z==0 ){
+      offsets[i] = -1;
+    }else{
+      offsets[i] = (int)text.size();
+      text.insert(text.end(), z, z + n);
+    }
+    lengths[i] = n;
+  }
+
+  void bind(ImportBindSink &sink){
+    for(size_t i=0; i<offsets.size(); i++){
+      /* An empty value needs a pointer other than 0 to stay non-NULL */
+      const char *z = offsets[i]<0 ? 0 : lengths[i]==0 ? "" : &text[offsets[i]];
+      sink.field((int)i, z, lengths[i]);
+    }
+  }
+};
+
+/*
+** A slice of the mapped input and the records tokenized from it by one
+** of the parallel import workers.
+*/
+struct ImportChunk {
+  const char *zBegin;          /* First byte of the slice */
+  const char *zEnd;            /* One past the last byte of the slice */
+  std::vector<char> text;      /* Values that could not be left in place */
+  std::vector<ImportSpan> fields;  /* nCol spans per record */
+  std::vector<int> lines;      /* Chunk-relative start line of each record */
+  std::vector<ImportWarning> warnings;
+  unsigned int nRow;           /* Number of complete records */
+  int nLine;                   /* Line number after the last record */
+  bool dirty;                  /* Slice did not end on a record boundary, or ran
+                               ** out of memory */
+  bool done;                   /* Tokenizing has finished */
+
+  ImportChunk(const char *zBegin_, const char *zEnd_) :
+    zBegin(zBegin_), zEnd(zEnd_), nRow(0), nLine(1), dirty(false), done(false) { }
+};
+
+/*
+** Record sink that collects spans into an ImportChunk.  Unquoted values
+** point straight into the mapped slice; values the tokenizer had to copy
+** (quoted fields) go to pChunk->text.  That buffer is reserved at the size
+** of the slice up front and a copied value is always shorter than its
+** quoted form, so it never reallocates and the spans stay valid.
+*/
+struct ImportChunkSink {
+  ImportChunk *pChunk;
+
+  void field(int i, const char *z, int n){
+    ImportSpan span;
+    span.z = z;
+    span.n = n;
+    if( z!=0 && (z<pChunk->zBegin || z>=pChunk->zEnd) ){
+      assert( pChunk->text.size() + n<=pChunk->text.capacity() );
+      span.z = pChunk->text.data() + pChunk->text.size();
+      pChunk->text.insert(pChunk->text.end(), z, z + n);
+    }
+    pChunk->fields.push_back(span);
+  }
+};
+
+/*
+** Cut z..zEnd into slices of roughly chunkBytes that each begin at the
+** start of a record.  A row separator is taken to end a record when an
+** even number of quote characters precede it, which memchr() can count
+** far faster than the tokenizer runs.  A stray quote inside an unquoted
+** field defeats that rule; the worker that tokenizes the slice notices
+** (see ImportChunk::dirty) and the remainder is imported serially.
+*/
+static void import_split_chunks(const char *z, const char *zEnd, int rSep,
+                                size_t chunkBytes, std::vector<ImportChunk> &chunks){
+  const char *zStart = z;
+  const char *zPos = z;
+  bool inQuote = false;
+  while( (size_t)(zEnd - zPos)>chunkBytes ){
+    const char *zTarget = zPos + chunkBytes;
+    const char *q = zPos;
+    while( (q = (const char*)memchr(q, '"', zTarget - q))!=0 ){
+      inQuote = !inQuote;
+      q++;
+    }
+    zPos = zTarget;
+    while( zPos<zEnd ){
+      int c = *(zPos++);
+      if( c=='"' ){
+        inQuote = !inQuote;
+      }else if( c==rSep && !inQuote ){
+        break;
+      }
+    }
+    if( zPos>=zEnd ) break;
+    chunks.push_back(ImportChunk(zStart, zPos));
+    zStart = zPos;
+  }
+  chunks.push_back(ImportChunk(zStart, zEnd));
+}
+
+/* Shared state of the parallel import workers and the inserting thread */
+struct ImportPipeline {
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  const ImportCtx *pProto;     /* File name and separators to tokenize with */
+  int nCol;
+  std::vector<ImportChunk> chunks;
+  size_t iNext;                /* Next chunk for a worker to claim */
+  size_t nConsumed;            /* Chunks already inserted and released */
+  size_t nAhead;               /* Max chunks tokenized ahead of insertion */
+  bool abort;
+};
+
+/* Tokenize one chunk.  Runs on a worker thread; touches only the chunk. */
+static void import_parse_chunk(const ImportCtx *pProto, int nCol, ImportChunk *pChunk,
+                               bool isLast){
+  ImportCtx ctx;
+  ImportChunkSink sink;
+  int i = 0;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.zFile = pProto->zFile;
+  ctx.cColSep = pProto->cColSep;
+  ctx.cRowSep = pProto->cRowSep;
+  ctx.nLine = 1;
+  ctx.zIn = pChunk->zBegin;
+  ctx.zInEnd = pChunk->zEnd;
+  ctx.warnings = &pChunk->warnings;
+  import_append_char(&ctx, 0);    /* To ensure ctx.z is allocated */
+  sink.pChunk = pChunk;
+  pChunk->text.reserve(pChunk->zEnd - pChunk->zBegin);
+  do{
+    int startLine = ctx.nLine;
+    i = csv_read_record(&ctx, nCol, sink);
+    if( i>=nCol ){
+      pChunk->lines.push_back(startLine);
+      pChunk->nRow++;
+    }
+    pChunk->fields.resize(pChunk->nRow * nCol);
+  }while( ctx.cTerm!=EOF );
+  /* A slice that starts on a record boundary ends on one exactly when the
+  ** final read hit end-of-input before any field */
+  pChunk->dirty = (!isLast && i!=0) || ctx.rc!=SQLITE_OK;
+  pChunk->nLine = ctx.nLine;
+  import_close(&ctx);
+}
+
+static void import_worker(void *arg){
+  ImportPipeline *pipe = static_cast<ImportPipeline*>(arg);
+  uv_mutex_lock(&pipe->mutex);
+  while( 1 ){
+    while( !pipe->abort && pipe->iNext<pipe->chunks.size()
+        && pipe->iNext>=pipe->nConsumed + pipe->nAhead ){
+      uv_cond_wait(&pipe->cond, &pipe->mutex);
+    }
+    if( pipe->abort || pipe->iNext>=pipe->chunks.size() ) break;
+    size_t iChunk = pipe->iNext++;
+    ImportChunk *pChunk = &pipe->chunks[iChunk];
+    uv_mutex_unlock(&pipe->mutex);
+    import_parse_chunk(pipe->pProto, pipe->nCol, pChunk,
+                       iChunk+1==pipe->chunks.size());
+    uv_mutex_lock(&pipe->mutex);
+    pChunk->done = true;
+    uv_cond_broadcast(&pipe->cond);
+  }
+  uv_mutex_unlock(&pipe->mutex);
+}
+
+/* Number of tokenizer threads: as requested, else one per spare core */
+static int import_worker_count(int nRequested){
+  uv_cpu_info_t *cpus;
+  int count;
+  if( nRequested>0 ) return nRequested;
+  if( uv_cpu_info(&cpus, &count)!=0 ) return 1;
+  uv_free_cpu_info(cpus, count);
+  return count>1 ? count-1 : 1;
+}
+
+/*
+** Counts inserted rows.  When the import owns the transaction, commits and
+** begins a new one every nEvery rows so that the journal stays small; time
+** spent committing is kept in commitNs.  Rows inserted and bytes consumed
+** so far are reported to the monitor every IMPORT_PROGRESS_ROWS rows.  If
+** the COMMIT or the BEGIN after it fails, or an error such as SQLITE_FULL
+** rolls back the transaction the import owns, the error is kept in zErr
+** and row() or rolledBack() returns non-zero so that the load stops.
+*/
+struct ImportTracker {
+  sqlite3 *db;
+  ImportCtx *ctx;              /* Input, and its monitor if any */
+  bool bOwn;                   /* True if the import owns the transaction */
+  unsigned int nEvery;         /* Rows per transaction, or 0 for just one */
+  unsigned int nPending;       /* Rows inserted since the last commit */
+  unsigned int nRow;           /* Rows inserted */
+  uint64_t commitNs;
+  std::string zErr;            /* Why a COMMIT or BEGIN failed, if one did */
+
+  ImportTracker(sqlite3 *db_, ImportCtx *ctx_, bool bOwn_, unsigned int nEvery_) :
+    db(db_), ctx(ctx_), bOwn(bOwn_), nEvery(bOwn_ ? nEvery_ : 0), nPending(0), nRow(0),
+    commitNs(0) { }
+
+  int row(const char *zFile){
+    nRow++;
+    if( ctx->monitor && nRow%IMPORT_PROGRESS_ROWS==0 ){
+      ctx->monitor->progress(nRow, import_offset(ctx), false);
+    }
+    if( nEvery==0 || ++nPending<nEvery ) return 0;
+    uint64_t t = uv_hrtime();
+    if( sqlite3_exec(db, "COMMIT", 0, 0, 0)!=SQLITE_OK ){
+      fail(zFile, "COMMIT");
+    }else if( sqlite3_exec(db, "BEGIN", 0, 0, 0)!=SQLITE_OK ){
+      fail(zFile, "BEGIN");
+    }
+    commitNs += uv_hrtime() - t;
+    nPending = 0;
+    return !zErr.empty();
+  }
+
+  /* Called after an INSERT fails */
+  int rolledBack(const char *zFile){
+    if( !bOwn || !sqlite3_get_autocommit(db) ) return 0;
+    fail(zFile, "INSERT");
+    return 1;
+  }
+
+  void fail(const char *zFile, const char *zWhat){
+    std::ostringstream ss;
+    ss << zWhat << " failed: " << sqlite3_errmsg(db);
+    zErr = ss.str();
+    utf8_printf(stderr, "%s: %s\n", zFile, zErr.c_str());
+  }
+};
+
+/* Connection settings applied for the duration of a bulk import */
+static const char *const azBulkPragma[][2] = {
+  { "synchronous",  "OFF" },
+  { "cache_size",   "-65536" },     /* 64MB */
+  { "temp_store",   "MEMORY" },
+  { "journal_mode", "MEMORY" },
+};
+const int IMPORT_BULK_PRAGMAS = sizeof(azBulkPragma)/sizeof(azBulkPragma[0]);
+
+/* Return the current value of PRAGMA zName, or "" if it has none */
+static std::string import_get_pragma(sqlite3 *db, const char *zName){
+  std::string value;
+  char *zSql = sqlite3_mprintf("PRAGMA %s", zName);
+  sqlite3_stmt *pStmt = 0;
+  if( zSql && sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW ){
+    const unsigned char *z = sqlite3_column_text(pStmt, 0);
+    if( z ) value = reinterpret_cast<const char*>(z);
+  }
+  sqlite3_finalize(pStmt);
+  sqlite3_free(zSql);
+  return value;
+}
+
+/* Set PRAGMA zName to zValue, ignoring any error */
+static void import_set_pragma(sqlite3 *db, const char *zName, const char *zValue){
+  char *zSql = sqlite3_mprintf("PRAGMA %s=%s", zName, zValue);
+  if( zSql ) sqlite3_exec(db, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+}
+
+/*
+** Apply the bulk profile, saving the settings it replaces in azSaved.
+** The journal mode can only change outside a transaction, and a WAL
+** database is left alone since it journals efficiently already.
+*/
+static void import_bulk_begin(sqlite3 *db, std::vector<std::string> &azSaved){
+  azSaved.clear();
+  for(int i=0; i<IMPORT_BULK_PRAGMAS; i++){
+    const char *zName = azBulkPragma[i][0];
+    std::string saved = import_get_pragma(db, zName);
+    if( strcmp(zName, "journal_mode")==0
+     && (!sqlite3_get_autocommit(db) || sqlite3_stricmp(saved.c_str(), "wal")==0) ){
+      saved.clear();
+    }
+    if( !saved.empty() ) import_set_pragma(db, zName, azBulkPragma[i][1]);
+    azSaved.push_back(saved);
+  }
+}
+
+/* Restore the settings saved by import_bulk_begin() */
+static void import_bulk_end(sqlite3 *db, std::vector<std::string> const &azSaved){
+  for(int i=IMPORT_BULK_PRAGMAS-1; i>=0; i--){
+    if( !azSaved[i].empty() ) import_set_pragma(db, azBulkPragma[i][0], azSaved[i].c_str());
+  }
+}
+
+/*
+** Insert every record of p->zIn..p->zInEnd into pStmt, tokenizing on a
+** pool of worker threads while this thread steps the INSERT in input
+** order.  If a chunk boundary turns out not to fall between records,
+** p->zIn is left at the start of the first unread chunk and non-zero is
+** returned so that the caller can finish the job serially.
+*/
+static int import_load_parallel(ImportCtx *p, int nCol, int nWorker,
+                                sqlite3 *db, sqlite3_stmt *pStmt, const ColType *aType,
+                                ImportTracker &tracker, unsigned int &rowCount){
+  ImportPipeline pipe;
+  std::vector<uv_thread_t> threads;
+  ImportBindSink sink;
+  size_t iChunk;
+  int lineBase = p->nLine - 1;
+  int rc = 0;
+
+  pipe.pProto = p;
+  pipe.nCol = nCol;
+  pipe.iNext = 0;
+  pipe.nConsumed = 0;
+  pipe.nAhead = nWorker * IMPORT_CHUNKS_PER_WORKER;
+  pipe.abort = false;
+  import_split_chunks(p->zIn, p->zInEnd, p->cRowSep, IMPORT_CHUNK_BYTES, pipe.chunks);
+  uv_mutex_init(&pipe.mutex);
+  uv_cond_init(&pipe.cond);
+  for(int i=0; i<nWorker && (size_t)i<pipe.chunks.size(); i++){
+    uv_thread_t tid;
+    if( uv_thread_create(&tid, import_worker, &pipe)!=0 ) break;
+    threads.push_back(tid);
+  }
+  if( threads.empty() ){
+    /* No threads to be had; tokenize each chunk on this thread instead */
+    pipe.nAhead = 0;
+  }
+
+  sink.pStmt = pStmt;
+  sink.aType = aType;
+  for(iChunk=0; iChunk<pipe.chunks.size() && !import_cancelled(p) && tracker.zErr.empty();
+      iChunk++){
+    ImportChunk *pChunk = &pipe.chunks[iChunk];
+    if( threads.empty() ){
+      import_parse_chunk(p, nCol, pChunk, iChunk+1==pipe.chunks.size());
+    }else{
+      uv_mutex_lock(&pipe.mutex);
+      while( !pChunk->done ) uv_cond_wait(&pipe.cond, &pipe.mutex);
+      uv_mutex_unlock(&pipe.mutex);
+    }
+    if( pChunk->dirty ){
+      p->zIn = pChunk->zBegin;
+      p->nLine = lineBase + 1;
+      rc = 1;
+      break;
+    }
+
+    for(size_t w=0; w<pChunk->warnings.size(); w++){
+      utf8_printf(stderr, "%s:%d: %s\n", p->zFile,
+                  lineBase + pChunk->warnings[w].nLine, pChunk->warnings[w].zMsg.c_str());
+    }
+    const ImportSpan *aField = pChunk->fields.empty() ? 0 : &pChunk->fields[0];
+    p->zIn = pChunk->zEnd;    /* For progress reports */
+    for(unsigned int r=0; r<pChunk->nRow && !import_cancelled(p); r++, aField += nCol){
+      for(int i=0; i<nCol; i++){
+        sink.field(i, aField[i].z, aField[i].n);
+      }
+      sqlite3_step(pStmt);
+      int rcReset = sqlite3_reset(pStmt);
+      if( rcReset==SQLITE_INTERRUPT ){
+        p->monitor->cancelled = true;
+        break;
+      }
+      if( rcReset!=SQLITE_OK ){
+        utf8_printf(stderr, "%s:%d: INSERT failed: %s\n", p->zFile,
+                    lineBase + pChunk->lines[r], sqlite3_errmsg(db));
+        if( tracker.rolledBack(p->zFile) ) break;
+      }
+      rowCount++;
+      if( tracker.row(p->zFile) ) break;
+    }
+    lineBase += pChunk->nLine - 1;
+
+    /* Hand the memory back before the next chunk is claimed */
+    std::vector<char>().swap(pChunk->text);
+    std::vector<ImportSpan>().swap(pChunk->fields);
+    std::vector<int>().swap(pChunk->lines);
+    std::vector<ImportWarning>().swap(pChunk->warnings);
+    uv_mutex_lock(&pipe.mutex);
+    pipe.nConsumed++;
+    uv_cond_broadcast(&pipe.cond);
+    uv_mutex_unlock(&pipe.mutex);
+  }
+  if( rc==0 && !import_cancelled(p) && tracker.zErr.empty() ){
+    p->zIn = p->zInEnd;
+    p->nLine = lineBase + 1;
+  }
+
+  uv_mutex_lock(&pipe.mutex);
+  pipe.abort = true;
+  uv_cond_broadcast(&pipe.cond);
+  uv_mutex_unlock(&pipe.mutex);
+  for(size_t t=0; t<threads.size(); t++){
+    uv_thread_join(&threads[t]);
+  }
+  uv_cond_destroy(&pipe.cond);
+  uv_mutex_destroy(&pipe.mutex);
+  return rc;
+}
+
 const char *NO_TABLE_ERR_PREFIX = "no such table:";
 const size_t NO_TABLE_ERR_LEN = strlen(NO_TABLE_ERR_PREFIX);
 
-ImportResult *sqlite_import(
+/*
+** Import CSV text into zTable.  The text comes from pSource if that is
+** set, otherwise from the nData bytes at zData if that is set, and
+** otherwise from the file zFile.  zFile names the input in diagnostics
+** in every case.  pMonitor, if set, is told about progress and may
+** cancel the import.
+*/
+static ImportResult *import_main(
   sqlite3 *db,
-  const char *zFile,      // CSV file to import
-  const char *zTable,     // sqlite destination table name
-  ImportOptions &options,  // import options
-  std::string &errMsg     // set in case of error
+  const char *zFile,
+  const char *zData,
+  size_t nData,
+  ImportSource *pSource,
+  const char *zTable,
+  ImportOptions &options,
+  std::string &errMsg,
+  ImportMonitor *pMonitor
 ) {
   struct ShellState ss;
   struct ShellState *p = &ss;  /* TODO: replace */
@@ -305,12 +1304,16 @@ ImportResult *sqlite_import(
   ImportCtx sCtx;             /* Reader context */
   std::stringstream ssErr;    // string stream for error messages
   int content_offset = 0;     // updated later if header row
+  const char *zContent = 0;   // same, for in-memory input
+  int content_line = 1;       // line number at content_offset
+  std::vector<char> history;  // header and metascan text read from pSource
+  ImportMonitor noMonitor;    // stands in for pMonitor if there is none
 
   p->mode = MODE_Csv;
   sqlite3_snprintf(sizeof(p->colSeparator), p->colSeparator, "%c", options.columnDelimiter);
   sqlite3_snprintf(sizeof(p->rowSeparator), p->rowSeparator, SEP_CrLf);
-  seenInterrupt = 0;
   memset(&sCtx, 0, sizeof(sCtx));
+  sCtx.monitor = pMonitor ? pMonitor : &noMonitor;
   nSep = strlen30(p->colSeparator);
   if( nSep==0 ){
     errMsg = "non-null column separator required for import";
@@ -339,8 +1342,27 @@ ImportResult *sqlite_import(
   }
   sCtx.zFile = zFile;
   sCtx.nLine = 1;
-  sCtx.in = fopen(sCtx.zFile, "rb");
-  if( sCtx.in==0 ){
+  if( pSource ){
+    if( import_open_source(&sCtx, pSource, &history)!=0 ){
+      errMsg = "out of memory";
+      return NULL;
+    }
+  }else if( zData ){
+    sCtx.zMem = zData;
+    sCtx.zIn = sCtx.zMem;
+    sCtx.zInEnd = sCtx.zMem + nData;
+    zContent = sCtx.zIn;
+  }else if( options.parallel ){
+    if( import_map_open(&sCtx.map, sCtx.zFile)==0 ){
+      sCtx.zMem = sCtx.map.z;
+      sCtx.zIn = sCtx.map.z;
+      sCtx.zInEnd = sCtx.map.z + sCtx.map.n;
+      zContent = sCtx.zIn;
+    }
+  }else{
+    import_open_file(&sCtx, sCtx.zFile);
+  }
+  if( !import_buffered(&sCtx) && sCtx.zMem==0 ){
     ssErr << "cannot open file \"" << zFile << '"';
     errMsg = ssErr.str();
     return NULL;
@@ -350,7 +1372,7 @@ ImportResult *sqlite_import(
   zSql = sqlite3_mprintf("SELECT * FROM %s", zTable);
   if( zSql==0 ){
     errMsg = "out of memory";
-    fclose(sCtx.in);
+    import_close(&sCtx);
     return NULL;
   }
 
@@ -361,7 +1383,7 @@ ImportResult *sqlite_import(
     ssErr << "Error: " << rc << ": " << sqlite3_errmsg(db);
     errMsg = ssErr.str();
     sqlite3_free(zSql);
-    fclose(sCtx.in);
+    import_close(&sCtx);
     return NULL;
   }
   sqlite3_free(zSql);
@@ -370,18 +1392,23 @@ ImportResult *sqlite_import(
   int nCol = 0;
   if (!options.noHeaderRow) {
     while (csv_read_one_field(&sCtx)) {
-      colNames.push_back(std::string(sCtx.z));
+      colNames.push_back(std::string(sCtx.zField, sCtx.nField));
       if( sCtx.cTerm!=sCtx.cColSep ) break;
     }
     nCol = colNames.size();
-    if (nCol==0) {
-      sqlite3_free(sCtx.z);
-      fclose(sCtx.in);
+    if (nCol==0 || sCtx.rc!=SQLITE_OK) {
+      import_close(&sCtx);
       ssErr << '"' << sCtx.zFile << ": empty file";
-      errMsg = ssErr.str();
+      errMsg = import_cancelled(&sCtx) ? "interrupted"
+             : sCtx.rc!=SQLITE_OK ? sqlite3_errstr(sCtx.rc) : ssErr.str();
       return NULL;
     }
-    content_offset = ftell(sCtx.in);
+    if( import_buffered(&sCtx) ){
+      content_offset = import_tell(&sCtx);
+    }else{
+      zContent = sCtx.zIn;
+    }
+    content_line = sCtx.nLine;
   }
   if (options.columnIds.size() > 0) {
     // column ids provided via options -- let's use those
@@ -389,10 +1416,26 @@ ImportResult *sqlite_import(
     nCol = colNames.size();
   }
 
+  uint64_t tMetascan = uv_hrtime();
   std::vector<ColType> colTypes(nCol, CT_NONE);
-  if (metascan(colTypes,sCtx,nCol)!=0) {
+  int nSampleRows = options.sampleRows>0 ? options.sampleRows : METASCAN_ROWS;
+  rc = metascan(colTypes,sCtx,nCol,nSampleRows,false);
+  if( rc==0 && options.sampleRegions>1 && sCtx.cTerm!=EOF && sCtx.source==0 ){
+    /* Diagnostics for these rows come from the import itself */
+    std::vector<ImportWarning> sampleWarnings;
+    sCtx.warnings = &sampleWarnings;
+    rc = metascan_regions(colTypes, sCtx, nCol, nSampleRows, options.sampleRegions,
+                          sCtx.in ? content_offset : (long)(zContent - sCtx.zMem));
+    sCtx.warnings = 0;
+  }
+  if (rc!=0) {
     errMsg = "error performing metascan";
-    fclose(sCtx.in);
+    import_close(&sCtx);
+    return NULL;
+  }
+  if( import_cancelled(&sCtx) || sCtx.rc!=SQLITE_OK ){
+    errMsg = import_cancelled(&sCtx) ? "interrupted" : sqlite3_errstr(sCtx.rc);
+    import_close(&sCtx);
     return NULL;
   }
   std::vector<std::string> colTypeNames;
@@ -403,6 +1446,7 @@ ImportResult *sqlite_import(
     colTypeNames.push_back(typeName);
   }
 
+  uint64_t tCreate = uv_hrtime();
   std::stringstream ssCreate;
   ssCreate << "CREATE TABLE " << zTable;
   char cSep = '(';
@@ -420,22 +1464,26 @@ ImportResult *sqlite_import(
             sqlite3_errmsg(db));
     ssErr << "CREATE TABLE " << zTable << "(...) failed: " << sqlite3_errmsg(db);
     errMsg = ssErr.str();
-    sqlite3_free(sCtx.z);
-    fclose(sCtx.in);
+    import_close(&sCtx);
     return NULL;
   }
 
   // rewind to content_offset:
-  if (fseek(sCtx.in, content_offset, SEEK_SET)!=0) {
-    errMsg = "error rewinding file";
-    fclose(sCtx.in);
-    return NULL;
+  if( import_buffered(&sCtx) ){
+    if (import_seek(&sCtx, content_offset)!=0) {
+      errMsg = "error rewinding file";
+      import_close(&sCtx);
+      return NULL;
+    }
+  }else{
+    sCtx.zIn = zContent;
   }
+  sCtx.nLine = content_line;
 
   zSql = reinterpret_cast<char*>(sqlite3_malloc( nByte*2 + 20 + nCol*2 ));
   if( zSql==0 ){
     raw_printf(stderr, "Error: out of memory\n");
-    fclose(sCtx.in);
+    import_close(&sCtx);
     return NULL;
   }
   sqlite3_snprintf(nByte+20, zSql, "INSERT INTO \"%w\" VALUES(?", zTable);
@@ -453,60 +1501,590 @@ ImportResult *sqlite_import(
     ssErr << "prepare insert statement failed: " << sqlite3_errmsg(db);
     errMsg = ssErr.str();
     if (pStmt) sqlite3_finalize(pStmt);
-    fclose(sCtx.in);
+    import_close(&sCtx);
     return NULL;
   }
+  std::vector<std::string> azSaved;
+  if( options.bulk ) import_bulk_begin(db, azSaved);
+  uint64_t tLoad = uv_hrtime();
   needCommit = sqlite3_get_autocommit(db);
-  if( needCommit ) sqlite3_exec(db, "BEGIN", 0, 0, 0);
   unsigned int rowCount = 0;
-  do{
+  unsigned int commitRows = options.commitRows>0 ? options.commitRows
+                            : options.bulk ? IMPORT_BULK_COMMIT_ROWS : 0;
+  ImportTracker tracker(db, &sCtx, needCommit, commitRows);
+  if( needCommit && sqlite3_exec(db, "BEGIN", 0, 0, 0)!=SQLITE_OK ){
+    tracker.fail(zFile, "BEGIN");
+  }
+  bool serial = tracker.zErr.empty();
+  if( serial && options.parallel && sCtx.zMem ){
+    /* Fall through to the serial loop for whatever could not be split */
+    serial = import_load_parallel(&sCtx, nCol, import_worker_count(options.workers),
+                                  db, pStmt, colTypes.data(), tracker, rowCount)!=0;
+  }
+  ImportBindSink sink;
+  ImportRowSink row(nCol);
+  sink.pStmt = pStmt;
+  sink.aType = colTypes.data();
+  while( serial ){
     int startLine = sCtx.nLine;
-    for(i=0; i<nCol; i++){
-      char *z = csv_read_one_field(&sCtx);
-      /*
-      ** Did we reach end-of-file before finding any columns?
-      ** If so, stop instead of NULL filling the remaining columns.
-      */
-      if( z==0 && i==0 ) break;
-      if (sCtx.isNull) {
-        sqlite3_bind_null(pStmt, i+1);
-      } else {
-        sqlite3_bind_text(pStmt, i+1, z, -1, SQLITE_TRANSIENT);
-      }
-      if( i<nCol-1 && sCtx.cTerm!=sCtx.cColSep ){
-        utf8_printf(stderr, "%s:%d: expected %d columns but found %d - "
-                        "filling the rest with NULL\n",
-                        sCtx.zFile, startLine, nCol, i+1);
-        i += 2;
-        while( i<=nCol ){ sqlite3_bind_null(pStmt, i); i++; }
-      }
-    }
-    if( sCtx.cTerm==sCtx.cColSep ){
-      do{
-        csv_read_one_field(&sCtx);
-        i++;
-      }while( sCtx.cTerm==sCtx.cColSep );
-      utf8_printf(stderr, "%s:%d: expected %d columns but found %d - "
-                      "extras ignored\n",
-                      sCtx.zFile, startLine, nCol, i);
+    i = csv_read_record(&sCtx, nCol, row);
+    if( sCtx.rc!=SQLITE_OK ){
+      tracker.zErr = sqlite3_errstr(sCtx.rc);
+      break;
     }
     if( i>=nCol ){
+      row.bind(sink);
       sqlite3_step(pStmt);
       rc = sqlite3_reset(pStmt);
+      if( rc==SQLITE_INTERRUPT ){
+        sCtx.monitor->cancelled = true;
+        break;
+      }
       if( rc!=SQLITE_OK ){
         utf8_printf(stderr, "%s:%d: INSERT failed: %s\n", sCtx.zFile,
                     startLine, sqlite3_errmsg(db));
+        if( tracker.rolledBack(sCtx.zFile) ) break;
       }
       rowCount++;
+      if( tracker.row(sCtx.zFile) ) break;
     }
-  }while( sCtx.cTerm!=EOF );
+    serial = sCtx.cTerm!=EOF;
+  }
 
-  fclose(sCtx.in);
-  sqlite3_free(sCtx.z);
+  bool cancelled = import_cancelled(&sCtx);
+  sCtx.monitor->progress(rowCount, import_offset(&sCtx), true);
+  import_close(&sCtx);
   sqlite3_finalize(pStmt);
-  if( needCommit ) sqlite3_exec(db, "COMMIT", 0, 0, 0);
+  uint64_t tCommit = uv_hrtime();
+  if( !cancelled && tracker.zErr.empty() && needCommit
+   && sqlite3_exec(db, "COMMIT", 0, 0, 0)!=SQLITE_OK ){
+    tracker.fail(zFile, "COMMIT");
+  }
+  if( cancelled || !tracker.zErr.empty() ){
+    /* An interrupted INSERT or a failed COMMIT may have rolled the
+    ** transaction back already.  Rows from chunks committed earlier go
+    ** with the table. */
+    if( needCommit && !sqlite3_get_autocommit(db) ){
+      sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+    }
+    std::string dropSql = std::string("DROP TABLE IF EXISTS ") + zTable;
+    sqlite3_exec(db, dropSql.c_str(), 0, 0, 0);
+  }
+  if( options.bulk ) import_bulk_end(db, azSaved);
+  if( cancelled ){
+    errMsg = "interrupted";
+    return NULL;
+  }
+  if( !tracker.zErr.empty() ){
+    errMsg = tracker.zErr;
+    return NULL;
+  }
+  uint64_t tDone = uv_hrtime();
 
   ImportResult *ires = new ImportResult(zTable, colNames, colTypeNames, rowCount);
+  ires->metascanMs = (tCreate - tMetascan) / 1e6;
+  ires->createMs = (tLoad - tCreate) / 1e6;
+  ires->loadMs = (tCommit - tLoad - tracker.commitNs) / 1e6;
+  ires->commitMs = (tDone - tCommit + tracker.commitNs) / 1e6;
 
   return ires;
 }
+
+ImportResult *sqlite_import(
+  sqlite3 *db,
+  const char *zFile,      // CSV file to import
+  const char *zTable,     // sqlite destination table name
+  ImportOptions &options,  // import options
+  std::string &errMsg,     // set in case of error
+  ImportMonitor *pMonitor  // told about progress, if set
+) {
+  return import_main(db, zFile, 0, 0, 0, zTable, options, errMsg, pMonitor);
+}
+
+ImportResult *sqlite_import_memory(
+  sqlite3 *db,
+  const char *zData,
+  size_t nData,
+  const char *zName,
+  const char *zTable,
+  ImportOptions &options,
+  std::string &errMsg,
+  ImportMonitor *pMonitor
+) {
+  return import_main(db, zName, zData ? zData : "", nData, 0, zTable, options, errMsg, pMonitor);
+}
+
+ImportResult *sqlite_import_source(
+  sqlite3 *db,
+  ImportSource *pSource,
+  const char *zName,
+  const char *zTable,
+  ImportOptions &options,
+  std::string &errMsg,
+  ImportMonitor *pMonitor
+) {
+  return import_main(db, zName, 0, 0, pSource, zTable, options, errMsg, pMonitor);
+}
+
+/*
+** The "csv" virtual table module, for queries that run straight over a
+** file without importing it:
+**
+**   CREATE VIRTUAL TABLE t USING csv(file='data.csv', delimiter=';', ...)
+**
+** The file is mapped into memory and read with the import tokenizer.  Its
+** columns are named by the header row and typed by metascan, and values
+** are converted to those types as an import would store them.  Options:
+**
+**   file=PATH        the CSV file; required
+**   delimiter=C      the column separator, one character or "tab"; ","
+**   header=BOOL      whether the first row names the columns; yes
+**   columns=A,B,...  column names, in place of the header's
+**   sample=N         rows metascan examines; 1024
+**   parallel=BOOL    tokenize a full scan on worker threads, as the
+**                    parallel import engine does; no
+**   workers=N        threads for parallel; one per spare core
+**
+** The table is read-only, and its rows are numbered from 1 in file order.
+** The file is expected not to change while it is open.
+*/
+
+typedef struct CsvTable CsvTable;
+struct CsvTable {
+  sqlite3_vtab base;           /* Base class.  Must be first */
+  std::string zFile;           /* Name of the file */
+  ImportMap map;               /* The file, mapped */
+  int cColSep;                 /* Column separator */
+  int nCol;                    /* Columns declared */
+  std::vector<ColType> colTypes;
+  const char *zContent;        /* First byte after the header row */
+  int contentLine;             /* Line number at zContent */
+  int nWorker;                 /* Tokenizer threads for a scan, or 0 */
+};
+
+typedef struct CsvCursor CsvCursor;
+struct CsvCursor {
+  sqlite3_vtab_cursor base;    /* Base class.  Must be first */
+  ImportCtx ctx;               /* Serial reader; separators for the workers */
+  ImportRowSink *row;          /* Values of the current record, serially */
+  std::vector<ImportWarning> warnings;  /* Not reported; cleared each row */
+  ImportPipeline *pipe;        /* The parallel scan, or 0 */
+  std::vector<uv_thread_t> threads;
+  size_t iChunk;               /* Chunk the current record is in */
+  unsigned int iRow;           /* Records of it already read */
+  const ImportSpan *aField;    /* Values of the current record, in parallel */
+  sqlite3_int64 iRowid;
+  bool eof;
+};
+
+/* Strip one layer of '', "" or [] quoting from z, in place */
+static void csv_dequote(std::string &z){
+  if( z.size()<2 ) return;
+  char cQuote = z[0];
+  char cEnd = cQuote=='[' ? ']' : cQuote;
+  if( (cQuote!='\'' && cQuote!='"' && cQuote!='[') || z[z.size()-1]!=cEnd ) return;
+  std::string out;
+  for(size_t i=1; i<z.size()-1; i++){
+    out += z[i];
+    if( z[i]==cEnd && cEnd!=']' && i+1<z.size()-1 && z[i+1]==cEnd ) i++;
+  }
+  z.swap(out);
+}
+
+static void csv_trim(std::string &z){
+  size_t b = 0, e = z.size();
+  while( b<e && isspace((unsigned char)z[b]) ) b++;
+  while( e>b && isspace((unsigned char)z[e-1]) ) e--;
+  z = z.substr(b, e-b);
+}
+
+/* Parse a yes/no option.  Returns 0 or 1, or -1 if it is neither. */
+static int csv_boolean(const std::string &z){
+  if( sqlite3_stricmp(z.c_str(), "yes")==0 || sqlite3_stricmp(z.c_str(), "true")==0
+   || z=="1" || sqlite3_stricmp(z.c_str(), "on")==0 ) return 1;
+  if( sqlite3_stricmp(z.c_str(), "no")==0 || sqlite3_stricmp(z.c_str(), "false")==0
+   || z=="0" || sqlite3_stricmp(z.c_str(), "off")==0 ) return 0;
+  return -1;
+}
+
+static int csv_disconnect(sqlite3_vtab *pVtab){
+  CsvTable *pTab = reinterpret_cast<CsvTable*>(pVtab);
+  import_map_close(&pTab->map);
+  delete pTab;
+  return SQLITE_OK;
+}
+
+static int csv_connect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                       sqlite3_vtab **ppVtab, char **pzErr){
+  std::string zFile;
+  char cColSep = ',';
+  bool header = true;
+  bool parallel = false;
+  int nWorker = 0;
+  int nSampleRows = METASCAN_ROWS;
+  std::vector<std::string> colNames;
+  bool namesGiven = false;
+
+  for(int i=3; i<argc; i++){
+    std::string zArg(argv[i]);
+    size_t eq = zArg.find('=');
+    std::string zKey = zArg.substr(0, eq);
+    std::string zValue = eq==std::string::npos ? "" : zArg.substr(eq+1);
+    csv_trim(zKey);
+    csv_trim(zValue);
+    csv_dequote(zValue);
+    if( zKey=="file" ){
+      zFile = zValue;
+    }else if( zKey=="delimiter" ){
+      if( sqlite3_stricmp(zValue.c_str(), "tab")==0 ) zValue = "\t";
+      if( zValue.size()!=1 ){
+        *pzErr = sqlite3_mprintf("csv: delimiter must be one character");
+        return SQLITE_ERROR;
+      }
+      cColSep = zValue[0];
+    }else if( zKey=="header" || zKey=="parallel" ){
+      int b = csv_boolean(zValue);
+      if( b<0 ){
+        *pzErr = sqlite3_mprintf("csv: %s must be yes or no", zKey.c_str());
+        return SQLITE_ERROR;
+      }
+      if( zKey=="header" ) header = b==1;
+      else parallel = b==1;
+    }else if( zKey=="columns" ){
+      std::stringstream ss(zValue);
+      std::string zName;
+      while( std::getline(ss, zName, ',') ){
+        csv_trim(zName);
+        csv_dequote(zName);
+        colNames.push_back(zName);
+      }
+      namesGiven = true;
+    }else if( zKey=="sample" || zKey=="workers" ){
+      char *zEnd = 0;
+      long n = strtol(zValue.c_str(), &zEnd, 10);
+      if( zValue.empty() || *zEnd!=0 || n<(zKey=="sample" ? 1 : 0) || n>0x7fffffff ){
+        *pzErr = sqlite3_mprintf("csv: %s must be a %s integer", zKey.c_str(),
+                                 zKey=="sample" ? "positive" : "non-negative");
+        return SQLITE_ERROR;
+      }
+      if( zKey=="sample" ) nSampleRows = (int)n;
+      else nWorker = (int)n;
+    }else{
+      *pzErr = sqlite3_mprintf("csv: unknown option \"%s\"", zKey.c_str());
+      return SQLITE_ERROR;
+    }
+  }
+  if( zFile.empty() ){
+    *pzErr = sqlite3_mprintf("csv: file is required");
+    return SQLITE_ERROR;
+  }
+
+  CsvTable *pTab = new CsvTable();
+  pTab->zFile = zFile;
+  pTab->cColSep = cColSep;
+  pTab->nWorker = parallel ? import_worker_count(nWorker) : 0;
+  if( import_map_open(&pTab->map, zFile.c_str())!=0 ){
+    *pzErr = sqlite3_mprintf("cannot open file \"%s\"", zFile.c_str());
+    delete pTab;
+    return SQLITE_ERROR;
+  }
+
+  ImportCtx ctx;
+  std::vector<ImportWarning> warnings;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.zFile = pTab->zFile.c_str();
+  ctx.zMem = ctx.zIn = pTab->map.z;
+  ctx.zInEnd = pTab->map.z + pTab->map.n;
+  ctx.cColSep = cColSep;
+  ctx.cRowSep = '\n';
+  ctx.nLine = 1;
+  ctx.warnings = &warnings;
+  import_append_char(&ctx, 0);    /* To ensure ctx.z is allocated */
+
+  /* Name the columns after the header, or count those of the first row */
+  std::vector<std::string> headerNames;
+  while( csv_read_one_field(&ctx) ){
+    headerNames.push_back(std::string(ctx.zField, ctx.nField));
+    if( ctx.cTerm!=ctx.cColSep ) break;
+  }
+  if( ctx.rc!=SQLITE_OK ){
+    import_close(&ctx);
+    csv_disconnect(&pTab->base);
+    return ctx.rc;
+  }
+  if( header ){
+    pTab->zContent = ctx.zIn;
+    pTab->contentLine = ctx.nLine;
+  }else{
+    pTab->zContent = pTab->map.z;
+    pTab->contentLine = 1;
+    for(size_t i=0; i<headerNames.size(); i++){
+      headerNames[i] = "c" + std::to_string(i+1);
+    }
+  }
+  if( !namesGiven ) colNames = headerNames;
+  pTab->nCol = (int)colNames.size();
+  if( pTab->nCol==0 ){
+    *pzErr = sqlite3_mprintf("\"%s\": empty file", zFile.c_str());
+    import_close(&ctx);
+    csv_disconnect(&pTab->base);
+    return SQLITE_ERROR;
+  }
+
+  ctx.zIn = pTab->zContent;
+  ctx.nLine = pTab->contentLine;
+  pTab->colTypes.assign(pTab->nCol, CT_NONE);
+  metascan(pTab->colTypes, ctx, pTab->nCol, nSampleRows, false);
+  import_close(&ctx);
+  if( ctx.rc!=SQLITE_OK ){
+    csv_disconnect(&pTab->base);
+    return ctx.rc;
+  }
+
+  std::string zSchema = "CREATE TABLE x(";
+  for(int i=0; i<pTab->nCol; i++){
+    char *zCol = sqlite3_mprintf("%s\"%w\" %s", i ? ", " : "", colNames[i].c_str(),
+                                 colTypeName(pTab->colTypes[i]));
+    zSchema += zCol;
+    sqlite3_free(zCol);
+  }
+  zSchema += ")";
+  int rc = sqlite3_declare_vtab(db, zSchema.c_str());
+  if( rc!=SQLITE_OK ){
+    *pzErr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+    csv_disconnect(&pTab->base);
+    return rc;
+  }
+#ifdef SQLITE_VTAB_DIRECTONLY
+  /* Reading files is for the application's own SQL, not a schema's */
+  sqlite3_vtab_config(db, SQLITE_VTAB_DIRECTONLY);
+#endif
+  *ppVtab = &pTab->base;
+  return SQLITE_OK;
+}
+
+static int csv_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo){
+  CsvTable *pTab = reinterpret_cast<CsvTable*>(pVtab);
+  /* Only full scans, which cost about as much as the file is long */
+  pInfo->estimatedCost = 1000000.0 + (double)pTab->map.n;
+  return SQLITE_OK;
+}
+
+static int csv_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  CsvTable *pTab = reinterpret_cast<CsvTable*>(pVtab);
+  CsvCursor *pCur = new CsvCursor();
+  pCur->ctx.zFile = pTab->zFile.c_str();
+  pCur->ctx.cColSep = pTab->cColSep;
+  pCur->ctx.cRowSep = '\n';
+  pCur->ctx.warnings = &pCur->warnings;
+  import_append_char(&pCur->ctx, 0);    /* To ensure ctx.z is allocated */
+  pCur->row = new ImportRowSink(pTab->nCol);
+  pCur->eof = true;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+/* Stop and join the workers of a parallel scan */
+static void csv_stop_pipeline(CsvCursor *pCur){
+  ImportPipeline *pipe = pCur->pipe;
+  if( pipe==0 ) return;
+  uv_mutex_lock(&pipe->mutex);
+  pipe->abort = true;
+  uv_cond_broadcast(&pipe->cond);
+  uv_mutex_unlock(&pipe->mutex);
+  for(size_t t=0; t<pCur->threads.size(); t++){
+    uv_thread_join(&pCur->threads[t]);
+  }
+  pCur->threads.clear();
+  uv_cond_destroy(&pipe->cond);
+  uv_mutex_destroy(&pipe->mutex);
+  delete pipe;
+  pCur->pipe = 0;
+}
+
+static int csv_close(sqlite3_vtab_cursor *pCursor){
+  CsvCursor *pCur = reinterpret_cast<CsvCursor*>(pCursor);
+  csv_stop_pipeline(pCur);
+  import_close(&pCur->ctx);
+  delete pCur->row;
+  delete pCur;
+  return SQLITE_OK;
+}
+
+/*
+** Move to the next record of a parallel scan.  Returns 0 when the scan is
+** over, or has to go on serially from pCur->ctx because a chunk did not
+** split on a record boundary.
+*/
+static bool csv_next_parallel(CsvCursor *pCur, int nCol){
+  ImportPipeline *pipe = pCur->pipe;
+  while( pCur->iChunk<pipe->chunks.size() ){
+    ImportChunk *pChunk = &pipe->chunks[pCur->iChunk];
+    if( pCur->iRow==0 ){
+      if( pCur->threads.empty() ){
+        import_parse_chunk(&pCur->ctx, nCol, pChunk, pCur->iChunk+1==pipe->chunks.size());
+      }else{
+        uv_mutex_lock(&pipe->mutex);
+        while( !pChunk->done ) uv_cond_wait(&pipe->cond, &pipe->mutex);
+        uv_mutex_unlock(&pipe->mutex);
+      }
+      if( pChunk->dirty ){
+        pCur->ctx.zIn = pChunk->zBegin;
+        pCur->ctx.zInEnd = pipe->chunks.back().zEnd;
+        return false;
+      }
+    }
+    if( pCur->iRow<pChunk->nRow ){
+      pCur->aField = &pChunk->fields[(size_t)pCur->iRow * nCol];
+      pCur->iRow++;
+      return true;
+    }
+    /* Hand the memory back before the next chunk is claimed */
+    std::vector<char>().swap(pChunk->text);
+    std::vector<ImportSpan>().swap(pChunk->fields);
+    std::vector<int>().swap(pChunk->lines);
+    std::vector<ImportWarning>().swap(pChunk->warnings);
+    uv_mutex_lock(&pipe->mutex);
+    pipe->nConsumed++;
+    uv_cond_broadcast(&pipe->cond);
+    uv_mutex_unlock(&pipe->mutex);
+    pCur->iChunk++;
+    pCur->iRow = 0;
+  }
+  pCur->ctx.zIn = pCur->ctx.zInEnd;
+  return false;
+}
+
+static int csv_next(sqlite3_vtab_cursor *pCursor){
+  CsvCursor *pCur = reinterpret_cast<CsvCursor*>(pCursor);
+  CsvTable *pTab = reinterpret_cast<CsvTable*>(pCursor->pVtab);
+  pCur->warnings.clear();
+  if( pCur->pipe ){
+    if( csv_next_parallel(pCur, pTab->nCol) ){
+      pCur->iRowid++;
+      return SQLITE_OK;
+    }
+    csv_stop_pipeline(pCur);
+  }
+  pCur->aField = 0;
+  while( pCur->ctx.zIn<pCur->ctx.zInEnd ){
+    int i = csv_read_record(&pCur->ctx, pTab->nCol, *pCur->row);
+    if( pCur->ctx.rc!=SQLITE_OK ) return pCur->ctx.rc;
+    if( i>=pTab->nCol ){
+      pCur->iRowid++;
+      return SQLITE_OK;
+    }
+    if( pCur->ctx.cTerm==EOF ) break;
+  }
+  pCur->eof = true;
+  return SQLITE_OK;
+}
+
+static int csv_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr,
+                      int argc, sqlite3_value **argv){
+  CsvCursor *pCur = reinterpret_cast<CsvCursor*>(pCursor);
+  CsvTable *pTab = reinterpret_cast<CsvTable*>(pCursor->pVtab);
+  csv_stop_pipeline(pCur);
+  pCur->ctx.zMem = pTab->map.z;
+  pCur->ctx.zIn = pTab->zContent;
+  pCur->ctx.zInEnd = pTab->map.z + pTab->map.n;
+  pCur->ctx.nLine = pTab->contentLine;
+  pCur->iRowid = 0;
+  pCur->eof = false;
+  if( pTab->nWorker>0 && (size_t)(pCur->ctx.zInEnd - pCur->ctx.zIn)>IMPORT_CHUNK_BYTES ){
+    ImportPipeline *pipe = new ImportPipeline();
+    pipe->pProto = &pCur->ctx;
+    pipe->nCol = pTab->nCol;
+    pipe->iNext = 0;
+    pipe->nConsumed = 0;
+    pipe->nAhead = pTab->nWorker * IMPORT_CHUNKS_PER_WORKER;
+    pipe->abort = false;
+    import_split_chunks(pCur->ctx.zIn, pCur->ctx.zInEnd, pCur->ctx.cRowSep,
+                        IMPORT_CHUNK_BYTES, pipe->chunks);
+    uv_mutex_init(&pipe->mutex);
+    uv_cond_init(&pipe->cond);
+    pCur->pipe = pipe;
+    pCur->iChunk = 0;
+    pCur->iRow = 0;
+    for(int i=0; i<pTab->nWorker && (size_t)i<pipe->chunks.size(); i++){
+      uv_thread_t tid;
+      if( uv_thread_create(&tid, import_worker, pipe)!=0 ) break;
+      pCur->threads.push_back(tid);
+    }
+    if( pCur->threads.empty() ){
+      /* No threads to be had; tokenize each chunk on this thread instead */
+      pipe->nAhead = 0;
+    }
+  }
+  return csv_next(pCursor);
+}
+
+static int csv_eof(sqlite3_vtab_cursor *pCursor){
+  return reinterpret_cast<CsvCursor*>(pCursor)->eof;
+}
+
+static int csv_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *ctx, int i){
+  CsvCursor *pCur = reinterpret_cast<CsvCursor*>(pCursor);
+  CsvTable *pTab = reinterpret_cast<CsvTable*>(pCursor->pVtab);
+  const char *z;
+  int n;
+  if( pCur->aField ){
+    z = pCur->aField[i].z;
+    n = pCur->aField[i].n;
+  }else{
+    ImportRowSink *row = pCur->row;
+    n = row->lengths[i];
+    z = row->offsets[i]<0 ? 0 : n==0 ? "" : &row->text[row->offsets[i]];
+  }
+  if( z==0 ){
+    sqlite3_result_null(ctx);
+    return SQLITE_OK;
+  }
+  /* As ImportBindSink stores them */
+  sqlite3_int64 iValue;
+  double rValue;
+  if( pTab->colTypes[i]==CT_INT && import_parse_int64(z, n, &iValue) ){
+    sqlite3_result_int64(ctx, iValue);
+  }else if( pTab->colTypes[i]==CT_REAL && import_parse_double(z, n, &rValue) ){
+    sqlite3_result_double(ctx, rValue);
+  }else{
+    sqlite3_result_text(ctx, z, n, SQLITE_TRANSIENT);
+  }
+  return SQLITE_OK;
+}
+
+static int csv_rowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid){
+  *pRowid = reinterpret_cast<CsvCursor*>(pCursor)->iRowid;
+  return SQLITE_OK;
+}
+
+static sqlite3_module csvModule = {
+  0,                /* iVersion */
+  csv_connect,      /* xCreate */
+  csv_connect,      /* xConnect */
+  csv_best_index,   /* xBestIndex */
+  csv_disconnect,   /* xDisconnect */
+  csv_disconnect,   /* xDestroy */
+  csv_open,         /* xOpen */
+  csv_close,        /* xClose */
+  csv_filter,       /* xFilter */
+  csv_next,         /* xNext */
+  csv_eof,          /* xEof */
+  csv_column,       /* xColumn */
+  csv_rowid,        /* xRowid */
+  0,                /* xUpdate */
+  0,                /* xBegin */
+  0,                /* xSync */
+  0,                /* xCommit */
+  0,                /* xRollback */
+  0,                /* xFindFunction */
+  0,                /* xRename */
+  0,                /* xSavepoint */
+  0,                /* xRelease */
+  0,                /* xRollbackTo */
+  0                 /* xShadowName */
+};
+
+int sqlite_import_register_csv(sqlite3 *db){
+  return sqlite3_create_module(db, "csv", &csvModule, 0);
+}
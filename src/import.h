@@ -1,8 +1,8 @@
-
 #ifndef NODE_SQLITE3_SRC_IMPORT_H
 #define NODE_SQLITE3_SRC_IMPORT_H
 
 #include <sqlite3.h>
+#include <atomic>
 #include <vector>
 #include <string>
 
@@ -10,13 +10,20 @@ struct ImportOptions {
   std::vector<std::string> columnIds;
   char columnDelimiter;
   bool noHeaderRow;
+  bool parallel;    // memory-map the input and tokenize it on a worker pool
+  int workers;      // tokenizer threads for the parallel engine; 0 picks one per core
+  int sampleRows;   // rows examined per sample to infer column types; 0 for the default
+  int sampleRegions; // evenly spaced points in the file to sample, counting the start
+  bool bulk;        // load-friendly pragmas for the duration of the import
+  int commitRows;   // commit every this many rows; 0 for one transaction (bulk: 1000000)
 
   ImportOptions(std::vector<std::string> const &columnIds_,
     const char columnDelimiter_,
     bool noHeaderRow_
   ) :
   columnIds(columnIds_), columnDelimiter(columnDelimiter_),
-  noHeaderRow(noHeaderRow_) { }
+  noHeaderRow(noHeaderRow_), parallel(false), workers(0),
+  sampleRows(0), sampleRegions(1), bulk(false), commitRows(0) { }
 };
 
 struct ImportResult {
@@ -24,10 +31,39 @@ struct ImportResult {
   std::vector<std::string> columnIds;
   std::vector<std::string> columnTypes;
   unsigned int rowCount;
+  // Milliseconds spent in each phase of the import
+  double metascanMs;
+  double createMs;
+  double loadMs;
+  double commitMs;
 
   ImportResult(std::string const &tableName_, std::vector<std::string> const &columnIds_,
     std::vector<std::string> const &columnTypes_, unsigned int rowCount_) :
-    tableName(tableName_), columnIds(columnIds_), columnTypes(columnTypes_), rowCount(rowCount_) { }
+    tableName(tableName_), columnIds(columnIds_), columnTypes(columnTypes_), rowCount(rowCount_),
+    metascanMs(0), createMs(0), loadMs(0), commitMs(0) { }
+};
+
+// CSV text handed to the importer a piece at a time, e.g. from a stream
+struct ImportSource {
+  virtual ~ImportSource() { }
+  // Copy up to n bytes of input to z, waiting for more if need be.
+  // Returns 0 at the end of the input.  Called on the importing thread.
+  virtual size_t read(char *z, size_t n) = 0;
+};
+
+// Watches over an import from outside
+struct ImportMonitor {
+  // Set from any thread to stop the import; what it loaded is rolled back
+  // and the table it created is dropped.  The import sets it too when it
+  // is stopped by sqlite3_interrupt().
+  std::atomic<bool> cancelled;
+
+  ImportMonitor() : cancelled(false) { }
+  virtual ~ImportMonitor() { }
+  // Told the rows inserted and input bytes consumed so far every few
+  // thousand rows, and once more with done set when the load is over.
+  // Called on the importing thread.
+  virtual void progress(unsigned int rowCount, sqlite3_int64 nBytes, bool done) { }
 };
 
 ImportResult *sqlite_import(
@@ -35,7 +71,38 @@ ImportResult *sqlite_import(
   const char *zFile,      // CSV file to import
   const char *zTable,     // sqlite destination table name
   ImportOptions &options,  // import options
-  std::string &errMsg      // Set in case of error
+  std::string &errMsg,     // Set in case of error
+  ImportMonitor *pMonitor = 0  // Told about progress, if set
 );
 
+// As sqlite_import, reading the nData bytes at zData; zName labels diagnostics
+ImportResult *sqlite_import_memory(
+  sqlite3 *db,
+  const char *zData,
+  size_t nData,
+  const char *zName,
+  const char *zTable,
+  ImportOptions &options,
+  std::string &errMsg,
+  ImportMonitor *pMonitor = 0
+);
+
+// As sqlite_import, reading from pSource until it is exhausted.  The
+// parallel and sampleRegions options do not apply.
+ImportResult *sqlite_import_source(
+  sqlite3 *db,
+  ImportSource *pSource,
+  const char *zName,
+  const char *zTable,
+  ImportOptions &options,
+  std::string &errMsg,
+  ImportMonitor *pMonitor = 0
+);
+
+// Registers the "csv" virtual table module with db, for queries straight
+// over a file: CREATE VIRTUAL TABLE t USING csv(file='data.csv', ...)
+// The module reads whatever file the SQL names, so it is only registered
+// on connections opened with { csvModule: true }.
+int sqlite_import_register_csv(sqlite3 *db);
+
 #endif
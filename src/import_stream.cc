@@ -0,0 +1,241 @@
+#include <string.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <node_version.h>
+
+#include "macros.h"
+#include "database.h"
+#include "import_stream.h"
+
+// Bytes queued but not yet parsed before write() holds back its callback.
+#define IMPORT_STREAM_HIGH_WATER (4 * 1024 * 1024)
+
+using namespace node_sqlite3;
+
+NAN_MODULE_INIT(ImportStream::Init) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    t->SetClassName(Nan::New("ImportStream").ToLocalChecked());
+
+    Nan::SetPrototypeMethod(t, "write", Write);
+    Nan::SetPrototypeMethod(t, "end", End);
+    Nan::SetPrototypeMethod(t, "cancel", Cancel);
+
+    Nan::Set(target, Nan::New("ImportStream").ToLocalChecked(),
+        Nan::GetFunction(t).ToLocalChecked());
+}
+
+NAN_METHOD(ImportStream::New) {
+    if (!info.IsConstructCall()) {
+        return Nan::ThrowTypeError("Use the new operator to create new ImportStream objects");
+    }
+
+    int length = info.Length();
+
+    if (length <= 0 || !Database::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("Database object expected");
+    }
+    else if (length <= 1 || !info[1]->IsString()) {
+        return Nan::ThrowTypeError("Table name expected");
+    }
+    else if (length <= 2 || !info[2]->IsObject()) {
+        return Nan::ThrowTypeError("Options object expected");
+    }
+    else if (length > 3 && !info[3]->IsUndefined() && !info[3]->IsFunction()) {
+        return Nan::ThrowTypeError("Callback expected");
+    }
+
+    Database* db = Nan::ObjectWrap::Unwrap<Database>(info[0].As<Object>());
+    Nan::Utf8String tablename(info[1]);
+
+    ImportOptions importOptions(std::vector<std::string>(), ',', false);
+    Local<Function> progress;
+    if (!Database::ParseImportOptions(info[2].As<Object>(), importOptions, progress)) {
+        return;
+    }
+
+    Local<Function> callback;
+    if (length > 3 && info[3]->IsFunction()) {
+        callback = Local<Function>::Cast(info[3]);
+    }
+
+    ImportStream* stream = new ImportStream(db);
+    stream->Wrap(info.This());
+
+    // The baton holds a reference to the stream until the import is over.
+    Database::ImportBaton* baton =
+        new Database::ImportBaton(db, callback, "<stream>", *tablename, importOptions);
+    baton->stream = stream;
+    baton->progressCallback.Reset(progress);
+    stream->baton = baton;
+    stream->Ref();
+    db->Schedule(Database::Work_BeginImport, baton, true);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(ImportStream::Write) {
+    ImportStream* stream = Nan::ObjectWrap::Unwrap<ImportStream>(info.This());
+
+    if (info.Length() <= 0 || !node::Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("Argument 0 must be a Buffer");
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+
+    Local<Object> buffer = info[0].As<Object>();
+    const char* data = node::Buffer::Data(buffer);
+    size_t size = node::Buffer::Length(buffer);
+
+    bool wait = false;
+    uv_mutex_lock(&stream->mutex);
+    if (!stream->closed && size > 0) {
+        stream->chunks.push_back(std::string(data, size));
+        stream->queued += size;
+        uv_cond_signal(&stream->cond);
+        if (stream->queued >= IMPORT_STREAM_HIGH_WATER && !callback.IsEmpty()) {
+            stream->drain.Reset(callback);
+            stream->drainWaiting = true;
+            wait = true;
+        }
+    }
+    uv_mutex_unlock(&stream->mutex);
+
+    if (!wait && !callback.IsEmpty()) {
+        TRY_CATCH_CALL(stream->handle(), callback, 0, NULL);
+    }
+
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(ImportStream::End) {
+    ImportStream* stream = Nan::ObjectWrap::Unwrap<ImportStream>(info.This());
+
+    uv_mutex_lock(&stream->mutex);
+    stream->ended = true;
+    uv_cond_signal(&stream->cond);
+    uv_mutex_unlock(&stream->mutex);
+
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(ImportStream::Cancel) {
+    ImportStream* stream = Nan::ObjectWrap::Unwrap<ImportStream>(info.This());
+
+    stream->Abandon();
+
+    info.GetReturnValue().Set(info.This());
+}
+
+void ImportStream::Abandon() {
+    if (baton) {
+        baton->cancelled = true;
+    }
+    Close();
+}
+
+void ImportStream::Start(Database::ImportBaton* baton_) {
+    assert(baton == baton_);
+    db->running.insert(this);
+    async = new AsyncEvent(db->loop, this, EventCallback);
+    int status = uv_thread_create(&thread, Work_Import, this);
+    assert(status == 0);
+}
+
+void ImportStream::Work_Import(void* data) {
+    ImportStream* stream = static_cast<ImportStream*>(data);
+    Database::Work_Import(&stream->baton->request);
+
+    // Anything written from now on has nowhere to go.
+    uv_mutex_lock(&stream->mutex);
+    stream->closed = true;
+    stream->chunks.clear();
+    stream->queued = 0;
+    stream->offset = 0;
+    uv_mutex_unlock(&stream->mutex);
+
+    stream->async->send(new Event(Event::DONE));
+}
+
+void ImportStream::Close() {
+    Nan::HandleScope scope;
+
+    uv_mutex_lock(&mutex);
+    closed = true;
+    chunks.clear();
+    queued = 0;
+    offset = 0;
+    drainWaiting = false;
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+
+    // Release a writer still waiting for room.
+    if (!drain.IsEmpty()) {
+        Local<Function> cb = Nan::New(drain);
+        drain.Reset();
+        TRY_CATCH_CALL(handle(), cb, 0, NULL);
+    }
+}
+
+size_t ImportStream::read(char* z, size_t n) {
+    size_t nRead = 0;
+    bool bDrain = false;
+
+    uv_mutex_lock(&mutex);
+    while (chunks.empty() && !ended && !closed) {
+        uv_cond_wait(&cond, &mutex);
+    }
+    while (nRead < n && !chunks.empty()) {
+        std::string& chunk = chunks.front();
+        size_t nCopy = chunk.size() - offset;
+        if (nCopy > n - nRead) nCopy = n - nRead;
+        memcpy(z + nRead, chunk.data() + offset, nCopy);
+        nRead += nCopy;
+        offset += nCopy;
+        if (offset == chunk.size()) {
+            chunks.pop_front();
+            offset = 0;
+        }
+    }
+    queued -= nRead;
+    if (drainWaiting && queued < IMPORT_STREAM_HIGH_WATER) {
+        drainWaiting = false;
+        bDrain = true;
+    }
+    uv_mutex_unlock(&mutex);
+
+    if (bDrain) {
+        async->send(new Event(Event::DRAIN));
+    }
+    return nRead;
+}
+
+void ImportStream::EventCallback(ImportStream* stream, Event* event) {
+    // Note: This function is called in the main V8 thread.
+    Nan::HandleScope scope;
+
+    Event::Type type = event->type;
+    if (type == Event::DRAIN) {
+        if (!stream->drain.IsEmpty()) {
+            Local<Function> cb = Nan::New(stream->drain);
+            stream->drain.Reset();
+            TRY_CATCH_CALL(stream->handle(), cb, 0, NULL);
+        }
+    }
+    delete event;
+
+    if (type == Event::DONE) {
+        uv_thread_join(&stream->thread);
+        AsyncEvent* async = stream->async;
+        stream->async = NULL;
+        async->finish();
+        stream->db->running.erase(stream);
+
+        // Reports the result and drops the baton, which closes the stream.
+        Database::ImportBaton* baton = stream->baton;
+        stream->baton = NULL;
+        Database::Work_AfterImport(&baton->request);
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef NODE_SQLITE3_SRC_IMPORT_STREAM_H
+#define NODE_SQLITE3_SRC_IMPORT_STREAM_H
+
+#include "database.h"
+#include "import.h"
+
+#include <string>
+#include <deque>
+
+#include <sqlite3.h>
+#include <nan.h>
+#include <uv.h>
+
+using namespace v8;
+using namespace node;
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * CSV text pushed from JS into Database#import, so that data arriving
+ * over the network need not go through a temporary file.
+ *
+ * Intended usage from node, through the wrapper in lib/sqlite3.js:
+ *
+ *   var sink = db.createImportStream('table', options, function(err, res) {
+ *       ...
+ *   });
+ *   sink.on('progress', function(p) { ... p.rows, p.bytes ... });
+ *   response.pipe(sink);
+ *
+ * The native object underneath has three methods:
+ *
+ *   - `stream.write(buffer, [callback])` queues a copy of the buffer.
+ *     The callback is called once there is room for more, which is at
+ *     once unless more than IMPORT_STREAM_HIGH_WATER bytes are waiting
+ *     to be parsed.  Node's Writable turns that into backpressure.
+ *   - `stream.end()` marks the end of the input.
+ *   - `stream.cancel()` abandons the import, which rolls back and reports
+ *     SQLITE_INTERRUPT, as Database#interrupt does.
+ *
+ * The import itself runs like any other, exclusively on the database,
+ * but on a thread of its own since it spends its time waiting for JS.
+ * It emits a `progress` event with the rows inserted and bytes parsed so
+ * far every few thousand rows.  Data written after the import has ended,
+ * for instance because the table could not be created, is dropped; the
+ * import callback reports what happened.
+ *
+ */
+class ImportStream : public Nan::ObjectWrap, public ImportSource, public Database::Running {
+public:
+    static NAN_MODULE_INIT(Init);
+    static NAN_METHOD(New);
+    static NAN_METHOD(Write);
+    static NAN_METHOD(End);
+    static NAN_METHOD(Cancel);
+
+    struct Event {
+        enum Type { DRAIN, DONE };
+        Type type;
+        Event(Type type_) : type(type_) {}
+    };
+
+    typedef Async<Event, ImportStream> AsyncEvent;
+
+    ImportStream(Database* db_) : Nan::ObjectWrap(),
+        db(db_),
+        baton(NULL),
+        async(NULL),
+        queued(0),
+        offset(0),
+        ended(false),
+        closed(false),
+        drainWaiting(false) {
+        db->Ref();
+        uv_mutex_init(&mutex);
+        uv_cond_init(&cond);
+    }
+
+    ~ImportStream() {
+        drain.Reset();
+        uv_cond_destroy(&cond);
+        uv_mutex_destroy(&mutex);
+        db->Unref();
+    }
+
+    // Called on the main thread by Database::Work_BeginImport.
+    void Start(Database::ImportBaton* baton);
+    // Called when the import is over, will never run, or is cancelled.
+    void Close();
+    // Database::Running: cancel, as JavaScript can no longer write.
+    void Abandon();
+
+    // ImportSource, called on the import thread.
+    size_t read(char* z, size_t n);
+
+protected:
+    static void Work_Import(void* data);
+    static void EventCallback(ImportStream* stream, Event* event);
+
+    Database* db;
+    Database::ImportBaton* baton;
+    AsyncEvent* async;
+    uv_thread_t thread;
+
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    std::deque<std::string> chunks;
+    size_t queued;           // Bytes in chunks, less offset
+    size_t offset;           // Bytes of chunks.front() already read
+    bool ended;
+    bool closed;
+    bool drainWaiting;       // drain needs calling once below the high water
+    Nan::Persistent<Function> drain;
+};
+
+}
+
+#endif
@@ -134,11 +134,11 @@ const char *sqlite_authorizer_string(int type);
     assert(baton->stmt);                                                                           \
     assert(!baton->stmt->locked);                                                                  \
     assert(!baton->stmt->finalized);                                                               \
-    assert(baton->stmt->prepared);                                                                 \
+    assert(baton->stmt->prepared || baton->stmt->fusing);                                          \
     baton->stmt->locked = true;                                                                    \
     baton->stmt->db->pending++;                                                                    \
-    int status = uv_queue_work(uv_default_loop(),                                                  \
-                               &baton->request,                                                    \
+    baton->started = uv_hrtime();                                                                  \
+    int status = baton->stmt->QueueWork(&baton->request,                                           \
                                Work_##type, reinterpret_cast<uv_after_work_cb>(Work_After##type)); \
     assert(status == 0);
 
@@ -163,8 +163,7 @@ const char *sqlite_authorizer_string(int type);
     assert(baton->backup->inited);                                                                 \
     baton->backup->locked = true;                                                                  \
     baton->backup->db->pending++;                                                                  \
-    int status = uv_queue_work(uv_default_loop(),                                                  \
-                               &baton->request,                                                    \
+    int status = baton->backup->db->QueueWork(&baton->request,                                     \
                                Work_##type, reinterpret_cast<uv_after_work_cb>(Work_After##type)); \
     assert(status == 0);
 
@@ -181,27 +180,29 @@ const char *sqlite_authorizer_string(int type);
     backup->db->Process();       \
     delete baton;
 
-#define DELETE_FIELD(field)                    \
-    if (field != NULL)                         \
-    {                                          \
-        switch ((field)->type)                 \
-        {                                      \
-        case SQLITE_INTEGER:                   \
-            delete (Values::Integer *)(field); \
-            break;                             \
-        case SQLITE_FLOAT:                     \
-            delete (Values::Float *)(field);   \
-            break;                             \
-        case SQLITE_TEXT:                      \
-            delete (Values::Text *)(field);    \
-            break;                             \
-        case SQLITE_BLOB:                      \
-            delete (Values::Blob *)(field);    \
-            break;                             \
-        case SQLITE_NULL:                      \
-            delete (Values::Null *)(field);    \
-            break;                             \
-        }                                      \
-    }
+#define BLOB_BEGIN(type)                                                                           \
+    assert(baton);                                                                                 \
+    assert(baton->blob);                                                                           \
+    assert(!baton->blob->locked);                                                                  \
+    assert(!baton->blob->finished);                                                                \
+    assert(baton->blob->inited);                                                                   \
+    baton->blob->locked = true;                                                                    \
+    baton->blob->db->pending++;                                                                    \
+    int status = baton->blob->db->QueueWork(&baton->request,                                       \
+                               Work_##type, reinterpret_cast<uv_after_work_cb>(Work_After##type)); \
+    assert(status == 0);
+
+#define BLOB_INIT(type)                           \
+    type *baton = static_cast<type *>(req->data); \
+    Blob *blob = baton->blob;
+
+#define BLOB_END()             \
+    assert(blob->locked);      \
+    assert(blob->db->pending); \
+    blob->locked = false;      \
+    blob->db->pending--;       \
+    blob->Process();           \
+    blob->db->Process();       \
+    delete baton;
 
 #endif
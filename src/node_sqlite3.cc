@@ -8,6 +8,9 @@
 #include "database.h"
 #include "statement.h"
 #include "backup.h"
+#include "blob.h"
+#include "import_stream.h"
+#include "export_stream.h"
 
 using namespace node_sqlite3;
 
@@ -19,6 +22,9 @@ NAN_MODULE_INIT(RegisterModule) {
     Database::Init(target);
     Statement::Init(target);
     Backup::Init(target);
+    Blob::Init(target);
+    ImportStream::Init(target);
+    ExportStream::Init(target);
 
     DEFINE_CONSTANT_INTEGER(target, SQLITE_OPEN_READONLY, OPEN_READONLY);
     DEFINE_CONSTANT_INTEGER(target, SQLITE_OPEN_READWRITE, OPEN_READWRITE);
@@ -108,4 +114,4 @@ const char* sqlite_authorizer_string(int type) {
     }
 }
 
-NODE_MODULE(node_sqlite3, RegisterModule)
+NAN_MODULE_WORKER_ENABLED(node_sqlite3, RegisterModule)
@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <node.h>
+
+#include "profiler.h"
+
+using namespace node_sqlite3;
+
+Profiler::Profiler(uv_loop_t* loop, void* parent_, Callback callback_) :
+    parent(parent_),
+    callback(callback_),
+    threshold(0),
+    every(1),
+    seen(0),
+    ring(PROFILE_RING_SIZE),
+    head(0),
+    count(0),
+    names(PROFILE_NAMES_MAX + PROFILE_RING_SIZE),
+    used(0),
+    slots(PROFILE_SLOTS),
+    batch(PROFILE_RING_SIZE),
+    delivered(0) {
+    uv_mutex_init(&mutex);
+    Slot empty = { NULL, 0 };
+    std::fill(slots.begin(), slots.end(), empty);
+    watcher.data = this;
+    uv_async_init(loop, &watcher, Wakeup);
+}
+
+Profiler::~Profiler() {
+    uv_mutex_destroy(&mutex);
+}
+
+void Profiler::Configure(double sampling, double threshold_) {
+    double n = sampling > 0 ? floor(1 / sampling + 0.5) : 1;
+    every.store(n < 1 ? 1 : static_cast<unsigned int>(n), std::memory_order_relaxed);
+    threshold.store(static_cast<sqlite3_int64>(threshold_ * 1e6), std::memory_order_relaxed);
+}
+
+void Profiler::Record(sqlite3_stmt* stmt, sqlite3_int64 nsecs) {
+    if (nsecs < threshold.load(std::memory_order_relaxed)) return;
+    unsigned int n = every.load(std::memory_order_relaxed);
+    if (n > 1 && seen.fetch_add(1, std::memory_order_relaxed) % n != 0) return;
+
+    uv_mutex_lock(&mutex);
+    if (count == ring.size()) {
+        uv_mutex_unlock(&mutex);
+        return;
+    }
+    Event& event = ring[(head + count) % ring.size()];
+    event.name = Name(stmt);
+    event.nsecs = nsecs;
+    // The main thread empties the ring each time it wakes, so it only
+    // needs waking for the first event after that.
+    bool wake = count++ == 0;
+    uv_mutex_unlock(&mutex);
+
+    if (wake) uv_async_send(&watcher);
+}
+
+size_t Profiler::Name(sqlite3_stmt* stmt) {
+    const char* sql = sqlite3_sql(stmt);
+    if (sql == NULL) sql = "";
+
+    size_t i = (reinterpret_cast<uintptr_t>(stmt) >> 4) & (PROFILE_SLOTS - 1);
+    while (slots[i].stmt != NULL && slots[i].stmt != stmt) {
+        i = (i + 1) & (PROFILE_SLOTS - 1);
+    }
+    // A statement's address can be reused by another once it is finalized,
+    // so the SQL is checked too.
+    if (slots[i].stmt == stmt && names[slots[i].name] == sql) {
+        return slots[i].name;
+    }
+    assert(used < names.size());
+    names[used].assign(sql);
+    slots[i].stmt = stmt;
+    slots[i].name = used;
+    return used++;
+}
+
+void Profiler::Deliver() {
+    uv_mutex_lock(&mutex);
+    for (delivered = 0; delivered < count; delivered++) {
+        const Event& event = ring[(head + delivered) % ring.size()];
+        batch[delivered].sql.assign(names[event.name]);
+        batch[delivered].nsecs = event.nsecs;
+    }
+    head = (head + count) % ring.size();
+    count = 0;
+    // With the ring empty, no event refers to the names.
+    if (used >= PROFILE_NAMES_MAX) {
+        Slot empty = { NULL, 0 };
+        std::fill(slots.begin(), slots.end(), empty);
+        used = 0;
+    }
+    uv_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < delivered; i++) {
+        callback(parent, batch[i].sql, batch[i].nsecs);
+    }
+}
+
+void Profiler::Wakeup(uv_async_t* handle) {
+    static_cast<Profiler*>(handle->data)->Deliver();
+}
+
+void Profiler::Stop() {
+    // Deliver the events recorded since the last wakeup.
+    Deliver();
+    uv_close(reinterpret_cast<uv_handle_t*>(&watcher), Closed);
+}
+
+void Profiler::Discard() {
+    uv_close(reinterpret_cast<uv_handle_t*>(&watcher), Closed);
+}
+
+void Profiler::Closed(uv_handle_t* handle) {
+    delete static_cast<Profiler*>(handle->data);
+}
@@ -0,0 +1,108 @@
+#ifndef NODE_SQLITE3_SRC_PROFILER_H
+#define NODE_SQLITE3_SRC_PROFILER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+// Events the ring holds before more are dropped, and the statements whose
+// SQL is kept before the names start over.  As the names only start over
+// when the ring is emptied, and each event adds one at most, there are
+// never more than PROFILE_NAMES_MAX + PROFILE_RING_SIZE.
+#define PROFILE_RING_SIZE 4096
+#define PROFILE_NAMES_MAX 4096
+// Slots in the table from statements to names: a power of two, at least
+// twice as many as there can be names.
+#define PROFILE_SLOTS 16384
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Collects the SQLITE_TRACE_PROFILE events of a Database's connections
+ * for the 'profile' event.  An event goes into a ring of PROFILE_RING_SIZE
+ * entries, and names its statement by an index into a table of SQL text
+ * that is only added to the first time a statement is seen.  The table
+ * and the ring are allocated up front and their strings reused, so once
+ * warm, recording an event only allocates for SQL longer than any its entry
+ * in the table held before.  The main thread is woken once for all the
+ * events recorded since it last looked, copies their SQL out as it takes
+ * them in one go, and starts the names over once there are too many.
+ *
+ * Events that run for less than the threshold are not recorded, and of
+ * the rest, one in every 1 / sampling is.  When the ring is full, events
+ * are dropped.
+ *
+ */
+class Profiler {
+public:
+    // Called on the main thread for each event.
+    typedef void (*Callback)(void* parent, const std::string& sql, sqlite3_int64 nsecs);
+
+    Profiler(uv_loop_t* loop, void* parent, Callback callback);
+
+    // sampling is the fraction of events recorded, and threshold the
+    // milliseconds an event must run for to be considered.
+    void Configure(double sampling, double threshold);
+    // Called on any thread that steps a statement.
+    void Record(sqlite3_stmt* stmt, sqlite3_int64 nsecs);
+    // Deliver what is left, and free this once the uv_async_t is closed.
+    void Stop();
+    // As Stop, dropping what is left, for when JavaScript can no longer run.
+    void Discard();
+
+protected:
+    struct Event {
+        size_t name; // Into names
+        sqlite3_int64 nsecs;
+    };
+
+    struct Delivery {
+        std::string sql;
+        sqlite3_int64 nsecs;
+    };
+
+    // A statement seen since the names started over, or stmt NULL.
+    struct Slot {
+        sqlite3_stmt* stmt;
+        size_t name;
+    };
+
+    ~Profiler();
+
+    // The index of stmt's SQL in names.  Called with mutex held.
+    size_t Name(sqlite3_stmt* stmt);
+    void Deliver();
+
+    static void Wakeup(uv_async_t* handle);
+    static void Closed(uv_handle_t* handle);
+
+    void* parent;
+    Callback callback;
+    uv_async_t watcher;
+
+    std::atomic<sqlite3_int64> threshold; // In nanoseconds
+    std::atomic<unsigned int> every;
+    std::atomic<unsigned int> seen;
+
+    uv_mutex_t mutex;
+    std::vector<Event> ring;
+    size_t head;
+    size_t count;
+    // The first used of names are in use, and slots index them by
+    // statement, with linear probing.
+    std::vector<std::string> names;
+    size_t used;
+    std::vector<Slot> slots;
+
+    // Main thread only; the first delivered are the batch being delivered.
+    std::vector<Delivery> batch;
+    size_t delivered;
+};
+
+}
+
+#endif
@@ -1,4 +1,7 @@
 #include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <set>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_version.h>
@@ -9,8 +12,6 @@
 
 using namespace node_sqlite3;
 
-Nan::Persistent<FunctionTemplate> Statement::constructor_template;
-
 NAN_MODULE_INIT(Statement::Init) {
     Nan::HandleScope scope;
 
@@ -22,16 +23,31 @@ NAN_MODULE_INIT(Statement::Init) {
     Nan::SetPrototypeMethod(t, "bind", Bind);
     Nan::SetPrototypeMethod(t, "get", Get);
     Nan::SetPrototypeMethod(t, "run", Run);
+    Nan::SetPrototypeMethod(t, "runBatch", RunBatch);
     Nan::SetPrototypeMethod(t, "all", All);
     Nan::SetPrototypeMethod(t, "each", Each);
+    Nan::SetPrototypeMethod(t, "eachBatch", EachBatch);
+    Nan::SetPrototypeMethod(t, "fetch", Fetch);
     Nan::SetPrototypeMethod(t, "reset", Reset);
     Nan::SetPrototypeMethod(t, "finalize", Finalize);
+    Nan::SetPrototypeMethod(t, "setRowMode", SetRowMode);
+    Nan::SetPrototypeMethod(t, "stats", Stats);
+
+    NODE_SET_GETTER(t, "columns", ColumnsGetter);
 
-    constructor_template.Reset(t);
     Nan::Set(target, Nan::New("Statement").ToLocalChecked(),
         Nan::GetFunction(t).ToLocalChecked());
 }
 
+// Blobs, and ASCII text, of this many bytes or more are handed to JS without
+// copying them again.  Smaller values are cheaper to copy than to track.
+#define EXTERNAL_VALUE_BYTES 4096
+
+// Columnar results are only for all(); everything else gets arrays instead.
+static inline Statement::RowMode ArrayMode(Statement::RowMode mode) {
+    return mode == Statement::ROW_MODE_COLUMNAR ? Statement::ROW_MODE_ARRAY : mode;
+}
+
 void Statement::Process() {
     if (finalized && !queue.empty()) {
         return CleanQueue();
@@ -51,6 +67,10 @@ void Statement::Schedule(Work_Callback callback, Baton* baton) {
         queue.push(new Call(callback, baton));
         CleanQueue();
     }
+    else if (deferring) {
+        queue.push(new Call(callback, baton));
+        SchedulePrepare();
+    }
     else if (!prepared || locked) {
         queue.push(new Call(callback, baton));
     }
@@ -79,7 +99,7 @@ template <class T> void Statement::Error(T* baton) {
     }
 }
 
-// { Database db, String sql, Array params, Function callback }
+// { Database db, String sql, Function callback, Boolean cached }
 NAN_METHOD(Statement::New) {
     if (!info.IsConstructCall()) {
         return Nan::ThrowTypeError("Use the new operator to create new Statement objects");
@@ -105,24 +125,190 @@ NAN_METHOD(Statement::New) {
     Statement* stmt = new Statement(db);
     stmt->Wrap(info.This());
 
-    PrepareBaton* baton = new PrepareBaton(db, Local<Function>::Cast(info[2]), stmt);
-    baton->sql = std::string(*Nan::Utf8String(sql));
-    db->Schedule(Work_BeginPrepare, baton);
+    if (length > 3 && Nan::To<bool>(info[3]).FromJust()) {
+        // Wait for the call to make, so that it can be fused with preparing.
+        stmt->cached = true;
+        stmt->sql = std::string(*Nan::Utf8String(sql));
+        stmt->deferred.Reset(Local<Function>::Cast(info[2]));
+        stmt->deferring = true;
+    }
+    else {
+        PrepareBaton* baton = new PrepareBaton(db, Local<Function>::Cast(info[2]), stmt);
+        baton->sql = std::string(*Nan::Utf8String(sql));
+        db->Schedule(Work_BeginPrepare, baton);
+    }
 
     info.GetReturnValue().Set(info.This());
 }
 
+// Schedules preparing a statement that was waiting for its first call.
+void Statement::SchedulePrepare() {
+    Nan::HandleScope scope;
+
+    deferring = false;
+    PrepareBaton* baton = new PrepareBaton(db, Nan::New(deferred), this);
+    deferred.Reset();
+    baton->sql = sql;
+    db->Schedule(Work_BeginPrepare, baton);
+}
+
+// The calls that can run on the same thread right after preparing.  Each
+// is left out, as it reports rows as it goes.
+static bool IsFusable(Statement::Work_Callback callback) {
+    return callback == Statement::Work_BeginBind ||
+        callback == Statement::Work_BeginGet ||
+        callback == Statement::Work_BeginRun ||
+        callback == Statement::Work_BeginRunBatch ||
+        callback == Statement::Work_BeginAll ||
+        callback == Statement::Work_BeginFetch ||
+        callback == Statement::Work_BeginReset;
+}
+
 void Statement::Work_BeginPrepare(Database::Baton* baton) {
     assert(baton->db->open);
     baton->db->pending++;
-    int status = uv_queue_work(uv_default_loop(),
-        &baton->request, Work_Prepare, (uv_after_work_cb)Work_AfterPrepare);
+
+    PrepareBaton* prepare = static_cast<PrepareBaton*>(baton);
+    Statement* stmt = prepare->stmt;
+    stmt->schema = baton->db->schemaChanges.load();
+    if (stmt->cached && baton->db->TakeCachedStatement(stmt->sql, &stmt->_handle, &stmt->reader)) {
+        // Already prepared: there is nothing to do on another thread.
+        stmt->status = SQLITE_OK;
+        stmt->ResetStatus();
+        Work_AfterPrepare(&baton->request);
+        return;
+    }
+
+    // A one-off statement from Database#get and the like has its call
+    // queued by now.  Start that call too, capturing the work it queues, so
+    // that it runs on the same trip to the thread as preparing does.
+    if (stmt->cached && !stmt->queue.empty() && IsFusable(stmt->queue.front()->callback)) {
+        Call* call = stmt->queue.front();
+        stmt->queue.pop();
+        stmt->locked = false;
+        stmt->fusing = prepare;
+        call->callback(call->baton);
+        stmt->fusing = NULL;
+        delete call;
+    }
+
+    int status = baton->db->QueueWork(&baton->request,
+                                      Work_Prepare, (uv_after_work_cb)Work_AfterPrepare);
     assert(status == 0);
 }
 
+// Whether sql is a query, which is worth trying on a reader.  Transaction
+// control, ATTACH and many PRAGMAs also count as read-only to SQLite, but
+// must run on the database's own connection.
+static bool IsQuery(const std::string& sql) {
+    static const char* const keywords[] = { "SELECT", "WITH", "VALUES" };
+    size_t start = 0;
+    while (start < sql.size() && isspace((unsigned char)sql[start])) start++;
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        size_t length = strlen(keywords[i]);
+        if (sql.size() - start > length &&
+                sqlite3_strnicmp(sql.c_str() + start, keywords[i], length) == 0 &&
+                !isalnum((unsigned char)sql[start + length]) && sql[start + length] != '_') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Queries go to a reader while the database is outside a transaction, so
+// that they would see no more on it than a reader does.  Anything a reader
+// cannot prepare, such as a query on a TEMP table, falls back to the
+// database's own connection.
+bool Statement::PrepareOnReader(PrepareBaton* baton) {
+    Statement* stmt = baton->stmt;
+    if (baton->db->readers.empty() || !sqlite3_get_autocommit(baton->db->_handle) ||
+            !IsQuery(baton->sql)) {
+        return false;
+    }
+
+    stmt->reader = baton->db->AcquireReader();
+    stmt->status = sqlite3_prepare_v2(
+        stmt->reader->handle,
+        baton->sql.c_str(),
+        baton->sql.size(),
+        &stmt->_handle,
+        NULL
+    );
+    if (stmt->status == SQLITE_OK && stmt->_handle &&
+            sqlite3_stmt_readonly(stmt->_handle)) {
+        return true;
+    }
+    sqlite3_finalize(stmt->_handle);
+    stmt->_handle = NULL;
+    stmt->reader->statements--;
+    stmt->reader = NULL;
+    return false;
+}
+
+// Prepares a statement on a reader again on the database's connection, with
+// the parameters it has bound, then runs the call it was queued for.  If
+// that fails, the statement stays where it is.
+void Statement::Work_LeaveReader(uv_work_t* req) {
+    STATEMENT_INIT(Baton);
+
+    sqlite3_stmt* handle = NULL;
+    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->db->_handle);
+    sqlite3_mutex_enter(mtx);
+    int status = sqlite3_prepare_v2(stmt->db->_handle, sqlite3_sql(stmt->_handle), -1, &handle, NULL);
+    sqlite3_mutex_leave(mtx);
+
+    if (status == SQLITE_OK && handle) {
+        sqlite3_finalize(stmt->_handle);
+        stmt->_handle = handle;
+        stmt->reader->statements--;
+        stmt->reader = NULL;
+        stmt->Bind(stmt->bound, 0, stmt->bound.size());
+        stmt->ResetStatus();
+    }
+    else {
+        sqlite3_finalize(handle);
+    }
+
+    Work_Call(req);
+}
+
+// Runs the call's work, tells the change feed if it failed, then takes the
+// memory the statement uses, which needs the connection's mutex, while on
+// a thread that can wait for it.
+void Statement::Work_Call(uv_work_t* req) {
+    STATEMENT_INIT(Baton);
+
+    // The rows of a statement that fails are rolled back, so the change
+    // feed drops them too.
+    bool main = stmt->_handle && stmt->Connection() == stmt->db->_handle;
+    uint64_t before = main ? stmt->db->ChangeMark() : 0;
+    baton->work(req);
+    if (main && stmt->status != SQLITE_OK && stmt->status != SQLITE_ROW &&
+            stmt->status != SQLITE_DONE) {
+        stmt->db->ChangeFailed(stmt->_handle, before);
+    }
+#if SQLITE_VERSION_NUMBER >= 3020000
+    if (stmt->_handle) {
+        stmt->memoryUsed = sqlite3_stmt_status(stmt->_handle, SQLITE_STMTSTATUS_MEMUSED, 0);
+    }
+#endif
+}
+
 void Statement::Work_Prepare(uv_work_t* req) {
     STATEMENT_INIT(PrepareBaton);
 
+    if (!PrepareOnReader(baton)) {
+        Prepare(baton);
+    }
+
+    if (stmt->status == SQLITE_OK && baton->fused.request) {
+        baton->fused.work(baton->fused.request);
+    }
+}
+
+void Statement::Prepare(PrepareBaton* baton) {
+    Statement* stmt = baton->stmt;
+
     // In case preparing fails, we use a mutex to make sure we get the associated
     // error message.
     sqlite3_mutex* mtx = sqlite3_db_mutex(baton->db->_handle);
@@ -149,8 +335,17 @@ void Statement::Work_AfterPrepare(uv_work_t* req) {
 
     STATEMENT_INIT(PrepareBaton);
 
+    uv_work_t* fused = baton->fused.request;
+    uv_after_work_cb after = baton->fused.after;
+
     if (stmt->status != SQLITE_OK) {
         Error(baton);
+        if (fused) {
+            // Dropped without a word, like the calls still queued.
+            stmt->db->pending--;
+            delete static_cast<Baton*>(fused->data);
+            fused = NULL;
+        }
         stmt->Finalize();
     }
     else {
@@ -162,36 +357,52 @@ void Statement::Work_AfterPrepare(uv_work_t* req) {
         }
     }
 
+    if (fused) {
+        // The statement stays locked until the fused call is done.
+        stmt->db->pending--;
+        delete baton;
+        after(fused);
+        return;
+    }
+
     STATEMENT_END();
 }
 
-template <class T> Values::Field*
-                   Statement::BindParameter(const Local<Value> source, T pos) {
+void Statement::AddParameter(const Local<Value> source, Parameters& parameters, int index,
+                             const char* name, size_t nameLength) {
     if (source->IsString() || source->IsRegExp()) {
         Nan::Utf8String val(source);
-        return new Values::Text(pos, val.length(), *val);
+        Parameters::Value& value = parameters.Add(SQLITE_TEXT, index, name, nameLength);
+        value.length = val.length();
+        value.offset = parameters.Append(*val, val.length());
     }
     else if (source->IsInt32()) {
-        return new Values::Integer(pos, Nan::To<int32_t>(source).FromJust());
+        parameters.Add(SQLITE_INTEGER, index, name, nameLength).integer =
+            Nan::To<int32_t>(source).FromJust();
     }
     else if (source->IsNumber()) {
-        return new Values::Float(pos, Nan::To<double>(source).FromJust());
+        parameters.Add(SQLITE_FLOAT, index, name, nameLength).number =
+            Nan::To<double>(source).FromJust();
     }
     else if (source->IsBoolean()) {
-        return new Values::Integer(pos, Nan::To<bool>(source).FromJust() ? 1 : 0);
+        parameters.Add(SQLITE_INTEGER, index, name, nameLength).integer =
+            Nan::To<bool>(source).FromJust() ? 1 : 0;
     }
     else if (source->IsNull()) {
-        return new Values::Null(pos);
+        parameters.Add(SQLITE_NULL, index, name, nameLength);
     }
     else if (Buffer::HasInstance(source)) {
         Local<Object> buffer = Nan::To<Object>(source).ToLocalChecked();
-        return new Values::Blob(pos, Buffer::Length(buffer), Buffer::Data(buffer));
+        Parameters::Value& value = parameters.Add(SQLITE_BLOB, index, name, nameLength);
+        value.length = Buffer::Length(buffer);
+        value.offset = parameters.Append(Buffer::Data(buffer), value.length);
     }
     else if (source->IsDate()) {
-        return new Values::Float(pos, Nan::To<double>(source).FromJust());
+        parameters.Add(SQLITE_FLOAT, index, name, nameLength).number =
+            Nan::To<double>(source).FromJust();
     }
     else {
-        return NULL;
+        parameters.Add(0, index, name, nameLength);
     }
 }
 
@@ -208,103 +419,154 @@ template <class T> T* Statement::Bind(Nan::NAN_METHOD_ARGS_TYPE info, int start,
     T* baton = new T(this, callback);
 
     if (start < last) {
-        if (info[start]->IsArray()) {
-            Local<Array> array = Local<Array>::Cast(info[start]);
-            int length = array->Length();
-            // Note: bind parameters start with 1.
-            for (int i = 0, pos = 1; i < length; i++, pos++) {
-                baton->parameters.push_back(BindParameter(Nan::Get(array, i).ToLocalChecked(), pos));
-            }
-        }
-        else if (!info[start]->IsObject() || info[start]->IsRegExp() || info[start]->IsDate() || Buffer::HasInstance(info[start])) {
+        if (!info[start]->IsArray() && (!info[start]->IsObject() || info[start]->IsRegExp() ||
+                info[start]->IsDate() || Buffer::HasInstance(info[start]))) {
             // Parameters directly in array.
             // Note: bind parameters start with 1.
             for (int i = start, pos = 1; i < last; i++, pos++) {
-                baton->parameters.push_back(BindParameter(info[i], pos));
-            }
-        }
-        else if (info[start]->IsObject()) {
-            Local<Object> object = Local<Object>::Cast(info[start]);
-            Local<Array> array = Nan::GetPropertyNames(object).ToLocalChecked();
-            int length = array->Length();
-            for (int i = 0; i < length; i++) {
-                Local<Value> name = Nan::Get(array, i).ToLocalChecked();
-
-                if (name->IsInt32()) {
-                    baton->parameters.push_back(
-                        BindParameter(Nan::Get(object, name).ToLocalChecked(), Nan::To<int32_t>(name).FromJust()));
-                }
-                else {
-                    baton->parameters.push_back(BindParameter(Nan::Get(object, name).ToLocalChecked(),
-                        *Nan::Utf8String(name)));
-                }
+                AddParameter(info[i], baton->parameters, pos);
             }
         }
         else {
-            return NULL;
+            AddParameters(info[start], baton->parameters);
         }
     }
 
     return baton;
 }
 
-bool Statement::Bind(const Parameters & parameters) {
+// Adds the parameters in an array, the named parameters in an object, or a
+// single value as the first parameter.
+void Statement::AddParameters(Local<Value> source, Parameters& parameters) {
+    if (source->IsArray()) {
+        Local<Array> array = Local<Array>::Cast(source);
+        int length = array->Length();
+        // Note: bind parameters start with 1.
+        for (int i = 0, pos = 1; i < length; i++, pos++) {
+            AddParameter(Nan::Get(array, i).ToLocalChecked(), parameters, pos);
+        }
+    }
+    else if (!source->IsObject() || source->IsRegExp() || source->IsDate() || Buffer::HasInstance(source)) {
+        AddParameter(source, parameters, 1);
+    }
+    else {
+        Local<Object> object = Local<Object>::Cast(source);
+        Local<Array> array = Nan::GetPropertyNames(object).ToLocalChecked();
+        int length = array->Length();
+        for (int i = 0; i < length; i++) {
+            Local<Value> name = Nan::Get(array, i).ToLocalChecked();
+
+            if (name->IsInt32()) {
+                AddParameter(Nan::Get(object, name).ToLocalChecked(), parameters,
+                    Nan::To<int32_t>(name).FromJust());
+            }
+            else {
+                Nan::Utf8String key(name);
+                AddParameter(Nan::Get(object, name).ToLocalChecked(), parameters, 0,
+                    *key, key.length());
+            }
+        }
+    }
+}
+
+// Binds a new set of parameters, which the statement then keeps.  The set
+// it had goes back to the caller, to be recycled.
+bool Statement::Bind(Parameters& parameters) {
     if (parameters.size() == 0) {
         return true;
     }
 
     sqlite3_reset(_handle);
     sqlite3_clear_bindings(_handle);
+    bound.Swap(parameters);
 
-    Parameters::const_iterator it = parameters.begin();
-    Parameters::const_iterator end = parameters.end();
+    return Bind(bound, 0, bound.size());
+}
 
-    for (; it < end; ++it) {
-        Values::Field* field = *it;
+// Binds the values from begin to end of a set that outlives the bindings.
+bool Statement::Bind(const Parameters& parameters, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        const Parameters::Value& value = parameters.values[i];
+        if (value.type == 0) {
+            continue;
+        }
 
-        if (field != NULL) {
-            int pos;
-            if (field->index > 0) {
-                pos = field->index;
-            }
-            else {
-                pos = sqlite3_bind_parameter_index(_handle, field->name.c_str());
-            }
+        int pos = value.index;
+        if (pos == 0) {
+            pos = ParameterIndex(parameters.Data(value.name), value.nameLength);
+        }
 
-            switch (field->type) {
-                case SQLITE_INTEGER: {
-                    status = sqlite3_bind_int(_handle, pos,
-                        ((Values::Integer*)field)->value);
-                } break;
-                case SQLITE_FLOAT: {
-                    status = sqlite3_bind_double(_handle, pos,
-                        ((Values::Float*)field)->value);
-                } break;
-                case SQLITE_TEXT: {
-                    status = sqlite3_bind_text(_handle, pos,
-                        ((Values::Text*)field)->value.c_str(),
-                        ((Values::Text*)field)->value.size(), SQLITE_TRANSIENT);
-                } break;
-                case SQLITE_BLOB: {
+        switch (value.type) {
+            case SQLITE_INTEGER: {
+                status = sqlite3_bind_int64(_handle, pos, value.integer);
+            } break;
+            case SQLITE_FLOAT: {
+                status = sqlite3_bind_double(_handle, pos, value.number);
+            } break;
+            case SQLITE_TEXT: {
+                status = sqlite3_bind_text(_handle, pos,
+                    value.length ? parameters.Data(value.offset) : "",
+                    value.length, SQLITE_STATIC);
+            } break;
+            case SQLITE_BLOB: {
+                if (value.length) {
                     status = sqlite3_bind_blob(_handle, pos,
-                        ((Values::Blob*)field)->value,
-                        ((Values::Blob*)field)->length, SQLITE_TRANSIENT);
-                } break;
-                case SQLITE_NULL: {
-                    status = sqlite3_bind_null(_handle, pos);
-                } break;
-            }
+                        parameters.Data(value.offset), value.length, SQLITE_STATIC);
+                }
+                else {
+                    status = sqlite3_bind_zeroblob(_handle, pos, 0);
+                }
+            } break;
+            case SQLITE_NULL: {
+                status = sqlite3_bind_null(_handle, pos);
+            } break;
+        }
 
-            if (status != SQLITE_OK) {
-                message = std::string(sqlite3_errmsg(db->_handle));
-                return false;
-            }
+        if (status != SQLITE_OK) {
+            message = std::string(sqlite3_errmsg(Connection()));
+            return false;
         }
     }
 
     return true;
 }
 
+// The position of a named parameter, or 0 if there is none with the name.
+int Statement::ParameterIndex(const char* name, size_t length) {
+    if (!namesIndexed) {
+        int count = sqlite3_bind_parameter_count(_handle);
+        for (int i = 1; i <= count; i++) {
+            const char* parameter = sqlite3_bind_parameter_name(_handle, i);
+            if (parameter) {
+                parameterNames.push_back(std::make_pair(std::string(parameter), i));
+            }
+        }
+        std::sort(parameterNames.begin(), parameterNames.end());
+        namesIndexed = true;
+    }
+
+    // Compared in place, as the name is not NUL-terminated.
+    std::vector<std::pair<std::string, int> >::const_iterator it = std::lower_bound(
+        parameterNames.begin(), parameterNames.end(), name,
+        [length](const std::pair<std::string, int>& entry, const char* key) {
+            return entry.first.compare(0, std::string::npos, key, length) < 0;
+        });
+    if (it == parameterNames.end() ||
+            it->first.compare(0, std::string::npos, name, length) != 0) {
+        return 0;
+    }
+    return it->second;
+}
+
+// Keeps the larger of a finished call's buffers and the spare ones.
+void Statement::RecycleParameters(Parameters& parameters) {
+    if (parameters.values.capacity() > spare.values.capacity() ||
+            parameters.bytes.capacity() > spare.bytes.capacity()) {
+        parameters.Clear();
+        spare.Swap(parameters);
+    }
+}
+
 NAN_METHOD(Statement::Bind) {
     Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
 
@@ -325,7 +587,7 @@ void Statement::Work_BeginBind(Baton* baton) {
 void Statement::Work_Bind(uv_work_t* req) {
     STATEMENT_INIT(Baton);
 
-    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->db->_handle);
+    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->Connection());
     sqlite3_mutex_enter(mtx);
     stmt->Bind(baton->parameters);
     sqlite3_mutex_leave(mtx);
@@ -335,6 +597,7 @@ void Statement::Work_AfterBind(uv_work_t* req) {
     Nan::HandleScope scope;
 
     STATEMENT_INIT(Baton);
+    stmt->Completed(baton);
 
     if (stmt->status != SQLITE_OK) {
         Error(baton);
@@ -374,14 +637,14 @@ void Statement::Work_Get(uv_work_t* req) {
     STATEMENT_INIT(RowBaton);
 
     if (stmt->status != SQLITE_DONE || baton->parameters.size()) {
-        sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->db->_handle);
+        sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->Connection());
         sqlite3_mutex_enter(mtx);
 
         if (stmt->Bind(baton->parameters)) {
             stmt->status = sqlite3_step(stmt->_handle);
 
             if (!(stmt->status == SQLITE_ROW || stmt->status == SQLITE_DONE)) {
-                stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+                stmt->message = std::string(sqlite3_errmsg(stmt->Connection()));
             }
         }
 
@@ -389,7 +652,7 @@ void Statement::Work_Get(uv_work_t* req) {
 
         if (stmt->status == SQLITE_ROW) {
             // Acquire one result row before returning.
-            GetRow(&baton->row, stmt->_handle);
+            baton->row.Add(stmt->_handle);
         }
     }
 }
@@ -398,6 +661,7 @@ void Statement::Work_AfterGet(uv_work_t* req) {
     Nan::HandleScope scope;
 
     STATEMENT_INIT(RowBaton);
+    stmt->Completed(baton);
 
     if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
         Error(baton);
@@ -408,7 +672,9 @@ void Statement::Work_AfterGet(uv_work_t* req) {
         if (!cb.IsEmpty() && cb->IsFunction()) {
             if (stmt->status == SQLITE_ROW) {
                 // Create the result array from the data we acquired.
-                Local<Value> argv[] = { Nan::Null(), RowToJS(&baton->row) };
+                RowShape shape;
+                stmt->GetRowShape(baton->row, shape);
+                Local<Value> argv[] = { Nan::Null(), RowToJS(baton->row, 0, shape, baton->rowMode) };
                 TRY_CATCH_CALL(stmt->handle(), cb, 2, argv);
             }
             else {
@@ -441,7 +707,7 @@ void Statement::Work_BeginRun(Baton* baton) {
 void Statement::Work_Run(uv_work_t* req) {
     STATEMENT_INIT(RunBaton);
 
-    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->db->_handle);
+    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->Connection());
     sqlite3_mutex_enter(mtx);
 
     // Make sure that we also reset when there are no parameters.
@@ -453,11 +719,11 @@ void Statement::Work_Run(uv_work_t* req) {
         stmt->status = sqlite3_step(stmt->_handle);
 
         if (!(stmt->status == SQLITE_ROW || stmt->status == SQLITE_DONE)) {
-            stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+            stmt->message = std::string(sqlite3_errmsg(stmt->Connection()));
         }
         else {
-            baton->inserted_id = sqlite3_last_insert_rowid(stmt->db->_handle);
-            baton->changes = sqlite3_changes(stmt->db->_handle);
+            baton->inserted_id = sqlite3_last_insert_rowid(stmt->Connection());
+            baton->changes = sqlite3_changes(stmt->Connection());
         }
     }
 
@@ -468,6 +734,7 @@ void Statement::Work_AfterRun(uv_work_t* req) {
     Nan::HandleScope scope;
 
     STATEMENT_INIT(RunBaton);
+    stmt->Completed(baton);
 
     if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
         Error(baton);
@@ -487,6 +754,178 @@ void Statement::Work_AfterRun(uv_work_t* req) {
     STATEMENT_END();
 }
 
+NAN_METHOD(Statement::RunBatch) {
+    Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
+
+    if (info.Length() <= 0 || !info[0]->IsArray()) {
+        return Nan::ThrowTypeError("Array of parameter sets expected");
+    }
+    Local<Array> sets = Local<Array>::Cast(info[0]);
+
+    int last = info.Length();
+    Local<Function> callback;
+    if (last > 1 && info[last - 1]->IsFunction()) {
+        callback = Local<Function>::Cast(info[--last]);
+    }
+
+    bool transaction = true;
+    if (last > 1 && !info[1]->IsUndefined()) {
+        if (!info[1]->IsObject()) {
+            return Nan::ThrowTypeError("Options object expected");
+        }
+        Local<Object> options = info[1].As<Object>();
+        Local<String> key = Nan::New("transaction").ToLocalChecked();
+        if (Nan::Has(options, key).FromJust()) {
+            Local<Value> value = Nan::Get(options, key).ToLocalChecked();
+            if (!value->IsBoolean()) {
+                return Nan::ThrowTypeError("options.transaction must be a boolean");
+            }
+            transaction = Nan::To<bool>(value).FromJust();
+        }
+    }
+
+    RunBatchBaton* baton = new RunBatchBaton(stmt, callback);
+    baton->transaction = transaction;
+    baton->sets.reserve(sets->Length());
+    for (uint32_t i = 0; i < sets->Length(); i++) {
+        baton->sets.push_back(baton->parameters.size());
+        stmt->AddParameters(Nan::Get(sets, i).ToLocalChecked(), baton->parameters);
+    }
+
+    stmt->Schedule(Work_BeginRunBatch, baton);
+    info.GetReturnValue().Set(info.This());
+}
+
+void Statement::Work_BeginRunBatch(Baton* baton) {
+    STATEMENT_BEGIN(RunBatch);
+}
+
+void Statement::Work_RunBatch(uv_work_t* req) {
+    STATEMENT_INIT(RunBatchBaton);
+
+    sqlite3* db = stmt->Connection();
+    sqlite3_mutex* mtx = sqlite3_db_mutex(db);
+    sqlite3_mutex_enter(mtx);
+
+    // Outside a transaction, the batch is one of its own, so that a batch
+    // that fails ends in a ROLLBACK, which the rollback hook sees, rather
+    // than a RELEASE, which commits.  Inside one, it is a savepoint.
+    bool own = baton->transaction && sqlite3_get_autocommit(db);
+    if (baton->transaction) {
+        stmt->status = sqlite3_exec(db, own ? "BEGIN" : "SAVEPOINT node_sqlite3_batch",
+            NULL, NULL, NULL);
+        if (stmt->status != SQLITE_OK) {
+            stmt->message = std::string(sqlite3_errmsg(db));
+            sqlite3_mutex_leave(mtx);
+            return;
+        }
+    }
+
+    // The statement keeps every set, as text and blobs are bound from them.
+    // Until the first set that is not empty, the previous bindings stay in
+    // use, and alive in the baton.
+    Parameters& parameters = stmt->bound;
+    size_t total = baton->parameters.size();
+    if (total) {
+        parameters.Swap(baton->parameters);
+    }
+
+    stmt->status = SQLITE_DONE;
+    for (size_t i = 0; i < baton->sets.size(); i++) {
+        size_t begin = baton->sets[i];
+        size_t end = i + 1 < baton->sets.size() ? baton->sets[i + 1] : total;
+        sqlite3_reset(stmt->_handle);
+        if (begin < end) {
+            sqlite3_clear_bindings(stmt->_handle);
+        }
+        if (stmt->Bind(parameters, begin, end)) {
+            stmt->status = sqlite3_step(stmt->_handle);
+            if (!(stmt->status == SQLITE_ROW || stmt->status == SQLITE_DONE)) {
+                stmt->message = std::string(sqlite3_errmsg(db));
+            }
+        }
+        if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
+            baton->failed = i;
+            break;
+        }
+        baton->changes += sqlite3_changes(db);
+    }
+    baton->inserted_id = sqlite3_last_insert_rowid(db);
+    sqlite3_reset(stmt->_handle);
+
+    if (baton->transaction && own) {
+        if (baton->failed >= 0) {
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            baton->changes = 0;
+        }
+        else {
+            int status = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+            if (status != SQLITE_OK) {
+                stmt->status = status;
+                stmt->message = std::string(sqlite3_errmsg(db));
+                // Don't leave the work done so far pending.
+                sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+                baton->changes = 0;
+            }
+        }
+    }
+    else if (baton->transaction) {
+        if (baton->failed >= 0) {
+            sqlite3_exec(db, "ROLLBACK TO node_sqlite3_batch", NULL, NULL, NULL);
+            baton->changes = 0;
+        }
+        int status = sqlite3_exec(db, "RELEASE node_sqlite3_batch", NULL, NULL, NULL);
+        if (status != SQLITE_OK && baton->failed < 0) {
+            stmt->status = status;
+            stmt->message = std::string(sqlite3_errmsg(db));
+            // Don't leave the work done so far pending.
+            sqlite3_exec(db, "ROLLBACK TO node_sqlite3_batch", NULL, NULL, NULL);
+            sqlite3_exec(db, "RELEASE node_sqlite3_batch", NULL, NULL, NULL);
+            baton->changes = 0;
+        }
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Statement::Work_AfterRunBatch(uv_work_t* req) {
+    Nan::HandleScope scope;
+
+    STATEMENT_INIT(RunBatchBaton);
+    stmt->Completed(baton);
+
+    if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
+        EXCEPTION(stmt->message, stmt->status, exception);
+        if (baton->failed >= 0) {
+            // Which set of parameters failed
+            Nan::Set(exception_obj, Nan::New("index").ToLocalChecked(), Nan::New(baton->failed));
+        }
+
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Local<Value> argv[] = { exception };
+            TRY_CATCH_CALL(stmt->handle(), cb, 1, argv);
+        }
+        else {
+            Local<Value> argv[] = { Nan::New("error").ToLocalChecked(), exception };
+            EMIT_EVENT(stmt->handle(), 2, argv);
+        }
+    }
+    else {
+        // Fire callbacks.
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Nan::Set(stmt->handle(), Nan::New("lastID").ToLocalChecked(), Nan::New<Number>(baton->inserted_id));
+            Nan::Set(stmt->handle(), Nan::New("changes").ToLocalChecked(), Nan::New(baton->changes));
+
+            Local<Value> argv[] = { Nan::Null() };
+            TRY_CATCH_CALL(stmt->handle(), cb, 1, argv);
+        }
+    }
+
+    STATEMENT_END();
+}
+
 NAN_METHOD(Statement::All) {
     Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
 
@@ -507,7 +946,7 @@ void Statement::Work_BeginAll(Baton* baton) {
 void Statement::Work_All(uv_work_t* req) {
     STATEMENT_INIT(RowsBaton);
 
-    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->db->_handle);
+    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->Connection());
     sqlite3_mutex_enter(mtx);
 
     // Make sure that we also reset when there are no parameters.
@@ -517,13 +956,15 @@ void Statement::Work_All(uv_work_t* req) {
 
     if (stmt->Bind(baton->parameters)) {
         while ((stmt->status = sqlite3_step(stmt->_handle)) == SQLITE_ROW) {
-            Row* row = new Row();
-            GetRow(row, stmt->_handle);
-            baton->rows.push_back(row);
+            baton->rows.Add(stmt->_handle);
+        }
+        if (baton->rows.Empty()) {
+            // Columnar results have their columns even without rows.
+            baton->rows.Describe(stmt->_handle);
         }
 
         if (stmt->status != SQLITE_DONE) {
-            stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+            stmt->message = std::string(sqlite3_errmsg(stmt->Connection()));
         }
     }
 
@@ -534,6 +975,7 @@ void Statement::Work_AfterAll(uv_work_t* req) {
     Nan::HandleScope scope;
 
     STATEMENT_INIT(RowsBaton);
+    stmt->Completed(baton);
 
     if (stmt->status != SQLITE_DONE) {
         Error(baton);
@@ -542,28 +984,77 @@ void Statement::Work_AfterAll(uv_work_t* req) {
         // Fire callbacks.
         Local<Function> cb = Nan::New(baton->callback);
         if (!cb.IsEmpty() && cb->IsFunction()) {
-            if (baton->rows.size()) {
-                // Create the result array from the data we acquired.
-                Local<Array> result(Nan::New<Array>(baton->rows.size()));
-                Rows::const_iterator it = baton->rows.begin();
-                Rows::const_iterator end = baton->rows.end();
-                for (int i = 0; it < end; ++it, i++) {
-                    Nan::Set(result, i, RowToJS(*it));
-                    delete *it;
-                }
+            // Create the result array from the data we acquired.
+            Local<Value> argv[] = { Nan::Null(), stmt->RowsToJS(baton->rows, baton->rowMode) };
+            TRY_CATCH_CALL(stmt->handle(), cb, 2, argv);
+        }
+    }
 
-                Local<Value> argv[] = { Nan::Null(), result };
-                TRY_CATCH_CALL(stmt->handle(), cb, 2, argv);
+    STATEMENT_END();
+}
+
+NAN_METHOD(Statement::Fetch) {
+    Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
+
+    if (info.Length() <= 0 || !info[0]->IsUint32() || Nan::To<uint32_t>(info[0]).FromJust() == 0) {
+        return Nan::ThrowTypeError("Row count must be a positive integer");
+    }
+
+    FetchBaton* baton = stmt->Bind<FetchBaton>(info, 1);
+    if (baton == NULL) {
+        return Nan::ThrowError("Data type is not supported");
+    }
+    else {
+        baton->count = Nan::To<uint32_t>(info[0]).FromJust();
+        stmt->Schedule(Work_BeginFetch, baton);
+        info.GetReturnValue().Set(info.This());
+    }
+}
+
+void Statement::Work_BeginFetch(Baton* baton) {
+    STATEMENT_BEGIN(Fetch);
+}
+
+void Statement::Work_Fetch(uv_work_t* req) {
+    STATEMENT_INIT(FetchBaton);
+
+    // Like Get, carry on from the last row fetched, and return nothing
+    // once the statement is done until it is reset or rebound.
+    if (stmt->status != SQLITE_DONE || baton->parameters.size()) {
+        sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->Connection());
+        sqlite3_mutex_enter(mtx);
+
+        if (stmt->Bind(baton->parameters)) {
+            while (baton->rows.rows < baton->count &&
+                    (stmt->status = sqlite3_step(stmt->_handle)) == SQLITE_ROW) {
+                baton->rows.Add(stmt->_handle);
             }
-            else {
-                // There were no result rows.
-                Local<Value> argv[] = {
-                    Nan::Null(),
-                    Nan::New<Array>(0)
-                };
-                TRY_CATCH_CALL(stmt->handle(), cb, 2, argv);
+
+            if (!(stmt->status == SQLITE_ROW || stmt->status == SQLITE_DONE)) {
+                stmt->message = std::string(sqlite3_errmsg(stmt->Connection()));
             }
         }
+
+        sqlite3_mutex_leave(mtx);
+    }
+}
+
+void Statement::Work_AfterFetch(uv_work_t* req) {
+    Nan::HandleScope scope;
+
+    STATEMENT_INIT(FetchBaton);
+    stmt->Completed(baton);
+
+    if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
+        Error(baton);
+    }
+    else {
+        // Fire callbacks.
+        Local<Function> cb = Nan::New(baton->callback);
+        if (!cb.IsEmpty() && cb->IsFunction()) {
+            Local<Value> argv[] = { Nan::Null(), stmt->RowsToJS(baton->rows, ArrayMode(baton->rowMode)) };
+            TRY_CATCH_CALL(stmt->handle(), cb, 2, argv);
+        }
     }
 
     STATEMENT_END();
@@ -590,12 +1081,41 @@ NAN_METHOD(Statement::Each) {
     }
 }
 
+NAN_METHOD(Statement::EachBatch) {
+    Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
+
+    if (info.Length() <= 0 || !info[0]->IsUint32() || Nan::To<uint32_t>(info[0]).FromJust() == 0) {
+        return Nan::ThrowTypeError("Batch size must be a positive integer");
+    }
+    unsigned int size = Nan::To<uint32_t>(info[0]).FromJust();
+
+    int last = info.Length();
+
+    Local<Function> completed;
+    if (last >= 3 && info[last - 1]->IsFunction() && info[last - 2]->IsFunction()) {
+        completed = Local<Function>::Cast(info[--last]);
+    }
+
+    EachBaton* baton = stmt->Bind<EachBaton>(info, 1, last);
+    if (baton == NULL) {
+        return Nan::ThrowError("Data type is not supported");
+    }
+    else {
+        baton->completed.Reset(completed);
+        baton->batchSize = size;
+        stmt->Schedule(Work_BeginEach, baton);
+        info.GetReturnValue().Set(info.This());
+    }
+}
+
 void Statement::Work_BeginEach(Baton* baton) {
     // Only create the Async object when we're actually going into
     // the event loop. This prevents dangling events.
     EachBaton* each_baton = static_cast<EachBaton*>(baton);
-    each_baton->async = new Async(each_baton->stmt, reinterpret_cast<uv_async_cb>(AsyncEach));
+    each_baton->async = new Async(each_baton->stmt, reinterpret_cast<uv_async_cb>(AsyncEach),
+                                  each_baton->batchSize > 0);
     each_baton->async->item_cb.Reset(each_baton->callback);
+    each_baton->async->rowMode = each_baton->rowMode;
     each_baton->async->completed_cb.Reset(each_baton->completed);
 
     STATEMENT_BEGIN(Each);
@@ -606,7 +1126,7 @@ void Statement::Work_Each(uv_work_t* req) {
 
     Async* async = baton->async;
 
-    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->db->_handle);
+    sqlite3_mutex* mtx = sqlite3_db_mutex(stmt->Connection());
 
     int retrieved = 0;
 
@@ -615,16 +1135,35 @@ void Statement::Work_Each(uv_work_t* req) {
         sqlite3_reset(stmt->_handle);
     }
 
+    RowSet* batch = NULL;
+
     if (stmt->Bind(baton->parameters)) {
         while (true) {
+            if (stmt->db->abandoned.load(std::memory_order_relaxed)) {
+                // Nothing is left to take the rows.
+                stmt->status = SQLITE_INTERRUPT;
+                stmt->message = "interrupted";
+                break;
+            }
             sqlite3_mutex_enter(mtx);
             stmt->status = sqlite3_step(stmt->_handle);
             if (stmt->status == SQLITE_ROW) {
                 sqlite3_mutex_leave(mtx);
-                Row* row = new Row();
-                GetRow(row, stmt->_handle);
+                if (async->batched) {
+                    // Rows are only handed over, and JS woken, a batch at a time.
+                    if (batch == NULL) {
+                        batch = new RowSet();
+                    }
+                    batch->Add(stmt->_handle);
+                    retrieved++;
+                    if (batch->rows == baton->batchSize) {
+                        QueueBatch(async, batch);
+                        batch = NULL;
+                    }
+                    continue;
+                }
                 NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
-                async->data.push_back(row);
+                async->data.Add(stmt->_handle);
                 retrieved++;
                 NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
 
@@ -632,7 +1171,7 @@ void Statement::Work_Each(uv_work_t* req) {
             }
             else {
                 if (stmt->status != SQLITE_DONE) {
-                    stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+                    stmt->message = std::string(sqlite3_errmsg(stmt->Connection()));
                 }
                 sqlite3_mutex_leave(mtx);
                 break;
@@ -640,10 +1179,31 @@ void Statement::Work_Each(uv_work_t* req) {
         }
     }
 
+    if (batch != NULL) {
+        QueueBatch(async, batch);
+    }
+
     async->completed = true;
     uv_async_send(&async->watcher);
 }
 
+void Statement::QueueBatch(Async* async, RowSet* batch) {
+    // Wait for JS to catch up if it is EACH_BATCH_QUEUE batches behind,
+    // unless there is no JS left, which Abandon posts a slot for.
+    std::atomic<bool>& abandoned = async->stmt->db->abandoned;
+    if (!abandoned) {
+        uv_sem_wait(&async->slots);
+    }
+    if (abandoned) {
+        delete batch;
+        return;
+    }
+    NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
+    async->batches.push_back(batch);
+    NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
+    uv_async_send(&async->watcher);
+}
+
 void Statement::CloseCallback(uv_handle_t* handle) {
     assert(handle != NULL);
     assert(handle->data != NULL);
@@ -656,14 +1216,54 @@ void Statement::AsyncEach(uv_async_t* handle, int status) {
 
     Async* async = static_cast<Async*>(handle->data);
 
+    if (async->stmt->db->abandoned) {
+        // JavaScript can no longer run: drop the rows, and once the worker
+        // is done, close.
+        NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
+        for (size_t i = 0; i < async->batches.size(); i++) delete async->batches[i];
+        async->batches.clear();
+        async->data.Clear();
+        NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
+        if (async->completed) {
+            async->stmt->db->running.erase(async);
+            uv_close(reinterpret_cast<uv_handle_t*>(handle), CloseCallback);
+        }
+        return;
+    }
+
+    while (async->batched) {
+        std::vector<RowSet*> batches;
+        NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
+        batches.swap(async->batches);
+        NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
+
+        if (batches.empty()) {
+            break;
+        }
+
+        Local<Function> cb = Nan::New(async->item_cb);
+        for (size_t i = 0; i < batches.size(); i++) {
+            Nan::HandleScope scope;
+            RowSet* rows = batches[i];
+            async->retrieved += rows->rows;
+            if (!cb.IsEmpty() && cb->IsFunction()) {
+                Local<Value> argv[] = { Nan::Null(), async->stmt->RowsToJS(*rows, ArrayMode(async->rowMode)) };
+                TRY_CATCH_CALL(async->stmt->handle(), cb, 2, argv);
+            }
+            delete rows;
+            // Let the worker queue another batch.
+            uv_sem_post(&async->slots);
+        }
+    }
+
     while (true) {
         // Get the contents out of the data cache for us to process in the JS callback.
-        Rows rows;
+        RowSet rows;
         NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
-        rows.swap(async->data);
+        rows.Swap(async->data);
         NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
 
-        if (rows.empty()) {
+        if (rows.Empty()) {
             break;
         }
 
@@ -672,13 +1272,12 @@ void Statement::AsyncEach(uv_async_t* handle, int status) {
             Local<Value> argv[2];
             argv[0] = Nan::Null();
 
-            Rows::const_iterator it = rows.begin();
-            Rows::const_iterator end = rows.end();
-            for (int i = 0; it < end; ++it, i++) {
-                argv[1] = RowToJS(*it);
+            RowShape shape;
+            async->stmt->GetRowShape(rows, shape);
+            for (size_t i = 0; i < rows.rows; i++) {
+                argv[1] = RowToJS(rows, i, shape, async->rowMode);
                 async->retrieved++;
                 TRY_CATCH_CALL(async->stmt->handle(), cb, 2, argv);
-                delete *it;
             }
         }
     }
@@ -693,6 +1292,7 @@ void Statement::AsyncEach(uv_async_t* handle, int status) {
             };
             TRY_CATCH_CALL(async->stmt->handle(), cb, 2, argv);
         }
+        async->stmt->db->running.erase(async);
         uv_close(reinterpret_cast<uv_handle_t*>(handle), CloseCallback);
     }
 }
@@ -701,6 +1301,7 @@ void Statement::Work_AfterEach(uv_work_t* req) {
     Nan::HandleScope scope;
 
     STATEMENT_INIT(EachBaton);
+    stmt->Completed(baton);
 
     if (stmt->status != SQLITE_DONE) {
         Error(baton);
@@ -709,6 +1310,106 @@ void Statement::Work_AfterEach(uv_work_t* req) {
     STATEMENT_END();
 }
 
+NAN_METHOD(Statement::SetRowMode) {
+    Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
+
+    REQUIRE_ARGUMENT_STRING(0, mode);
+
+    if (*mode == std::string("object")) {
+        stmt->rowMode = ROW_MODE_OBJECT;
+    }
+    else if (*mode == std::string("array")) {
+        stmt->rowMode = ROW_MODE_ARRAY;
+    }
+    else if (*mode == std::string("columnar")) {
+        stmt->rowMode = ROW_MODE_COLUMNAR;
+    }
+    else {
+        return Nan::ThrowTypeError("Row mode must be \"object\", \"array\" or \"columnar\"");
+    }
+
+    info.GetReturnValue().Set(info.This());
+}
+
+// The sqlite3_stmt_status counters Statement#stats reports, in the order
+// of statusBase.  None of them needs the connection's mutex to read.
+static const struct {
+    int op;
+    const char* name;
+} statementStatus[STATEMENT_STATUS_COUNT] = {
+    { SQLITE_STMTSTATUS_FULLSCAN_STEP, "fullscanSteps" },
+    { SQLITE_STMTSTATUS_SORT, "sorts" },
+    { SQLITE_STMTSTATUS_AUTOINDEX, "autoindexes" },
+    { SQLITE_STMTSTATUS_VM_STEP, "vmSteps" },
+#if SQLITE_VERSION_NUMBER >= 3020000
+    { SQLITE_STMTSTATUS_REPREPARE, "reprepares" },
+    { SQLITE_STMTSTATUS_RUN, "runs" },
+#endif
+};
+
+void Statement::Completed(Baton* baton) {
+    calls++;
+    waitTime += (baton->started - baton->queued) / 1e6;
+    runTime += (uv_hrtime() - baton->started) / 1e6;
+}
+
+void Statement::ResetStatus() {
+    for (int i = 0; i < STATEMENT_STATUS_COUNT; i++) {
+        statusBase[i] = _handle ? sqlite3_stmt_status(_handle, statementStatus[i].op, 0) : 0;
+    }
+}
+
+NAN_METHOD(Statement::Stats) {
+    Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
+
+    bool reset = info.Length() > 0 && Nan::To<bool>(info[0]).FromJust();
+
+    Local<Object> stats = Nan::New<Object>();
+    Nan::Set(stats, Nan::New("calls").ToLocalChecked(), Nan::New<Number>(stmt->calls));
+    Nan::Set(stats, Nan::New("queued").ToLocalChecked(),
+        Nan::New<Number>(stmt->queue.size()));
+    Nan::Set(stats, Nan::New("waitTime").ToLocalChecked(), Nan::New<Number>(stmt->waitTime));
+    Nan::Set(stats, Nan::New("runTime").ToLocalChecked(), Nan::New<Number>(stmt->runTime));
+    // Without the connection's mutex, so this does not wait for a call
+    // that is running.
+    for (int i = 0; i < STATEMENT_STATUS_COUNT; i++) {
+        int value = stmt->_handle ? sqlite3_stmt_status(stmt->_handle, statementStatus[i].op, 0) : 0;
+        Nan::Set(stats, Nan::New(statementStatus[i].name).ToLocalChecked(),
+            Nan::New<Number>(value - stmt->statusBase[i]));
+    }
+#if SQLITE_VERSION_NUMBER >= 3020000
+    // A level rather than a count, so never reset.
+    Nan::Set(stats, Nan::New("memoryUsed").ToLocalChecked(),
+        Nan::New<Number>(stmt->memoryUsed.load()));
+#endif
+
+    if (reset) {
+        stmt->calls = 0;
+        stmt->waitTime = 0;
+        stmt->runTime = 0;
+        stmt->ResetStatus();
+    }
+
+    info.GetReturnValue().Set(stats);
+}
+
+// The column names of the rows last returned.
+NAN_GETTER(Statement::ColumnsGetter) {
+    Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
+
+    if (stmt->columnKeys.IsEmpty()) {
+        info.GetReturnValue().Set(Nan::Undefined());
+    }
+    else {
+        Local<Array> keys = Nan::New(stmt->columnKeys);
+        Local<Array> columns = Nan::New<Array>(keys->Length());
+        for (uint32_t i = 0; i < keys->Length(); i++) {
+            Nan::Set(columns, i, Nan::Get(keys, i).ToLocalChecked());
+        }
+        info.GetReturnValue().Set(columns);
+    }
+}
+
 NAN_METHOD(Statement::Reset) {
     Statement* stmt = Nan::ObjectWrap::Unwrap<Statement>(info.This());
 
@@ -735,6 +1436,7 @@ void Statement::Work_AfterReset(uv_work_t* req) {
     Nan::HandleScope scope;
 
     STATEMENT_INIT(Baton);
+    stmt->Completed(baton);
 
     // Fire callbacks.
     Local<Function> cb = Nan::New(baton->callback);
@@ -746,74 +1448,286 @@ void Statement::Work_AfterReset(uv_work_t* req) {
     STATEMENT_END();
 }
 
-Local<Object> Statement::RowToJS(Row* row) {
-    Nan::EscapableHandleScope scope;
+// Templates are only used for plain, distinct names.  Index-like names
+// such as "1" would become elements, and a repeated name would be defined
+// twice.
+static bool IsShapeable(const std::vector<std::string>& names) {
+    std::set<std::string> seen;
+    for (size_t i = 0; i < names.size(); i++) {
+        const std::string& name = names[i];
+        if (name.empty() || name.find_first_not_of("0123456789") == std::string::npos) {
+            return false;
+        }
+        if (!seen.insert(name).second) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    Local<Object> result = Nan::New<Object>();
+void Statement::GetRowShape(const RowSet& rows, RowShape& shape) {
+    // A set with no names needs no keys.
+    if (rows.names.empty()) return;
+
+    if (columnKeys.IsEmpty() || rows.names != columnNames) {
+        columnNames = rows.names;
+        Isolate* isolate = Isolate::GetCurrent();
+        Local<Array> keys = Nan::New<Array>(static_cast<int>(columnNames.size()));
+        Local<ObjectTemplate> tpl = Nan::New<ObjectTemplate>();
+        for (size_t i = 0; i < columnNames.size(); i++) {
+            Local<String> key = String::NewFromUtf8(isolate, columnNames[i].c_str(),
+                NewStringType::kInternalized).ToLocalChecked();
+            Nan::Set(keys, i, key);
+            Nan::SetTemplate(tpl, key, Nan::Null());
+        }
+        columnKeys.Reset(keys);
+        if (IsShapeable(columnNames)) {
+            rowTemplate.Reset(tpl);
+        }
+        else {
+            rowTemplate.Reset();
+        }
+    }
 
-    Row::const_iterator it = row->begin();
-    Row::const_iterator end = row->end();
-    for (int i = 0; it < end; ++it, i++) {
-        Values::Field* field = *it;
+    Local<Array> keys = Nan::New(columnKeys);
+    shape.keys.resize(keys->Length());
+    for (size_t i = 0; i < shape.keys.size(); i++) {
+        shape.keys[i] = Nan::Get(keys, i).ToLocalChecked().As<String>();
+    }
+    if (!rowTemplate.IsEmpty()) {
+        shape.shape = Nan::New(rowTemplate);
+    }
+}
+
+// ASCII text that V8 keeps in, and frees, the allocation it was read into.
+class ExternalText : public Nan::ExternalOneByteStringResource {
+public:
+    ExternalText(char* data, size_t length) : data_(data), length_(length) {}
+    ~ExternalText() { free(data_); }
+    const char* data() const { return data_; }
+    size_t length() const { return length_; }
+
+private:
+    char* data_;
+    size_t length_;
+};
+
+Local<Value> Statement::CellToJS(RowSet& rows, RowSet::Cell& cell) {
+    switch (cell.type) {
+        case SQLITE_INTEGER: {
+            return Nan::New<Number>(cell.integer);
+        }
+        case SQLITE_FLOAT: {
+            return Nan::New<Number>(cell.number);
+        }
+        case SQLITE_TEXT: {
+            if (cell.external) {
+                return Nan::New<String>(new ExternalText(rows.Take(cell), cell.length)).ToLocalChecked();
+            }
+            return Nan::New<String>(rows.Data(cell), cell.length).ToLocalChecked();
+        }
+        case SQLITE_BLOB: {
+            if (cell.external) {
+                // The Buffer frees the memory.
+                return Nan::NewBuffer(rows.Take(cell), cell.length).ToLocalChecked();
+            }
+            return Nan::CopyBuffer(rows.Data(cell), cell.length).ToLocalChecked();
+        }
+        default: {
+            return Nan::Null();
+        }
+    }
+}
 
-        Local<Value> value;
+Local<Object> Statement::RowToJS(RowSet& rows, size_t row, const RowShape& shape, RowMode mode) {
+    Nan::EscapableHandleScope scope;
 
-        switch (field->type) {
-            case SQLITE_INTEGER: {
-                value = Nan::New<Number>(((Values::Integer*)field)->value);
-            } break;
-            case SQLITE_FLOAT: {
-                value = Nan::New<Number>(((Values::Float*)field)->value);
-            } break;
-            case SQLITE_TEXT: {
-                value = Nan::New<String>(((Values::Text*)field)->value.c_str(), ((Values::Text*)field)->value.size()).ToLocalChecked();
-            } break;
-            case SQLITE_BLOB: {
-                value = Nan::CopyBuffer(((Values::Blob*)field)->value, ((Values::Blob*)field)->length).ToLocalChecked();
-            } break;
-            case SQLITE_NULL: {
-                value = Nan::Null();
-            } break;
+    if (mode != ROW_MODE_OBJECT) {
+        Local<Array> result = Nan::New<Array>(static_cast<int>(rows.columns));
+        for (size_t i = 0; i < rows.columns; i++) {
+            Nan::Set(result, i, CellToJS(rows, rows.At(row, i)));
         }
+        return scope.Escape(result);
+    }
+
+    // An instance of the template has every property already, so setting
+    // them does not change its shape.
+    Local<Object> result = shape.shape.IsEmpty() ?
+        Nan::New<Object>() : Nan::NewInstance(shape.shape).ToLocalChecked();
+
+    for (size_t i = 0; i < rows.columns; i++) {
+        Nan::Set(result, shape.keys[i], CellToJS(rows, rows.At(row, i)));
+    }
+
+    return scope.Escape(result);
+}
 
-        Nan::Set(result, Nan::New(field->name.c_str()).ToLocalChecked(), value);
+Local<Object> Statement::RowsToJS(RowSet& rows, RowMode mode) {
+    Nan::EscapableHandleScope scope;
+
+    RowShape shape;
+    GetRowShape(rows, shape);
+    if (mode == ROW_MODE_COLUMNAR) {
+        return scope.Escape(ColumnsToJS(rows, shape));
+    }
 
-        DELETE_FIELD(field);
+    Local<Array> result = Nan::New<Array>(static_cast<int>(rows.rows));
+    for (size_t i = 0; i < rows.rows; i++) {
+        Nan::Set(result, i, RowToJS(rows, i, shape, mode));
     }
 
     return scope.Escape(result);
 }
 
-void Statement::GetRow(Row* row, sqlite3_stmt* stmt) {
-    int rows = sqlite3_column_count(stmt);
+// A column of nothing but numbers becomes a Float64Array, any other an Array.
+Local<Object> Statement::ColumnsToJS(RowSet& rows, const RowShape& shape) {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> result = Nan::New<Object>();
+    for (size_t i = 0; i < shape.keys.size(); i++) {
+        bool numeric = rows.rows > 0;
+        for (size_t j = 0; j < rows.rows && numeric; j++) {
+            int type = rows.At(j, i).type;
+            numeric = type == SQLITE_INTEGER || type == SQLITE_FLOAT;
+        }
 
-    for (int i = 0; i < rows; i++) {
-        int type = sqlite3_column_type(stmt, i);
+        Local<Object> column;
+        if (numeric) {
+            Local<Float64Array> array = Float64Array::New(
+                ArrayBuffer::New(Isolate::GetCurrent(), rows.rows * sizeof(double)), 0, rows.rows);
+            Nan::TypedArrayContents<double> data(array);
+            for (size_t j = 0; j < rows.rows; j++) {
+                const RowSet::Cell& cell = rows.At(j, i);
+                (*data)[j] = cell.type == SQLITE_INTEGER ? (double)cell.integer : cell.number;
+            }
+            column = array;
+        }
+        else {
+            Local<Array> array = Nan::New<Array>(static_cast<int>(rows.rows));
+            for (size_t j = 0; j < rows.rows; j++) {
+                Nan::Set(array, j, CellToJS(rows, rows.At(j, i)));
+            }
+            column = array;
+        }
+        Nan::Set(result, shape.keys[i], column);
+    }
+
+    return scope.Escape(result);
+}
+
+static bool IsAscii(const char* z, int n) {
+    for (int i = 0; i < n; i++) {
+        if ((unsigned char)z[i] >= 0x80) return false;
+    }
+    return true;
+}
+
+Parameters::Value& Parameters::Add(short type, int index, const char* name, size_t nameLength) {
+    values.push_back(Value());
+    Value& value = values.back();
+    value.type = type;
+    value.index = index;
+    value.name = name ? Append(name, nameLength) : 0;
+    value.nameLength = nameLength;
+    value.length = 0;
+    value.integer = 0;
+    return value;
+}
+
+size_t Parameters::Append(const char* data, size_t length) {
+    size_t offset = bytes.size();
+    bytes.insert(bytes.end(), data, data + length);
+    return offset;
+}
+
+// Copy n bytes into an allocation of their own.  Returns false if there is
+// no memory for it, and the value goes in with the others.
+static bool Copy(char** data, const char* z, int n) {
+    *data = static_cast<char*>(malloc(n));
+    if (*data == NULL) return false;
+    memcpy(*data, z, n);
+    return true;
+}
+
+void RowSet::Describe(sqlite3_stmt* stmt) {
+    columns = sqlite3_column_count(stmt);
+    names.clear();
+    for (size_t i = 0; i < columns; i++) {
         const char* name = sqlite3_column_name(stmt, i);
-        switch (type) {
+        names.push_back(name ? name : "");
+    }
+}
+
+void RowSet::Add(sqlite3_stmt* stmt) {
+    if (rows == 0) {
+        Describe(stmt);
+    }
+
+    for (size_t i = 0; i < columns; i++) {
+        Cell cell;
+        cell.type = sqlite3_column_type(stmt, i);
+        cell.external = false;
+        cell.length = 0;
+        switch (cell.type) {
             case SQLITE_INTEGER: {
-                row->push_back(new Values::Integer(name, sqlite3_column_int64(stmt, i)));
+                cell.integer = sqlite3_column_int64(stmt, i);
             }   break;
             case SQLITE_FLOAT: {
-                row->push_back(new Values::Float(name, sqlite3_column_double(stmt, i)));
+                cell.number = sqlite3_column_double(stmt, i);
             }   break;
             case SQLITE_TEXT: {
                 const char* text = (const char*)sqlite3_column_text(stmt, i);
-                int length = sqlite3_column_bytes(stmt, i);
-                row->push_back(new Values::Text(name, length, text));
+                cell.length = sqlite3_column_bytes(stmt, i);
+                if (cell.length >= EXTERNAL_VALUE_BYTES && IsAscii(text, cell.length)) {
+                    cell.external = Copy(&cell.data, text, cell.length);
+                }
+                if (!cell.external) {
+                    cell.offset = bytes.size();
+                    bytes.insert(bytes.end(), text, text + cell.length);
+                }
             } break;
             case SQLITE_BLOB: {
-                const void* blob = sqlite3_column_blob(stmt, i);
-                int length = sqlite3_column_bytes(stmt, i);
-                row->push_back(new Values::Blob(name, length, blob));
+                const char* blob = (const char*)sqlite3_column_blob(stmt, i);
+                cell.length = sqlite3_column_bytes(stmt, i);
+                if (cell.length >= EXTERNAL_VALUE_BYTES) {
+                    cell.external = Copy(&cell.data, blob, cell.length);
+                }
+                if (!cell.external) {
+                    cell.offset = bytes.size();
+                    bytes.insert(bytes.end(), blob, blob + cell.length);
+                }
             }   break;
             case SQLITE_NULL: {
-                row->push_back(new Values::Null(name));
             }   break;
             default:
                 assert(false);
         }
+        if (cell.external) owned++;
+        cells.push_back(cell);
     }
+    rows++;
+}
+
+void RowSet::Clear() {
+    for (size_t i = 0; owned > 0 && i < cells.size(); i++) {
+        if (cells[i].external && cells[i].data) {
+            free(Take(cells[i]));
+        }
+    }
+    names.clear();
+    cells.clear();
+    bytes.clear();
+    columns = 0;
+    rows = 0;
+}
+
+void RowSet::Swap(RowSet& other) {
+    names.swap(other.names);
+    cells.swap(other.cells);
+    bytes.swap(other.bytes);
+    std::swap(columns, other.columns);
+    std::swap(rows, other.rows);
+    std::swap(owned, other.owned);
 }
 
 NAN_METHOD(Statement::Finalize) {
@@ -846,8 +1760,22 @@ void Statement::Finalize() {
     CleanQueue();
     // Finalize returns the status code of the last operation. We already fired
     // error events in case those failed.
-    sqlite3_finalize(_handle);
+    if (cached && _handle) {
+        db->CacheStatement(sql, _handle, reader, schema);
+    }
+    else if (_handle) {
+        sqlite3* connection = sqlite3_db_handle(_handle);
+        db->EnterConnection(connection);
+        sqlite3_finalize(_handle);
+        db->LeaveConnection(connection);
+        if (reader) reader->statements--;
+    }
+    else if (reader) {
+        reader->statements--;
+    }
     _handle = NULL;
+    reader = NULL;
+    bound = Parameters();
     db->Unref();
 }
 
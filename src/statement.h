@@ -17,83 +17,157 @@
 using namespace v8;
 using namespace node;
 
-namespace node_sqlite3 {
+// Batches of rows eachBatch queues ahead of its callback before waiting.
+#define EACH_BATCH_QUEUE 4
+
+// The sqlite3_stmt_status counters Statement#stats reports.
+#if SQLITE_VERSION_NUMBER >= 3020000
+#define STATEMENT_STATUS_COUNT 6
+#else
+#define STATEMENT_STATUS_COUNT 4
+#endif
 
-namespace Values {
-    struct Field {
-        inline Field(unsigned short _index, unsigned short _type = SQLITE_NULL) :
-            type(_type), index(_index) {}
-        inline Field(const char* _name, unsigned short _type = SQLITE_NULL) :
-            type(_type), index(0), name(_name) {}
+namespace node_sqlite3 {
 
-        unsigned short type;
-        unsigned short index;
-        std::string name;
+// Bind parameters, converted on the main thread into two flat buffers: a
+// Value per parameter, and the bytes of all text and blob values and of the
+// parameter names.  A statement hands its spare buffers to each call and
+// gets them back after, so converting parameters does not allocate once
+// they have grown.  Text and blobs are bound straight from the buffers, so
+// the statement also keeps the set it has bound.
+struct Parameters {
+    struct Value {
+        short type;        // 0 for a value of a type that cannot be bound
+        int index;         // Position, from 1, or 0 if named
+        size_t name;       // Offset of the name into bytes, if named
+        size_t nameLength;
+        int length;        // Bytes of a text or blob value
+        union {
+            sqlite3_int64 integer;
+            double number;
+            size_t offset; // Of a text or blob value, into bytes
+        };
     };
 
-    struct Integer : Field {
-        template <class T> inline Integer(T _name, int64_t val) :
-            Field(_name, SQLITE_INTEGER), value(val) {}
-        int64_t value;
-    };
+    size_t size() const { return values.size(); }
+    void Clear() {
+        values.clear();
+        bytes.clear();
+    }
+    void Swap(Parameters& other) {
+        values.swap(other.values);
+        bytes.swap(other.bytes);
+    }
+    // Append a parameter by position, or by name if name is not NULL.
+    Value& Add(short type, int index, const char* name = NULL, size_t nameLength = 0);
+    // Append data to bytes, returning its offset.
+    size_t Append(const char* data, size_t length);
+    const char* Data(size_t offset) const { return bytes.data() + offset; }
+
+    std::vector<Value> values;
+    std::vector<char> bytes;
+};
 
-    struct Float : Field {
-        template <class T> inline Float(T _name, double val) :
-            Field(_name, SQLITE_FLOAT), value(val) {}
-        double value;
+// Result rows, packed into three flat buffers: the column names once, a
+// Cell per value, and the bytes of all text and blob values.  A RowSet is
+// filled on the worker thread and converted, then freed, in one go on the
+// main thread, so no memory is allocated per value.
+//
+// The exceptions are blobs, and ASCII text, of EXTERNAL_VALUE_BYTES or
+// more.  Each of those gets an allocation of its own that is handed to JS
+// as the memory of its Buffer or string, so it is never copied again.
+struct RowSet {
+    struct Cell {
+        short type;
+        bool external; // data is a separate allocation, not in bytes
+        int length;    // Bytes of a text or blob value
+        union {
+            sqlite3_int64 integer;
+            double number;
+            size_t offset; // Of a text or blob value, into bytes
+            char* data;    // Of an external value, until it is taken
+        };
     };
 
-    struct Text : Field {
-        template <class T> inline Text(T _name, size_t len, const char* val) :
-            Field(_name, SQLITE_TEXT), value(val, len) {}
-        std::string value;
-    };
+    RowSet() : columns(0), rows(0), owned(0) {}
+    ~RowSet() { Clear(); }
 
-    struct Blob : Field {
-        template <class T> inline Blob(T _name, size_t len, const void* val) :
-                Field(_name, SQLITE_BLOB), length(len) {
-            value = (char*)malloc(len);
-            memcpy(value, val, len);
-        }
-        inline ~Blob() {
-            free(value);
-        }
-        int length;
-        char* value;
-    };
+    // Append the current row of stmt, and take the column names from it if
+    // the set is empty.
+    void Add(sqlite3_stmt* stmt);
+    // Take the column names from stmt.
+    void Describe(sqlite3_stmt* stmt);
+    void Swap(RowSet& other);
+    void Clear();
+    bool Empty() const { return rows == 0; }
 
-    typedef Field Null;
-}
+    Cell& At(size_t row, size_t column) {
+        return cells[row * columns + column];
+    }
+    const Cell& At(size_t row, size_t column) const {
+        return cells[row * columns + column];
+    }
+    const char* Data(const Cell& cell) const {
+        if (cell.external) return cell.data;
+        return cell.length ? &bytes[cell.offset] : "";
+    }
+    // Hand over the allocation of an external value, to be freed with free().
+    char* Take(Cell& cell) {
+        char* data = cell.data;
+        cell.data = NULL;
+        owned--;
+        return data;
+    }
+
+    std::vector<std::string> names;
+    std::vector<Cell> cells;
+    std::vector<char> bytes;
+    size_t columns;
+    size_t rows;
+    size_t owned; // External values not yet taken
 
-typedef std::vector<Values::Field*> Row;
-typedef std::vector<Row*> Rows;
-typedef Row Parameters;
+private:
+    RowSet(const RowSet&);
+    RowSet& operator=(const RowSet&);
+};
 
 
 
 class Statement : public Nan::ObjectWrap {
 public:
-    static Nan::Persistent<FunctionTemplate> constructor_template;
+    // How result rows are handed to JS, set by Statement#setRowMode.
+    enum RowMode {
+        ROW_MODE_OBJECT,  // { column: value }
+        ROW_MODE_ARRAY,   // [ value, ... ], with names in stmt.columns
+        ROW_MODE_COLUMNAR // all() only: { column: [ value, ... ] }
+    };
 
     static NAN_MODULE_INIT(Init);
     static NAN_METHOD(New);
 
     struct Baton {
-        uv_work_t request;
+        WorkRequest request;
         Statement* stmt;
         Nan::Persistent<Function> callback;
         Parameters parameters;
-
-        Baton(Statement* stmt_, Local<Function> cb_) : stmt(stmt_) {
+        // The statement's row mode when the call was made
+        RowMode rowMode;
+        // When the call was made, and when it left the queue to run
+        uint64_t queued;
+        uint64_t started;
+        // The call's work, while Work_Call or Work_LeaveReader runs in its
+        // place
+        uv_work_cb work;
+
+        Baton(Statement* stmt_, Local<Function> cb_) : stmt(stmt_), rowMode(stmt_->rowMode),
+                queued(uv_hrtime()), started(0), work(NULL) {
             stmt->Ref();
             request.data = this;
             callback.Reset(cb_);
+            parameters.Swap(stmt->spare);
         }
         virtual ~Baton() {
-            for (unsigned int i = 0; i < parameters.size(); i++) {
-                Values::Field* field = parameters[i];
-                DELETE_FIELD(field);
-            }
+            stmt->RecycleParameters(parameters);
             stmt->Unref();
             callback.Reset();
         }
@@ -102,7 +176,7 @@ public:
     struct RowBaton : Baton {
         RowBaton(Statement* stmt_, Local<Function> cb_) :
             Baton(stmt_, cb_) {}
-        Row row;
+        RowSet row;
     };
 
     struct RunBaton : Baton {
@@ -112,10 +186,27 @@ public:
         int changes;
     };
 
+    struct RunBatchBaton : Baton {
+        RunBatchBaton(Statement* stmt_, Local<Function> cb_) :
+            Baton(stmt_, cb_), transaction(true), inserted_id(0), changes(0), failed(-1) {}
+        // Where each set starts in parameters, which holds them all.
+        std::vector<size_t> sets;
+        bool transaction; // Run all of the sets or none
+        sqlite3_int64 inserted_id;
+        int changes;
+        int failed; // Index of the set that failed
+    };
+
     struct RowsBaton : Baton {
         RowsBaton(Statement* stmt_, Local<Function> cb_) :
             Baton(stmt_, cb_) {}
-        Rows rows;
+        RowSet rows;
+    };
+
+    struct FetchBaton : RowsBaton {
+        unsigned int count;
+        FetchBaton(Statement* stmt_, Local<Function> cb_) :
+            RowsBaton(stmt_, cb_), count(0) {}
     };
 
     struct Async;
@@ -123,9 +214,10 @@ public:
     struct EachBaton : Baton {
         Nan::Persistent<Function> completed;
         Async* async; // Isn't deleted when the baton is deleted.
+        unsigned int batchSize; // Rows per callback for eachBatch, 0 for each
 
         EachBaton(Statement* stmt_, Local<Function> cb_) :
-            Baton(stmt_, cb_) {}
+            Baton(stmt_, cb_), batchSize(0) {}
         virtual ~EachBaton() {
             completed.Reset();
         }
@@ -134,9 +226,16 @@ public:
     struct PrepareBaton : Database::Baton {
         Statement* stmt;
         std::string sql;
+        // The work of the first call, to run right after preparing.
+        struct {
+            uv_work_t* request;
+            uv_work_cb work;
+            uv_after_work_cb after;
+        } fused;
         PrepareBaton(Database* db_, Local<Function> cb_, Statement* stmt_) :
             Baton(db_, cb_), stmt(stmt_) {
             stmt->Ref();
+            fused.request = NULL;
         }
         virtual ~PrepareBaton() {
             stmt->Unref();
@@ -150,88 +249,202 @@ public:
 
     typedef void (*Work_Callback)(Baton* baton);
 
+    // What RowToJS builds the objects for a RowSet from.
+    struct RowShape {
+        std::vector<Local<String> > keys;
+        // Empty if the rows are built a property at a time.
+        Local<ObjectTemplate> shape;
+    };
+
     struct Call {
         Call(Work_Callback cb_, Baton* baton_) : callback(cb_), baton(baton_) {};
         Work_Callback callback;
         Baton* baton;
     };
 
-    struct Async {
+    struct Async : Database::Running {
         uv_async_t watcher;
         Statement* stmt;
-        Rows data;
+        RowSet data;
         NODE_SQLITE3_MUTEX_t;
         bool completed;
         int retrieved;
+        RowMode rowMode;
+
+        // Batches of rows for eachBatch.  The worker waits on slots before
+        // queueing each one, so no more than EACH_BATCH_QUEUE are pending.
+        bool batched;
+        std::vector<RowSet*> batches;
+        uv_sem_t slots;
 
         // Store the callbacks here because we don't have
         // access to the baton in the async callback.
         Nan::Persistent<Function> item_cb;
         Nan::Persistent<Function> completed_cb;
 
-        Async(Statement* st, uv_async_cb async_cb) :
-                stmt(st), completed(false), retrieved(0) {
+        Async(Statement* st, uv_async_cb async_cb, bool batched_ = false) :
+                stmt(st), completed(false), retrieved(0), rowMode(st->rowMode),
+                batched(batched_) {
             watcher.data = this;
             NODE_SQLITE3_MUTEX_INIT
+            if (batched) uv_sem_init(&slots, EACH_BATCH_QUEUE);
             stmt->Ref();
-            uv_async_init(uv_default_loop(), &watcher, async_cb);
+            uv_async_init(st->db->loop, &watcher, async_cb);
+            st->db->running.insert(this);
         }
 
         ~Async() {
+            stmt->db->running.erase(this);
             stmt->Unref();
             item_cb.Reset();
             completed_cb.Reset();
+            if (batched) uv_sem_destroy(&slots);
             NODE_SQLITE3_MUTEX_DESTROY
         }
+
+        // The worker stops once it sees the database abandoned, and only
+        // needs waking if it waits for a slot.
+        void Abandon() {
+            if (batched) uv_sem_post(&slots);
+        }
     };
 
     Statement(Database* db_) : Nan::ObjectWrap(),
             db(db_),
+            reader(NULL),
+            cached(false),
+            schema(0),
+            deferring(false),
+            fusing(NULL),
+            namesIndexed(false),
             _handle(NULL),
             status(SQLITE_OK),
             prepared(false),
             locked(true),
-            finalized(false) {
+            finalized(false),
+            rowMode(ROW_MODE_OBJECT),
+            calls(0),
+            waitTime(0),
+            runTime(0),
+            memoryUsed(0) {
         db->Ref();
+        memset(statusBase, 0, sizeof(statusBase));
     }
 
     ~Statement() {
-        if (!finalized) Finalize();
+        if (!finalized) {
+            // Freed by the garbage collector, where no JavaScript may run.
+            db->collecting++;
+            Finalize();
+            db->collecting--;
+        }
+        deferred.Reset();
+        columnKeys.Reset();
+        rowTemplate.Reset();
     }
 
     WORK_DEFINITION(Bind);
     WORK_DEFINITION(Get);
     WORK_DEFINITION(Run);
+    WORK_DEFINITION(RunBatch);
     WORK_DEFINITION(All);
     WORK_DEFINITION(Each);
+    WORK_DEFINITION(Fetch);
     WORK_DEFINITION(Reset);
 
+    static NAN_METHOD(EachBatch);
+    static NAN_METHOD(SetRowMode);
+    static NAN_METHOD(Stats);
+    static NAN_GETTER(ColumnsGetter);
+
     static NAN_METHOD(Finalize);
 
 protected:
+    void SchedulePrepare();
     static void Work_BeginPrepare(Database::Baton* baton);
+    static bool PrepareOnReader(PrepareBaton* baton);
+    static void Prepare(PrepareBaton* baton);
     static void Work_Prepare(uv_work_t* req);
     static void Work_AfterPrepare(uv_work_t* req);
+    static void Work_Call(uv_work_t* req);
+    static void Work_LeaveReader(uv_work_t* req);
 
     static void AsyncEach(uv_async_t* handle, int status);
+    static void QueueBatch(Async* async, RowSet* batch);
     static void CloseCallback(uv_handle_t* handle);
 
     static void Finalize(Baton* baton);
     void Finalize();
 
-    template <class T> inline Values::Field* BindParameter(const Local<Value> source, T pos);
+    static void AddParameter(const Local<Value> source, Parameters& parameters, int index,
+        const char* name = NULL, size_t nameLength = 0);
     template <class T> T* Bind(Nan::NAN_METHOD_ARGS_TYPE info, int start = 0, int end = -1);
-    bool Bind(const Parameters &parameters);
-
-    static void GetRow(Row* row, sqlite3_stmt* stmt);
-    static Local<Object> RowToJS(Row* row);
+    void AddParameters(Local<Value> source, Parameters& parameters);
+    bool Bind(Parameters& parameters);
+    bool Bind(const Parameters& parameters, size_t begin, size_t end);
+    int ParameterIndex(const char* name, size_t length);
+    void RecycleParameters(Parameters& parameters);
+
+    void GetRowShape(const RowSet& rows, RowShape& shape);
+    static Local<Value> CellToJS(RowSet& rows, RowSet::Cell& cell);
+    static Local<Object> RowToJS(RowSet& rows, size_t row, const RowShape& shape, RowMode mode);
+    Local<Object> RowsToJS(RowSet& rows, RowMode mode);
+    Local<Object> ColumnsToJS(RowSet& rows, const RowShape& shape);
+    // The connection the statement was prepared on: the database's own, or
+    // one of its readers.
+    sqlite3* Connection() { return sqlite3_db_handle(_handle); }
+    // Work on a reader goes to the threadpool, so that queries run
+    // alongside each other and the database's own thread if it has one.
+    // Once a transaction is open on the database's connection, a statement
+    // on a reader would miss its writes, and moves over before it runs.
+    int QueueWork(WorkRequest* req, uv_work_cb work, uv_after_work_cb after) {
+        static_cast<Baton*>(req->data)->work = work;
+        if (fusing) {
+            fusing->fused.request = req;
+            fusing->fused.work = Work_Call;
+            fusing->fused.after = after;
+            return 0;
+        }
+        if (reader && sqlite3_get_autocommit(db->_handle)) {
+            return db->QueueWork(req, Work_Call, after, true);
+        }
+        if (reader) {
+            return db->QueueWork(req, Work_LeaveReader, after);
+        }
+        return db->QueueWork(req, Work_Call, after);
+    }
     void Schedule(Work_Callback callback, Baton* baton);
     void Process();
     void CleanQueue();
     template <class T> static void Error(T* baton);
+    // Count a call's time in the queue and running, once it is done.
+    void Completed(Baton* baton);
+    // Start the sqlite3_stmt_status counters over from their values now.
+    void ResetStatus();
 
 protected:
     Database* db;
+    // The reader the statement was prepared on, if any.
+    Database::Reader* reader;
+    // Whether the statement goes to the database's cache when finalized, to
+    // be reused for the same SQL, and the schema it was prepared against.
+    bool cached;
+    std::string sql;
+    unsigned int schema;
+    // Such a statement is prepared once its first call is made, with the
+    // callback passed to the constructor.
+    bool deferring;
+    Nan::Persistent<Function> deferred;
+    // The prepare a call that is starting is fused into, if any.
+    PrepareBaton* fusing;
+
+    // The parameters bound now, and the buffers for the next call's.
+    Parameters bound;
+    Parameters spare;
+    // The names of the statement's parameters, sorted, and their positions.
+    // Filled in the first time a parameter is bound by name.
+    std::vector<std::pair<std::string, int> > parameterNames;
+    bool namesIndexed;
 
     sqlite3_stmt* _handle;
     int status;
@@ -241,6 +454,27 @@ protected:
     bool locked;
     bool finalized;
     std::queue<Call*> queue;
+    RowMode rowMode;
+
+    // For Statement#stats: the calls completed, and the milliseconds they
+    // spent waiting in queue, and from then until they were done.  The
+    // status counters are reported from statusBase, rather than reset, as
+    // the statement may be running.  The memory it uses can only be read
+    // under the connection's mutex, so is taken on the thread at the end of
+    // each call.
+    double calls;
+    double waitTime;
+    double runTime;
+    int statusBase[STATEMENT_STATUS_COUNT];
+    std::atomic<int> memoryUsed;
+
+    // The column names of the rows last converted, their keys as internalized
+    // strings, and a template for objects with those properties so that all
+    // rows share one shape.  Rebuilt when the names change, as they can when
+    // the schema does.
+    std::vector<std::string> columnNames;
+    Nan::Persistent<Array> columnKeys;
+    Nan::Persistent<ObjectTemplate> rowTemplate;
 };
 
 }
@@ -0,0 +1,73 @@
+#include <assert.h>
+#include <node.h>
+
+#include "worker_thread.h"
+
+using namespace node_sqlite3;
+
+WorkerThread::WorkerThread(uv_loop_t* loop) : pending(0) {
+    uv_sem_init(&queued, 0);
+    watcher.data = this;
+    uv_async_init(loop, &watcher, Completed);
+    // Only keep the loop alive while there is work queued.
+    uv_unref(reinterpret_cast<uv_handle_t*>(&watcher));
+    int status = uv_thread_create(&thread, Run, this);
+    assert(status == 0);
+}
+
+WorkerThread::~WorkerThread() {
+    uv_sem_destroy(&queued);
+}
+
+void WorkerThread::Queue(uv_work_t* req, uv_work_cb work, uv_after_work_cb after) {
+    Item item = { req, work, after };
+    if (pending++ == 0) {
+        uv_ref(reinterpret_cast<uv_handle_t*>(&watcher));
+    }
+    requests.Push(item);
+    uv_sem_post(&queued);
+}
+
+void WorkerThread::Stop() {
+    assert(pending == 0);
+    Item item = { NULL, NULL, NULL };
+    requests.Push(item);
+    uv_sem_post(&queued);
+    uv_thread_join(&thread);
+    uv_close(reinterpret_cast<uv_handle_t*>(&watcher), Closed);
+}
+
+void WorkerThread::Run(void* data) {
+    WorkerThread* worker = static_cast<WorkerThread*>(data);
+    Item item;
+
+    while (true) {
+        uv_sem_wait(&worker->queued);
+        bool popped = worker->requests.Pop(item);
+        assert(popped);
+        (void)popped;
+        if (item.req == NULL) break;
+
+        item.work(item.req);
+        worker->completions.Push(item);
+        uv_async_send(&worker->watcher);
+    }
+}
+
+void WorkerThread::Completed(uv_async_t* handle) {
+    WorkerThread* worker = static_cast<WorkerThread*>(handle->data);
+    Item item;
+
+    // Completion callbacks may queue more work, or stop the thread; neither
+    // touches the completions queue.
+    while (worker->completions.Pop(item)) {
+        if (--worker->pending == 0) {
+            uv_unref(reinterpret_cast<uv_handle_t*>(&worker->watcher));
+        }
+        item.after(item.req, 0);
+    }
+}
+
+void WorkerThread::Closed(uv_handle_t* handle) {
+    delete static_cast<WorkerThread*>(handle->data);
+}
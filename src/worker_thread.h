@@ -0,0 +1,94 @@
+#ifndef NODE_SQLITE3_SRC_WORKER_THREAD_H
+#define NODE_SQLITE3_SRC_WORKER_THREAD_H
+
+#include <atomic>
+
+#include <uv.h>
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * A thread of a Database's own, used instead of the libuv threadpool when
+ * it is opened with { workerThread: true }.  Work runs in the order it was
+ * queued, and is never held up by, nor holds up, fs, crypto or DNS work in
+ * the pool.
+ *
+ * Work is queued from the main thread, and handed back to it, through a
+ * pair of lock-free single producer, single consumer queues.  Completions
+ * are reported through one uv_async_t, so several that finish before the
+ * main thread wakes are handled in one go.
+ *
+ */
+class WorkerThread {
+public:
+    WorkerThread(uv_loop_t* loop);
+
+    // Like uv_queue_work.  Called on the main thread.
+    void Queue(uv_work_t* req, uv_work_cb work, uv_after_work_cb after);
+    // Wait for the thread to finish, and free this once the uv_async_t is
+    // closed.  Nothing may be queued after this.
+    void Stop();
+
+protected:
+    struct Item {
+        uv_work_t* req; // NULL tells the thread to exit
+        uv_work_cb work;
+        uv_after_work_cb after;
+    };
+
+    // Dmitry Vyukov's unbounded single producer, single consumer queue.
+    // head is a used node owned by the consumer, and tail is owned by the
+    // producer.
+    class SpscQueue {
+    public:
+        SpscQueue() : head(new Node()), tail(head) {}
+        ~SpscQueue() {
+            while (head) {
+                Node* next = head->next.load(std::memory_order_relaxed);
+                delete head;
+                head = next;
+            }
+        }
+        void Push(const Item& item) {
+            Node* node = new Node();
+            node->item = item;
+            tail->next.store(node, std::memory_order_release);
+            tail = node;
+        }
+        bool Pop(Item& item) {
+            Node* next = head->next.load(std::memory_order_acquire);
+            if (next == NULL) return false;
+            item = next->item;
+            delete head;
+            head = next;
+            return true;
+        }
+
+    private:
+        struct Node {
+            Node() : next(NULL) {}
+            Item item;
+            std::atomic<Node*> next;
+        };
+        Node* head;
+        Node* tail;
+    };
+
+    ~WorkerThread();
+
+    static void Run(void* data);
+    static void Completed(uv_async_t* handle);
+    static void Closed(uv_handle_t* handle);
+
+    uv_thread_t thread;
+    uv_sem_t queued;        // Counts the items in requests
+    uv_async_t watcher;
+    SpscQueue requests;     // Main thread to worker
+    SpscQueue completions;  // Worker to main thread
+    unsigned int pending;   // Queued and not yet completed; main thread only
+};
+
+}
+
+#endif
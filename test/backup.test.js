@@ -276,4 +276,32 @@ describe('backup', function() {
             });
         });
     });
+
+    it ('run steps the backup through to the end', function(done) {
+        var backup = db.backup('test/tmp/backup.db');
+        var progress = [];
+        backup.on('progress', function(p) {
+            progress.push(p);
+        });
+        backup.run({ slice: 1 }, function(err) {
+            if (err) throw err;
+            assert.equal(backup.completed, true);
+            assert.ok(progress.length > 0);
+            var last = progress[progress.length - 1];
+            assert.equal(last.remaining, 0);
+            assert.equal(last.pageCount, backup.pageCount);
+            assertRowsMatchFile(db, 'test/tmp/backup.db', done);
+        });
+    });
+
+    it ('stepFor requires a positive time', function() {
+        var backup = db.backup('test/tmp/backup.db');
+        assert.throws(function() {
+            backup.stepFor(0);
+        }, /Argument 0 must be a positive number/);
+        assert.throws(function() {
+            backup.run({ slice: -1 });
+        }, /options.slice must be a positive number/);
+        backup.finish();
+    });
 });
@@ -51,4 +51,34 @@ describe('blob', function() {
             done();
         });
     });
+
+    it('should retrieve small and large values through get and each', function(done) {
+        var small = Buffer.from([0, 1, 2]);
+        var text = new Array(10001).join('a');
+        var utf8 = new Array(5001).join('\u00e9');
+        db.run('CREATE TABLE mixed (small BLOB, large BLOB, text TEXT, utf8 TEXT)', function(err) {
+            if (err) throw err;
+            db.run('INSERT INTO mixed VALUES (?, ?, ?, ?)', small, elmo, text, utf8, function(err) {
+                if (err) throw err;
+                db.get('SELECT * FROM mixed', function(err, row) {
+                    if (err) throw err;
+                    assert.ok(row.small.equals(small));
+                    assert.ok(row.large.equals(elmo));
+                    assert.equal(row.text, text);
+                    assert.equal(row.utf8, utf8);
+                    var seen = 0;
+                    db.each('SELECT large, text FROM mixed', function(err, row) {
+                        if (err) throw err;
+                        assert.ok(row.large.equals(elmo));
+                        assert.equal(row.text, text);
+                        seen++;
+                    }, function(err) {
+                        if (err) throw err;
+                        assert.equal(seen, 1);
+                        done();
+                    });
+                });
+            });
+        });
+    });
 });
@@ -0,0 +1,107 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('blob streams', function() {
+    var db;
+    var value = Buffer.alloc(1024 * 1024 + 100);
+    for (var i = 0; i < value.length; i++) value[i] = (i * 7) & 0xff;
+
+    before(function(done) {
+        db = new sqlite3.Database(':memory:', function(err) {
+            if (err) throw err;
+            db.run("CREATE TABLE assets (id INTEGER PRIMARY KEY, data BLOB)");
+            db.run("INSERT INTO assets VALUES (1, ?)", value);
+            db.run("INSERT INTO assets VALUES (2, zeroblob(?))", value.length, done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('reads a value a chunk at a time', function(done) {
+        var chunks = [];
+        var stream = db.openBlob('assets', 'data', 1, { chunkSize: 65536 });
+        stream.on('open', function(size) {
+            assert.equal(size, value.length);
+        });
+        stream.on('data', function(chunk) {
+            assert.ok(chunk.length <= 65536);
+            chunks.push(chunk);
+        });
+        stream.on('error', done);
+        stream.on('end', function() {
+            assert.equal(chunks.length, 17);
+            assert.ok(Buffer.concat(chunks).equals(value));
+            done();
+        });
+    });
+
+    it('writes a value in place', function(done) {
+        var stream = db.openBlob('assets', 'data', 2, { writable: true, chunkSize: 10000 });
+        stream.on('error', done);
+        stream.on('finish', function() {
+            db.get("SELECT data FROM assets WHERE id = 2", function(err, row) {
+                if (err) throw err;
+                assert.ok(row.data.equals(value));
+                done();
+            });
+        });
+        stream.write(value.slice(0, 100));
+        stream.end(value.slice(100));
+    });
+
+    it('can not write past the end of the value', function(done) {
+        var stream = db.openBlob('assets', 'data', 2, { writable: true });
+        stream.on('error', function(err) {
+            assert.equal(err.code, 'SQLITE_ERROR');
+            done();
+        });
+        stream.end(Buffer.concat([value, Buffer.from('x')]));
+    });
+
+    it('closes the blob when destroyed early', function(done) {
+        db.openBlob('assets', 'data', 1, function(err) {
+            if (err) throw err;
+            var stream = this;
+            stream.destroy();
+            stream.on('close', done);
+        });
+    });
+
+    it('reports a missing row', function(done) {
+        db.openBlob('assets', 'data', 3, function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            assert.ok(/no such rowid: 3/.test(err.message));
+            this.on('close', done);
+        });
+    });
+
+    it('emits a missing row as an error without a callback', function(done) {
+        var stream = db.openBlob('assets', 'data', 999);
+        var failed = false;
+        stream.on('error', function(err) {
+            assert.equal(err.code, 'SQLITE_ERROR');
+            assert.ok(/no such rowid: 999/.test(err.message));
+            failed = true;
+        });
+        stream.on('close', function() {
+            assert.ok(failed);
+            done();
+        });
+    });
+
+    it('closes a stream destroyed before the blob opens', function(done) {
+        var stream = db.openBlob('assets', 'data', 999);
+        stream.on('error', function() {});
+        stream.destroy();
+        stream.on('close', done);
+    });
+
+    it('requires a positive chunk size', function() {
+        assert.throws(function() {
+            db.openBlob('assets', 'data', 1, { chunkSize: 0 });
+        }, /options.chunkSize must be a positive integer/);
+    });
+});
@@ -0,0 +1,126 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+function rows(changes) {
+    return changes.map(function(change) {
+        return [change.table, change.type, Array.from(change.rowids)];
+    });
+}
+
+describe('change feed', function() {
+    var db;
+    beforeEach(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.exec("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT);" +
+                "CREATE TABLE bar (id INTEGER PRIMARY KEY)", done);
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    it('reports a transaction once, grouped by table', function(done) {
+        db.on('change', function(changes) {
+            assert.ok(changes[0].rowids instanceof Float64Array);
+            assert.equal(changes[0].database, 'main');
+            assert.deepEqual(rows(changes), [
+                ['foo', 'insert', [1, 2, 3]],
+                ['bar', 'insert', [7]],
+                ['foo', 'update', [2, 3]],
+                ['foo', 'delete', [1]]
+            ]);
+            done();
+        });
+        db.exec("BEGIN;" +
+                "INSERT INTO foo (txt) VALUES ('a'), ('b');" +
+                "INSERT INTO bar VALUES (7);" +
+                "INSERT INTO foo (txt) VALUES ('c');" +
+                "UPDATE foo SET txt = 'x' WHERE id > 1;" +
+                "DELETE FROM foo WHERE id = 1;" +
+                "COMMIT");
+    });
+
+    it('leaves out rolled back transactions', function(done) {
+        db.on('change', function(changes) {
+            assert.deepEqual(rows(changes), [['foo', 'insert', [10]]]);
+            done();
+        });
+        db.exec("BEGIN;" +
+                "INSERT INTO foo VALUES (9, 'gone');" +
+                "ROLLBACK;" +
+                "INSERT INTO foo VALUES (10, 'kept')");
+    });
+
+    it('leaves out a batch that failed', function(done) {
+        db.on('change', function(changes) {
+            assert.deepEqual(rows(changes), [['foo', 'insert', [3]]]);
+            done();
+        });
+        db.runBatch("INSERT INTO foo VALUES (?, ?)", [[1, 'a'], [2, 'b'], [1, 'again']], function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_CONSTRAINT');
+            db.run("INSERT INTO foo VALUES (3, 'kept')");
+        });
+    });
+
+    it('reports every row a DELETE without a WHERE clause removes', function(done) {
+        db.run("INSERT INTO foo (txt) VALUES ('a'), ('b'), ('c')", function(err) {
+            if (err) throw err;
+            db.on('change', function(changes) {
+                assert.deepEqual(rows(changes), [['foo', 'delete', [1, 2, 3]]]);
+                done();
+            });
+            db.run("DELETE FROM foo");
+        });
+    });
+
+    it('leaves out rows rolled back to a savepoint', function(done) {
+        db.on('change', function(changes) {
+            assert.deepEqual(rows(changes), [['foo', 'insert', [1, 3]], ['bar', 'insert', [5]]]);
+            done();
+        });
+        db.exec("BEGIN;" +
+                "INSERT INTO foo VALUES (1, 'kept');" +
+                "SAVEPOINT inner;" +
+                "INSERT INTO foo VALUES (2, 'gone');" +
+                "ROLLBACK TO inner;" +
+                "INSERT INTO foo VALUES (3, 'kept');" +
+                "RELEASE inner;" +
+                "INSERT INTO bar VALUES (5);" +
+                "COMMIT");
+    });
+
+    it('leaves out a statement that failed inside a transaction', function(done) {
+        db.on('change', function(changes) {
+            assert.deepEqual(rows(changes), [['foo', 'insert', [1, 3]]]);
+            done();
+        });
+        db.serialize(function() {
+            db.run("BEGIN");
+            db.run("INSERT INTO foo VALUES (1, 'kept')");
+            db.run("INSERT INTO foo VALUES (2, 'gone'), (1, 'again')", function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_CONSTRAINT');
+            });
+            db.run("INSERT INTO foo VALUES (3, 'kept')");
+            db.run("COMMIT");
+        });
+    });
+
+    it('stops with the last listener', function(done) {
+        var seen = 0;
+        function listener() {
+            seen++;
+            db.removeListener('change', listener);
+            db.run("INSERT INTO bar VALUES (2)", function(err) {
+                if (err) throw err;
+                setImmediate(function() {
+                    assert.equal(seen, 1);
+                    done();
+                });
+            });
+        }
+        db.on('change', listener);
+        db.run("INSERT INTO bar VALUES (1)");
+    });
+});
@@ -0,0 +1,116 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var fs = require('fs');
+var helper = require('./support/helper');
+
+describe('csv virtual table', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:', { csvModule: true }, done);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('is only available with { csvModule: true }', function(done) {
+        var plain = new sqlite3.Database(':memory:');
+        plain.run("CREATE VIRTUAL TABLE sample USING csv(file='test/support/import/sample.csv')", function(err) {
+            assert.ok(err);
+            assert.ok(/no such module: csv/.test(err.message));
+            assert.throws(function() {
+                new sqlite3.Database(':memory:', { csvModule: 'yes' });
+            }, /options.csvModule must be a boolean/);
+            plain.close(done);
+        });
+    });
+
+    it('queries a file with the types an import would infer', function(done) {
+        db.run("CREATE VIRTUAL TABLE sample USING csv(file='test/support/import/sample.csv')", function(err) {
+            if (err) throw err;
+            db.all("PRAGMA table_info(sample)", function(err, columns) {
+                if (err) throw err;
+                assert.deepEqual(columns.map(function(c) { return c.name + ' ' + c.type; }),
+                    ['firstName text', 'lastName text', 'email text', 'phoneNumber integer']);
+                db.all("SELECT rowid, firstName, phoneNumber FROM sample WHERE lastName = 'Doe'", function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows, [
+                        { rowid: 1, firstName: 'John', phoneNumber: 123456789 },
+                        { rowid: 2, firstName: 'Jane', phoneNumber: 9876543210 }
+                    ]);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('reads TSV using the delimiter option', function(done) {
+        db.run("CREATE VIRTUAL TABLE data USING csv(file='test/support/import/data.tsv', delimiter=tab)", function(err) {
+            if (err) throw err;
+            db.all("SELECT * FROM data", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [{ x: 5, y: 90 }, { x: 25, y: 30 }]);
+                done();
+            });
+        });
+    });
+
+    it('names the columns of a file without a header', function(done) {
+        db.run("CREATE VIRTUAL TABLE named USING csv(file='test/support/import/sample.csv', " +
+               "header=no, columns='first,last,email,phone')", function(err) {
+            if (err) throw err;
+            db.get("SELECT count(*) AS n, min(first) AS first FROM named", function(err, row) {
+                if (err) throw err;
+                assert.deepEqual(row, { n: 4, first: 'James' });
+                done();
+            });
+        });
+    });
+
+    it('reports bad options', function(done) {
+        db.run("CREATE VIRTUAL TABLE missing USING csv(file='test/support/import/none.csv')", function(err) {
+            assert.ok(err);
+            assert.ok(/cannot open file/.test(err.message));
+            db.run("CREATE VIRTUAL TABLE unknown USING csv(file='test/support/import/sample.csv', size=1)", function(err) {
+                assert.ok(err);
+                assert.ok(/unknown option "size"/.test(err.message));
+                done();
+            });
+        });
+    });
+
+    describe('parallel scan', function() {
+        var file = 'test/tmp/csv-table-parallel.csv';
+        var rows = 200000;
+
+        before(function() {
+            helper.ensureExists('test/tmp');
+            var lines = ['id,label,note'];
+            for (var i = 0; i < rows; i++) {
+                lines.push(i + ',"label, ' + i + '","line one\nline ""two"" ' + i + '"');
+            }
+            fs.writeFileSync(file, lines.join('\n') + '\n');
+        });
+
+        after(function() {
+            helper.deleteFile(file);
+        });
+
+        it('matches a serial scan', function(done) {
+            db.serialize(function() {
+                db.run("CREATE VIRTUAL TABLE scanSerial USING csv(file='" + file + "')");
+                db.run("CREATE VIRTUAL TABLE scanParallel USING csv(file='" + file + "', parallel=yes, workers=3)");
+                db.get("SELECT count(*) AS n, sum(id) AS ids, max(rowid) AS last FROM scanParallel", function(err, row) {
+                    if (err) throw err;
+                    assert.deepEqual(row, { n: rows, ids: rows * (rows - 1) / 2, last: rows });
+                });
+                db.get("SELECT count(*) AS n FROM (SELECT rowid, * FROM scanSerial EXCEPT " +
+                       "SELECT rowid, * FROM scanParallel)", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.n, 0);
+                    done();
+                });
+            });
+        });
+    });
+});
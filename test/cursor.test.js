@@ -0,0 +1,78 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('cursor', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database('test/support/big.db', sqlite3.OPEN_READONLY, done);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('fetches rows a page at a time with Statement#fetch', function(done) {
+        var stmt = db.prepare('SELECT rowid AS id FROM foo WHERE rowid <= ?', 250);
+        stmt.fetch(100, function(err, rows) {
+            if (err) throw err;
+            assert.equal(rows.length, 100);
+            assert.equal(rows[0].id, 1);
+            stmt.fetch(200, function(err, rows) {
+                if (err) throw err;
+                assert.equal(rows.length, 150);
+                assert.equal(rows[0].id, 101);
+                stmt.fetch(100, function(err, rows) {
+                    if (err) throw err;
+                    assert.equal(rows.length, 0);
+                    stmt.finalize(done);
+                });
+            });
+        });
+    });
+
+    it('retrieves 100,000 rows with for await', async function() {
+        var total = 100000;
+        var next = 1;
+        for await (var row of db.iterate('SELECT rowid AS id, txt FROM foo LIMIT ?', [total], { pageSize: 1000 })) {
+            assert.equal(row.id, next++);
+        }
+        assert.equal(next - 1, total);
+    });
+
+    it('stops fetching when the loop breaks', async function() {
+        var stmt = db.prepare('SELECT rowid AS id FROM foo');
+        var seen = 0;
+        for await (var row of stmt.iterate(undefined, { pageSize: 10 })) {
+            if (++seen === 25) break;
+        }
+        // The statement was reset, and starts over.
+        var first = await stmt.iterate().next();
+        assert.equal(first.value.id, 1);
+        await new Promise(function(resolve) { stmt.finalize(resolve); });
+    });
+
+    it('reports errors from next()', async function() {
+        var cursor = db.iterate('SELECT * FROM nowhere');
+        await assert.rejects(cursor.next(), /no such table: nowhere/);
+        assert.deepEqual(await cursor.next(), { value: undefined, done: true });
+    });
+
+    it('streams rows as an object mode Readable', function(done) {
+        var count = 0;
+        db.createReadStream('SELECT rowid AS id FROM foo LIMIT ?', 5000, { pageSize: 64 })
+            .on('data', function(row) {
+                assert.equal(row.id, ++count);
+            })
+            .on('error', done)
+            .on('end', function() {
+                assert.equal(count, 5000);
+                done();
+            });
+    });
+
+    it('requires a positive page size', function() {
+        assert.throws(function() {
+            db.iterate('SELECT 1', undefined, { pageSize: 0 });
+        }, /options.pageSize must be a positive integer/);
+    });
+});
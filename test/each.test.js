@@ -36,4 +36,48 @@ describe('each', function() {
             done();
         });
     });
+
+    it('retrieve rows in batches with Statement#eachBatch', function(done) {
+        var total = 10005;
+        var sizes = [];
+        var next = 1;
+
+        db.eachBatch('SELECT rowid AS id, txt FROM foo ORDER BY rowid LIMIT 0, ?', 1000, total, function(err, rows) {
+            if (err) throw err;
+            sizes.push(rows.length);
+            rows.forEach(function(row) {
+                assert.equal(row.id, next++);
+            });
+        }, function(err, num) {
+            if (err) throw err;
+            assert.equal(num, total);
+            assert.equal(sizes.length, 11);
+            assert.deepEqual(sizes.slice(0, 10), [1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000]);
+            assert.equal(sizes[10], 5);
+            done();
+        });
+    });
+
+    it('Statement#eachBatch with no rows', function(done) {
+        var called = false;
+        db.eachBatch('SELECT id FROM foo WHERE id < 0', 10, function(err, rows) {
+            called = true;
+        }, function(err, num) {
+            if (err) throw err;
+            assert.equal(num, 0);
+            assert.ok(!called);
+            done();
+        });
+    });
+
+    it('Statement#eachBatch requires a batch size', function() {
+        var stmt = db.prepare('SELECT id FROM foo');
+        assert.throws(function() {
+            stmt.eachBatch(0, function() {});
+        }, /Batch size must be a positive integer/);
+        assert.throws(function() {
+            stmt.eachBatch(function() {});
+        }, /Batch size must be a positive integer/);
+        stmt.finalize();
+    });
 });
@@ -0,0 +1,140 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var fs = require('fs');
+var stream = require('stream');
+var helper = require('./support/helper');
+
+describe('export', function() {
+    var db;
+    var file = 'test/tmp/export.csv';
+    var rows = 100000;
+
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        db = new sqlite3.Database(':memory:', function(err) {
+            if (err) throw err;
+            db.exec(
+                "CREATE TABLE quirks (n INTEGER, t TEXT, r REAL);" +
+                "INSERT INTO quirks VALUES (1, 'plain', 0.1);" +
+                "INSERT INTO quirks VALUES (-9223372036854775808, 'comma, \"quote\"', 1e300);" +
+                "INSERT INTO quirks VALUES (NULL, '', NULL);" +
+                "INSERT INTO quirks VALUES (3, 'two\nlines', -2.5);" +
+                "CREATE TABLE big (id INTEGER, label TEXT, amount REAL);" +
+                "WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c WHERE i < " + (rows - 1) + ") " +
+                "INSERT INTO big SELECT i, 'label, ' || i, i / 8.0 FROM c;", done);
+        });
+    });
+
+    after(function(done) {
+        helper.deleteFile(file);
+        db.close(done);
+    });
+
+    it('writes RFC 4180 CSV to a file', function(done) {
+        db.export('SELECT * FROM quirks', file, {}, function(err, res) {
+            if (err) throw err;
+            assert.deepEqual(res.columnIds, ['n', 't', 'r']);
+            assert.equal(res.rowCount, 4);
+            var text = fs.readFileSync(file, 'utf8');
+            assert.equal(res.bytes, Buffer.byteLength(text));
+            assert.equal(text,
+                'n,t,r\r\n' +
+                '1,plain,0.1\r\n' +
+                '-9223372036854775808,"comma, ""quote""",1e+300\r\n' +
+                ',"",\r\n' +
+                '3,"two\nlines",-2.5\r\n');
+            done();
+        });
+    });
+
+    it('honours delimiter and noHeaderRow', function(done) {
+        db.export('SELECT n, t FROM quirks WHERE n = 1', file, { delimiter: '\t', noHeaderRow: true }, function(err, res) {
+            if (err) throw err;
+            assert.equal(fs.readFileSync(file, 'utf8'), '1\tplain\r\n');
+            done();
+        });
+    });
+
+    it('round-trips through Database#import', function(done) {
+        db.export('SELECT * FROM big', file, {}, function(err, res) {
+            if (err) throw err;
+            assert.equal(res.rowCount, rows);
+            db.import(file, 'bigAgain', {}, function(err, res) {
+                if (err) throw err;
+                assert.deepEqual(res.columnTypes, ['integer', 'text', 'real']);
+                db.get('SELECT count(*) AS n FROM (SELECT * FROM big EXCEPT SELECT * FROM bigAgain)', function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.n, 0);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('writes whole reals so that they read back as reals', function(done) {
+        db.export('SELECT 5.0 AS a, -2.0 AS b, 5 AS c', file, {}, function(err) {
+            if (err) throw err;
+            assert.equal(fs.readFileSync(file, 'utf8'), 'a,b,c\r\n5.0,-2.0,5\r\n');
+            db.import(file, 'wholeAgain', {}, function(err, res) {
+                if (err) throw err;
+                assert.deepEqual(res.columnTypes, ['real', 'real', 'integer']);
+                db.get('SELECT typeof(a) AS a, typeof(c) AS c FROM wholeAgain', function(err, row) {
+                    if (err) throw err;
+                    assert.deepEqual(row, { a: 'real', c: 'integer' });
+                    done();
+                });
+            });
+        });
+    });
+
+    it('writes the same text to a stream', function(done) {
+        var chunks = [];
+        var sink = new stream.Writable({
+            // Slow enough that the export has to wait for it.
+            highWaterMark: 1024,
+            write: function(chunk, encoding, cb) {
+                chunks.push(chunk);
+                setImmediate(cb);
+            }
+        });
+        db.export('SELECT * FROM big', file, {}, function(err) {
+            if (err) throw err;
+            db.export('SELECT * FROM big', sink, function(err, res) {
+                if (err) throw err;
+                assert.equal(res.rowCount, rows);
+                assert.ok(chunks.length > 1);
+                assert.ok(Buffer.concat(chunks).equals(fs.readFileSync(file)));
+                done();
+            });
+        });
+    });
+
+    it('reports a bad query and leaves the file alone', function(done) {
+        fs.writeFileSync(file, 'untouched');
+        db.export('SELECT * FROM nowhere', file, {}, function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            assert.equal(err.message, 'SQLITE_ERROR: no such table: nowhere');
+            assert.equal(fs.readFileSync(file, 'utf8'), 'untouched');
+            done();
+        });
+    });
+
+    it('is cancelled when its stream is destroyed', function(done) {
+        // Far more than is buffered ahead of the reader
+        var sql = 'SELECT * FROM big, (SELECT 1 FROM big LIMIT 100)';
+        var source = db.createExportStream(sql, function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_INTERRUPT');
+            // The database is free again.
+            db.get('SELECT count(*) AS n FROM big', function(err, row) {
+                if (err) throw err;
+                assert.equal(row.n, rows);
+                done();
+            });
+        });
+        source.once('data', function() {
+            source.destroy();
+        });
+    });
+});
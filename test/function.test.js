@@ -0,0 +1,168 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('user functions', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, grp TEXT, num INTEGER)");
+            var stmt = db.prepare("INSERT INTO foo (grp, num) VALUES (?, ?)");
+            for (var i = 1; i <= 10; i++) stmt.run(i % 2 ? 'odd' : 'even', i);
+            stmt.finalize(done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('calls a scalar function from SQL', function(done) {
+        db.function('twice', { deterministic: true }, function(x) {
+            return x * 2;
+        });
+        db.all("SELECT id FROM foo WHERE twice(num) > 16 ORDER BY id", function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [{ id: 9 }, { id: 10 }]);
+            done();
+        });
+    });
+
+    it('passes and returns each type', function(done) {
+        db.function('same', function(x) { return x; });
+        db.function('reversed', function(x) { return Buffer.from(x).reverse(); });
+        db.get("SELECT same(1) AS i, same(1.5) AS f, same('eé') AS t, same(NULL) AS n, " +
+               "reversed(x'010203') AS b", function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(row, { i: 1, f: 1.5, t: 'eé', n: null, b: Buffer.from([3, 2, 1]) });
+            done();
+        });
+    });
+
+    it('takes any number of arguments with { varargs: true }', function(done) {
+        db.function('joined', { varargs: true }, function() {
+            return Array.prototype.join.call(arguments, '-');
+        });
+        db.get("SELECT joined() AS a, joined(1, 'b', 3) AS b", function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(row, { a: '', b: '1-b-3' });
+            done();
+        });
+    });
+
+    it('reports what the function throws', function(done) {
+        db.function('fails', function() { throw new Error('no luck'); }, function(err) {
+            if (err) throw err;
+            db.get("SELECT fails()", function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_ERROR');
+                assert.ok(/no luck/.test(err.message));
+                done();
+            });
+        });
+    });
+
+    it('folds groups with an aggregate', function(done) {
+        db.aggregate('listed', {
+            start: function() { return []; },
+            step: function(list, num) { list.push(num); return list; },
+            result: function(list) { return list.join(','); }
+        });
+        db.aggregate('product', {
+            start: 1,
+            step: function(product, num) { return product * num; }
+        });
+        db.all("SELECT grp, listed(num) AS nums, product(num) AS p FROM foo GROUP BY grp ORDER BY grp",
+            function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [
+                    { grp: 'even', nums: '2,4,6,8,10', p: 3840 },
+                    { grp: 'odd', nums: '1,3,5,7,9', p: 945 }
+                ]);
+                db.get("SELECT product(num) AS p FROM foo WHERE 0", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.p, 1);
+                    done();
+                });
+            });
+    });
+
+    it('lets a function use the connection it is called on', function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/test_function_backup.db');
+        var probe = db.prepare("SELECT num FROM foo WHERE id = ?");
+        var left = 4;
+        function finished(err) {
+            if (err) throw err;
+            if (--left === 0) probe.finalize(done);
+        }
+        db.get("SELECT count(*) AS n FROM foo", function(err) {
+            if (err) throw err;
+            var blob = db.openBlob('foo', 'grp', 1, function(err) {
+                if (err) throw err;
+                var backup = db.backup('test/tmp/test_function_backup.db', function(err) {
+                    if (err) throw err;
+                    db.function('touches', function(id) {
+                        if (id === 1) {
+                            // Each of these needs the connection this call
+                            // holds the mutex of.
+                            assert.equal(typeof probe.stats().memoryUsed, 'number');
+                            db.get("SELECT count(*) AS n FROM foo", finished);
+                            blob.on('close', finished);
+                            blob.destroy();
+                            backup.finish(finished);
+                        }
+                        return id;
+                    });
+                    db.all("SELECT touches(id) AS id FROM foo", function(err, rows) {
+                        if (err) throw err;
+                        assert.equal(rows.length, 10);
+                        finished();
+                    });
+                });
+            });
+        });
+    });
+
+    it('requires a step function', function() {
+        assert.throws(function() {
+            db.aggregate('broken', { start: 0 });
+        }, /options.step must be a function/);
+    });
+});
+
+describe('user functions on readers', function() {
+    var db;
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/test_functions.db');
+        helper.deleteFile('test/tmp/test_functions.db-wal');
+        helper.deleteFile('test/tmp/test_functions.db-shm');
+        db = new sqlite3.Database('test/tmp/test_functions.db', { readers: 2 });
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (num INTEGER)");
+            db.runBatch("INSERT INTO foo VALUES (?)", Array.from({ length: 100 }, function(_, i) {
+                return [i];
+            }));
+        });
+        db.function('plusOne', function(x) { return x + 1; }, done);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('runs calls from queries on several connections at once', function(done) {
+        var remaining = 20;
+        for (var i = 0; i < 20; i++) {
+            db.get("SELECT sum(plusOne(num)) AS total FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.total, 5050);
+                if (--remaining === 0) done();
+            });
+        }
+        // May have to wait for the mutex of a connection running plusOne().
+        db.configure('busyTimeout', 1000);
+    });
+});
@@ -35,4 +35,28 @@ describe('named columns', function() {
         });
     });
 
+    it('should keep the last of repeated and index-like names', function(done) {
+        db.all("SELECT txt AS a, num AS a, num AS '1' FROM foo", function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [{ a: 1, '1': 1 }]);
+            done();
+        });
+    });
+
+    it('should pick up columns added to the table', function(done) {
+        var stmt = db.prepare("SELECT * FROM foo");
+        stmt.all(function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(Object.keys(rows[0]), ['txt', 'num']);
+            db.run("ALTER TABLE foo ADD COLUMN extra TEXT DEFAULT 'x'", function(err) {
+                if (err) throw err;
+                stmt.all(function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows, [{ txt: "Lorem Ipsum", num: 1, extra: 'x' }]);
+                    stmt.finalize(done);
+                });
+            });
+        });
+    });
+
 });
@@ -66,4 +66,35 @@ describe('named parameters', function() {
             done();
         });
     });
+
+    it('should rebind named parameters on a prepared statement', function(done) {
+        var stmt = db.prepare("INSERT INTO foo VALUES($text, $id)");
+        for (var i = 7; i <= 1006; i++) {
+            stmt.run({ $id: i, $text: "Row " + i });
+        }
+        stmt.finalize(function(err) {
+            if (err) throw err;
+            db.get("SELECT count(*) AS n, max(num) AS last FROM foo WHERE txt LIKE 'Row %'", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.n, 1000);
+                assert.equal(row.last, 1006);
+                done();
+            });
+        });
+    });
+
+    it('should keep bound text after the call that bound it', function(done) {
+        var stmt = db.prepare("SELECT $text || '!' AS txt, $blob AS blb");
+        stmt.get({ $text: "Kept", $blob: Buffer.from('abc') }, function(err, row) {
+            if (err) throw err;
+            assert.equal(row.txt, "Kept!");
+            // Without parameters, the statement runs with the ones bound.
+            stmt.reset().get(function(err, row) {
+                if (err) throw err;
+                assert.equal(row.txt, "Kept!");
+                assert.equal(row.blb.toString(), 'abc');
+                stmt.finalize(done);
+            });
+        });
+    });
 });
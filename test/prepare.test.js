@@ -424,4 +424,59 @@ describe('prepare', function() {
 
         after(function(done) { db.close(done); });
     });
+
+    describe('one-off statements', function() {
+        var db;
+        before(function(done) {
+            // Without the cache, every call prepares on a worker thread.
+            db = new sqlite3.Database(':memory:', { statementCache: 0 }, function(err) {
+                if (err) throw err;
+                db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)", done);
+            });
+        });
+
+        it('should report a failed prepare once', function(done) {
+            var calls = 0;
+            db.get("SELECT * FROM nowhere", function(err) {
+                calls++;
+                assert.ok(err);
+                assert.equal(err.message, 'SQLITE_ERROR: no such table: nowhere');
+                setTimeout(function() {
+                    assert.equal(calls, 1);
+                    done();
+                }, 20);
+            });
+        });
+
+        it('should keep calls in order', function(done) {
+            var results = [];
+            db.serialize(function() {
+                for (var i = 1; i <= 50; i++) {
+                    db.run("INSERT INTO foo (txt) VALUES (?)", 'row ' + i);
+                    db.get("SELECT count(*) AS n FROM foo", function(err, row) {
+                        if (err) throw err;
+                        results.push(row.n);
+                    });
+                }
+                db.all("SELECT txt FROM foo ORDER BY id", function(err, rows) {
+                    if (err) throw err;
+                    assert.equal(rows.length, 50);
+                    assert.equal(rows[49].txt, 'row 50');
+                    for (var i = 0; i < 50; i++) assert.equal(results[i], i + 1);
+                    done();
+                });
+            });
+        });
+
+        it('should set lastID and changes', function(done) {
+            db.run("INSERT INTO foo (txt) VALUES ('last')", function(err) {
+                if (err) throw err;
+                assert.equal(this.lastID, 51);
+                assert.equal(this.changes, 1);
+                done();
+            });
+        });
+
+        after(function(done) { db.close(done); });
+    });
 });
@@ -55,3 +55,49 @@ describe('profiling', function() {
         db.close(done);
     });
 });
+
+describe('profiling with sampling', function() {
+    it('reports one in every 1 / sampling statements', function(done) {
+        var db = new sqlite3.Database(':memory:');
+        var seen = 0;
+        db.configure('profileSampling', 0.25);
+        db.on('profile', function(sql, ms) {
+            assert.equal(sql, 'SELECT 1');
+            seen++;
+        });
+        db.serialize(function() {
+            for (var i = 0; i < 20; i++) db.run('SELECT 1');
+        });
+        db.close(function(err) {
+            if (err) throw err;
+            assert.equal(seen, 5);
+            done();
+        });
+    });
+
+    it('leaves out statements faster than the threshold', function(done) {
+        var db = new sqlite3.Database(':memory:');
+        var seen = [];
+        db.configure('profileThreshold', 60000);
+        db.on('profile', function(sql) {
+            seen.push(sql);
+        });
+        db.run('SELECT 1');
+        db.close(function(err) {
+            if (err) throw err;
+            assert.deepEqual(seen, []);
+            done();
+        });
+    });
+
+    it('checks its settings', function() {
+        var db = new sqlite3.Database(':memory:');
+        assert.throws(function() {
+            db.configure('profileSampling', 0);
+        }, /Value must be a number above 0 and at most 1/);
+        assert.throws(function() {
+            db.configure('profileThreshold', -1);
+        }, /Value must be a non-negative number/);
+        db.close();
+    });
+});
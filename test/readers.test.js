@@ -0,0 +1,129 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('readers', function() {
+    var db;
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/test_readers.db');
+        helper.deleteFile('test/tmp/test_readers.db-wal');
+        helper.deleteFile('test/tmp/test_readers.db-shm');
+        db = new sqlite3.Database('test/tmp/test_readers.db', { readers: 4 }, done);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('switches the database to WAL', function(done) {
+        db.get("PRAGMA journal_mode", function(err, row) {
+            if (err) throw err;
+            assert.equal(row.journal_mode, 'wal');
+            done();
+        });
+    });
+
+    it('sees committed writes from queries', function(done) {
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.runBatch("INSERT INTO foo VALUES (?, ?)", Array.from({ length: 1000 }, function(_, i) {
+                return [i + 1, 'row ' + (i + 1)];
+            }));
+            db.get("SELECT count(*) AS n FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.n, 1000);
+                done();
+            });
+        });
+    });
+
+    it('runs many queries at once', function(done) {
+        var left = 200;
+        for (var i = 1; i <= 200; i++) {
+            (function(i) {
+                db.get("SELECT txt FROM foo WHERE id = ?", i, function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.txt, 'row ' + i);
+                    if (--left === 0) done();
+                });
+            })(i);
+        }
+    });
+
+    it('keeps queries inside a transaction on its own connection', function(done) {
+        db.serialize(function() {
+            db.run("BEGIN");
+            db.run("INSERT INTO foo (txt) VALUES ('uncommitted')");
+            db.get("SELECT count(*) AS n FROM foo WHERE txt = 'uncommitted'", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.n, 1);
+            });
+            db.run("ROLLBACK", done);
+        });
+    });
+
+    it('moves statements prepared before a transaction onto its connection', function(done) {
+        var stmt = db.prepare("SELECT count(*) AS n FROM foo WHERE txt = ?", 'uncommitted', function(err) {
+            if (err) throw err;
+            db.serialize(function() {
+                db.run("BEGIN");
+                db.run("INSERT INTO foo (txt) VALUES ('uncommitted')", function(err) {
+                    if (err) throw err;
+                    stmt.get(function(err, row) {
+                        if (err) throw err;
+                        assert.equal(row.n, 1);
+                        db.run("ROLLBACK", function(err) {
+                            if (err) throw err;
+                            stmt.get(function(err, row) {
+                                if (err) throw err;
+                                assert.equal(row.n, 0);
+                                stmt.finalize(done);
+                            });
+                        });
+                    });
+                });
+            });
+        });
+    });
+
+    it('falls back for what readers cannot see', function(done) {
+        db.serialize(function() {
+            db.run("CREATE TEMP TABLE bar (id INTEGER)");
+            db.run("INSERT INTO bar VALUES (1)");
+            db.all("SELECT id FROM bar", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [{ id: 1 }]);
+                done();
+            });
+        });
+    });
+
+    it('refuses to close with statements left on a reader', function(done) {
+        var stmt = db.prepare("SELECT 1", function(err) {
+            if (err) throw err;
+            db.close(function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_BUSY');
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('is ignored for in-memory databases', function(done) {
+        var memory = new sqlite3.Database(':memory:', { readers: 2 }, function(err) {
+            if (err) throw err;
+            memory.get("SELECT 1 AS one", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.one, 1);
+                memory.close(done);
+            });
+        });
+    });
+
+    it('checks the option', function() {
+        assert.throws(function() {
+            new sqlite3.Database(':memory:', { readers: -1 });
+        }, /options.readers must be a non-negative integer/);
+    });
+});
@@ -0,0 +1,94 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('row mode', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:', function(err) {
+            if (err) throw err;
+            db.exec(
+                "CREATE TABLE foo (id INTEGER, txt TEXT, num REAL);" +
+                "INSERT INTO foo VALUES (1, 'one', 1.5);" +
+                "INSERT INTO foo VALUES (2, NULL, 2.5);" +
+                "INSERT INTO foo VALUES (3, 'three', 3.5);", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('returns arrays from all, get and each', function(done) {
+        var stmt = db.prepare('SELECT id, txt FROM foo ORDER BY id').setRowMode('array');
+        stmt.all(function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [[1, 'one'], [2, null], [3, 'three']]);
+            assert.deepEqual(stmt.columns, ['id', 'txt']);
+            stmt.reset().get(function(err, row) {
+                if (err) throw err;
+                assert.deepEqual(row, [1, 'one']);
+                var seen = [];
+                stmt.each(function(err, row) {
+                    if (err) throw err;
+                    seen.push(row);
+                }, function(err, count) {
+                    if (err) throw err;
+                    assert.equal(count, 3);
+                    assert.deepEqual(seen[2], [3, 'three']);
+                    stmt.finalize(done);
+                });
+            });
+        });
+    });
+
+    it('returns columns from all', function(done) {
+        var stmt = db.prepare('SELECT id, txt, num FROM foo ORDER BY id').setRowMode('columnar');
+        stmt.all(function(err, result) {
+            if (err) throw err;
+            assert.ok(result.id instanceof Float64Array);
+            assert.deepEqual(Array.prototype.slice.call(result.id), [1, 2, 3]);
+            assert.ok(result.num instanceof Float64Array);
+            assert.deepEqual(Array.prototype.slice.call(result.num), [1.5, 2.5, 3.5]);
+            // NULL keeps the column an Array.
+            assert.ok(Array.isArray(result.txt));
+            assert.deepEqual(result.txt, ['one', null, 'three']);
+            stmt.reset().get(function(err, row) {
+                if (err) throw err;
+                // Single rows come as arrays.
+                assert.deepEqual(row, [1, 'one', 1.5]);
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('returns empty columns when there are no rows', function(done) {
+        var stmt = db.prepare('SELECT id, txt FROM foo WHERE id < 0').setRowMode('columnar');
+        stmt.all(function(err, result) {
+            if (err) throw err;
+            assert.deepEqual(result, { id: [], txt: [] });
+            stmt.finalize(done);
+        });
+    });
+
+    it('applies the mode in force when each call was made', function(done) {
+        var stmt = db.prepare('SELECT id FROM foo WHERE id = ?');
+        stmt.get(1, function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(row, { id: 1 });
+        });
+        stmt.setRowMode('array');
+        stmt.get(1, function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(row, [1]);
+            stmt.finalize(done);
+        });
+    });
+
+    it('rejects unknown modes', function() {
+        var stmt = db.prepare('SELECT 1');
+        assert.throws(function() {
+            stmt.setRowMode('rows');
+        }, /Row mode must be "object", "array" or "columnar"/);
+        stmt.finalize();
+    });
+});
@@ -0,0 +1,88 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('runBatch', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:', function(err) {
+            if (err) throw err;
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT UNIQUE)", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('inserts every set of parameters in one call', function(done) {
+        var sets = [];
+        for (var i = 1; i <= 10000; i++) {
+            sets.push([i, 'row ' + i]);
+        }
+        var stmt = db.prepare("INSERT INTO foo VALUES (?, ?)");
+        stmt.runBatch(sets, function(err) {
+            if (err) throw err;
+            assert.equal(this.changes, 10000);
+            assert.equal(this.lastID, 10000);
+            stmt.finalize();
+            db.get("SELECT count(*) AS n, max(txt) AS last FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.n, 10000);
+                assert.equal(row.last, 'row 9999');
+                done();
+            });
+        });
+    });
+
+    it('takes named parameters and single values', function(done) {
+        db.runBatch("UPDATE foo SET txt = $txt WHERE id = $id", [
+            { $id: 1, $txt: 'first' },
+            { $id: 2, $txt: 'second' }
+        ], function(err) {
+            if (err) throw err;
+            assert.equal(this.changes, 2);
+            db.runBatch("DELETE FROM foo WHERE id = ?", [3, 4, 5], function(err) {
+                if (err) throw err;
+                assert.equal(this.changes, 3);
+                db.all("SELECT txt FROM foo WHERE id <= 5 ORDER BY id", function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows, [{ txt: 'first' }, { txt: 'second' }]);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('rolls back every set when one fails', function(done) {
+        db.runBatch("INSERT INTO foo (txt) VALUES (?)", ['new 1', 'new 2', 'first', 'new 3'], function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_CONSTRAINT');
+            assert.equal(err.index, 2);
+            db.get("SELECT count(*) AS n FROM foo WHERE txt LIKE 'new %'", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.n, 0);
+                done();
+            });
+        });
+    });
+
+    it('keeps the sets before a failure without a transaction', function(done) {
+        db.runBatch("INSERT INTO foo (txt) VALUES (?)", ['new 1', 'first', 'new 2'], { transaction: false }, function(err) {
+            assert.ok(err);
+            assert.equal(err.index, 1);
+            db.all("SELECT txt FROM foo WHERE txt LIKE 'new %'", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [{ txt: 'new 1' }]);
+                done();
+            });
+        });
+    });
+
+    it('requires an array of parameter sets', function() {
+        var stmt = db.prepare("SELECT 1");
+        assert.throws(function() {
+            stmt.runBatch({}, function() {});
+        }, /Array of parameter sets expected/);
+        stmt.finalize();
+    });
+});
@@ -0,0 +1,119 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('statement cache', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:', { statementCache: 4 }, function(err) {
+            if (err) throw err;
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('reuses statements for the same SQL', function(done) {
+        var before = db.statementCache;
+        assert.equal(before.capacity, 4);
+        var left = 100;
+        function insert(i) {
+            db.run("INSERT INTO foo (txt) VALUES (?)", 'row ' + i, function(err) {
+                if (err) throw err;
+                if (--left > 0) return insert(i + 1);
+                var stats = db.statementCache;
+                assert.equal(stats.misses - before.misses, 1);
+                assert.equal(stats.hits - before.hits, 99);
+                db.get("SELECT count(*) AS n FROM foo", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.n, 100);
+                    done();
+                });
+            });
+        }
+        insert(1);
+    });
+
+    it('binds fresh parameters every time', function(done) {
+        db.get("SELECT txt FROM foo WHERE id = ?", 1, function(err, row) {
+            if (err) throw err;
+            assert.equal(row.txt, 'row 1');
+            db.get("SELECT txt FROM foo WHERE id = ?", function(err, row) {
+                if (err) throw err;
+                // The previous binding was cleared.
+                assert.equal(row, undefined);
+                db.all("SELECT txt FROM foo WHERE id = ?", 2, function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows, [{ txt: 'row 2' }]);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('keeps the most recently used statements', function(done) {
+        var sql = [];
+        for (var i = 0; i < 6; i++) sql.push("SELECT " + i + " AS n");
+        function next(i) {
+            if (i < sql.length) {
+                return db.get(sql[i], function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.n, i);
+                    next(i + 1);
+                });
+            }
+            assert.equal(db.statementCache.size, 4);
+            var misses = db.statementCache.misses;
+            db.get(sql[5], function(err) {
+                if (err) throw err;
+                assert.equal(db.statementCache.misses, misses);
+                db.get(sql[0], function(err) {
+                    if (err) throw err;
+                    // The first was evicted, the last was not.
+                    assert.equal(db.statementCache.misses - misses, 1);
+                    done();
+                });
+            });
+        }
+        next(0);
+    });
+
+    it('lets go of statements when the schema changes', function(done) {
+        db.get("SELECT * FROM foo WHERE id = 1", function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(Object.keys(row), ['id', 'txt']);
+            db.run("ALTER TABLE foo ADD COLUMN num INTEGER", function(err) {
+                if (err) throw err;
+                var misses = db.statementCache.misses;
+                db.get("SELECT * FROM foo WHERE id = 1", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(db.statementCache.misses - misses, 1);
+                    assert.deepEqual(Object.keys(row), ['id', 'txt', 'num']);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('can be turned off', function(done) {
+        var other = new sqlite3.Database(':memory:', { statementCache: 0 }, function(err) {
+            if (err) throw err;
+            other.get("SELECT 1", function(err) {
+                if (err) throw err;
+                other.get("SELECT 1", function(err) {
+                    if (err) throw err;
+                    assert.equal(other.statementCache.hits, 0);
+                    assert.equal(other.statementCache.size, 0);
+                    other.close(done);
+                });
+            });
+        });
+    });
+
+    it('checks the option', function() {
+        assert.throws(function() {
+            new sqlite3.Database(':memory:', { statementCache: 'big' });
+        }, /options.statementCache must be a non-negative integer/);
+    });
+});
@@ -0,0 +1,89 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('stats', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            var stmt = db.prepare("INSERT INTO foo (txt) VALUES (?)");
+            for (var i = 0; i < 100; i++) stmt.run('row ' + (i % 10));
+            stmt.finalize(done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('counts full scans and sorts of a statement', function(done) {
+        var stmt = db.prepare("SELECT id FROM foo WHERE txt LIKE ? ORDER BY txt");
+        stmt.all('row 1', function(err, rows) {
+            if (err) throw err;
+            assert.equal(rows.length, 10);
+            stmt.all('row 2', function(err) {
+                if (err) throw err;
+                var stats = stmt.stats();
+                assert.equal(stats.calls, 2);
+                assert.equal(stats.queued, 0);
+                assert.equal(stats.fullscanSteps, 198);
+                assert.equal(stats.sorts, 2);
+                assert.ok(stats.vmSteps > 0);
+                assert.equal(stats.runs, 2);
+                assert.equal(stats.reprepares, 0);
+                assert.ok(stats.memoryUsed > 0);
+                assert.ok(stats.waitTime >= 0);
+                assert.ok(stats.runTime > 0);
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('starts over when reset', function(done) {
+        var stmt = db.prepare("SELECT count(*) FROM foo WHERE txt = ?");
+        stmt.get('row 1', function(err) {
+            if (err) throw err;
+            assert.ok(stmt.stats(true).fullscanSteps > 0);
+            var stats = stmt.stats();
+            assert.equal(stats.calls, 0);
+            assert.equal(stats.fullscanSteps, 0);
+            assert.equal(stats.runTime, 0);
+            stmt.get('row 2', function(err) {
+                if (err) throw err;
+                var stats = stmt.stats();
+                assert.equal(stats.calls, 1);
+                assert.ok(stats.fullscanSteps > 0);
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('reports how many calls are queued', function(done) {
+        var stmt = db.prepare("SELECT * FROM foo");
+        stmt.all();
+        stmt.all();
+        stmt.all(function(err) {
+            if (err) throw err;
+            assert.equal(stmt.stats().queued, 0);
+            assert.equal(stmt.stats().calls, 3);
+            stmt.finalize(done);
+        });
+        // All wait for the statement to be prepared.
+        assert.equal(stmt.stats().queued, 3);
+    });
+
+    it('reports the counters of the connection', function(done) {
+        db.stats(function(err, stats) {
+            if (err) throw err;
+            assert.ok(stats.cacheUsed > 0);
+            assert.ok(stats.schemaUsed > 0);
+            assert.ok(stats.cacheMisses >= 0);
+            assert.ok('cacheHits' in stats);
+            assert.ok('cacheWrites' in stats);
+            assert.ok('lookasideUsed' in stats);
+            assert.ok('statementUsed' in stats);
+            done();
+        });
+    });
+});
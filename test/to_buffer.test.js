@@ -0,0 +1,97 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('toBuffer and fromBuffer', function() {
+    var db;
+    var snapshot;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.exec(
+            "CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT);" +
+            "INSERT INTO foo VALUES (1, 'one');" +
+            "INSERT INTO foo VALUES (2, 'two');", done);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('copies the whole database into a Buffer', function(done) {
+        db.toBuffer(function(err, buffer) {
+            if (err) throw err;
+            assert.ok(Buffer.isBuffer(buffer));
+            assert.equal(buffer.toString('latin1', 0, 16), 'SQLite format 3\u0000');
+            snapshot = buffer;
+            done();
+        });
+    });
+
+    it('opens a copy of a Buffer', function(done) {
+        var copy = sqlite3.Database.fromBuffer(snapshot, function(err) {
+            if (err) throw err;
+            copy.run("INSERT INTO foo VALUES (3, 'three')", function(err) {
+                if (err) throw err;
+                copy.all("SELECT txt FROM foo ORDER BY id", function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows, [{ txt: 'one' }, { txt: 'two' }, { txt: 'three' }]);
+                    db.get("SELECT count(*) AS n FROM foo", function(err, row) {
+                        if (err) throw err;
+                        assert.equal(row.n, 2);
+                        copy.close(done);
+                    });
+                });
+            });
+        });
+    });
+
+    it('reads a Buffer in place with { readonly: true }', function(done) {
+        var copy = sqlite3.Database.fromBuffer(snapshot, { readonly: true }, function(err) {
+            if (err) throw err;
+            copy.get("SELECT txt FROM foo WHERE id = 2", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.txt, 'two');
+                copy.run("DELETE FROM foo", function(err) {
+                    assert.ok(err);
+                    assert.equal(err.code, 'SQLITE_READONLY');
+                    copy.close(done);
+                });
+            });
+        });
+    });
+
+    it('replaces the contents of an open database', function(done) {
+        var other = new sqlite3.Database(':memory:');
+        other.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+        other.get("SELECT count(*) AS n FROM foo", function(err, row) {
+            if (err) throw err;
+            assert.equal(row.n, 0);
+            other.loadBuffer(snapshot, function(err) {
+                if (err) throw err;
+                // The same SQL, which may come from the statement cache.
+                other.get("SELECT count(*) AS n FROM foo", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.n, 2);
+                    other.close(done);
+                });
+            });
+        });
+    });
+
+    it('gives an empty Buffer for an empty database', function(done) {
+        var empty = new sqlite3.Database(':memory:');
+        empty.toBuffer(function(err, buffer) {
+            if (err) throw err;
+            assert.equal(buffer.length, 0);
+            empty.close(done);
+        });
+    });
+
+    it('reports unknown schemas', function(done) {
+        db.toBuffer('nowhere', function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            assert.ok(/unknown database nowhere/.test(err.message));
+            done();
+        });
+    });
+});
@@ -0,0 +1,67 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('worker thread', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:', sqlite3.OPEN_READWRITE | sqlite3.OPEN_CREATE, { workerThread: true }, done);
+    });
+
+    it('runs statements in order', function(done) {
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INT, txt TEXT)");
+            var stmt = db.prepare("INSERT INTO foo VALUES (?, ?)");
+            for (var i = 0; i < 1000; i++) {
+                stmt.run(i, 'row ' + i);
+            }
+            stmt.finalize();
+        });
+        db.all("SELECT id FROM foo ORDER BY id", function(err, rows) {
+            if (err) throw err;
+            assert.equal(rows.length, 1000);
+            assert.equal(rows[999].id, 999);
+            done();
+        });
+    });
+
+    it('runs many statements at once', function(done) {
+        var left = 100;
+        for (var i = 0; i < 100; i++) {
+            db.get("SELECT count(*) AS n FROM foo WHERE id >= ?", i, function(err, row) {
+                if (err) throw err;
+                assert.ok(row.n > 0);
+                if (--left === 0) done();
+            });
+        }
+    });
+
+    it('streams rows with each', function(done) {
+        var seen = 0;
+        db.each("SELECT * FROM foo", function(err) {
+            if (err) throw err;
+            seen++;
+        }, function(err, count) {
+            if (err) throw err;
+            assert.equal(seen, 1000);
+            assert.equal(count, 1000);
+            done();
+        });
+    });
+
+    it('closes', function(done) {
+        db.close(function(err) {
+            if (err) throw err;
+            db.get("SELECT 1", function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_MISUSE');
+                done();
+            });
+        });
+    });
+
+    it('checks the option', function() {
+        assert.throws(function() {
+            new sqlite3.Database(':memory:', { workerThread: 'yes' });
+        }, /options.workerThread must be a boolean/);
+    });
+});
@@ -0,0 +1,138 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var path = require('path');
+var helper = require('./support/helper');
+
+var worker_threads;
+try { worker_threads = require('worker_threads'); } catch (err) {}
+
+// Loading the module in a worker needs a context-aware addon, and a worker
+// that exits with databases open needs the cleanup hook of Node 14.8.
+var supported = worker_threads && (function() {
+    var version = process.versions.node.split('.').map(Number);
+    return version[0] > 14 || (version[0] === 14 && version[1] >= 8);
+})();
+
+(supported ? describe : describe.skip)('node worker threads', function() {
+    var module = path.join(__dirname, '..');
+
+    function run(source, callback) {
+        var messages = [];
+        var worker = new worker_threads.Worker(source, { eval: true, workerData: module });
+        worker.on('message', function(message) { messages.push(message); });
+        worker.on('error', callback);
+        worker.on('exit', function(code) { callback(null, code, messages); });
+    }
+
+    it('opens and queries databases in several workers at once', function(done) {
+        var source =
+            "var sqlite3 = require(require('worker_threads').workerData);\n" +
+            "var parentPort = require('worker_threads').parentPort;\n" +
+            "var db = new sqlite3.Database(':memory:');\n" +
+            "db.serialize(function() {\n" +
+            "    db.run('CREATE TABLE foo (id INT)');\n" +
+            "    var stmt = db.prepare('INSERT INTO foo VALUES (?)');\n" +
+            "    for (var i = 0; i < 1000; i++) stmt.run(i);\n" +
+            "    stmt.finalize();\n" +
+            "    db.get('SELECT count(*) AS n, sum(id) AS s FROM foo', function(err, row) {\n" +
+            "        if (err) throw err;\n" +
+            "        parentPort.postMessage(row);\n" +
+            "        db.close();\n" +
+            "    });\n" +
+            "});\n";
+        var left = 3;
+        for (var i = 0; i < 3; i++) {
+            run(source, function(err, code, messages) {
+                if (err) throw err;
+                assert.equal(code, 0);
+                assert.deepEqual(messages, [{ n: 1000, s: 499500 }]);
+                if (!--left) done();
+            });
+        }
+    });
+
+    it('keeps working on the main thread alongside a worker', function(done) {
+        var db = new sqlite3.Database(':memory:');
+        run("require(require('worker_threads').workerData);", function(err, code) {
+            if (err) throw err;
+            assert.equal(code, 0);
+            db.get('SELECT 1 AS one', function(err, row) {
+                if (err) throw err;
+                assert.equal(row.one, 1);
+                db.close(done);
+            });
+        });
+    });
+
+    it('lets a worker exit with databases still open', function(done) {
+        var source =
+            "var sqlite3 = require(require('worker_threads').workerData);\n" +
+            "var parentPort = require('worker_threads').parentPort;\n" +
+            "var db = new sqlite3.Database(':memory:', sqlite3.OPEN_READWRITE | sqlite3.OPEN_CREATE,\n" +
+            "                              { workerThread: true });\n" +
+            "db.on('profile', function() {});\n" +
+            "db.on('change', function() {});\n" +
+            "db.function('twice', function(x) { return x * 2; });\n" +
+            "db.run('CREATE TABLE foo (id INT)');\n" +
+            "db.get('SELECT twice(21) AS n', function(err, row) {\n" +
+            "    if (err) throw err;\n" +
+            "    parentPort.postMessage(row.n);\n" +
+            "    process.exit(0);\n" +
+            "});\n";
+        run(source, function(err, code, messages) {
+            if (err) throw err;
+            assert.equal(code, 0);
+            assert.deepEqual(messages, [42]);
+            done();
+        });
+    });
+
+    it('lets a worker exit with statements open on its readers', function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/test_worker_readers.db');
+        var source =
+            "var sqlite3 = require(require('worker_threads').workerData);\n" +
+            "var parentPort = require('worker_threads').parentPort;\n" +
+            "var db = new sqlite3.Database('test/tmp/test_worker_readers.db', { readers: 2 });\n" +
+            "db.run('CREATE TABLE foo (id INT)', function(err) {\n" +
+            "    if (err) throw err;\n" +
+            "    var stmt = db.prepare('SELECT count(*) AS n FROM foo');\n" +
+            "    stmt.get(function(err, row) {\n" +
+            "        if (err) throw err;\n" +
+            "        parentPort.postMessage(row.n);\n" +
+            "        process.exit(0);\n" +
+            "    });\n" +
+            "});\n";
+        run(source, function(err, code, messages) {
+            if (err) throw err;
+            assert.equal(code, 0);
+            assert.deepEqual(messages, [0]);
+            done();
+        });
+    });
+
+    it('lets a worker be terminated with work still running', function(done) {
+        var forever = "WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c) ";
+        var source =
+            "var sqlite3 = require(require('worker_threads').workerData);\n" +
+            "var parentPort = require('worker_threads').parentPort;\n" +
+            "var db = new sqlite3.Database(':memory:');\n" +
+            "db.get(\"" + forever + "SELECT count(*) FROM c\");\n" +
+            "var batches = new sqlite3.Database(':memory:', sqlite3.OPEN_READWRITE | sqlite3.OPEN_CREATE,\n" +
+            "                                   { workerThread: true });\n" +
+            "batches.eachBatch(\"" + forever + "SELECT i FROM c\", 10, function(err) {\n" +
+            "    if (err) throw err;\n" +
+            "    parentPort.postMessage('rows');\n" +
+            "    while (true) {}\n" +
+            "});\n";
+        var worker = new worker_threads.Worker(source, { eval: true, workerData: module });
+        worker.on('error', done);
+        worker.once('message', function(message) {
+            assert.equal(message, 'rows');
+            worker.terminate();
+        });
+        worker.on('exit', function() {
+            done();
+        });
+    });
+});